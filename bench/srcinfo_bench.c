@@ -0,0 +1,196 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <git2.h>
+#include "../src/ctx/srcinfo.h"
+
+/*
+ * Microbenchmarks for the .SRCINFO parser.
+ *   justin_bench_srcinfo              parses a synthetic split package
+ *   justin_bench_srcinfo FILE...      parses each file
+ *   justin_bench_srcinfo -g REPO      loads and parses the .SRCINFO of every commit reachable from HEAD
+ */
+
+#define BENCH_ITERATIONS 200000
+
+static const char *BENCH_SYNTHETIC =
+        "pkgbase = linux-bench\n"
+        "\tpkgdesc = A synthetic split package\n"
+        "\tpkgver = 6.10.3\n"
+        "\tpkgrel = 1\n"
+        "\turl = https://example.org/\n"
+        "\tarch = x86_64\n"
+        "\tarch = aarch64\n"
+        "\tlicense = GPL-2.0-only\n"
+        "\tmakedepends = bc\n"
+        "\tmakedepends = cpio\n"
+        "\tmakedepends = gettext\n"
+        "\tmakedepends = libelf\n"
+        "\tmakedepends = pahole\n"
+        "\tmakedepends = perl\n"
+        "\tmakedepends = python\n"
+        "\tmakedepends = tar\n"
+        "\tmakedepends = xz\n"
+        "\toptions = !debug\n"
+        "\toptions = !strip\n"
+        "\tsource = https://example.org/linux-6.10.3.tar.xz\n"
+        "\tsource = https://example.org/linux-6.10.3.tar.sign\n"
+        "\tsource = config\n"
+        "\tsource_x86_64 = https://example.org/patch-x86_64.patch\n"
+        "\tsource_aarch64 = https://example.org/patch-aarch64.patch\n"
+        "\tsha256sums = 0c1a3e0b4cd5b2e2c6d8e1f1c0d5e6f9a3b7c2d1e4f5a6b7c8d9e0f1a2b3c4d5\n"
+        "\tsha256sums = SKIP\n"
+        "\tsha256sums = 9f8e7d6c5b4a39281706f5e4d3c2b1a09f8e7d6c5b4a39281706f5e4d3c2b1a0\n"
+        "\tsha256sums_x86_64 = 1111111111111111111111111111111111111111111111111111111111111111\n"
+        "\tsha256sums_aarch64 = 2222222222222222222222222222222222222222222222222222222222222222\n"
+        "\n"
+        "pkgname = linux-bench\n"
+        "\tpkgdesc = The kernel\n"
+        "\tdepends = coreutils\n"
+        "\tdepends = kmod\n"
+        "\tdepends = initramfs\n"
+        "\toptdepends = wireless-regdb: to set the correct wireless channels of your country\n"
+        "\toptdepends = linux-firmware: firmware images needed for some devices\n"
+        "\tprovides = KSMBD-MODULE\n"
+        "\tprovides = VIRTUALBOX-GUEST-MODULES\n"
+        "\tprovides = WIREGUARD-MODULE\n"
+        "\treplaces = virtualbox-guest-modules-arch\n"
+        "\treplaces = wireguard-arch\n"
+        "\n"
+        "pkgname = linux-bench-headers\n"
+        "\tpkgdesc = Headers and scripts for building modules\n"
+        "\tdepends = pahole\n"
+        "\n"
+        "pkgname = linux-bench-docs\n"
+        "\tpkgdesc = Documentation\n";
+
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+static void bench_report(const char *label, size_t count, size_t bytes, double elapsed) {
+    printf("%-32s %10zu parses  %10.1f ns/parse  %8.1f MB/s\n",
+           label, count, (elapsed * 1e9) / (double) count, ((double) bytes / 1e6) / elapsed);
+}
+
+static int bench_buffer(const char *label, const char *data, size_t len) {
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    justin_srcinfo_iter iter;
+    justin_srcinfo_str str;
+    size_t values = 0;
+
+    double start = bench_now();
+    for (size_t i=0; i < BENCH_ITERATIONS; i++) {
+        if (!justin_srcinfo_parse(&info, data, len)) {
+            fprintf(stderr, "%s: not a .SRCINFO\n", label);
+            justin_srcinfo_free(&info);
+            return 1;
+        }
+        // Touch the results so the parse cannot be optimized away
+        justin_srcinfo_iter_init(&info, &iter, JUSTIN_SRCINFO_DEPENDS, 1, -1);
+        while (justin_srcinfo_iter_next(&info, &iter, &str)) values += str.len;
+    }
+    bench_report(label, BENCH_ITERATIONS, len * BENCH_ITERATIONS, bench_now() - start);
+    printf("%-32s %10zu packages %10zu entries (%zu)\n", "", info.pkgnames_len, info.entries_len, values);
+    justin_srcinfo_free(&info);
+    return 0;
+}
+
+static int bench_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    char *data = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    size_t r;
+    do {
+        if (len == cap) {
+            cap = cap == 0 ? 65536 : cap << 1;
+            char *grown = (char*) realloc(data, cap);
+            if (grown == NULL) break;
+            data = grown;
+        }
+        r = fread(&data[len], 1, cap - len, f);
+        len += r;
+    } while (r != 0);
+    fclose(f);
+    int ret = bench_buffer(path, data, len);
+    free(data);
+    return ret;
+}
+
+static int bench_history(const char *path) {
+    git_repository *repo = NULL;
+    git_revwalk *walk = NULL;
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    int ret = 1;
+
+    git_libgit2_init();
+    if (git_repository_open(&repo, path) != 0 || git_revwalk_new(&walk, repo) != 0 || git_revwalk_push_head(walk) != 0) {
+        fprintf(stderr, "%s: %s\n", path, git_error_last()->message);
+        goto ex;
+    }
+
+    git_oid oid;
+    git_commit *commit;
+    size_t commits = 0;
+    size_t parsed = 0;
+    size_t bytes = 0;
+    justin_err err;
+    double start = bench_now();
+    while (git_revwalk_next(&oid, walk) == 0) {
+        if (git_commit_lookup(&commit, repo, &oid) != 0) continue;
+        commits++;
+        git_blob *blob = justin_srcinfo_load(repo, commit, &info, &err);
+        if (blob != NULL) {
+            parsed++;
+            bytes += (size_t) git_blob_rawsize(blob);
+            git_blob_free(blob);
+        }
+        git_commit_free(commit);
+    }
+    double elapsed = bench_now() - start;
+    if (parsed != 0) bench_report(path, parsed, bytes, elapsed);
+    printf("%-32s %10zu commits  %10.1f us/commit (with object lookups)\n",
+           "", commits, commits == 0 ? 0.0 : (elapsed * 1e6) / (double) commits);
+    ret = 0;
+
+    ex:
+    justin_srcinfo_free(&info);
+    if (walk != NULL) git_revwalk_free(walk);
+    if (repo != NULL) git_repository_free(repo);
+    git_libgit2_shutdown();
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "-g") == 0) return bench_history(argv[2]);
+    if (argc == 1) return bench_buffer("synthetic", BENCH_SYNTHETIC, strlen(BENCH_SYNTHETIC));
+    int ret = 0;
+    for (int i=1; i < argc; i++) ret |= bench_file(argv[i]);
+    return ret;
+}
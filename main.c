@@ -26,12 +26,41 @@
 #include "src/ctx/aur.h"
 #include "src/ctx/repo.h"
 #include "src/ctx/pkg.h"
+#include "src/ctx/bisect.h"
+#include "src/ctx/deps.h"
+#include "src/ctx/pipeline.h"
+#include "src/ctx/artifact.h"
+#include "src/ctx/sources.h"
+#include "src/ctx/vcs.h"
+#include "src/ctx/sandbox.h"
+#include "src/ctx/srcinfo.h"
+#include "src/ctx/journal.h"
+#include "src/ctx/remote.h"
 
 void display_help() {
     fprintf(stderr, "\n%sUsage%s: justin %s<target> %s[flags]%s\n", BWHT, WHT, CYN, MAG, CRESET);
-    fprintf(stderr, "%starget %s:: %sPackage to install%s\n", CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%starget %s:: %sPackage to install, or packages with -n and -c%s\n", CYN, BWHT, WHT, CRESET);
     fprintf(stderr, "%s-l     %s:: %sAlways install the latest version%s\n", MAG, BWHT, WHT, CRESET);
     fprintf(stderr, "%s-y     %s:: %sAccept prompts by default%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-n     %s:: %sTargets are exact package names, install them all%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-d     %s:: %sDo not resolve or install dependencies%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-e     %s:: %sKeep git history in memory, write only the chosen tree to disk%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-p     %s:: %sFetch history first, download files only for the chosen version (implies -e)%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-f     %s:: %sSkip package compression for builds that are installed right away%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-c     %s:: %sRebuild installed VCS packages whose upstream moved (all without targets)%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-s     %s:: %sBuild in a clean sandbox with only base-devel and the dependencies%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-R     %s:: %sResume builds an earlier run did not finish%s\n", MAG, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-r%s<url>%s:: %sBase URL of the AUR git server%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-P%s<pkg>%s:: %sPackages of a split base to build, e.g. foo,foo-docs%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-g%s<rev>%s:: %sBisect: known good commit or version%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-b%s<rev>%s:: %sBisect: known bad commit or version%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-t%s<cmd>%s:: %sBisect: test command, exits 0 if good, 125 to skip%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-j%s<n>  %s:: %sNumber of packages to build at once%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-w%s<adr>%s:: %sAlso build on these workers, e.g. /run/justin.sock,host:7070%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-W%s<adr>%s:: %sRun as a build worker on a UNIX socket path or host:port%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-B%s<src>%s:: %sDownload builds from these caches first, e.g. https://host/artifacts,/mnt/artifacts%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-C%s[sz] %s:: %sUse a compiler cache of at most sz (e.g. 20G, default 5G)%s\n", MAG, CYN, BWHT, WHT, CRESET);
+    fprintf(stderr, "%s-L%s[lim]%s:: %sRun builds in cgroups with low priority and limits, e.g. cpu=10,io=10,high=8G,max=12G%s\n", MAG, CYN, BWHT, WHT, CRESET);
     fprintf(stderr, "\n");
 }
 
@@ -56,6 +85,115 @@ bool pkg_list_print(justin_context ctx, justin_aur_project_t *project, int64_t i
     return true;
 }
 
+// True if a comma-separated list has the name
+bool pkgnames_contains(const char *list, const char *name, size_t len) {
+    const char *end;
+    while (1) {
+        end = strchr(list, ',');
+        if (end == NULL) end = &list[strlen(list)];
+        if ((size_t) (end - list) == len && strncmp(list, name, len) == 0) return true;
+        if (*end == '\0') return false;
+        list = end + 1;
+    }
+}
+
+// Asks which packages of a split base to build, or takes them from -P. Returns NULL to build them all.
+char *select_pkgnames(justin_context ctx, const char *dir, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_params params = ctx->params;
+    size_t dir_len = strlen(dir);
+    char *file = (char*) malloc(dir_len + 10);
+    if (file == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    justin_util_path_join(dir, dir_len, ".SRCINFO", 8, file);
+    size_t len;
+    char *data = justin_util_read_file(file, &len);
+    free(file);
+    if (data == NULL) return NULL;
+
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    char *ret = NULL;
+    size_t selected = 0;
+    char buf[256];
+    if (!justin_srcinfo_parse(&info, data, len)) goto ex;
+
+    if (params->v_pkgnames != NULL) {
+        const char *name = params->v_pkgnames;
+        const char *end;
+        bool found;
+        do {
+            end = strchr(name, ',');
+            if (end == NULL) end = &name[strlen(name)];
+            found = false;
+            for (size_t i=0; i < info.pkgnames_len && !found; i++) {
+                found = info.pkgnames[i].len == (size_t) (end - name) && strncmp(info.pkgnames[i].ptr, name, end - name) == 0;
+            }
+            if (!found) {
+                snprintf(buf, sizeof buf, "%.*s is not a package of %.*s", (int) (end - name > 100 ? 100 : end - name),
+                         name, (int) info.pkgbase.len, info.pkgbase.ptr);
+                justin_log_err_msg(JUSTIN_ERR_ARGS, buf);
+                *err = JUSTIN_ERR_ARGS;
+                goto ex;
+            }
+            name = end + 1;
+        } while (*end != '\0');
+        for (size_t i=0; i < info.pkgnames_len; i++) {
+            if (pkgnames_contains(params->v_pkgnames, info.pkgnames[i].ptr, info.pkgnames[i].len)) selected++;
+        }
+        if (selected != info.pkgnames_len && (ret = strdup(params->v_pkgnames)) == NULL) *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    if (info.pkgnames_len < 2 || params->f_yes) goto ex;
+
+    snprintf(buf, sizeof buf, "%.*s is a split package:", (int) info.pkgbase.len, info.pkgbase.ptr);
+    justin_log_info(buf);
+    for (size_t i=0; i < info.pkgnames_len; i++) {
+        snprintf(buf, sizeof buf, "%s[%s%ld%s]%s %.*s", CYN, BYEL, i + 1, CYN, BWHT, (int) info.pkgnames[i].len, info.pkgnames[i].ptr);
+        justin_log_info_indent(buf, 1);
+    }
+    justin_log_info("Build all packages (Y/n)? ");
+    char sel;
+    scanf(" %c", &sel);
+    if (!(sel == 'n' || sel == 'N')) goto ex;
+
+    justin_log_info("Enter the packages to build (e.g. 1, 2, 5-7):");
+    scanf("%255s", buf);
+    justin_util_iset iset = justin_util_iset_parse(buf, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    // The names are slices of the .SRCINFO, so the list can not be longer than it
+    ret = (char*) malloc(len + 1);
+    if (ret == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        justin_util_iset_destroy(iset);
+        goto ex;
+    }
+    size_t ret_len = 0;
+    for (size_t i=0; i < info.pkgnames_len; i++) {
+        if (!justin_util_iset_contains(iset, (int) (i + 1))) continue;
+        if (ret_len != 0) ret[ret_len++] = ',';
+        memcpy(&ret[ret_len], info.pkgnames[i].ptr, info.pkgnames[i].len);
+        ret_len += info.pkgnames[i].len;
+        selected++;
+    }
+    ret[ret_len] = '\0';
+    justin_util_iset_destroy(iset);
+    if (selected == 0) {
+        justin_log_err_msg(JUSTIN_ERR_ARGS, "No packages selected");
+        *err = JUSTIN_ERR_ARGS;
+    }
+    if (selected == 0 || selected == info.pkgnames_len) {
+        free(ret);
+        ret = NULL;
+    }
+
+    ex:
+    justin_srcinfo_free(&info);
+    free(data);
+    return ret;
+}
+
 justin_err install_package(justin_context ctx, justin_aur_project_t *project) {
     justin_err err = JUSTIN_ERR_OK;
     if ((!ctx->params->f_yes) && alpm_db_get_pkg(ctx->alpm_db, project->name) != NULL) {
@@ -70,18 +208,67 @@ justin_err install_package(justin_context ctx, justin_aur_project_t *project) {
     justin_log_debug("Locking storage");
     err = justin_storage_lock(ctx->storage);
     if (err != JUSTIN_ERR_OK) return err;
+    if (ctx->params->f_sandbox) {
+        justin_sandbox_prepare(ctx, &err);
+        if (err != JUSTIN_ERR_OK) goto ex;
+    }
 
-    justin_log_debug("Creating temp dir");
-    const char *dir = justin_storage_dir_create(ctx->storage, &err);
-    if (err != JUSTIN_ERR_OK) goto ex;
+    justin_deps_graph graph = NULL;
+    if (!ctx->params->f_nodeps) {
+        justin_log_info("Resolving dependencies");
+        graph = justin_deps_resolve(ctx, &project->name, 1, true, &err);
+        if (err != JUSTIN_ERR_OK) goto ex;
+        justin_deps_confirm(ctx, graph, &err);
+        if (err == JUSTIN_ERR_OK) justin_deps_install_repo(graph, &err);
+        if (err != JUSTIN_ERR_OK) goto ex_r;
+    }
 
-    justin_log_info("Cloning...");
-    git_repository *repo = justin_aur_project_clone_into(ctx, project, dir, &err);
-    if (err != JUSTIN_ERR_OK) goto ex_b;
+    justin_log_debug("Creating build dir");
+    const char *base = project->base != NULL ? project->base : project->name;
+    justin_journal_t journal = JUSTIN_JOURNAL_INITIALIZER;
+    char *dir = NULL;
+    if (ctx->params->f_resume) dir = justin_journal_resume(ctx->storage, base, &journal);
+    if (dir == NULL) {
+        dir = justin_storage_build_dir_create(ctx->storage, base, &err);
+        if (err != JUSTIN_ERR_OK) goto ex_r;
+        justin_journal_begin(ctx->storage, base, dir);
+    }
+    bool built = false;
+
+    const char *git_dir = NULL;
+    git_repository *repo = NULL;
+    git_commit *selected = NULL;
+    justin_repo_commit_list commits = NULL;
+    bool hit = false;
+    bool lookup = false;
+    char *artifacts = NULL;
+    char *pkgnames = NULL;
+    // A checkout that was left behind is built as it is, without the artifact cache
+    if (journal.stage >= JUSTIN_JOURNAL_CHECKOUT) goto resume;
+
+    if (journal.stage == JUSTIN_JOURNAL_CLONED && !ctx->params->f_ephemeral) {
+        if (git_repository_open(&repo, dir) != 0) err = JUSTIN_ERR_GIT;
+    } else {
+        justin_log_info("Cloning...");
+        if (ctx->params->f_ephemeral) {
+            justin_log_debug("Creating memory-backed git dir");
+            git_dir = justin_storage_mem_dir_create(ctx->storage, &err);
+            if (err != JUSTIN_ERR_OK) goto ex_b;
+            if (ctx->params->f_partial) {
+                repo = justin_aur_project_fetch_history(ctx, project, git_dir, &err);
+            } else {
+                repo = justin_aur_project_clone_bare(ctx, project, git_dir, &err);
+            }
+        } else {
+            repo = justin_aur_project_clone_into(ctx, project, dir, &err);
+            if (err == JUSTIN_ERR_OK) justin_journal_mark(dir, JUSTIN_JOURNAL_CLONED, NULL);
+        }
+    }
+    if (err != JUSTIN_ERR_OK) goto ex_g;
 
     if (!ctx->params->f_latest) {
         justin_log_debug("Creating commit list");
-        justin_repo_commit_list commits = justin_repo_commit_list_create(repo, &err);
+        commits = justin_repo_commit_list_create(repo, ctx->storage, project->name, &err);
         if (err != JUSTIN_ERR_OK) goto ex_c;
 
         justin_repo_commit_list_goto(commits, 0);
@@ -89,33 +276,100 @@ justin_err install_package(justin_context ctx, justin_aur_project_t *project) {
         if (!justin_repo_commit_list_next(commits, &entry, &err)) {
             justin_log_err_msg(JUSTIN_ERR_ASSERTION, "Commit list has no first element(?) Try running again with -l");
             if (err == JUSTIN_ERR_OK) err = JUSTIN_ERR_ASSERTION;
-            justin_repo_commit_list_free(commits);
-            goto ex_c;
+            goto ex_l;
         }
 
         justin_log_debug("Opening commit list prompt");
         entry = justin_repo_commit_list_prompt(commits, 0, &err);
-        if (err != JUSTIN_ERR_OK) {
-            justin_repo_commit_list_free(commits);
-            goto ex_c;
-        }
-
-        justin_log_info("Rolling back");
-        int reset_stat = git_reset(repo, (const git_object *) entry.commit, GIT_RESET_HARD, NULL);
+        if (err != JUSTIN_ERR_OK) goto ex_l;
+        selected = justin_repo_commit_list_resolve(commits, &entry, &err);
         justin_repo_commit_list_free(commits);
-        if (reset_stat != 0) {
-            err = JUSTIN_ERR_GIT;
-            goto ex_c;
-        }
+        commits = NULL;
+        if (err != JUSTIN_ERR_OK) goto ex_c;
+    } else {
+        selected = justin_repo_head_commit(repo, &err);
+        if (err != JUSTIN_ERR_OK) goto ex_c;
     }
 
-    justin_log_info("Running makepkg");
-    justin_pkg_make(ctx->storage->user, dir, &err);
-    if (err != JUSTIN_ERR_OK) goto ex_c;
+    // The versions of AUR dependencies are part of the key, so with some to build first the pipeline looks it up
+    for (size_t i=0; graph != NULL && i < graph->len && !lookup; i++) {
+        lookup = graph->nodes[i].edge_count != 0 && justin_deps_strv_contains(&graph->nodes[i].names, project->name);
+    }
+    // The key covers what the .SRCINFO says, which a partial fetch does not have yet
+    if (ctx->params->f_partial) {
+        justin_log_info("Fetching files");
+        justin_aur_project_fetch_blobs(ctx, project, repo, selected, &err);
+    }
+    if (err == JUSTIN_ERR_OK && !lookup) artifacts = justin_artifact_lookup(ctx, project->name, repo, selected, &hit, &err);
+    if (err == JUSTIN_ERR_OK && !hit) {
+        justin_log_info("Writing tree");
+        justin_repo_checkout_into(repo, selected, dir, &err);
+        if (err == JUSTIN_ERR_OK && justin_util_chown_r(dir, ctx->storage->user) != 0) err = JUSTIN_ERR_SYSTEM;
+        if (err == JUSTIN_ERR_OK) {
+            char oid[GIT_OID_HEXSZ + 1];
+            git_oid_tostr(oid, sizeof oid, git_commit_id(selected));
+            justin_journal_mark(dir, JUSTIN_JOURNAL_CHECKOUT, oid);
+        }
+    }
+    git_commit_free(selected);
+
+    resume:
+    if (err == JUSTIN_ERR_OK && !hit && journal.stage < JUSTIN_JOURNAL_BUILT) pkgnames = select_pkgnames(ctx, dir, &err);
+    // Only what was built is left to install
+    bool partial = pkgnames != NULL;
+    if (err != JUSTIN_ERR_OK) goto ex_a;
+
+    if (graph != NULL) {
+        // The AUR dependencies are fetched, built and installed while the sources of the target download, and the
+        // target is built once they are in place. It is not installed by the pipeline, so that targets can be picked.
+        justin_pipeline pipeline = justin_pipeline_create(ctx, graph, &err);
+        if (err != JUSTIN_ERR_OK) goto ex_a;
+        justin_pipeline_item *item = justin_pipeline_find(pipeline, project->name);
+        if (item == NULL) {
+            err = JUSTIN_ERR_ASSERTION;
+        } else {
+            item->dir = dir;
+            item->install = false;
+            item->prebuilt = hit;
+            item->lookup = lookup;
+            item->repo = repo;
+            item->artifacts = artifacts;
+            item->pkgnames = pkgnames;
+            item->resume = journal.stage;
+            justin_pipeline_run(pipeline, &err);
+            // The pipeline forgets the cache directory if there was nothing to store
+            artifacts = item->artifacts;
+            item->artifacts = NULL;
+            item->pkgnames = NULL;
+            built = item->built;
+        }
+        justin_pipeline_free(pipeline);
+    } else if (!hit && journal.stage < JUSTIN_JOURNAL_BUILT) {
+        if (journal.stage < JUSTIN_JOURNAL_SOURCES) {
+            justin_err prefetch_err;
+            justin_sources_prefetch(ctx, (const char *const *) &dir, 1, &prefetch_err);
+            if (prefetch_err == JUSTIN_ERR_OK) {
+                justin_journal_mark(dir, JUSTIN_JOURNAL_SOURCES, NULL);
+            } else {
+                justin_log_err_soft(prefetch_err);
+            }
+        }
+        justin_log_info("Running makepkg");
+        justin_buildlog log = justin_buildlog_open(ctx, project->name);
+        built = true;
+        justin_pkg_make_split(ctx, dir, pkgnames, log, &err);
+        justin_buildlog_close(log);
+        if (err == JUSTIN_ERR_OK) justin_journal_mark(dir, JUSTIN_JOURNAL_BUILT, NULL);
+        if (err == JUSTIN_ERR_OK && (artifacts == NULL || ctx->params->f_fast || partial || !justin_artifact_store(ctx, dir, artifacts, &err))) {
+            free(artifacts);
+            artifacts = NULL;
+        }
+    }
+    if (err != JUSTIN_ERR_OK) goto ex_a;
 
     justin_log_debug("Building target list");
-    justin_pkg_target_list targets = justin_pkg_target_list_create(dir, &err);
-    if (err != JUSTIN_ERR_OK) goto ex_c;
+    justin_pkg_target_list targets = justin_pkg_target_list_create(artifacts != NULL ? artifacts : dir, &err);
+    if (err != JUSTIN_ERR_OK) goto ex_a;
 
     justin_log_info("Identified targets:");
     const char *target;
@@ -133,14 +387,29 @@ justin_err install_package(justin_context ctx, justin_aur_project_t *project) {
         goto ex_d;
     }
 
-    bool install_all = counter == 1 || ctx->params->f_yes;
-    if (!install_all) {
+    // A whole base may have turned up in the artifact cache after all, see justin_pipeline_build
+    const char *wanted = pkgnames != NULL ? pkgnames : ctx->params->v_pkgnames;
+    bool install_all = counter == 1 || ctx->params->f_yes || (partial && wanted == NULL);
+    if (!install_all && wanted == NULL) {
         justin_log_info("Install all targets (Y/n)? ");
         char sel;
         scanf(" %c", &sel);
         install_all = !(sel == 'n' || sel == 'N');
     }
-    if (install_all) {
+    if (wanted != NULL) {
+        // Also picks them out of a whole base found in the artifact cache
+        size_t picked = 0;
+        for (size_t i=0; i < counter && err == JUSTIN_ERR_OK; i++) {
+            target = justin_pkg_target_list_get(targets, i);
+            if (!pkgnames_contains(wanted, target, justin_pkg_archive_name_len(target))) continue;
+            justin_pkg_target_list_select(targets, i, &err);
+            picked++;
+        }
+        if (err == JUSTIN_ERR_OK && picked == 0) {
+            justin_log_err_msg(JUSTIN_ERR_ARGS, "None of the targets were given with -P");
+            err = JUSTIN_ERR_ARGS;
+        }
+    } else if (install_all) {
         justin_pkg_target_list_select_all(targets, &err);
     } else {
         justin_log_info("Enter the targets to install (e.g. 1, 2, 5-7):");
@@ -160,14 +429,220 @@ justin_err install_package(justin_context ctx, justin_aur_project_t *project) {
     justin_log_info("Installing targets");
     justin_pkg_target_list_install(ctx, targets, &err);
     if (err != JUSTIN_ERR_OK) goto ex_d;
+    justin_journal_mark(dir, JUSTIN_JOURNAL_INSTALLED, NULL);
     justin_log_info("Success!");
 
     ex_d:
     justin_pkg_target_list_destroy(targets);
+    ex_a:
+    if (artifacts != NULL) free(artifacts);
+    free(pkgnames);
+    ex_l:
+    if (commits != NULL) justin_repo_commit_list_free(commits);
     ex_c:
     git_repository_free(repo);
+    ex_g:
+    if (git_dir != NULL) {
+        justin_log_debug("Removing memory-backed git dir");
+        if (justin_util_rimraf(git_dir) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        free((void*) git_dir);
+    }
     ex_b:
-    free((void*) dir);
+    justin_journal_done(ctx->storage, base, dir, built, err != JUSTIN_ERR_OK);
+    ex_r:
+    if (graph != NULL) justin_deps_graph_free(graph);
+    ex:
+    justin_log_debug("Unlocking storage");
+    justin_err unlock_err = justin_storage_unlock(ctx->storage);
+    if (err == 0) err = unlock_err;
+    return err;
+}
+
+// Install several packages by exact name, without prompting for versions
+int install_names(justin_context ctx, const char *const *names, size_t count) {
+    justin_params params = ctx->params;
+    justin_log_debug("Locking storage");
+    justin_err err = justin_storage_lock(ctx->storage);
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err(err);
+        return 1;
+    }
+    if (params->f_sandbox) {
+        justin_sandbox_prepare(ctx, &err);
+        if (err != JUSTIN_ERR_OK) goto ex;
+    }
+
+    justin_log_info("Resolving packages");
+    justin_deps_graph graph = justin_deps_resolve(ctx, names, count, !params->f_nodeps, &err);
+    if (err != JUSTIN_ERR_OK) goto ex;
+    justin_deps_confirm(ctx, graph, &err);
+    if (err == JUSTIN_ERR_OK) justin_deps_install_repo(graph, &err);
+    if (err != JUSTIN_ERR_OK) goto ex_r;
+
+    justin_pipeline pipeline = justin_pipeline_create(ctx, graph, &err);
+    if (err != JUSTIN_ERR_OK) goto ex_r;
+    justin_pipeline_run(pipeline, &err);
+    justin_pipeline_free(pipeline);
+    justin_artifact_summary();
+
+    ex_r:
+    justin_deps_graph_free(graph);
+    ex:
+    justin_log_debug("Unlocking storage");
+    justin_err unlock_err = justin_storage_unlock(ctx->storage);
+    if (err == 0) err = unlock_err;
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err_msg(err, "Failed to install packages");
+        return 1;
+    }
+    justin_log_info("Success!");
+    return 0;
+}
+
+// Build for the coordinators that connect to -W, until stopped
+int serve_builds(justin_context ctx) {
+    justin_log_debug("Locking storage");
+    justin_err err = justin_storage_lock(ctx->storage);
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err(err);
+        return 1;
+    }
+    // Nothing a coordinator sends gets to install packages on this machine
+    ctx->params->f_sandbox = true;
+    justin_sandbox_prepare(ctx, &err);
+    if (err == JUSTIN_ERR_OK) justin_remote_serve(ctx, ctx->params->v_serve, &err);
+
+    justin_log_debug("Unlocking storage");
+    justin_err unlock_err = justin_storage_unlock(ctx->storage);
+    if (err == 0) err = unlock_err;
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err_msg(err, "Failed to take builds");
+        return 1;
+    }
+    return 0;
+}
+
+int install_packages(justin_context ctx) {
+    justin_params params = ctx->params;
+    const char *const *names = (const char *const *) &params->argv[params->v_target_start];
+    size_t count = (size_t) (params->v_target_end - params->v_target_start + 1);
+    return install_names(ctx, names, count);
+}
+
+// True if the installed package was named as a target, by its name or its base
+bool check_is_target(justin_params params, const char *name, const char *base) {
+    for (int i=params->v_target_start; i <= params->v_target_end; i++) {
+        if (strcmp(params->argv[i], name) == 0 || strcmp(params->argv[i], base) == 0) return true;
+    }
+    return false;
+}
+
+// Rebuild the installed VCS packages (or the given ones) whose upstream moved since they were built
+int check_packages(justin_context ctx) {
+    justin_params params = ctx->params;
+    bool all = params->v_target_start == 0;
+    alpm_list_t *cache = alpm_db_get_pkgcache(ctx->alpm_db);
+    size_t cap = alpm_list_count(cache) + 1;
+    const char **names = (const char**) malloc(cap * sizeof(char*));
+    const char **name_bases = (const char**) malloc(cap * sizeof(char*));
+    const char **bases = (const char**) malloc(cap * sizeof(char*));
+    bool *changed = (bool*) malloc(cap * sizeof(bool));
+    int ret = 1;
+    if (names == NULL || name_bases == NULL || bases == NULL || changed == NULL) {
+        justin_log_err(JUSTIN_ERR_NOMEM);
+        goto ex;
+    }
+
+    size_t name_count = 0;
+    size_t base_count = 0;
+    for (alpm_list_t *it = cache; it != NULL; it = alpm_list_next(it)) {
+        alpm_pkg_t *pkg = (alpm_pkg_t*) it->data;
+        const char *name = alpm_pkg_get_name(pkg);
+        const char *base = alpm_pkg_get_base(pkg);
+        if (base == NULL) base = name;
+        if (all ? !(justin_vcs_is_vcs_name(name) || justin_vcs_has_record(ctx, base)) : !check_is_target(params, name, base)) continue;
+
+        names[name_count] = name;
+        name_bases[name_count++] = base;
+        size_t i = 0;
+        while (i < base_count && strcmp(bases[i], base) != 0) i++;
+        if (i == base_count) bases[base_count++] = base;
+    }
+    if (base_count == 0) {
+        justin_log_warn(all ? "No installed VCS packages found" : "None of the targets are installed");
+        ret = 0;
+        goto ex;
+    }
+
+    char buf[128];
+    snprintf(buf, sizeof buf, "Checking the upstream of %zu package%s", base_count, base_count == 1 ? "" : "s");
+    justin_log_info(buf);
+    justin_err err;
+    justin_vcs_check(ctx, bases, base_count, changed, &err);
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err_msg(err, "Failed to check packages");
+        goto ex;
+    }
+
+    // Every installed package of a changed base is rebuilt, so that split packages stay in step
+    size_t rebuild = 0;
+    for (size_t i=0; i < name_count; i++) {
+        size_t b = 0;
+        while (strcmp(bases[b], name_bases[i]) != 0) b++;
+        if (changed[b]) names[rebuild++] = names[i];
+    }
+    if (rebuild == 0) {
+        justin_log_info("Everything is up to date");
+        ret = 0;
+        goto ex;
+    }
+    ret = install_names(ctx, names, rebuild);
+
+    ex:
+    free(names);
+    free(name_bases);
+    free(bases);
+    free(changed);
+    return ret;
+}
+
+justin_err bisect_package(justin_context ctx, justin_aur_project_t *project) {
+    justin_err err;
+    justin_log_debug("Locking storage");
+    err = justin_storage_lock(ctx->storage);
+    if (err != JUSTIN_ERR_OK) return err;
+    if (ctx->params->f_sandbox) {
+        justin_sandbox_prepare(ctx, &err);
+        if (err != JUSTIN_ERR_OK) goto ex;
+    }
+
+    // Every candidate is checked out into its own directory, so the history is always kept in memory
+    justin_log_debug("Creating memory-backed git dir");
+    const char *git_dir = justin_storage_mem_dir_create(ctx->storage, &err);
+    if (err != JUSTIN_ERR_OK) goto ex;
+
+    git_repository *repo;
+    justin_log_info("Cloning...");
+    if (ctx->params->f_partial) {
+        repo = justin_aur_project_fetch_history(ctx, project, git_dir, &err);
+    } else {
+        repo = justin_aur_project_clone_bare(ctx, project, git_dir, &err);
+    }
+    if (err != JUSTIN_ERR_OK) goto ex_g;
+
+    justin_log_debug("Creating commit list");
+    justin_repo_commit_list commits = justin_repo_commit_list_create(repo, ctx->storage, project->name, &err);
+    if (err != JUSTIN_ERR_OK) goto ex_c;
+
+    justin_bisect_run(ctx, project, commits, &err);
+    justin_repo_commit_list_free(commits);
+
+    ex_c:
+    git_repository_free(repo);
+    ex_g:
+    justin_log_debug("Removing memory-backed git dir");
+    if (justin_util_rimraf(git_dir) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    free((void*) git_dir);
     ex:
     justin_log_debug("Unlocking storage");
     justin_err unlock_err = justin_storage_unlock(ctx->storage);
@@ -235,14 +710,15 @@ int search_package(justin_context ctx) {
         return 1;
     }
 
-    sprintf(lb, "Installing %s%s", BYEL, project->name);
+    bool bisect = justin_params_is_bisect(ctx->params);
+    sprintf(lb, "%s %s%s", bisect ? "Bisecting" : "Installing", BYEL, project->name);
     justin_log_info(lb);
     free(lb);
 
-    err = install_package(ctx, project);
+    err = bisect ? bisect_package(ctx, project) : install_package(ctx, project);
     justin_aur_project_list_free(pl);
     if (err != JUSTIN_ERR_OK) {
-        justin_log_err_msg(err, "Failed to install package");
+        justin_log_err_msg(err, bisect ? "Failed to bisect package" : "Failed to install package");
         return 1;
     }
     return 0;
@@ -316,7 +792,13 @@ int main(int argc, char *argv[]) {
     justin_context ctx;
     if (justin_context_create(&ctx, params, db, curl, storage)) {
         justin_log_debug("Created context");
-        app_err = search_package(ctx);
+        if (params->v_serve != NULL) {
+            app_err = serve_builds(ctx);
+        } else if (params->f_check) {
+            app_err = check_packages(ctx);
+        } else {
+            app_err = params->f_names ? install_packages(ctx) : search_package(ctx);
+        }
         justin_context_destroy(ctx);
     } else {
         justin_log_err(JUSTIN_ERR_NOMEM);
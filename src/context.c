@@ -14,6 +14,10 @@
    limitations under the License.
  */
 
+#define _GNU_SOURCE
+#include <string.h>
+#include <pwd.h>
+#include "ctx/artifact.h"
 #include "context.h"
 
 bool justin_context_create(justin_context *out, justin_params params, alpm_db_t *alpm_db, CURL *curl, justin_storage storage) {
@@ -24,6 +28,24 @@ bool justin_context_create(justin_context *out, justin_params params, alpm_db_t
     ctx->alpm_db = alpm_db;
     ctx->curl = curl;
     ctx->storage = storage;
+    pthread_mutex_init(&ctx->alpm_mutex, NULL);
+    justin_resources_detect(params->v_jobs, &ctx->resources);
+
+    // Everything below is read by the pipeline threads, so it is worked out before any of them start
+    struct passwd *user = getpwuid(storage->user);
+    ctx->home = user == NULL ? NULL : strdup(user->pw_dir);
+    justin_err err;
+    justin_artifact_config_hash(ctx, ctx->config, &err);
+    if ((user != NULL && ctx->home == NULL) || err != JUSTIN_ERR_OK) {
+        justin_context_destroy(ctx);
+        return false;
+    }
     *out = ctx;
     return true;
 }
+
+void justin_context_destroy(justin_context ctx) {
+    pthread_mutex_destroy(&ctx->alpm_mutex);
+    free(ctx->home);
+    free(ctx);
+}
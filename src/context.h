@@ -18,8 +18,10 @@
 #include <curl/curl.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "params.h"
 #include "storage.h"
+#include "resources.h"
 
 #ifndef JUSTIN_CONTEXT_H
 #define JUSTIN_CONTEXT_H
@@ -29,11 +31,18 @@ struct justin_context {
     alpm_db_t *alpm_db;
     CURL *curl;
     justin_storage storage;
+    justin_resources_t resources;
+    pthread_mutex_t alpm_mutex;     // alpm is not thread safe, hold this around every use of alpm_db once threads run
+    char *home;                     // of the user, looked up here since getpwuid is not thread safe; NULL if unknown
+    char config[41];                // hex hash of the makepkg configuration, see justin_artifact_config_hash
 };
 typedef struct justin_context *justin_context;
 
 bool justin_context_create(justin_context *out, justin_params params, alpm_db_t *alpm_db, CURL *curl, justin_storage storage);
 
-#define justin_context_destroy(ctx) free(ctx)
+void justin_context_destroy(justin_context ctx);
+
+#define justin_context_alpm_lock(ctx) pthread_mutex_lock(&(ctx)->alpm_mutex)
+#define justin_context_alpm_unlock(ctx) pthread_mutex_unlock(&(ctx)->alpm_mutex)
 
 #endif //JUSTIN_CONTEXT_H
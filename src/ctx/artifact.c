@@ -0,0 +1,531 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "pkg.h"
+#include "vcs.h"
+#include "deps.h"
+#include "srcinfo.h"
+#include "substitute.h"
+#include "artifact.h"
+
+static const char *ARTIFACT_DIR_S = JUSTIN_ARTIFACT_DIR;
+
+// Entries are put together under a hidden name and renamed into place when complete
+#define ARTIFACT_STAGE_TEMPLATE "/.stage-XXXXXX"
+
+#define CONF_FILE "/etc/makepkg.conf"
+static const char *CONF_FILE_S = CONF_FILE;
+
+#define CONF_DIR "/etc/makepkg.conf.d"
+static const char *CONF_DIR_S = CONF_DIR;
+
+// Relative to the home directory of the user
+static const char *CONF_USER_FILES[] = { ".makepkg.conf", ".config/pacman/makepkg.conf" };
+
+// Environment variables read by makepkg that change its output (MAKEFLAGS only changes how fast it gets there)
+static const char *CONF_ENV[] = {
+        "CARCH", "CHOST", "CFLAGS", "CXXFLAGS", "LDFLAGS", "RUSTFLAGS",
+        "PKGEXT", "BUILDENV", "OPTIONS", "PACKAGER"
+};
+
+// Dependencies whose versions are part of the key
+static const justin_srcinfo_field ARTIFACT_DEP_FIELDS[] = {
+        JUSTIN_SRCINFO_DEPENDS, JUSTIN_SRCINFO_MAKEDEPENDS, JUSTIN_SRCINFO_CHECKDEPENDS
+};
+
+static pthread_mutex_t ARTIFACT_STATS_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static size_t ARTIFACT_HITS = 0;
+static size_t ARTIFACT_SUBSTITUTED = 0;
+static size_t ARTIFACT_MISSES = 0;
+
+// Build directories of this run whose packages never made it into the cache, see justin_artifact_add_built
+static pthread_mutex_t ARTIFACT_BUILT_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static char **ARTIFACT_BUILT = NULL;
+static size_t ARTIFACT_BUILT_LEN = 0;
+
+typedef struct justin_artifact_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+} justin_artifact_buf;
+
+bool justin_artifact_buf_append(justin_artifact_buf *buf, const char *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = buf->cap == 0 ? 4096 : buf->cap;
+        while (cap < buf->len + len) cap <<= 1;
+        char *grown = (char*) realloc(buf->data, cap);
+        if (grown == NULL) return false;
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memcpy(&buf->data[buf->len], data, len);
+    buf->len += len;
+    return true;
+}
+
+// Appends the name of a file and its contents, or only the name if it does not exist
+bool justin_artifact_buf_file(justin_artifact_buf *buf, const char *path) {
+    if (!justin_artifact_buf_append(buf, path, strlen(path) + 1)) return false;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return true;
+    char chunk[4096];
+    size_t r;
+    bool ok = true;
+    while (ok && (r = fread(chunk, 1, sizeof chunk, f)) != 0) ok = justin_artifact_buf_append(buf, chunk, r);
+    fclose(f);
+    return ok;
+}
+
+int justin_artifact_conf_filter(const struct dirent *ent) {
+    size_t len = strlen(ent->d_name);
+    return len > 5 && strcmp(&ent->d_name[len - 5], ".conf") == 0;
+}
+
+void justin_artifact_config_hash(justin_context ctx, char *out, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_artifact_buf buf = { NULL, 0, 0 };
+    bool ok = justin_artifact_buf_file(&buf, CONF_FILE_S);
+
+    struct dirent **ents;
+    int n = scandir(CONF_DIR_S, &ents, justin_artifact_conf_filter, alphasort);
+    char path[PATH_MAX];
+    for (int i=0; i < n; i++) {
+        if (ok) {
+            snprintf(path, sizeof path, "%s/%s", CONF_DIR_S, ents[i]->d_name);
+            ok = justin_artifact_buf_file(&buf, path);
+        }
+        free(ents[i]);
+    }
+    if (n >= 0) free(ents);
+
+    for (size_t i=0; ok && ctx->home != NULL && i < (sizeof CONF_USER_FILES) / sizeof(char*); i++) {
+        snprintf(path, sizeof path, "%s/%s", ctx->home, CONF_USER_FILES[i]);
+        ok = justin_artifact_buf_file(&buf, path);
+    }
+
+    const char *value;
+    for (size_t i=0; ok && i < (sizeof CONF_ENV) / sizeof(char*); i++) {
+        value = getenv(CONF_ENV[i]);
+        if (value == NULL) continue;
+        ok = justin_artifact_buf_append(&buf, CONF_ENV[i], strlen(CONF_ENV[i]) + 1) &&
+                justin_artifact_buf_append(&buf, value, strlen(value) + 1);
+    }
+
+    git_oid oid;
+    if (!ok) {
+        *err = JUSTIN_ERR_NOMEM;
+    } else if (git_odb_hash(&oid, buf.data == NULL ? "" : buf.data, buf.len, GIT_OBJECT_BLOB) != 0) {
+        *err = JUSTIN_ERR_GIT;
+    } else {
+        git_oid_tostr(out, GIT_OID_HEXSZ + 1, &oid);
+    }
+    free(buf.data);
+}
+
+// Describes the package each dependency of the .SRCINFO resolves to: the installed one, or the one in the sync
+// repositories for sandboxed builds and dependencies that are not installed yet. NULL if there is no .SRCINFO; unsets
+// "known" if there is one that could not be read.
+char* justin_artifact_deps(justin_context ctx, git_repository *repo, git_commit *commit, const char *machine, bool *known, justin_err *err) {
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    justin_err load_err;
+    char *ret = NULL;
+    size_t ret_len;
+    git_blob *blob = justin_srcinfo_load(repo, commit, &info, &load_err);
+    *known = load_err == JUSTIN_ERR_OK;
+    if (blob == NULL) goto ex;
+    FILE *f = open_memstream(&ret, &ret_len);
+    if (f == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex_b;
+    }
+
+    int arch = justin_srcinfo_arch(&info, machine);
+    justin_srcinfo_iter iter;
+    justin_srcinfo_str value;
+    justin_context_alpm_lock(ctx);
+    alpm_handle_t *handle = alpm_db_get_handle(ctx->alpm_db);
+    justin_deps_register_syncdbs(handle);
+    alpm_list_t *installed = ctx->params->f_sandbox ? NULL : alpm_db_get_pkgcache(ctx->alpm_db);
+    for (size_t section=0; section <= info.pkgnames_len; section++) {
+        for (size_t i=0; i < (sizeof ARTIFACT_DEP_FIELDS) / sizeof(justin_srcinfo_field); i++) {
+            justin_srcinfo_iter_init(&info, &iter, ARTIFACT_DEP_FIELDS[i], (uint16_t) section, arch);
+            while (justin_srcinfo_iter_next(&info, &iter, &value)) {
+                char *dep = strndup(value.ptr, value.len);
+                if (dep == NULL) {
+                    *err = JUSTIN_ERR_NOMEM;
+                    goto ex_l;
+                }
+                alpm_pkg_t *pkg = installed == NULL ? NULL : alpm_find_satisfier(installed, dep);
+                if (pkg == NULL) pkg = alpm_find_dbs_satisfier(handle, alpm_get_syncdbs(handle), dep);
+                fprintf(f, "dep %s %s %s\n", dep, pkg == NULL ? "-" : alpm_pkg_get_name(pkg),
+                        pkg == NULL ? "-" : alpm_pkg_get_version(pkg));
+                free(dep);
+            }
+        }
+    }
+
+    ex_l:
+    justin_context_alpm_unlock(ctx);
+    if (fclose(f) != 0) *err = JUSTIN_ERR_NOMEM;
+    if ((*err) != JUSTIN_ERR_OK) {
+        free(ret);
+        ret = NULL;
+    }
+    ex_b:
+    git_blob_free(blob);
+    ex:
+    justin_srcinfo_free(&info);
+    return ret;
+}
+
+// Path of "name" in the cache. Root installs what is in there, so the cache belongs to root, not to the build user.
+char* justin_artifact_path(justin_context ctx, const char *name, justin_err *err) {
+    char *base = justin_storage_path(ctx->storage, ARTIFACT_DIR_S, "", err);
+    if (base == NULL) return NULL;
+    struct stat st;
+    if (lstat(base, &st) == -1 || !S_ISDIR(st.st_mode) ||
+        ((st.st_uid != 0 || (st.st_mode & 022) != 0) && (lchown(base, 0, 0) == -1 || chmod(base, 0755) == -1))) {
+        *err = JUSTIN_ERR_SYSTEM;
+        free(base);
+        return NULL;
+    }
+    if (*name == '\0') return base;
+    char *ret;
+    if (asprintf(&ret, "%s/%s", base, name) == -1) {
+        ret = NULL;
+        *err = JUSTIN_ERR_NOMEM;
+    }
+    free(base);
+    return ret;
+}
+
+char* justin_artifact_stage(justin_context ctx, justin_err *err) {
+    char *base = justin_artifact_path(ctx, "", err);
+    if (base == NULL) return NULL;
+    char *ret = (char*) malloc(strlen(base) + sizeof ARTIFACT_STAGE_TEMPLATE);
+    if (ret == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+    } else {
+        strcpy(ret, base);
+        strcat(ret, ARTIFACT_STAGE_TEMPLATE);
+        // Readable by all, so that the cache can be served to other machines as is
+        if (mkdtemp(ret) == NULL || chmod(ret, 0755) == -1) {
+            *err = JUSTIN_ERR_SYSTEM;
+            free(ret);
+            ret = NULL;
+        }
+    }
+    free(base);
+    return ret;
+}
+
+char* justin_artifact_lookup(justin_context ctx, const char *name, git_repository *repo, git_commit *commit, bool *hit, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    *hit = false;
+
+    struct utsname uts;
+    if (uname(&uts) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return NULL;
+    }
+
+    // A VCS package built from the same tree is only the same package while upstream has not moved
+    bool resolved;
+    char *upstream = justin_vcs_describe(name, repo, commit, &resolved, err);
+    if ((*err) != JUSTIN_ERR_OK) return NULL;
+    bool known = true;
+    char *deps = resolved ? justin_artifact_deps(ctx, repo, commit, uts.machine, &known, err) : NULL;
+    if ((*err) != JUSTIN_ERR_OK) {
+        free(upstream);
+        return NULL;
+    }
+    if (!resolved || !known) {
+        // A key missing what the build depends on would be hit by builds it does not describe
+        free(upstream);
+        free(deps);
+        char buf[256];
+        snprintf(buf, sizeof buf, "Not cached: %s%.160s %s(%s unknown)", BYEL, name, CYN, resolved ? "dependencies" : "upstream");
+        justin_log_info(buf);
+        return NULL;
+    }
+
+    char tree_hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(tree_hex, sizeof tree_hex, git_commit_tree_id(commit));
+    char *desc;
+    // A sandboxed build only sees its declared dependencies, so it can differ from one on the host
+    int desc_len = asprintf(&desc, "tree %s\nconfig %s\narch %s\n%s%s%s", tree_hex, ctx->config, uts.machine,
+                            ctx->params->f_sandbox ? "sandbox\n" : "", upstream == NULL ? "" : upstream,
+                            deps == NULL ? "" : deps);
+    free(upstream);
+    free(deps);
+    if (desc_len == -1) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+
+    git_oid key;
+    int hash_err = git_odb_hash(&key, desc, desc_len, GIT_OBJECT_BLOB);
+    free(desc);
+    if (hash_err != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+    char key_hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(key_hex, sizeof key_hex, &key);
+
+    char *path = justin_artifact_path(ctx, key_hex, err);
+    if (path == NULL) return NULL;
+
+    struct stat st;
+    *hit = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    bool substituted = false;
+    if (!(*hit)) {
+        justin_err sub_err;
+        substituted = *hit = justin_substitute_fetch(ctx, key_hex, path, &sub_err);
+        // Not being able to download is no reason not to build
+        if (sub_err != JUSTIN_ERR_OK) justin_log_err_soft(sub_err);
+    }
+
+    pthread_mutex_lock(&ARTIFACT_STATS_MUTEX);
+    if (substituted) {
+        ARTIFACT_SUBSTITUTED++;
+    } else if (*hit) {
+        ARTIFACT_HITS++;
+    } else {
+        ARTIFACT_MISSES++;
+    }
+    pthread_mutex_unlock(&ARTIFACT_STATS_MUTEX);
+
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s %s%.160s %s(%.12s)", substituted ? "Substituted:" : (*hit ? "Cache hit:" : "Cache miss:"),
+             BYEL, name, CYN, key_hex);
+    justin_log_info(buf);
+    return path;
+}
+
+// Moves the packages of a staged entry that could not be stored back to the build directory, returning false if some are left
+bool justin_artifact_unstage(justin_context ctx, const char *tmp, const char *build_dir) {
+    justin_err err;
+    justin_pkg_target_list targets = justin_pkg_target_list_create(tmp, &err);
+    if (err != JUSTIN_ERR_OK) return false;
+    bool ret = true;
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    const char *target;
+    while ((target = justin_pkg_target_list_next(targets, &err)) != NULL) {
+        snprintf(src, sizeof src, "%s/%s", tmp, target);
+        snprintf(dst, sizeof dst, "%s/%s", build_dir, target);
+        if (justin_util_file_move(src, dst) != 0 || chown(dst, ctx->storage->user, -1) == -1) ret = false;
+    }
+    justin_pkg_target_list_destroy(targets);
+    return ret && err == JUSTIN_ERR_OK;
+}
+
+bool justin_artifact_store(justin_context ctx, const char *build_dir, const char *path, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    bool stored = false;
+    char *tmp = justin_artifact_stage(ctx, err);
+    if (tmp == NULL) return false;
+
+    justin_pkg_target_list targets = justin_pkg_target_list_create(build_dir, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    size_t dir_len = strlen(build_dir);
+    size_t tmp_len = strlen(tmp);
+    size_t count = 0;
+    const char *target;
+    size_t target_len;
+    while ((target = justin_pkg_target_list_next(targets, err)) != NULL) {
+        target_len = strlen(target);
+        char *src = (char*) malloc(dir_len + target_len + 2);
+        char *dst = (char*) malloc(tmp_len + target_len + 2);
+        if (src == NULL || dst == NULL) {
+            free(src);
+            free(dst);
+            *err = JUSTIN_ERR_NOMEM;
+            break;
+        }
+        justin_util_path_join(build_dir, dir_len, target, target_len, src);
+        justin_util_path_join(tmp, tmp_len, target, target_len, dst);
+        int move_err = justin_util_file_move(src, dst);
+        // makepkg ran as the user, whose files these were
+        if (move_err == 0 && (chown(dst, 0, 0) == -1 || chmod(dst, 0644) == -1)) move_err = -1;
+        free(src);
+        free(dst);
+        if (move_err != 0) {
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
+        }
+        count++;
+    }
+    justin_pkg_target_list_destroy(targets);
+    if ((*err) == JUSTIN_ERR_OK && count == 0) {
+        justin_log_warn("makepkg produced no packages, nothing to cache");
+        goto ex;
+    }
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    // Entries are only published with their index, so that substituters can serve them
+    justin_substitute_index(tmp, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    // Losing the race to another build of the same key is fine, the packages are the same
+    stored = rename(tmp, path) == 0;
+    if (stored) {
+        free(tmp);
+        return true;
+    }
+    if (errno == EEXIST || errno == ENOTEMPTY) {
+        stored = true;
+    } else {
+        *err = JUSTIN_ERR_SYSTEM;
+    }
+
+    ex:
+    // The journal already says built, so a resumed build expects the packages where makepkg left them
+    if (!stored && !justin_artifact_unstage(ctx, tmp, build_dir)) {
+        char buf[PATH_MAX + 64];
+        snprintf(buf, sizeof buf, "Could not move the packages back, they are left in %s", tmp);
+        justin_log_warn(buf);
+    } else if (justin_util_rimraf(tmp) != 0) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    }
+    free(tmp);
+    return stored;
+}
+
+// True if "file" is an archive of "pkgname", i.e. "<pkgname>-<pkgver>-<pkgrel>-<arch>.pkg.tar*"
+bool justin_artifact_is_package(const char *file, const char *pkgname, size_t pkgname_len) {
+    if (strncmp(file, pkgname, pkgname_len) != 0 || file[pkgname_len] != '-') return false;
+    if (!justin_pkg_is_archive(file)) return false;
+    // Names may contain dashes, versions may not
+    const char *ext = strstr(&file[pkgname_len], ".pkg.tar");
+    int dashes = 0;
+    for (const char *c = &file[pkgname_len]; c < ext; c++) {
+        if (*c == '-') dashes++;
+    }
+    return dashes == 3;
+}
+
+// Replaces "best" with the newest archive of "pkgname" in "dir" if there is a newer one
+void justin_artifact_find_in(const char *dir, const char *pkgname, size_t pkgname_len, char **best, struct timespec *best_time) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+    struct dirent *file;
+    struct stat st;
+    char path[PATH_MAX];
+    while ((file = readdir(d)) != NULL) {
+        if (!justin_artifact_is_package(file->d_name, pkgname, pkgname_len)) continue;
+        snprintf(path, sizeof path, "%s/%s", dir, file->d_name);
+        if (stat(path, &st) == -1) continue;
+        if (*best != NULL && (st.st_mtim.tv_sec < best_time->tv_sec ||
+            (st.st_mtim.tv_sec == best_time->tv_sec && st.st_mtim.tv_nsec <= best_time->tv_nsec))) continue;
+        char *copy = strdup(path);
+        if (copy == NULL) continue;
+        free(*best);
+        *best = copy;
+        *best_time = st.st_mtim;
+    }
+    closedir(d);
+}
+
+char* justin_artifact_find(justin_context ctx, const char *pkgname) {
+    size_t pkgname_len = strlen(pkgname);
+    char *best = NULL;
+    struct timespec best_time = { 0, 0 };
+
+    // Packages built earlier in this run are the newest there are, whether or not they were cached
+    pthread_mutex_lock(&ARTIFACT_BUILT_MUTEX);
+    for (size_t i=0; i < ARTIFACT_BUILT_LEN; i++) {
+        justin_artifact_find_in(ARTIFACT_BUILT[i], pkgname, pkgname_len, &best, &best_time);
+    }
+    pthread_mutex_unlock(&ARTIFACT_BUILT_MUTEX);
+
+    justin_err err;
+    char *base = justin_artifact_path(ctx, "", &err);
+    if (base == NULL) return best;
+    DIR *d = opendir(base);
+    if (d == NULL) {
+        free(base);
+        return best;
+    }
+    struct dirent *entry;
+    char path[PATH_MAX];
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof path, "%s/%s", base, entry->d_name);
+        justin_artifact_find_in(path, pkgname, pkgname_len, &best, &best_time);
+    }
+    closedir(d);
+    free(base);
+    return best;
+}
+
+void justin_artifact_add_built(const char *build_dir) {
+    char *copy = strdup(build_dir);
+    if (copy == NULL) return;
+    pthread_mutex_lock(&ARTIFACT_BUILT_MUTEX);
+    char **grown = realloc(ARTIFACT_BUILT, (ARTIFACT_BUILT_LEN + 1) * sizeof(char*));
+    if (grown == NULL) {
+        free(copy);
+    } else {
+        ARTIFACT_BUILT = grown;
+        ARTIFACT_BUILT[ARTIFACT_BUILT_LEN++] = copy;
+    }
+    pthread_mutex_unlock(&ARTIFACT_BUILT_MUTEX);
+}
+
+void justin_artifact_forget_built(const char *build_dir) {
+    pthread_mutex_lock(&ARTIFACT_BUILT_MUTEX);
+    for (size_t i=0; i < ARTIFACT_BUILT_LEN; i++) {
+        if (strcmp(ARTIFACT_BUILT[i], build_dir) != 0) continue;
+        free(ARTIFACT_BUILT[i]);
+        ARTIFACT_BUILT[i] = ARTIFACT_BUILT[--ARTIFACT_BUILT_LEN];
+        break;
+    }
+    if (ARTIFACT_BUILT_LEN == 0) {
+        free(ARTIFACT_BUILT);
+        ARTIFACT_BUILT = NULL;
+    }
+    pthread_mutex_unlock(&ARTIFACT_BUILT_MUTEX);
+}
+
+void justin_artifact_summary() {
+    pthread_mutex_lock(&ARTIFACT_STATS_MUTEX);
+    size_t hits = ARTIFACT_HITS;
+    size_t substituted = ARTIFACT_SUBSTITUTED;
+    size_t misses = ARTIFACT_MISSES;
+    pthread_mutex_unlock(&ARTIFACT_STATS_MUTEX);
+    if (hits + substituted + misses == 0) return;
+
+    char buf[128];
+    int len = snprintf(buf, sizeof buf, "Package cache: %zu hit%s, ", hits, hits == 1 ? "" : "s");
+    if (substituted != 0) len += snprintf(&buf[len], sizeof buf - len, "%zu substituted, ", substituted);
+    snprintf(&buf[len], sizeof buf - len, "%zu miss%s", misses, misses == 1 ? "" : "es");
+    justin_log_info(buf);
+}
@@ -0,0 +1,85 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <git2.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_ARTIFACT_H
+#define JUSTIN_ARTIFACT_H
+
+/*
+ * Cache of built packages in the storage directory. Entries are keyed by the tree of the PKGBUILD repository at the
+ * built commit, a hash of the makepkg configuration (makepkg.conf and its drop-ins, the user's makepkg.conf and the
+ * environment variables makepkg reads) and the machine architecture. The same tree built with the same configuration
+ * gives the same key on any machine, so a hit can be installed without checking out or running makepkg. Packages with
+ * VCS sources also key on where their upstream refs point, see justin_vcs_describe, and every package keys on the
+ * versions its depends, makedepends and checkdepends resolve to. A miss is looked up in the substituters before it is
+ * built, see substitute.h. The cache and everything in it is owned by root.
+ */
+
+#define JUSTIN_ARTIFACT_DIR ".artifacts"
+
+/**
+ * Hashes everything that makepkg reads to decide how to build into "out", GIT_OID_HEXSZ + 1 bytes. Reads the files in
+ * the home directory of the context, and is done once as the context is created.
+ */
+void justin_artifact_config_hash(justin_context ctx, char *out, justin_err *err);
+
+/**
+ * Returns the cache directory for the tree of a commit, and whether it already holds packages, possibly just
+ * downloaded from a substituter. Hits and misses are reported and counted for justin_artifact_summary. Returns NULL
+ * with "err" unset if the package is to be built without being cached: a VCS package whose upstream cannot be asked,
+ * or a tree whose .SRCINFO cannot be read.
+ */
+char* justin_artifact_lookup(justin_context ctx, const char *name, git_repository *repo, git_commit *commit, bool *hit, justin_err *err);
+
+/**
+ * Moves the packages built in build_dir into a cache directory from justin_artifact_lookup. The entry appears
+ * atomically, so concurrent builds of the same key are harmless. Returns true if the cache directory now holds the
+ * packages; false if there was nothing to store, in which case they are still in build_dir.
+ */
+bool justin_artifact_store(justin_context ctx, const char *build_dir, const char *path, justin_err *err);
+
+/**
+ * Creates a hidden directory in the cache to put an entry together in, before it is renamed to its key
+ */
+char* justin_artifact_stage(justin_context ctx, justin_err *err);
+
+/**
+ * Returns the path of the newest package archive of "pkgname" in the cache or in a build directory registered with
+ * justin_artifact_add_built, or NULL if there is none
+ */
+char* justin_artifact_find(justin_context ctx, const char *pkgname);
+
+/**
+ * Makes the packages left in a build directory of this run visible to justin_artifact_find, for builds that were not
+ * stored in the cache (-f, or only some packages of a split base)
+ */
+void justin_artifact_add_built(const char *build_dir);
+
+/**
+ * Undoes justin_artifact_add_built, before the build directory is removed
+ */
+void justin_artifact_forget_built(const char *build_dir);
+
+/**
+ * Logs the number of hits and misses so far, if there were any lookups
+ */
+void justin_artifact_summary();
+
+#endif //JUSTIN_ARTIFACT_H
@@ -19,12 +19,21 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <json-c/json.h>
 #include <curl/curl.h>
 #include <git2.h>
 #include "../util.h"
+#include "fetch.h"
 #include "aur.h"
 
+void justin_aur_project_free_strv(const char **strv) {
+    if (strv == NULL) return;
+    for (const char **head = strv; *head != NULL; head++) free((void*) *head);
+    free(strv);
+}
+
 void justin_aur_project_list_free0(justin_aur_project_list list, bool root) {
     if (list == NULL) return;
     justin_aur_project_list next = list->next;
@@ -35,8 +44,11 @@ void justin_aur_project_list_free0(justin_aur_project_list list, bool root) {
     }
     justin_aur_project_t *project = &list->value;
     free((void*) project->name);
+    free((void*) project->base);
     free((void*) project->version);
     free((void*) project->description);
+    justin_aur_project_free_strv(project->depends);
+    justin_aur_project_free_strv(project->make_depends);
     if (root) free(list);
 }
 
@@ -125,23 +137,43 @@ size_t curl_collect(char *ptr, size_t size, size_t nmemb, void *userdata) {
     return real_size;
 }
 
+// Copies a JSON array of strings into a NULL-terminated array. A missing array is left as NULL.
+bool search_json2strv(struct json_object *arr, const char ***out) {
+    *out = NULL;
+    if (arr == NULL || json_object_get_type(arr) != json_type_array) return true;
+
+    size_t len = json_object_array_length(arr);
+    const char **strv = (const char**) calloc(len + 1, sizeof(char*));
+    if (strv == NULL) return false;
+    size_t n = 0;
+    struct json_object *element;
+    for (size_t i=0; i < len; i++) {
+        element = json_object_array_get_idx(arr, i);
+        if (element == NULL || json_object_get_type(element) != json_type_string) continue;
+        if ((strv[n] = strdup(json_object_get_string(element))) == NULL) {
+            justin_aur_project_free_strv(strv);
+            return false;
+        }
+        n++;
+    }
+    *out = strv;
+    return true;
+}
+
 justin_aur_project_list search_json2list(struct json_object *obj) {
     justin_aur_project_list node = (justin_aur_project_list) malloc(sizeof(justin_aur_project_list_t));
     if (node == NULL) return NULL;
+    node->size = 0;
+    node->next = NULL;
 
     struct json_object *temp;
     temp = json_object_object_get(obj, "resultcount");
-    if (temp == NULL) {
-        node->size = 0;
-        return node;
-    }
+    if (temp == NULL) return node;
     int64_t rc = json_object_get_int64(temp);
+    if (rc <= 0) return node;
 
     temp = json_object_object_get(obj, "results");
-    if (temp == NULL || json_object_get_type(temp) != json_type_array) {
-        node->size = 0;
-        return node;
-    }
+    if (temp == NULL || json_object_get_type(temp) != json_type_array) return node;
 
     justin_aur_project_list nodes = (justin_aur_project_list) realloc(node, sizeof(justin_aur_project_list_t) * rc);
     if (nodes == NULL) return NULL;
@@ -157,6 +189,9 @@ justin_aur_project_list search_json2list(struct json_object *obj) {
         if (element == NULL) continue;
 
         justin_aur_project_t *project = &node->value;
+        project->base = NULL;
+        project->depends = NULL;
+        project->make_depends = NULL;
 
         prop = json_object_object_get(element, "NumVotes");
         if (prop == NULL) continue;
@@ -185,17 +220,33 @@ justin_aur_project_list search_json2list(struct json_object *obj) {
         }
         project->version = version;
 
+        // Description is null for some packages
         prop = json_object_object_get(element, "Description");
-        if (prop == NULL) continue;
-        char* description = strdup(json_object_get_string(prop));
+        char* description = strdup(prop == NULL ? "" : json_object_get_string(prop));
         if (description == NULL) {
             free(name);
-            free(description);
+            free(version);
             justin_aur_project_list_free(nodes);
             return NULL;
         }
         project->description = description;
 
+        prop = json_object_object_get(element, "PackageBase");
+        char* base = strdup(prop == NULL ? name : json_object_get_string(prop));
+        bool deps_ok = search_json2strv(json_object_object_get(element, "Depends"), &project->depends) &&
+                search_json2strv(json_object_object_get(element, "MakeDepends"), &project->make_depends);
+        if (base == NULL || !deps_ok) {
+            free(name);
+            free(version);
+            free(description);
+            free(base);
+            justin_aur_project_free_strv(project->depends);
+            justin_aur_project_free_strv(project->make_depends);
+            justin_aur_project_list_free(nodes);
+            return NULL;
+        }
+        project->base = base;
+
         node->size = rc;
     }
 
@@ -236,6 +287,127 @@ justin_aur_project_list justin_aur_search(justin_context ctx, const char *term,
     return ret;
 }
 
+#define AUR_URL_INFO "https://aur.archlinux.org/rpc/v5/info?"
+static const char *AUR_URL_INFO_S = AUR_URL_INFO;
+#define AUR_URL_INFO_L ((sizeof AUR_URL_INFO) - 1)
+
+#define AUR_URL_INFO_ARG "arg%5B%5D="
+static const char *AUR_URL_INFO_ARG_S = AUR_URL_INFO_ARG;
+#define AUR_URL_INFO_ARG_L ((sizeof AUR_URL_INFO_ARG) - 1)
+
+char* build_url_info(const char *const *names, size_t count) {
+    size_t len = AUR_URL_INFO_L + 1;
+    for (size_t i=0; i < count; i++) len += AUR_URL_INFO_ARG_L + (strlen(names[i]) * 3) + 1;
+    char *full = (char*) malloc(len);
+    if (full == NULL) return NULL;
+
+    memcpy(full, AUR_URL_INFO_S, AUR_URL_INFO_L);
+    size_t head = AUR_URL_INFO_L;
+    const char *name;
+    char c;
+    for (size_t i=0; i < count; i++) {
+        if (i != 0) full[head++] = '&';
+        memcpy(&full[head], AUR_URL_INFO_ARG_S, AUR_URL_INFO_ARG_L);
+        head += AUR_URL_INFO_ARG_L;
+        name = names[i];
+        while ((c = *(name++)) != '\0') {
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.') {
+                full[head++] = c;
+            } else {
+                full[head++] = '%';
+                full[head++] = justin_util_n2hex((c >> 4) & 0xF);
+                full[head++] = justin_util_n2hex(c & 0xF);
+            }
+        }
+    }
+    full[head] = (char) 0;
+    return full;
+}
+
+justin_aur_project_list justin_aur_info0(justin_context ctx, const char *const *names, size_t count, justin_err *err) {
+    CURL *curl = ctx->curl;
+    CURLcode res;
+    char *url = build_url_info(names, count);
+    if (url == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+
+    struct json_tokener *tokener = json_tokener_new();
+    struct json_collector col = { tokener, NULL };
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, ((void*) (&col)));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_collect);
+    res = curl_easy_perform(curl);
+
+    json_tokener_free(tokener);
+    free(url);
+    if (res != CURLE_OK) {
+        *err = JUSTIN_ERR_CURL(res);
+        return NULL;
+    }
+
+    struct json_object *obj = col.obj;
+    if (obj == NULL) {
+        *err = JUSTIN_ERR_PROTOCOL;
+        return NULL;
+    }
+
+    justin_aur_project_list ret = search_json2list(obj);
+    if (ret == NULL) *err = JUSTIN_ERR_NOMEM;
+    json_object_free_userdata(NULL, obj);
+    return ret;
+}
+
+justin_aur_project_list justin_aur_info(justin_context ctx, const char *const *names, size_t count, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+
+    size_t batch_count = count == 0 ? 1 : ((count - 1) / JUSTIN_AUR_INFO_BATCH) + 1;
+    justin_aur_project_list *batches = (justin_aur_project_list*) calloc(batch_count, sizeof(justin_aur_project_list));
+    if (batches == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+
+    size_t total = 0;
+    size_t i;
+    for (i=0; i < batch_count; i++) {
+        size_t off = i * JUSTIN_AUR_INFO_BATCH;
+        size_t n = count - off < JUSTIN_AUR_INFO_BATCH ? count - off : JUSTIN_AUR_INFO_BATCH;
+        batches[i] = justin_aur_info0(ctx, &names[off], n, err);
+        if ((*err) != JUSTIN_ERR_OK) break;
+        for (justin_aur_project_list head = batches[i]; head != NULL; head = head->next) {
+            if (head->size != 0) total++;
+        }
+    }
+
+    // Move the valid entries of every batch into one array, so that the result is freed like a search result
+    justin_aur_project_list ret = NULL;
+    if ((*err) == JUSTIN_ERR_OK) {
+        ret = (justin_aur_project_list) calloc(total == 0 ? 1 : total, sizeof(justin_aur_project_list_t));
+        if (ret == NULL) *err = JUSTIN_ERR_NOMEM;
+    }
+    size_t n = 0;
+    for (size_t b=0; b < batch_count; b++) {
+        if (batches[b] == NULL) continue;
+        if (ret == NULL) {
+            justin_aur_project_list_free(batches[b]);
+            continue;
+        }
+        for (justin_aur_project_list head = batches[b]; head != NULL; head = head->next) {
+            if (head->size == 0) continue;
+            ret[n].value = head->value;
+            ret[n].size = (int64_t) total;
+            ret[n].next = n + 1 < total ? &ret[n + 1] : NULL;
+            n++;
+        }
+        free(batches[b]);
+    }
+    free(batches);
+    return ret;
+}
+
 #define AUR_GIT_URL_A "https://aur.archlinux.org/"
 static const char *AUR_GIT_URL_A_S = AUR_GIT_URL_A;
 #define AUR_GIT_URL_A_L ((sizeof AUR_GIT_URL_A) - 1)
@@ -244,22 +416,48 @@ static const char *AUR_GIT_URL_A_S = AUR_GIT_URL_A;
 static const char *AUR_GIT_URL_B_S = AUR_GIT_URL_B;
 #define AUR_GIT_URL_B_L ((sizeof AUR_GIT_URL_B) - 1)
 
-git_repository *justin_aur_project_clone_into(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err) {
-    const char *name = project->name;
+static char* build_url_git(justin_context ctx, justin_aur_project_t *project) {
+    const char *base = AUR_GIT_URL_A_S;
+    size_t base_len = AUR_GIT_URL_A_L;
+    bool base_slash = true;
+    if (ctx->params->v_remote != NULL) {
+        base = ctx->params->v_remote;
+        base_len = strlen(base);
+        base_slash = base_len > 0 && base[base_len - 1] == '/';
+    }
+    if (!base_slash) base_len++;
+
+    // The git repositories are named after the package base, which differs from the name for split packages
+    const char *name = project->base != NULL ? project->base : project->name;
     size_t name_len = strlen(name);
 
-    char* url = (char*) malloc(AUR_GIT_URL_A_L + AUR_GIT_URL_B_L + name_len + 1);
+    char* url = (char*) malloc(base_len + AUR_GIT_URL_B_L + name_len + 1);
+    if (url == NULL) return NULL;
+    if (base_slash) {
+        memcpy(url, base, base_len);
+    } else {
+        memcpy(url, base, base_len - 1);
+        url[base_len - 1] = '/';
+    }
+    memcpy(&url[base_len], name, name_len);
+    memcpy(&url[base_len + name_len], AUR_GIT_URL_B_S, AUR_GIT_URL_B_L);
+    url[base_len + AUR_GIT_URL_B_L + name_len] = (char) 0;
+    return url;
+}
+
+git_repository *justin_aur_project_clone_into(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err) {
+    char* url = build_url_git(ctx, project);
     if (url == NULL) {
         *err = JUSTIN_ERR_NOMEM;
         return NULL;
     }
-    memcpy(url, AUR_GIT_URL_A_S, AUR_GIT_URL_A_L);
-    memcpy(&url[AUR_GIT_URL_A_L], name, name_len);
-    memcpy(&url[AUR_GIT_URL_A_L + name_len], AUR_GIT_URL_B_S, AUR_GIT_URL_B_L);
-    url[AUR_GIT_URL_A_L + AUR_GIT_URL_B_L + name_len] = (char) 0;
+
+    git_clone_options opts;
+    git_clone_options_init(&opts, GIT_CLONE_OPTIONS_VERSION);
+    opts.checkout_opts.checkout_strategy = GIT_CHECKOUT_NONE;
 
     git_repository *repo;
-    if (git_clone(&repo, url, path, NULL) != 0) {
+    if (git_clone(&repo, url, path, &opts) != 0) {
         *err = JUSTIN_ERR_GIT;
         free(url);
         return NULL;
@@ -273,3 +471,57 @@ git_repository *justin_aur_project_clone_into(justin_context ctx, justin_aur_pro
     }
     return repo;
 }
+
+git_repository *justin_aur_project_clone_bare(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err) {
+    char* url = build_url_git(ctx, project);
+    if (url == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+
+    git_clone_options opts;
+    git_clone_options_init(&opts, GIT_CLONE_OPTIONS_VERSION);
+    opts.bare = 1;
+
+    git_repository *repo;
+    if (git_clone(&repo, url, path, &opts) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        free(url);
+        return NULL;
+    }
+    free(url);
+    return repo;
+}
+
+git_repository *justin_aur_project_fetch_history(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err) {
+    char* url = build_url_git(ctx, project);
+    if (url == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+
+    git_repository *repo = justin_fetch_history(ctx, url, path, err);
+    free(url);
+    if (*err == JUSTIN_ERR_PROTOCOL) {
+        justin_log_warn("Remote does not support partial fetch, cloning everything");
+        // The partial fetch may have got as far as creating a repository, and a clone needs an empty directory
+        struct stat st;
+        if (stat(path, &st) == -1 || justin_util_rimraf(path) != 0 || mkdir(path, st.st_mode & 07777) == -1 ||
+                chown(path, st.st_uid, st.st_gid) == -1) {
+            *err = JUSTIN_ERR_SYSTEM;
+            return NULL;
+        }
+        return justin_aur_project_clone_bare(ctx, project, path, err);
+    }
+    return repo;
+}
+
+void justin_aur_project_fetch_blobs(justin_context ctx, justin_aur_project_t *project, git_repository *repo, git_commit *commit, justin_err *err) {
+    char* url = build_url_git(ctx, project);
+    if (url == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    justin_fetch_blobs(ctx, repo, url, commit, err);
+    free(url);
+}
@@ -24,10 +24,14 @@
 
 typedef struct justin_aur_project_t {
     const char *name;
+    const char *base;
     const char *version;
     const char *description;
     int votes;
     float popularity;
+    // NULL-terminated, only filled in by justin_aur_info
+    const char **depends;
+    const char **make_depends;
 } justin_aur_project_t;
 
 typedef struct justin_aur_project_list_t {
@@ -46,6 +50,33 @@ void justin_aur_project_list_sort_popularity(justin_aur_project_list list);
 
 justin_aur_project_list justin_aur_search(justin_context ctx, const char *term, justin_err *err);
 
+/**
+ * Looks up several packages by exact name, including their dependencies. Names are sent in batches, so this costs
+ * one request per JUSTIN_AUR_INFO_BATCH names. Names that do not exist in the AUR are missing from the result.
+ */
+justin_aur_project_list justin_aur_info(justin_context ctx, const char *const *names, size_t count, justin_err *err);
+#define JUSTIN_AUR_INFO_BATCH 100
+
+/**
+ * Clones the project without writing the working tree, so that nothing is checked out if the packages are found in
+ * the artifact cache. Use justin_repo_checkout_into with the repository's working directory to write it.
+ */
 git_repository *justin_aur_project_clone_into(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err);
 
+/**
+ * Clones the project as a bare repository (no working tree, no index). Intended to be used with a path from
+ * justin_storage_mem_dir_create, so that the object database never touches the disk; the chosen tree is then written
+ * out with justin_repo_checkout_into.
+ */
+git_repository *justin_aur_project_clone_bare(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err);
+
+/**
+ * Like justin_aur_project_clone_bare, but transfers only commits and trees. Blobs must be requested with
+ * justin_aur_project_fetch_blobs before a commit can be checked out. Falls back to a full bare clone if the remote
+ * does not support filtered fetches.
+ */
+git_repository *justin_aur_project_fetch_history(justin_context ctx, justin_aur_project_t *project, const char *path, justin_err *err);
+
+void justin_aur_project_fetch_blobs(justin_context ctx, justin_aur_project_t *project, git_repository *repo, git_commit *commit, justin_err *err);
+
 #endif //JUSTIN_AUR_H
@@ -0,0 +1,353 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "../proc.h"
+#include "pkg.h"
+#include "artifact.h"
+#include "sources.h"
+#include "bisect.h"
+
+#define PATH2_SH "/bin/sh"
+static const char *PATH2_SH_S = PATH2_SH;
+
+#define BISECT_EXIT_SKIP 125
+
+typedef enum justin_bisect_verdict {
+    JUSTIN_BISECT_UNTESTED,
+    JUSTIN_BISECT_GOOD,
+    JUSTIN_BISECT_BAD,
+    JUSTIN_BISECT_SKIP
+} justin_bisect_verdict;
+
+typedef struct justin_bisect_candidate {
+    justin_context ctx;
+    const char *name;
+    size_t index;
+    git_oid oid;
+    uid_t user;
+    char *out;          // artifact cache directory, NULL if the packages cannot be cached
+    char *dir;          // build directory, NULL if the artifacts were cached
+    pthread_t thread;
+    bool started;
+    justin_err err;
+    justin_bisect_verdict verdict;
+} justin_bisect_candidate;
+
+// Finds the index of a revision in the commit list, either by revparse or by searching the summaries
+bool justin_bisect_resolve(justin_repo_commit_list list, const char *rev, size_t *out) {
+    justin_meta meta = list->meta;
+    size_t size = justin_meta_size(meta);
+    git_oid oid;
+
+    git_object *obj;
+    if (git_revparse_single(&obj, list->repo, rev) == 0) {
+        git_object *peeled;
+        int peel_err = git_object_peel(&peeled, obj, GIT_OBJECT_COMMIT);
+        git_object_free(obj);
+        if (peel_err == 0) {
+            git_oid_cpy(&oid, git_object_id(peeled));
+            git_object_free(peeled);
+            git_oid cur;
+            for (size_t i=0; i < size; i++) {
+                justin_meta_oid(meta, i, &cur);
+                if (git_oid_equal(&cur, &oid)) {
+                    *out = i;
+                    return true;
+                }
+            }
+        }
+    }
+
+    for (size_t i=0; i < size; i++) {
+        if (strstr(justin_meta_summary(meta, i), rev) != NULL) {
+            *out = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void *justin_bisect_build(void *arg) {
+    justin_bisect_candidate *cand = (justin_bisect_candidate*) arg;
+    char name[256];
+    char hex[9];
+    git_oid_tostr(hex, sizeof hex, &cand->oid);
+    snprintf(name, sizeof name, "%.200s-%s", cand->name, hex);
+    justin_buildlog log = justin_buildlog_open(cand->ctx, name);
+    justin_pkg_make(cand->ctx, cand->dir, log, &cand->err);
+    justin_buildlog_close(log);
+    if (cand->err == JUSTIN_ERR_OK && cand->out != NULL && !justin_artifact_store(cand->ctx, cand->dir, cand->out, &cand->err)) {
+        if (cand->err == JUSTIN_ERR_OK) cand->err = JUSTIN_ERR_ASSERTION;
+    }
+    return NULL;
+}
+
+// Writes the tree of a candidate into a fresh build directory, unless its packages are already stored
+void justin_bisect_prepare(justin_context ctx, justin_aur_project_t *project, justin_repo_commit_list list, justin_bisect_candidate *cand, justin_err *err) {
+    justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+    git_oid_cpy(&entry.oid, &cand->oid);
+    entry.index = cand->index;
+    git_commit *commit = justin_repo_commit_list_resolve(list, &entry, err);
+    if ((*err) != JUSTIN_ERR_OK) return;
+
+    // The key covers what the .SRCINFO says, which a partial fetch does not have yet
+    if (ctx->params->f_partial) {
+        justin_aur_project_fetch_blobs(ctx, project, list->repo, commit, err);
+        if ((*err) != JUSTIN_ERR_OK) goto ex;
+    }
+
+    bool hit;
+    cand->out = justin_artifact_lookup(ctx, project->name, list->repo, commit, &hit, err);
+    if ((*err) != JUSTIN_ERR_OK || hit) goto ex;
+
+    cand->dir = justin_storage_build_dir_create(ctx->storage, cand->name, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    justin_repo_checkout_into(list->repo, commit, cand->dir, err);
+    if ((*err) == JUSTIN_ERR_OK && justin_util_chown_r(cand->dir, cand->user) != 0) *err = JUSTIN_ERR_SYSTEM;
+
+    ex:
+    git_commit_free(commit);
+}
+
+// Runs the test command against the stored packages of a candidate, or the built ones if they were not stored
+justin_bisect_verdict justin_bisect_test(justin_context ctx, justin_bisect_candidate *cand, justin_err *err) {
+    const char *out = cand->out != NULL ? cand->out : cand->dir;
+    justin_pkg_target_list targets = justin_pkg_target_list_create(out, err);
+    if ((*err) != JUSTIN_ERR_OK) return JUSTIN_BISECT_UNTESTED;
+
+    size_t out_len = strlen(out);
+    size_t pkgs_len = 0;
+    size_t pkgs_cap = 256;
+    char *pkgs = (char*) malloc(pkgs_cap);
+    const char *target;
+    size_t target_len;
+    while (pkgs != NULL && (target = justin_pkg_target_list_next(targets, err)) != NULL) {
+        target_len = strlen(target);
+        while (pkgs_len + out_len + target_len + 3 > pkgs_cap) pkgs_cap <<= 1;
+        char *grown = (char*) realloc(pkgs, pkgs_cap);
+        if (grown == NULL) {
+            free(pkgs);
+            pkgs = NULL;
+            break;
+        }
+        pkgs = grown;
+        if (pkgs_len != 0) pkgs[pkgs_len++] = ' ';
+        pkgs_len += justin_util_path_join(out, out_len, target, target_len, &pkgs[pkgs_len]);
+    }
+    justin_pkg_target_list_destroy(targets);
+    if (pkgs == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return JUSTIN_BISECT_UNTESTED;
+    }
+    if ((*err) != JUSTIN_ERR_OK) {
+        free(pkgs);
+        return JUSTIN_BISECT_UNTESTED;
+    }
+    pkgs[pkgs_len] = '\0';
+
+    char commit[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(commit, sizeof commit, &cand->oid);
+
+    char *env_pkgs = (char*) malloc(pkgs_len + sizeof "JUSTIN_BISECT_PKGS=");
+    char env_commit[GIT_OID_HEXSZ + sizeof "JUSTIN_BISECT_COMMIT="];
+    if (env_pkgs == NULL) {
+        free(pkgs);
+        *err = JUSTIN_ERR_NOMEM;
+        return JUSTIN_BISECT_UNTESTED;
+    }
+    sprintf(env_pkgs, "JUSTIN_BISECT_PKGS=%s", pkgs);
+    sprintf(env_commit, "JUSTIN_BISECT_COMMIT=%s", commit);
+    free(pkgs);
+
+    char *const env[] = { env_pkgs, env_commit, NULL };
+    char *const argv[] = { "sh", "-c", (char*) ctx->params->v_test, NULL };
+    justin_proc_opts_t opts = JUSTIN_PROC_OPTS_INITIALIZER;
+    opts.cwd = out;
+    opts.user = cand->user;
+    opts.env_add = env;
+    justin_proc_result_t result;
+    justin_proc_run(PATH2_SH_S, argv, &opts, &result, err);
+    free(env_pkgs);
+    if ((*err) != JUSTIN_ERR_OK) return JUSTIN_BISECT_UNTESTED;
+
+    switch (justin_proc_exit_code(&result)) {
+        case 0:
+            return JUSTIN_BISECT_GOOD;
+        case BISECT_EXIT_SKIP:
+            return JUSTIN_BISECT_SKIP;
+        default:
+            return JUSTIN_BISECT_BAD;
+    }
+}
+
+void justin_bisect_log_commit(justin_meta meta, const char *prefix, size_t index) {
+    git_oid oid;
+    char hex[9];
+    char buf[256];
+    justin_meta_oid(meta, index, &oid);
+    git_oid_tostr(hex, sizeof hex, &oid);
+    snprintf(buf, sizeof buf, "%s %s[%s%s%s]%s %.160s", prefix, CYN, BYEL, hex, CYN, BWHT, justin_meta_summary(meta, index));
+    justin_log_info_indent(buf, 1);
+}
+
+void justin_bisect_run(justin_context ctx, justin_aur_project_t *project, justin_repo_commit_list list, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_meta meta = list->meta;
+
+    // Index 0 is the newest commit, so bad < good
+    size_t bad, good;
+    if (!justin_bisect_resolve(list, ctx->params->v_bad, &bad) || !justin_bisect_resolve(list, ctx->params->v_good, &good)) {
+        justin_log_err_msg(JUSTIN_ERR_ARGS, "Revision not found in the package history");
+        *err = JUSTIN_ERR_ARGS;
+        return;
+    }
+    if (bad >= good) {
+        justin_log_err_msg(JUSTIN_ERR_ARGS, "The bad revision must be newer than the good revision");
+        *err = JUSTIN_ERR_ARGS;
+        return;
+    }
+    justin_bisect_log_commit(meta, "Good:", good);
+    justin_bisect_log_commit(meta, "Bad: ", bad);
+
+    size_t origin = bad;
+    unsigned int jobs = ctx->resources.builds;
+    justin_bisect_candidate *cands = (justin_bisect_candidate*) calloc(jobs, sizeof(justin_bisect_candidate));
+    bool *skipped = (bool*) calloc(good - bad + 1, sizeof(bool));
+    size_t *avail = (size_t*) malloc((good - bad + 1) * sizeof(size_t));
+    const char **dirs = (const char**) calloc(jobs, sizeof(char*));
+    if (cands == NULL || skipped == NULL || avail == NULL || dirs == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+
+    char buf[128];
+    unsigned int round = 0;
+    while (good - bad > 1) {
+        size_t n = 0;
+        for (size_t i = bad + 1; i < good; i++) {
+            if (!skipped[i - origin]) avail[n++] = i;
+        }
+        if (n == 0) break;
+
+        // Spread k candidates evenly over the untested range
+        size_t k = n < jobs ? n : jobs;
+        snprintf(buf, sizeof buf, "Round %u: %zu versions left, building %zu", ++round, good - bad - 1, k);
+        justin_log_info(buf);
+        for (size_t i=0; i < k; i++) {
+            justin_bisect_candidate *cand = &cands[i];
+            memset(cand, 0, sizeof(justin_bisect_candidate));
+            cand->index = avail[((i + 1) * n) / (k + 1)];
+            cand->ctx = ctx;
+            cand->name = project->name;
+            cand->user = ctx->storage->user;
+            justin_meta_oid(meta, cand->index, &cand->oid);
+            justin_bisect_prepare(ctx, project, list, cand, &cand->err);
+        }
+
+        // Versions of one package mostly share their sources, so fetch them once for the whole round
+        size_t dirs_len = 0;
+        for (size_t i=0; i < k; i++) {
+            if (cands[i].err == JUSTIN_ERR_OK && cands[i].dir != NULL) dirs[dirs_len++] = cands[i].dir;
+        }
+        justin_err prefetch_err;
+        justin_sources_prefetch(ctx, dirs, dirs_len, &prefetch_err);
+        if (prefetch_err != JUSTIN_ERR_OK) justin_log_err_soft(prefetch_err);
+
+        // libgit2 was only used above; the builds themselves are independent processes
+        for (size_t i=0; i < k; i++) {
+            justin_bisect_candidate *cand = &cands[i];
+            if (cand->err != JUSTIN_ERR_OK || cand->dir == NULL) continue;
+            if (pthread_create(&cand->thread, NULL, justin_bisect_build, cand) == 0) {
+                cand->started = true;
+            } else {
+                justin_bisect_build(cand);
+            }
+        }
+        for (size_t i=0; i < k; i++) {
+            if (cands[i].started) pthread_join(cands[i].thread, NULL);
+        }
+
+        size_t next_bad = bad;
+        for (size_t i=0; i < k; i++) {
+            justin_bisect_candidate *cand = &cands[i];
+            if (cand->err == JUSTIN_ERR_OK) {
+                cand->verdict = justin_bisect_test(ctx, cand, &cand->err);
+            }
+            if (cand->err != JUSTIN_ERR_OK) {
+                justin_log_err_soft(cand->err);
+                cand->verdict = JUSTIN_BISECT_SKIP;
+            }
+            switch (cand->verdict) {
+                case JUSTIN_BISECT_GOOD:
+                    justin_bisect_log_commit(meta, "good", cand->index);
+                    break;
+                case JUSTIN_BISECT_BAD:
+                    justin_bisect_log_commit(meta, "bad ", cand->index);
+                    if (cand->index > next_bad) next_bad = cand->index;
+                    break;
+                default:
+                    justin_bisect_log_commit(meta, "skip", cand->index);
+                    skipped[cand->index - origin] = true;
+                    break;
+            }
+        }
+        // The oldest bad candidate bounds the range; the newest good one older than it closes it
+        size_t next_good = good;
+        for (size_t i=0; i < k; i++) {
+            if (cands[i].verdict == JUSTIN_BISECT_GOOD && cands[i].index > next_bad && cands[i].index < next_good) {
+                next_good = cands[i].index;
+            }
+        }
+        bad = next_bad;
+        good = next_good;
+
+        for (size_t i=0; i < k; i++) {
+            justin_bisect_candidate *cand = &cands[i];
+            if (cand->dir != NULL) {
+                justin_storage_build_dir_done(ctx->storage, cand->name, cand->dir, cand->started);
+                cand->dir = NULL;
+            }
+            free(cand->out);
+            cand->out = NULL;
+        }
+    }
+
+    if (good - bad > 1) {
+        justin_log_warn("Could not narrow the range further, the first bad version is one of:");
+        for (size_t i = good - 1; i >= bad; i--) {
+            justin_bisect_log_commit(meta, "", i);
+            if (i == 0) break;
+        }
+    } else {
+        justin_log_info("First bad version:");
+        justin_bisect_log_commit(meta, "", bad);
+    }
+
+    ex:
+    free(cands);
+    free(skipped);
+    free(avail);
+    free(dirs);
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <git2.h>
+#include "../context.h"
+#include "../logging.h"
+#include "aur.h"
+#include "repo.h"
+
+#ifndef JUSTIN_BISECT_H
+#define JUSTIN_BISECT_H
+
+/*
+ * Finds the first bad version of a package between a known good and a known bad commit. Every round checks out
+ * several candidates spread evenly over the remaining range, builds them concurrently and runs the test command on
+ * each. With k candidates per round the range shrinks to about 1/(k+1) of its size, instead of 1/2.
+ *
+ * Built packages go to the artifact cache, so candidates built in earlier rounds or earlier runs (or installed
+ * before) are tested again without rebuilding.
+ *
+ * The test command is run through /bin/sh as the invoking user, in the directory holding the built packages. Their
+ * paths are passed in JUSTIN_BISECT_PKGS (space separated) and the commit id in JUSTIN_BISECT_COMMIT. Exit status 0
+ * marks the version good, 125 skips it and anything else marks it bad.
+ */
+
+/**
+ * Runs the bisect described by the -g, -b, -t and -j parameters. The good and bad revisions may be anything
+ * git_revparse_single accepts, or text to look for in the commit summaries (e.g. a version number).
+ */
+void justin_bisect_run(justin_context ctx, justin_aur_project_t *project, justin_repo_commit_list list, justin_err *err);
+
+#endif //JUSTIN_BISECT_H
@@ -0,0 +1,184 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <zlib.h>
+#include "../ansi.h"
+#include "buildlog.h"
+
+#define LOGS_DIR ".logs"
+static const char *LOGS_DIR_S = LOGS_DIR;
+
+struct justin_buildlog_t {
+    char *path;
+    gzFile gz;
+    bool gz_failed;
+    size_t total;
+    void (*tee)(void *data, const char *buf, size_t len);
+    void *tee_data;
+    char ring[JUSTIN_BUILDLOG_RING_SIZE];
+};
+
+justin_buildlog justin_buildlog_open(justin_context ctx, const char *name) {
+    justin_err err = JUSTIN_ERR_OK;
+    justin_buildlog log = (justin_buildlog) malloc(sizeof(struct justin_buildlog_t));
+    if (log == NULL) {
+        justin_log_err_soft(JUSTIN_ERR_NOMEM);
+        return NULL;
+    }
+    log->gz = NULL;
+    log->gz_failed = false;
+    log->total = 0;
+    log->tee = NULL;
+    log->tee_data = NULL;
+
+    char stamp[32];
+    struct tm tm;
+    time_t now = time(NULL);
+    strftime(stamp, sizeof stamp, "%Y%m%d-%H%M%S", localtime_r(&now, &tm));
+
+    // Builds of the same package may start within the same second (bisect)
+    char file[256];
+    int fd = -1;
+    for (int attempt=0; attempt < 100 && fd == -1; attempt++) {
+        if (attempt == 0) {
+            snprintf(file, sizeof file, "%s-%s.log.gz", name, stamp);
+        } else {
+            snprintf(file, sizeof file, "%s-%s-%d.log.gz", name, stamp, attempt);
+        }
+        log->path = justin_storage_path(ctx->storage, LOGS_DIR_S, file, &err);
+        if (err != JUSTIN_ERR_OK) {
+            justin_log_err_soft(err);
+            free(log);
+            return NULL;
+        }
+        fd = open(log->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            int e = errno;
+            free(log->path);
+            log->path = NULL;
+            if (e != EEXIST) break;
+        }
+    }
+    if (fd == -1) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        free(log);
+        return NULL;
+    }
+    if (fchown(fd, ctx->storage->user, -1) == -1) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+
+    log->gz = gzdopen(fd, "wb");
+    if (log->gz == NULL) {
+        close(fd);
+        unlink(log->path);
+        free(log->path);
+        free(log);
+        justin_log_err_soft(JUSTIN_ERR_NOMEM);
+        return NULL;
+    }
+    return log;
+}
+
+void justin_buildlog_write_fd(int fd, const char *buf, size_t len) {
+    ssize_t w;
+    while (len > 0) {
+        w = write(fd, buf, len);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += w;
+        len -= w;
+    }
+}
+
+void justin_buildlog_write(void *data, const char *buf, size_t len) {
+    justin_buildlog log = (justin_buildlog) data;
+    justin_buildlog_write_fd(STDOUT_FILENO, buf, len);
+    if (log->tee != NULL) log->tee(log->tee_data, buf, len);
+
+    // A failing log must not fail the build, but the tail is still kept
+    if (!log->gz_failed && gzwrite(log->gz, buf, (unsigned int) len) != (int) len) {
+        log->gz_failed = true;
+        justin_log_warn("Failed to write build log");
+    }
+
+    size_t skip = len > JUSTIN_BUILDLOG_RING_SIZE ? len - JUSTIN_BUILDLOG_RING_SIZE : 0;
+    size_t off = (log->total + skip) % JUSTIN_BUILDLOG_RING_SIZE;
+    size_t rem = len - skip;
+    size_t first = JUSTIN_BUILDLOG_RING_SIZE - off;
+    if (first > rem) first = rem;
+    memcpy(&log->ring[off], &buf[skip], first);
+    memcpy(log->ring, &buf[skip + first], rem - first);
+    log->total += len;
+}
+
+void justin_buildlog_tee(justin_buildlog log, void (*fn)(void *data, const char *buf, size_t len), void *data) {
+    log->tee = fn;
+    log->tee_data = data;
+}
+
+const char* justin_buildlog_path(justin_buildlog log) {
+    return log->path;
+}
+
+void justin_buildlog_print_tail(justin_buildlog log, size_t lines) {
+    size_t len = log->total < JUSTIN_BUILDLOG_RING_SIZE ? log->total : JUSTIN_BUILDLOG_RING_SIZE;
+    size_t start = log->total - len;
+
+    // Walk back from the end, ignoring a trailing newline
+    size_t i = len;
+    if (i > 0 && log->ring[(start + i - 1) % JUSTIN_BUILDLOG_RING_SIZE] == '\n') i--;
+    size_t found = 0;
+    while (i > 0) {
+        if (log->ring[(start + i - 1) % JUSTIN_BUILDLOG_RING_SIZE] == '\n' && ++found == lines) break;
+        i--;
+    }
+
+    justin_log_warn("End of build output:");
+    fflush(stderr);
+
+    size_t from = (start + i) % JUSTIN_BUILDLOG_RING_SIZE;
+    size_t count = len - i;
+    size_t first = JUSTIN_BUILDLOG_RING_SIZE - from;
+    if (first > count) first = count;
+    justin_buildlog_write_fd(STDERR_FILENO, &log->ring[from], first);
+    justin_buildlog_write_fd(STDERR_FILENO, log->ring, count - first);
+    if (count > 0 && log->ring[(start + len - 1) % JUSTIN_BUILDLOG_RING_SIZE] != '\n') {
+        justin_buildlog_write_fd(STDERR_FILENO, "\n", 1);
+    }
+
+    char footer[PATH_MAX + 32];
+    snprintf(footer, sizeof footer, "Full log: " BWHT "%s" CRESET, log->path);
+    justin_log_warn(footer);
+}
+
+void justin_buildlog_close(justin_buildlog log) {
+    if (log == NULL) return;
+    if (gzclose(log->gz) != Z_OK) justin_log_warn("Failed to write build log");
+    free(log->path);
+    free(log);
+}
@@ -0,0 +1,65 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stddef.h>
+#include "../logging.h"
+#include "../context.h"
+
+#ifndef JUSTIN_BUILDLOG_H
+#define JUSTIN_BUILDLOG_H
+
+/*
+ * Output of a build. Everything makepkg prints is passed to the terminal as-is, written to a gzip-compressed log in
+ * the ".logs" storage directory, and kept in a bounded ring buffer, so that the end of a failed build can be shown
+ * without reading the log back.
+ */
+
+#define JUSTIN_BUILDLOG_RING_SIZE 65536
+#define JUSTIN_BUILDLOG_TAIL_LINES 30
+
+struct justin_buildlog_t;
+typedef struct justin_buildlog_t *justin_buildlog;
+
+/**
+ * Opens a new log named after "name" and the current time. A missing log should not stop a build, so this warns and
+ * returns NULL on failure; the build output then goes straight to the terminal.
+ */
+justin_buildlog justin_buildlog_open(justin_context ctx, const char *name);
+
+/**
+ * Suitable as justin_proc_opts_t.on_output, with the log as data
+ */
+void justin_buildlog_write(void *log, const char *buf, size_t len);
+
+/**
+ * Also passes everything written to the log on to "fn", e.g. to stream it to a remote coordinator
+ */
+void justin_buildlog_tee(justin_buildlog log, void (*fn)(void *data, const char *buf, size_t len), void *data);
+
+const char* justin_buildlog_path(justin_buildlog log);
+
+/**
+ * Prints up to "lines" lines from the end of the output, and where to find the rest
+ */
+void justin_buildlog_print_tail(justin_buildlog log, size_t lines);
+
+/**
+ * Flushes and closes the log. Does nothing if "log" is NULL.
+ */
+void justin_buildlog_close(justin_buildlog log);
+
+#endif //JUSTIN_BUILDLOG_H
@@ -0,0 +1,120 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include "../ansi.h"
+#include "pkg.h"
+#include "ccache.h"
+
+#define STATS_FILE ".ccache-stats"
+static const char *STATS_FILE_S = STATS_FILE;
+
+static pthread_once_t CCACHE_WARN_ONCE = PTHREAD_ONCE_INIT;
+
+void justin_ccache_warn_missing() {
+    justin_log_warn("ccache is not installed (" JUSTIN_CCACHE_WRAPPERS "), building without a compiler cache");
+}
+
+// Formats an environment variable, NULL if out of memory
+char* justin_ccache_var(const char *fmt, ...) {
+    va_list vl;
+    va_start(vl, fmt);
+    char *ret;
+    if (vasprintf(&ret, fmt, vl) == -1) ret = NULL;
+    va_end(vl);
+    return ret;
+}
+
+size_t justin_ccache_prepare(justin_context ctx, const char *path, justin_ccache_t *cc, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    const char *size = ctx->params->v_ccache;
+    if (size == NULL) return 0;
+    if (access(JUSTIN_CCACHE_WRAPPERS, X_OK) == -1) {
+        pthread_once(&CCACHE_WARN_ONCE, justin_ccache_warn_missing);
+        return 0;
+    }
+    if (*size == '\0') size = JUSTIN_CCACHE_SIZE_DEFAULT;
+
+    char *dir = justin_storage_path(ctx->storage, JUSTIN_CCACHE_DIR, "", err);
+    if ((*err) != JUSTIN_ERR_OK) return 0;
+    const char *env_path = getenv("PATH");
+    if (env_path == NULL) env_path = "/usr/local/sbin:/usr/local/bin:/usr/bin";
+
+    // CCACHE_NOHASHDIR keeps the working directory out of the hash of builds with debug info
+    cc->env[0] = justin_ccache_var("PATH=" JUSTIN_CCACHE_WRAPPERS ":%s", env_path);
+    cc->env[1] = justin_ccache_var("CCACHE_DIR=%s", dir);
+    cc->env[2] = justin_ccache_var("CCACHE_MAXSIZE=%s", size);
+    cc->env[3] = justin_ccache_var("CCACHE_BASEDIR=%s", path);
+    cc->env[4] = justin_ccache_var("CCACHE_NOHASHDIR=1");
+    cc->env[5] = justin_ccache_var("CCACHE_STATSLOG=%s/%s", path, STATS_FILE_S);
+    cc->stats = justin_ccache_var("%s/%s", path, STATS_FILE_S);
+    free(dir);
+    bool complete = cc->stats != NULL;
+    for (size_t i=0; i < JUSTIN_CCACHE_ENV_COUNT; i++) complete &= cc->env[i] != NULL;
+    if (!complete) {
+        justin_ccache_finish(path, cc);
+        *err = JUSTIN_ERR_NOMEM;
+        return 0;
+    }
+    return JUSTIN_CCACHE_ENV_COUNT;
+}
+
+void justin_ccache_finish(const char *path, justin_ccache_t *cc) {
+    for (size_t i=0; i < JUSTIN_CCACHE_ENV_COUNT; i++) {
+        free(cc->env[i]);
+        cc->env[i] = NULL;
+    }
+    if (cc->stats == NULL) return;
+
+    // One "# <file>" line per compiler call, followed by what came of it (direct_cache_hit, cache_miss, ...)
+    size_t hits = 0;
+    size_t misses = 0;
+    FILE *f = fopen(cc->stats, "re");
+    if (f != NULL) {
+        char line[PATH_MAX + 8];
+        size_t len;
+        while (fgets(line, sizeof line, f) != NULL) {
+            if (line[0] == '#') continue;
+            len = strcspn(line, "\n");
+            line[len] = '\0';
+            if (len >= 9 && strcmp(&line[len - 9], "cache_hit") == 0) {
+                hits++;
+            } else if (strcmp(line, "cache_miss") == 0) {
+                misses++;
+            }
+        }
+        fclose(f);
+        unlink(cc->stats);
+    }
+    free(cc->stats);
+    cc->stats = NULL;
+    if (hits + misses == 0) return;
+
+    char base[128];
+    justin_pkg_base_info(path, base, sizeof base, NULL, 0);
+    char buf[256];
+    snprintf(buf, sizeof buf, "Compiler cache: %s%s %s:: %s%zu hits, %zu misses (%zu%%)", BYEL, base, BWHT, WHT,
+             hits, misses, (hits * 100) / (hits + misses));
+    justin_log_info(buf);
+}
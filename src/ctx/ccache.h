@@ -0,0 +1,55 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_CCACHE_H
+#define JUSTIN_CCACHE_H
+
+/*
+ * Compiler cache for builds, enabled with -C. makepkg runs with the ccache compiler wrappers first on PATH and a cache
+ * in the ".ccache" storage directory, owned by the build user and capped in size (ccache evicts the oldest entries
+ * past the cap). Paths are hashed relative to the build directory, so the random name of each build directory does
+ * not cause misses. Every build writes its own ccache stats log, from which its hit rate is reported.
+ */
+
+#define JUSTIN_CCACHE_DIR ".ccache"
+#define JUSTIN_CCACHE_WRAPPERS "/usr/lib/ccache/bin"
+#define JUSTIN_CCACHE_SIZE_DEFAULT "5G"
+#define JUSTIN_CCACHE_ENV_COUNT 6
+
+typedef struct justin_ccache_t {
+    char *env[JUSTIN_CCACHE_ENV_COUNT];
+    char *stats;            // stats log of this build
+} justin_ccache_t;
+#define JUSTIN_CCACHE_INITIALIZER { { NULL }, NULL }
+
+/**
+ * Prepares the environment of a build in "path" if -C was given and ccache is installed. Returns the number of
+ * variables added to "cc->env", 0 if the cache is not used.
+ */
+size_t justin_ccache_prepare(justin_context ctx, const char *path, justin_ccache_t *cc, justin_err *err);
+
+/**
+ * Logs the hits and misses of the build, then frees "cc"
+ */
+void justin_ccache_finish(const char *path, justin_ccache_t *cc);
+
+#endif //JUSTIN_CCACHE_H
@@ -0,0 +1,205 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../ansi.h"
+#include "cgroup.h"
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+static const char *CGROUP_ROOT_S = CGROUP_ROOT;
+
+#define CGROUP_PARENT CGROUP_ROOT "/" JUSTIN_CGROUP_NAME
+static const char *CGROUP_PARENT_S = CGROUP_PARENT;
+
+// Controllers the builds are isolated with; the ones the kernel does not offer are skipped
+static const char *CGROUP_CONTROLLERS[] = { "+cpu", "+memory", "+io" };
+
+// Leftover processes get this long to die after cgroup.kill before the cgroup is given up on
+#define CGROUP_RMDIR_TRIES 50
+#define CGROUP_RMDIR_WAIT_NS 10000000L
+
+static pthread_once_t CGROUP_ONCE = PTHREAD_ONCE_INIT;
+static bool CGROUP_AVAILABLE = false;
+static unsigned int CGROUP_CPU_WEIGHT;
+static unsigned int CGROUP_IO_WEIGHT;
+static unsigned int CGROUP_COUNTER = 0;
+
+bool justin_cgroup_write(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    size_t len = strlen(value);
+    bool ok = write(fd, value, len) == (ssize_t) len;
+    close(fd);
+    return ok;
+}
+
+// Reads "<key> <value>" from a flat keyed file such as cpu.stat, or the first number if key is NULL
+bool justin_cgroup_read(const char *dir, const char *file, const char *key, unsigned long long *out) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, file);
+    FILE *f = fopen(path, "re");
+    if (f == NULL) return false;
+    char line[256];
+    size_t key_len = key == NULL ? 0 : strlen(key);
+    bool found = false;
+    while (!found && fgets(line, sizeof line, f) != NULL) {
+        if (key == NULL) {
+            found = sscanf(line, "%llu", out) == 1;
+            break;
+        }
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') found = sscanf(&line[key_len + 1], "%llu", out) == 1;
+    }
+    fclose(f);
+    return found;
+}
+
+void justin_cgroup_init() {
+    char controllers[256] = "";
+    FILE *f = fopen(CGROUP_ROOT "/cgroup.controllers", "re");
+    if (f == NULL) {
+        justin_log_warn("cgroup v2 is not mounted at " CGROUP_ROOT ", builds are not isolated");
+        return;
+    }
+    if (fgets(controllers, sizeof controllers, f) == NULL) controllers[0] = '\0';
+    fclose(f);
+
+    if (mkdir(CGROUP_PARENT_S, 0755) == -1 && errno != EEXIST) {
+        justin_log_warn("Could not create the cgroup " CGROUP_PARENT ", builds are not isolated");
+        return;
+    }
+    // Both the root and the parent have to pass the controllers down. The root usually does already (systemd).
+    for (size_t i=0; i < (sizeof CGROUP_CONTROLLERS) / sizeof(char*); i++) {
+        if (strstr(controllers, &CGROUP_CONTROLLERS[i][1]) == NULL) continue;
+        justin_cgroup_write(CGROUP_ROOT_S, "cgroup.subtree_control", CGROUP_CONTROLLERS[i]);
+        justin_cgroup_write(CGROUP_PARENT_S, "cgroup.subtree_control", CGROUP_CONTROLLERS[i]);
+    }
+
+    char value[32];
+    snprintf(value, sizeof value, "%u", CGROUP_CPU_WEIGHT);
+    if (!justin_cgroup_write(CGROUP_PARENT_S, "cpu.weight", value)) justin_log_warn("cpu.weight is not available, builds compete for CPU time as usual");
+    snprintf(value, sizeof value, "default %u", CGROUP_IO_WEIGHT);
+    // io.weight needs a cost model (io.cost) or BFQ on the device, which is not worth a warning
+    if (!justin_cgroup_write(CGROUP_PARENT_S, "io.weight", value)) justin_log_debug("io.weight is not available");
+    CGROUP_AVAILABLE = true;
+}
+
+void justin_cgroup_create(justin_context ctx, justin_cgroup_t *cg, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_params params = ctx->params;
+    if (!params->f_cgroup) return;
+    // The weights are the same for the whole run, pthread_once takes no argument
+    CGROUP_CPU_WEIGHT = params->v_cpu_weight;
+    CGROUP_IO_WEIGHT = params->v_io_weight;
+    pthread_once(&CGROUP_ONCE, justin_cgroup_init);
+    if (!CGROUP_AVAILABLE) return;
+
+    unsigned int n = __atomic_fetch_add(&CGROUP_COUNTER, 1, __ATOMIC_RELAXED);
+    if (asprintf(&cg->path, "%s/build-%ld-%u", CGROUP_PARENT_S, (long) getpid(), n) == -1) {
+        cg->path = NULL;
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    if (mkdir(cg->path, 0755) == -1) goto fail;
+
+    // Over memory.high the build is throttled and reclaimed from, over memory.max it is OOM-killed
+    char value[32];
+    if (params->v_mem_high != 0) {
+        snprintf(value, sizeof value, "%llu", (unsigned long long) params->v_mem_high);
+        if (!justin_cgroup_write(cg->path, "memory.high", value)) goto fail_dir;
+    }
+    if (params->v_mem_max != 0) {
+        snprintf(value, sizeof value, "%llu", (unsigned long long) params->v_mem_max);
+        if (!justin_cgroup_write(cg->path, "memory.max", value)) goto fail_dir;
+    }
+
+    char procs[PATH_MAX];
+    snprintf(procs, sizeof procs, "%s/cgroup.procs", cg->path);
+    cg->procs_fd = open(procs, O_WRONLY | O_CLOEXEC);
+    if (cg->procs_fd != -1) {
+        snprintf(procs, sizeof procs, "%s/cgroup.kill", cg->path);
+        cg->kill_fd = open(procs, O_WRONLY | O_CLOEXEC);
+        return;
+    }
+
+    fail_dir:
+    rmdir(cg->path);
+    fail:
+    *err = JUSTIN_ERR_SYSTEM;
+    free(cg->path);
+    cg->path = NULL;
+}
+
+// Returns the peak memory in bytes, 0 if unknown
+uint64_t justin_cgroup_report(const char *name, const char *path) {
+    unsigned long long peak = 0;
+    unsigned long long usage = 0;
+    unsigned long long oom = 0;
+    // memory.peak is only there since Linux 5.19
+    bool has_peak = justin_cgroup_read(path, "memory.peak", NULL, &peak);
+    if (!justin_cgroup_read(path, "cpu.stat", "usage_usec", &usage) || name == NULL) return peak;
+    justin_cgroup_read(path, "memory.events", "oom_kill", &oom);
+
+    unsigned long long secs = usage / 1000000ULL;
+    char buf[256];
+    int len = snprintf(buf, sizeof buf, "Build resources: %s%.128s %s:: %sCPU %llum %02llus", BYEL, name, BWHT, WHT,
+                       secs / 60, secs % 60);
+    if (has_peak) {
+        len += snprintf(&buf[len], sizeof buf - len, ", peak memory %llu MiB", peak >> 20);
+    }
+    justin_log_info(buf);
+    if (oom != 0) {
+        snprintf(buf, sizeof buf, "%llu process%s of %.128s killed for exceeding memory.max", oom, oom == 1 ? " was" : "es were", name);
+        justin_log_warn(buf);
+    }
+    return peak;
+}
+
+uint64_t justin_cgroup_finish(const char *name, justin_cgroup_t *cg) {
+    if (cg->procs_fd != -1) {
+        close(cg->procs_fd);
+        cg->procs_fd = -1;
+    }
+    if (cg->kill_fd != -1) {
+        close(cg->kill_fd);
+        cg->kill_fd = -1;
+    }
+    if (cg->path == NULL) return 0;
+    uint64_t peak = justin_cgroup_report(name, cg->path);
+
+    // Daemons started by the build (gradle, sccache, ...) would otherwise outlive it; cgroup.kill needs Linux 5.14
+    struct timespec wait = { 0, CGROUP_RMDIR_WAIT_NS };
+    for (int i=0; i < CGROUP_RMDIR_TRIES && rmdir(cg->path) == -1 && errno == EBUSY; i++) {
+        if (i == 0) justin_cgroup_write(cg->path, "cgroup.kill", "1");
+        nanosleep(&wait, NULL);
+    }
+    free(cg->path);
+    cg->path = NULL;
+    return peak;
+}
@@ -0,0 +1,52 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdint.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_CGROUP_H
+#define JUSTIN_CGROUP_H
+
+/*
+ * Build isolation with cgroup v2, enabled with -L. Builds run under a "justin" cgroup at the top of the hierarchy,
+ * next to system.slice and user.slice, whose cpu.weight and io.weight (10 by default, against 100 for everything else)
+ * let builds use whatever is idle and give way as soon as anything else wants the CPU or the disk. Each makepkg run
+ * gets a cgroup of its own below it, with the memory limits, and reports its peak memory and CPU time when done.
+ */
+
+#define JUSTIN_CGROUP_NAME "justin"
+
+typedef struct justin_cgroup_t {
+    char *path;             // NULL if the build is not isolated
+    int procs_fd;           // cgroup.procs, for justin_proc_opts_t.cgroup_fd
+    int kill_fd;            // cgroup.kill, for justin_proc_opts_t.kill_fd; -1 before Linux 5.14
+} justin_cgroup_t;
+#define JUSTIN_CGROUP_INITIALIZER { NULL, -1, -1 }
+
+/**
+ * Creates the cgroup for one makepkg run. If cgroup v2 or the controllers are not available, this warns once and
+ * leaves the cgroup empty, so that the build runs as it would without -L.
+ */
+void justin_cgroup_create(justin_context ctx, justin_cgroup_t *cg, justin_err *err);
+
+/**
+ * Reports the usage of a finished build (unless "name" is NULL), kills anything it left running and removes the
+ * cgroup. Returns the peak memory of the build in bytes, 0 if unknown.
+ */
+uint64_t justin_cgroup_finish(const char *name, justin_cgroup_t *cg);
+
+#endif //JUSTIN_CGROUP_H
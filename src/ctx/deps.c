@@ -0,0 +1,359 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <alpm.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "../proc.h"
+#include "deps.h"
+
+#define PATH2_PACMAN "/usr/bin/pacman"
+static const char *PATH2_PACMAN_S = PATH2_PACMAN;
+
+#define SYNC_DB_DIR "/var/lib/pacman/sync"
+static const char *SYNC_DB_DIR_S = SYNC_DB_DIR;
+
+#define SYNC_DB_EXT ".db"
+#define SYNC_DB_EXT_L ((sizeof SYNC_DB_EXT) - 1)
+
+#define MARK_NONE 0
+#define MARK_VISITING 1
+#define MARK_DONE 2
+
+// String vector
+
+bool justin_deps_strv_contains(justin_deps_strv *strv, const char *str) {
+    for (size_t i=0; i < strv->len; i++) {
+        if (strcmp(strv->data[i], str) == 0) return true;
+    }
+    return false;
+}
+
+// Adds a copy of str, unless it is already present
+bool justin_deps_strv_add(justin_deps_strv *strv, const char *str, justin_err *err) {
+    if (justin_deps_strv_contains(strv, str)) return true;
+    if (strv->len == strv->cap) {
+        size_t cap = strv->cap == 0 ? 8 : strv->cap << 1;
+        char **data = (char**) reallocarray(strv->data, cap, sizeof(char*));
+        if (data == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            return false;
+        }
+        strv->data = data;
+        strv->cap = cap;
+    }
+    if ((strv->data[strv->len] = strdup(str)) == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return false;
+    }
+    strv->len++;
+    return true;
+}
+
+void justin_deps_strv_free(justin_deps_strv *strv) {
+    for (size_t i=0; i < strv->len; i++) free(strv->data[i]);
+    free(strv->data);
+    strv->data = NULL;
+    strv->len = 0;
+    strv->cap = 0;
+}
+
+// Graph
+
+void justin_deps_graph_free(justin_deps_graph graph) {
+    justin_deps_node *node;
+    for (size_t i=0; i < graph->len; i++) {
+        node = &graph->nodes[i];
+        free(node->base);
+        justin_deps_strv_free(&node->names);
+        justin_deps_strv_free(&node->deps);
+        free(node->edges);
+    }
+    free(graph->nodes);
+    justin_deps_strv_free(&graph->repo);
+    free(graph);
+}
+
+// Returns the index of the node providing a package name, or -1
+ssize_t justin_deps_graph_find(justin_deps_graph graph, const char *name) {
+    for (size_t i=0; i < graph->len; i++) {
+        if (justin_deps_strv_contains(&graph->nodes[i].names, name)) return (ssize_t) i;
+    }
+    return -1;
+}
+
+justin_deps_node *justin_deps_graph_node(justin_deps_graph graph, const char *base, justin_err *err) {
+    for (size_t i=0; i < graph->len; i++) {
+        if (strcmp(graph->nodes[i].base, base) == 0) return &graph->nodes[i];
+    }
+    if (graph->len == graph->cap) {
+        size_t cap = graph->cap == 0 ? 8 : graph->cap << 1;
+        justin_deps_node *nodes = (justin_deps_node*) reallocarray(graph->nodes, cap, sizeof(justin_deps_node));
+        if (nodes == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            return NULL;
+        }
+        graph->nodes = nodes;
+        graph->cap = cap;
+    }
+    justin_deps_node *node = &graph->nodes[graph->len];
+    memset(node, 0, sizeof(justin_deps_node));
+    if ((node->base = strdup(base)) == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    graph->len++;
+    return node;
+}
+
+void justin_deps_register_syncdbs(alpm_handle_t *handle) {
+    if (alpm_get_syncdbs(handle) != NULL) return;
+    DIR *d = opendir(SYNC_DB_DIR_S);
+    if (d == NULL) {
+        justin_log_warn("Cannot read the sync databases, all dependencies will be looked up in the AUR");
+        return;
+    }
+    struct dirent *ent;
+    size_t len;
+    while ((ent = readdir(d)) != NULL) {
+        len = strlen(ent->d_name);
+        if (len <= SYNC_DB_EXT_L || strcmp(&ent->d_name[len - SYNC_DB_EXT_L], SYNC_DB_EXT) != 0) continue;
+        char *name = strndup(ent->d_name, len - SYNC_DB_EXT_L);
+        if (name == NULL) break;
+        alpm_register_syncdb(handle, name, ALPM_SIG_USE_DEFAULT);
+        free(name);
+    }
+    closedir(d);
+}
+
+// Sorts the dependencies of a node into installed, repository and AUR packages
+void justin_deps_classify_locked(justin_context ctx, justin_deps_graph graph, justin_deps_node *node, const char **depends,
+                                 justin_deps_strv *requested, justin_deps_strv *pending, justin_err *err) {
+    alpm_handle_t *handle = alpm_db_get_handle(ctx->alpm_db);
+    alpm_list_t *installed = alpm_db_get_pkgcache(ctx->alpm_db);
+
+    const char *dep;
+    for (; (dep = *depends) != NULL; depends++) {
+        if (alpm_find_satisfier(installed, dep) != NULL) continue;
+
+        char *name = strndup(dep, strcspn(dep, "<>=:"));
+        if (name == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            return;
+        }
+        if (!justin_deps_strv_contains(requested, name)) {
+            alpm_pkg_t *sync = alpm_find_dbs_satisfier(handle, alpm_get_syncdbs(handle), dep);
+            if (sync != NULL) {
+                justin_deps_strv_add(&graph->repo, alpm_pkg_get_name(sync), err);
+                free(name);
+                if ((*err) != JUSTIN_ERR_OK) return;
+                continue;
+            }
+            if (justin_deps_strv_add(requested, name, err)) justin_deps_strv_add(pending, name, err);
+        }
+        justin_deps_strv_add(&node->deps, name, err);
+        free(name);
+        if ((*err) != JUSTIN_ERR_OK) return;
+    }
+}
+
+void justin_deps_classify(justin_context ctx, justin_deps_graph graph, justin_deps_node *node, const char **depends,
+                          justin_deps_strv *requested, justin_deps_strv *pending, justin_err *err) {
+    if (depends == NULL) return;
+    justin_context_alpm_lock(ctx);
+    justin_deps_classify_locked(ctx, graph, node, depends, requested, pending, err);
+    justin_context_alpm_unlock(ctx);
+}
+
+// Depth-first search computing the layers, failing on the first cycle found
+bool justin_deps_visit(justin_deps_graph graph, size_t index, size_t *path, size_t depth) {
+    justin_deps_node *node = &graph->nodes[index];
+    if (node->mark == MARK_DONE) return true;
+    path[depth] = index;
+    if (node->mark == MARK_VISITING) {
+        size_t start = 0;
+        while (path[start] != index) start++;
+        justin_log_warn("Dependency cycle:");
+        for (size_t i = start; i <= depth; i++) justin_log_info_indent(graph->nodes[path[i]].base, 1);
+        return false;
+    }
+
+    node->mark = MARK_VISITING;
+    unsigned int layer = 0;
+    justin_deps_node *child;
+    for (size_t i=0; i < node->edge_count; i++) {
+        if (!justin_deps_visit(graph, node->edges[i], path, depth + 1)) return false;
+        child = &graph->nodes[node->edges[i]];
+        if (child->layer + 1 > layer) layer = child->layer + 1;
+    }
+    node->layer = layer;
+    node->mark = MARK_DONE;
+    return true;
+}
+
+void justin_deps_link(justin_deps_graph graph, justin_err *err) {
+    justin_deps_node *node;
+    for (size_t i=0; i < graph->len; i++) {
+        node = &graph->nodes[i];
+        node->edges = (size_t*) calloc(node->deps.len + 1, sizeof(size_t));
+        if (node->edges == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            return;
+        }
+        for (size_t d=0; d < node->deps.len; d++) {
+            ssize_t target = justin_deps_graph_find(graph, node->deps.data[d]);
+            if (target < 0 || (size_t) target == i) continue;
+            bool dup = false;
+            for (size_t e=0; e < node->edge_count; e++) dup |= node->edges[e] == (size_t) target;
+            if (!dup) node->edges[node->edge_count++] = (size_t) target;
+        }
+    }
+
+    size_t *path = (size_t*) calloc(graph->len + 1, sizeof(size_t));
+    if (path == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    for (size_t i=0; i < graph->len; i++) {
+        if (!justin_deps_visit(graph, i, path, 0)) {
+            *err = JUSTIN_ERR_DEPENDENCY;
+            break;
+        }
+    }
+    free(path);
+}
+
+justin_deps_graph justin_deps_resolve(justin_context ctx, const char *const *names, size_t count, bool deps, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_deps_graph graph = (justin_deps_graph) calloc(1, sizeof(justin_deps_graph_t));
+    if (graph == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    justin_context_alpm_lock(ctx);
+    justin_deps_register_syncdbs(alpm_db_get_handle(ctx->alpm_db));
+    justin_context_alpm_unlock(ctx);
+
+    justin_deps_strv requested = JUSTIN_DEPS_STRV_INITIALIZER;
+    justin_deps_strv pending = JUSTIN_DEPS_STRV_INITIALIZER;
+    justin_deps_strv batch = JUSTIN_DEPS_STRV_INITIALIZER;
+    for (size_t i=0; i < count; i++) {
+        if (!justin_deps_strv_add(&requested, names[i], err)) goto ex;
+        if (!justin_deps_strv_add(&pending, names[i], err)) goto ex;
+    }
+    bool targets = true;
+
+    char buf[256];
+    while (pending.len != 0) {
+        justin_deps_strv_free(&batch);
+        batch = pending;
+        pending = (justin_deps_strv) JUSTIN_DEPS_STRV_INITIALIZER;
+
+        justin_aur_project_list list = justin_aur_info(ctx, (const char *const *) batch.data, batch.len, err);
+        if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+        justin_aur_project_list head;
+        justin_aur_project_t *info;
+        justin_deps_node *node;
+        for (head = list; head != NULL && (*err) == JUSTIN_ERR_OK; head = head->next) {
+            if (head->size == 0) continue;
+            info = &head->value;
+            if ((node = justin_deps_graph_node(graph, info->base, err)) == NULL) break;
+            if (!justin_deps_strv_add(&node->names, info->name, err)) break;
+            node->target |= targets;
+            if (!deps) continue;
+            justin_deps_classify(ctx, graph, node, info->depends, &requested, &pending, err);
+            justin_deps_classify(ctx, graph, node, info->make_depends, &requested, &pending, err);
+        }
+        targets = false;
+        justin_aur_project_list_free(list);
+        if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+        for (size_t i=0; i < batch.len; i++) {
+            if (justin_deps_graph_find(graph, batch.data[i]) >= 0) continue;
+            snprintf(buf, sizeof buf, "Dependency not found in the repositories or the AUR: %.200s", batch.data[i]);
+            justin_log_warn(buf);
+            *err = JUSTIN_ERR_DEPENDENCY;
+        }
+        if ((*err) != JUSTIN_ERR_OK) goto ex;
+    }
+
+    justin_deps_link(graph, err);
+
+    ex:
+    justin_deps_strv_free(&requested);
+    justin_deps_strv_free(&pending);
+    justin_deps_strv_free(&batch);
+    if ((*err) != JUSTIN_ERR_OK) {
+        justin_deps_graph_free(graph);
+        return NULL;
+    }
+    return graph;
+}
+
+// Installs the repository dependencies with pacman, which knows about mirrors and keys
+void justin_deps_install_repo(justin_deps_graph graph, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    if (graph->repo.len == 0) return;
+    static const char *args[] = { "pacman", "-S", "--needed", "--asdeps", "--noconfirm" };
+    size_t argn = (sizeof args) / sizeof(char*);
+    char **argv = (char**) calloc(argn + graph->repo.len + 1, sizeof(char*));
+    if (argv == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    memcpy(argv, args, sizeof args);
+    memcpy(&argv[argn], graph->repo.data, graph->repo.len * sizeof(char*));
+
+    justin_proc_result_t result;
+    justin_proc_run(PATH2_PACMAN_S, argv, NULL, &result, err);
+    if ((*err) == JUSTIN_ERR_OK) justin_proc_check(&result, err);
+    free(argv);
+}
+
+void justin_deps_confirm(justin_context ctx, justin_deps_graph graph, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    char buf[256];
+    bool any = graph->repo.len != 0;
+    if (any) {
+        justin_log_info("Repository dependencies:");
+        for (size_t i=0; i < graph->repo.len; i++) justin_log_info_indent(graph->repo.data[i], 1);
+    }
+
+    justin_deps_node *node;
+    bool heading = false;
+    for (size_t i=0; i < graph->len; i++) {
+        node = &graph->nodes[i];
+        if (node->target) continue;
+        if (!heading) justin_log_info("AUR dependencies:");
+        heading = true;
+        any = true;
+        snprintf(buf, sizeof buf, "%s[%s%u%s]%s %.200s", CYN, BYEL, node->layer + 1, CYN, BWHT, node->base);
+        justin_log_info_indent(buf, 1);
+    }
+    if (!any || ctx->params->f_yes) return;
+
+    justin_log_info("Install dependencies (Y/n)? ");
+    char sel;
+    scanf(" %c", &sel);
+    if (sel == 'n' || sel == 'N') *err = JUSTIN_ERR_DEPENDENCY;
+}
@@ -0,0 +1,85 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../context.h"
+#include "../logging.h"
+#include "aur.h"
+
+#ifndef JUSTIN_DEPS_H
+#define JUSTIN_DEPS_H
+
+/*
+ * Dependency graph of AUR packages. Nodes are package bases (one git repository, one makepkg run), edges point from
+ * a base to the bases providing its AUR-only depends and makedepends. Dependencies already installed are dropped and
+ * those available from the sync repositories are collected separately, to be installed with pacman.
+ */
+
+typedef struct justin_deps_strv {
+    char **data;
+    size_t len;
+    size_t cap;
+} justin_deps_strv;
+#define JUSTIN_DEPS_STRV_INITIALIZER { NULL, 0, 0 }
+
+bool justin_deps_strv_contains(justin_deps_strv *strv, const char *str);
+
+typedef struct justin_deps_node {
+    char *base;
+    justin_deps_strv names;     // packages of this base that are needed
+    justin_deps_strv deps;      // names of the AUR packages this base depends on
+    size_t *edges;
+    size_t edge_count;
+    unsigned int layer;         // 0 for bases without AUR dependencies, otherwise 1 + the highest layer depended on
+    bool target;                // one of the packages asked for, as opposed to a dependency
+    uint8_t mark;
+} justin_deps_node;
+
+typedef struct justin_deps_graph_t {
+    justin_deps_node *nodes;
+    size_t len;
+    size_t cap;
+    justin_deps_strv repo;      // packages to install from the sync repositories
+} justin_deps_graph_t;
+typedef justin_deps_graph_t *justin_deps_graph;
+
+/**
+ * Looks up packages by name and, if "deps" is set, resolves their dependencies, looking up all names of one depth with
+ * a single batched request. Missing packages and dependency cycles are reported and fail with JUSTIN_ERR_DEPENDENCY.
+ */
+justin_deps_graph justin_deps_resolve(justin_context ctx, const char *const *names, size_t count, bool deps, justin_err *err);
+
+void justin_deps_graph_free(justin_deps_graph graph);
+
+/**
+ * Lists the dependencies about to be installed and asks for confirmation (unless -y). Fails with
+ * JUSTIN_ERR_DEPENDENCY if declined.
+ */
+void justin_deps_confirm(justin_context ctx, justin_deps_graph graph, justin_err *err);
+
+/**
+ * Installs the dependencies from the sync repositories with pacman
+ */
+void justin_deps_install_repo(justin_deps_graph graph, justin_err *err);
+
+/**
+ * Registers the sync databases with the handle unless some already are, so that repository packages can be told
+ * apart from AUR packages
+ */
+void justin_deps_register_syncdbs(alpm_handle_t *handle);
+
+#endif //JUSTIN_DEPS_H
@@ -0,0 +1,626 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <curl/curl.h>
+#include <git2.h>
+#include "../util.h"
+#include "fetch.h"
+
+/*
+ * Minimal client for the git v2 wire protocol over smart HTTP, covering just enough (ls-refs and fetch) to request
+ * a pack with an object filter. The pack itself is handed to libgit2 through the writepack interface of the object
+ * database, so indexing and storage are identical to a regular clone.
+ * https://git-scm.com/docs/protocol-v2
+ */
+
+#define FILE_URL "file://"
+static const char *FILE_URL_S = FILE_URL;
+#define FILE_URL_L ((sizeof FILE_URL) - 1)
+
+#define INFO_REFS "/info/refs?service=git-upload-pack"
+static const char *INFO_REFS_S = INFO_REFS;
+
+#define UPLOAD_PACK "/git-upload-pack"
+static const char *UPLOAD_PACK_S = UPLOAD_PACK;
+
+#define DEFAULT_BRANCH "refs/heads/master"
+static const char *DEFAULT_BRANCH_S = DEFAULT_BRANCH;
+
+#define PKT_MAX 65520
+#define PKT_FLUSH 0
+#define PKT_DELIM 1
+#define PKT_DATA (-1)
+
+// REQUEST BODY
+
+struct justin_fetch_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+bool justin_fetch_buf_append(struct justin_fetch_buf *buf, const char *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = buf->cap < 256 ? 256 : buf->cap;
+        while (cap < buf->len + len) cap <<= 1;
+        char *n_data = (char*) realloc(buf->data, cap);
+        if (n_data == NULL) return false;
+        buf->data = n_data;
+        buf->cap = cap;
+    }
+    memcpy(&buf->data[buf->len], data, len);
+    buf->len += len;
+    return true;
+}
+
+bool justin_fetch_pkt_line(struct justin_fetch_buf *buf, const char *line) {
+    size_t len = strlen(line);
+    char head[5];
+    sprintf(head, "%04zx", len + 4);
+    return justin_fetch_buf_append(buf, head, 4) && justin_fetch_buf_append(buf, line, len);
+}
+
+bool justin_fetch_pkt_special(struct justin_fetch_buf *buf, int special) {
+    return justin_fetch_buf_append(buf, special == PKT_DELIM ? "0001" : "0000", 4);
+}
+
+// RESPONSE READER
+
+typedef bool (*justin_fetch_pkt_cb)(const char *data, size_t len, int special, void *payload);
+
+struct justin_fetch_reader {
+    char head[4];
+    size_t head_len;
+    char *pkt;
+    size_t pkt_len;
+    size_t pkt_have;
+    justin_fetch_pkt_cb cb;
+    void *payload;
+};
+
+size_t justin_fetch_collect(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    size_t real_size = size * nmemb;
+    struct justin_fetch_reader *reader = (struct justin_fetch_reader*) userdata;
+
+    size_t i = 0;
+    while (i < real_size) {
+        if (reader->head_len < 4) {
+            reader->head[reader->head_len++] = ptr[i++];
+            if (reader->head_len < 4) continue;
+
+            size_t len = 0;
+            for (int q=0; q < 4; q++) {
+                if (!isxdigit(reader->head[q])) return 0;
+                len = (len << 4) | justin_util_hex2n(reader->head[q]);
+            }
+            if (len < 4) {
+                reader->head_len = 0;
+                if (!reader->cb(NULL, 0, (int) len, reader->payload)) return 0;
+                continue;
+            }
+            if (len - 4 > PKT_MAX) return 0;
+            reader->pkt_len = len - 4;
+            reader->pkt_have = 0;
+        } else {
+            size_t take = reader->pkt_len - reader->pkt_have;
+            if (take > real_size - i) take = real_size - i;
+            memcpy(&reader->pkt[reader->pkt_have], &ptr[i], take);
+            reader->pkt_have += take;
+            i += take;
+        }
+        if (reader->pkt_have == reader->pkt_len) {
+            reader->head_len = 0;
+            if (!reader->cb(reader->pkt, reader->pkt_len, PKT_DATA, reader->payload)) return 0;
+        }
+    }
+    return real_size;
+}
+
+// Line payloads usually end with LF, which is not significant
+static inline size_t justin_fetch_chomp(const char *data, size_t len) {
+    return (len > 0 && data[len - 1] == '\n') ? len - 1 : len;
+}
+
+static inline bool justin_fetch_starts_with(const char *data, size_t len, const char *prefix) {
+    size_t prefix_len = strlen(prefix);
+    return len >= prefix_len && memcmp(data, prefix, prefix_len) == 0;
+}
+
+void justin_fetch_request(justin_context ctx, const char *url, const char *suffix, struct justin_fetch_buf *body,
+                          justin_fetch_pkt_cb cb, void *payload, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+
+    size_t url_len = strlen(url);
+    size_t suffix_len = strlen(suffix);
+    char *full = (char*) malloc(url_len + suffix_len + 1);
+    if (full == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    memcpy(full, url, url_len);
+    memcpy(&full[url_len], suffix, suffix_len + 1);
+
+    struct justin_fetch_reader reader = { { 0 }, 0, NULL, 0, 0, cb, payload };
+    reader.pkt = (char*) malloc(PKT_MAX);
+    if (reader.pkt == NULL) {
+        free(full);
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+
+    struct curl_slist *headers = curl_slist_append(NULL, "Git-Protocol: version=2");
+    if (body != NULL) {
+        headers = curl_slist_append(headers, "Content-Type: application/x-git-upload-pack-request");
+        headers = curl_slist_append(headers, "Accept: application/x-git-upload-pack-result");
+    }
+
+    CURL *curl = ctx->curl;
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, full);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, ((void*) (&reader)));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, justin_fetch_collect);
+    if (body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) body->len);
+    }
+    CURLcode res = curl_easy_perform(curl);
+    if (res != CURLE_OK) *err = JUSTIN_ERR_CURL(res);
+
+    curl_easy_reset(curl);
+    curl_slist_free_all(headers);
+    free(reader.pkt);
+    free(full);
+}
+
+// CAPABILITIES
+
+struct justin_fetch_caps {
+    bool any;
+    bool v2;
+    bool filter;
+    bool sha1;
+};
+
+bool justin_fetch_on_caps(const char *data, size_t len, int special, void *payload) {
+    struct justin_fetch_caps *caps = (struct justin_fetch_caps*) payload;
+    if (special != PKT_DATA) return true;
+    len = justin_fetch_chomp(data, len);
+    // Smart HTTP v0 preamble, not sent by v2 servers but harmless
+    if (justin_fetch_starts_with(data, len, "# service=")) return true;
+
+    if (!caps->any) {
+        caps->any = true;
+        caps->v2 = len == 9 && memcmp(data, "version 2", 9) == 0;
+        return true;
+    }
+    if (!caps->v2) return true;
+
+    if (justin_fetch_starts_with(data, len, "fetch=")) {
+        caps->filter = memmem(data, len, "filter", 6) != NULL;
+    } else if (justin_fetch_starts_with(data, len, "object-format=")) {
+        caps->sha1 = len == 18 && memcmp(&data[14], "sha1", 4) == 0;
+    }
+    return true;
+}
+
+// LS-REFS
+
+struct justin_fetch_head {
+    bool found;
+    git_oid oid;
+    char target[256];
+};
+
+#define SYMREF_TARGET "symref-target:"
+
+bool justin_fetch_on_ls_refs(const char *data, size_t len, int special, void *payload) {
+    struct justin_fetch_head *head = (struct justin_fetch_head*) payload;
+    if (special != PKT_DATA) return true;
+    len = justin_fetch_chomp(data, len);
+
+    if (len < GIT_OID_HEXSZ + 5) return true;
+    if (memcmp(&data[GIT_OID_HEXSZ], " HEAD", 5) != 0) return true;
+    if (len > GIT_OID_HEXSZ + 5 && data[GIT_OID_HEXSZ + 5] != ' ') return true;
+    if (git_oid_fromstrn(&head->oid, data, GIT_OID_HEXSZ) != 0) return true;
+    head->found = true;
+
+    const char *sym = (const char*) memmem(data, len, SYMREF_TARGET, (sizeof SYMREF_TARGET) - 1);
+    if (sym != NULL) {
+        sym += (sizeof SYMREF_TARGET) - 1;
+        size_t sym_len = 0;
+        size_t max = len - (sym - data);
+        while (sym_len < max && sym[sym_len] != ' ') sym_len++;
+        if (sym_len < sizeof(head->target)) {
+            memcpy(head->target, sym, sym_len);
+            head->target[sym_len] = '\0';
+        }
+    }
+    return true;
+}
+
+// FETCH
+
+struct justin_fetch_pack {
+    git_odb_writepack *writepack;
+    git_indexer_progress stats;
+    bool in_pack;
+    justin_err err;
+};
+
+bool justin_fetch_on_pack(const char *data, size_t len, int special, void *payload) {
+    struct justin_fetch_pack *pack = (struct justin_fetch_pack*) payload;
+    if (special != PKT_DATA) return true;
+
+    if (!pack->in_pack) {
+        // Section headers; with "done" sent up front, the server skips straight to the pack
+        size_t line_len = justin_fetch_chomp(data, len);
+        if (line_len == 8 && memcmp(data, "packfile", 8) == 0) pack->in_pack = true;
+        return true;
+    }
+    if (len < 1) return true;
+
+    switch (data[0]) {
+        case 1:
+            if (pack->writepack->append(pack->writepack, &data[1], len - 1, &pack->stats) != 0) {
+                pack->err = JUSTIN_ERR_GIT;
+                return false;
+            }
+            return true;
+        case 2:
+            return true;
+        case 3: {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Remote: %.*s", (int) justin_fetch_chomp(&data[1], len - 1), &data[1]);
+            justin_log_warn(msg);
+            pack->err = JUSTIN_ERR_PROTOCOL;
+            return false;
+        }
+        default:
+            pack->err = JUSTIN_ERR_PROTOCOL;
+            return false;
+    }
+}
+
+// Sends a fetch command whose arguments (wants, filter) have already been written to "args"
+void justin_fetch_pack(justin_context ctx, git_repository *repo, const char *url, struct justin_fetch_buf *args, justin_err *err) {
+    struct justin_fetch_buf body = { NULL, 0, 0 };
+    if (!(justin_fetch_pkt_line(&body, "command=fetch\n") &&
+            justin_fetch_pkt_special(&body, PKT_DELIM) &&
+            justin_fetch_pkt_line(&body, "ofs-delta\n") &&
+            justin_fetch_pkt_line(&body, "no-progress\n") &&
+            justin_fetch_buf_append(&body, args->data, args->len) &&
+            justin_fetch_pkt_line(&body, "done\n") &&
+            justin_fetch_pkt_special(&body, PKT_FLUSH))) {
+        free(body.data);
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+
+    git_odb *odb;
+    if (git_repository_odb(&odb, repo) != 0) {
+        free(body.data);
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+
+    struct justin_fetch_pack pack = { NULL, { 0 }, false, JUSTIN_ERR_OK };
+    if (git_odb_write_pack(&pack.writepack, odb, NULL, NULL) != 0) {
+        git_odb_free(odb);
+        free(body.data);
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+
+    justin_fetch_request(ctx, url, UPLOAD_PACK_S, &body, justin_fetch_on_pack, &pack, err);
+    if (pack.err != JUSTIN_ERR_OK) {
+        *err = pack.err;
+    } else if (*err == JUSTIN_ERR_OK) {
+        if (!pack.in_pack) {
+            *err = JUSTIN_ERR_PROTOCOL;
+        } else if (pack.writepack->commit(pack.writepack, &pack.stats) != 0) {
+            *err = JUSTIN_ERR_GIT;
+        } else {
+            char msg[64];
+            sprintf(msg, "Received %u objects", pack.stats.received_objects);
+            justin_log_debug_indent(msg, 1);
+        }
+    }
+
+    pack.writepack->free(pack.writepack);
+    git_odb_free(odb);
+    free(body.data);
+}
+
+// LOCAL (file://)
+
+bool justin_fetch_copy_object(git_odb *src, git_odb *dst, const git_oid *oid, justin_err *err) {
+    if (git_odb_exists(dst, oid)) return false;
+
+    git_odb_object *obj;
+    if (git_odb_read(&obj, src, oid) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return true;
+    }
+    git_oid written;
+    int stat = git_odb_write(&written, dst, git_odb_object_data(obj), git_odb_object_size(obj), git_odb_object_type(obj));
+    git_odb_object_free(obj);
+    if (stat != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return true;
+    }
+    return false;
+}
+
+bool justin_fetch_copy_tree(git_repository *src_repo, git_odb *src, git_odb *dst, const git_oid *oid, justin_err *err) {
+    if (git_odb_exists(dst, oid)) return false;
+
+    git_tree *tree;
+    if (git_tree_lookup(&tree, src_repo, oid) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return true;
+    }
+    size_t count = git_tree_entrycount(tree);
+    const git_tree_entry *entry;
+    for (size_t i=0; i < count; i++) {
+        entry = git_tree_entry_byindex(tree, i);
+        if (git_tree_entry_type(entry) != GIT_OBJECT_TREE) continue;
+        if (justin_fetch_copy_tree(src_repo, src, dst, git_tree_entry_id(entry), err)) {
+            git_tree_free(tree);
+            return true;
+        }
+    }
+    git_tree_free(tree);
+    // Subtrees first, so that a tree present in "dst" always implies its subtrees are too
+    return justin_fetch_copy_object(src, dst, oid, err);
+}
+
+git_repository *justin_fetch_history_local(const char *src_path, const char *path, justin_err *err) {
+    git_repository *src_repo;
+    if (git_repository_open(&src_repo, src_path) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+
+    git_reference *src_head;
+    if (git_repository_head(&src_head, src_repo) != 0) {
+        git_repository_free(src_repo);
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+
+    git_repository *repo = NULL;
+    git_odb *src = NULL;
+    git_odb *dst = NULL;
+    git_revwalk *walker = NULL;
+    if (git_repository_init(&repo, path, 1) != 0 ||
+            git_repository_odb(&src, src_repo) != 0 ||
+            git_repository_odb(&dst, repo) != 0 ||
+            git_revwalk_new(&walker, src_repo) != 0 ||
+            git_revwalk_push(walker, git_reference_target(src_head)) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        goto ex;
+    }
+
+    git_oid oid;
+    git_commit *commit;
+    int no;
+    while ((no = git_revwalk_next(&oid, walker)) == 0) {
+        if (git_commit_lookup(&commit, src_repo, &oid) != 0) {
+            *err = JUSTIN_ERR_GIT;
+            goto ex;
+        }
+        bool failed = justin_fetch_copy_tree(src_repo, src, dst, git_commit_tree_id(commit), err) ||
+                justin_fetch_copy_object(src, dst, &oid, err);
+        git_commit_free(commit);
+        if (failed) goto ex;
+    }
+    if (no != GIT_ITEROVER) {
+        *err = JUSTIN_ERR_GIT;
+        goto ex;
+    }
+
+    git_reference *ref;
+    if (git_reference_create(&ref, repo, git_reference_name(src_head), git_reference_target(src_head), 1, NULL) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        goto ex;
+    }
+    git_reference_free(ref);
+    if (git_repository_set_head(repo, git_reference_name(src_head)) != 0) *err = JUSTIN_ERR_GIT;
+
+    ex:
+    if (walker != NULL) git_revwalk_free(walker);
+    if (dst != NULL) git_odb_free(dst);
+    if (src != NULL) git_odb_free(src);
+    git_reference_free(src_head);
+    git_repository_free(src_repo);
+    if (*err != JUSTIN_ERR_OK && repo != NULL) {
+        git_repository_free(repo);
+        return NULL;
+    }
+    return repo;
+}
+
+// PUBLIC
+
+git_repository *justin_fetch_history(justin_context ctx, const char *url, const char *path, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    if (strncmp(url, FILE_URL_S, FILE_URL_L) == 0) {
+        return justin_fetch_history_local(&url[FILE_URL_L], path, err);
+    }
+
+    justin_log_debug_indent("Reading remote capabilities", 1);
+    struct justin_fetch_caps caps = { false, false, false, true };
+    justin_fetch_request(ctx, url, INFO_REFS_S, NULL, justin_fetch_on_caps, &caps, err);
+    if (*err != JUSTIN_ERR_OK) return NULL;
+    if (!(caps.v2 && caps.filter && caps.sha1)) {
+        *err = JUSTIN_ERR_PROTOCOL;
+        return NULL;
+    }
+
+    justin_log_debug_indent("Listing remote refs", 1);
+    struct justin_fetch_buf body = { NULL, 0, 0 };
+    if (!(justin_fetch_pkt_line(&body, "command=ls-refs\n") &&
+            justin_fetch_pkt_special(&body, PKT_DELIM) &&
+            justin_fetch_pkt_line(&body, "symrefs\n") &&
+            justin_fetch_pkt_line(&body, "ref-prefix HEAD\n") &&
+            justin_fetch_pkt_special(&body, PKT_FLUSH))) {
+        free(body.data);
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    struct justin_fetch_head head = { false };
+    strcpy(head.target, DEFAULT_BRANCH_S);
+    justin_fetch_request(ctx, url, UPLOAD_PACK_S, &body, justin_fetch_on_ls_refs, &head, err);
+    free(body.data);
+    if (*err != JUSTIN_ERR_OK) return NULL;
+    if (!head.found) {
+        *err = JUSTIN_ERR_PROTOCOL;
+        return NULL;
+    }
+
+    git_repository *repo;
+    if (git_repository_init(&repo, path, 1) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+
+    justin_log_debug_indent("Fetching commits and trees", 1);
+    char line[GIT_OID_HEXSZ + 7];
+    memcpy(line, "want ", 5);
+    git_oid_fmt(&line[5], &head.oid);
+    line[GIT_OID_HEXSZ + 5] = '\n';
+    line[GIT_OID_HEXSZ + 6] = '\0';
+
+    struct justin_fetch_buf args = { NULL, 0, 0 };
+    if (!(justin_fetch_pkt_line(&args, "filter blob:none\n") && justin_fetch_pkt_line(&args, line))) {
+        free(args.data);
+        git_repository_free(repo);
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    justin_fetch_pack(ctx, repo, url, &args, err);
+    free(args.data);
+    if (*err != JUSTIN_ERR_OK) {
+        git_repository_free(repo);
+        return NULL;
+    }
+
+    git_reference *ref;
+    if (git_reference_create(&ref, repo, head.target, &head.oid, 1, NULL) != 0) {
+        git_repository_free(repo);
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+    git_reference_free(ref);
+    if (git_repository_set_head(repo, head.target) != 0) {
+        git_repository_free(repo);
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+    return repo;
+}
+
+struct justin_fetch_wants {
+    git_odb *odb;
+    struct justin_fetch_buf *args;
+    size_t count;
+    bool failed;
+};
+
+int justin_fetch_collect_wants(const char *root, const git_tree_entry *entry, void *payload) {
+    struct justin_fetch_wants *wants = (struct justin_fetch_wants*) payload;
+    if (git_tree_entry_type(entry) != GIT_OBJECT_BLOB) return 0;
+    const git_oid *oid = git_tree_entry_id(entry);
+    if (git_odb_exists(wants->odb, oid)) return 0;
+
+    char line[GIT_OID_HEXSZ + 7];
+    memcpy(line, "want ", 5);
+    git_oid_fmt(&line[5], oid);
+    line[GIT_OID_HEXSZ + 5] = '\n';
+    line[GIT_OID_HEXSZ + 6] = '\0';
+    if (!justin_fetch_pkt_line(wants->args, line)) {
+        wants->failed = true;
+        return -1;
+    }
+    wants->count++;
+    return 0;
+}
+
+void justin_fetch_blobs(justin_context ctx, git_repository *repo, const char *url, git_commit *commit, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+
+    git_tree *tree;
+    if (git_commit_tree(&tree, commit) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+    git_odb *odb;
+    if (git_repository_odb(&odb, repo) != 0) {
+        git_tree_free(tree);
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+
+    struct justin_fetch_buf args = { NULL, 0, 0 };
+    struct justin_fetch_wants wants = { odb, &args, 0, false };
+    if (git_tree_walk(tree, GIT_TREEWALK_PRE, justin_fetch_collect_wants, &wants) != 0) {
+        *err = wants.failed ? JUSTIN_ERR_NOMEM : JUSTIN_ERR_GIT;
+        goto ex;
+    }
+    if (wants.count == 0) goto ex;
+
+    if (strncmp(url, FILE_URL_S, FILE_URL_L) == 0) {
+        git_repository *src_repo;
+        git_odb *src;
+        if (git_repository_open(&src_repo, &url[FILE_URL_L]) != 0) {
+            *err = JUSTIN_ERR_GIT;
+            goto ex;
+        }
+        if (git_repository_odb(&src, src_repo) != 0) {
+            git_repository_free(src_repo);
+            *err = JUSTIN_ERR_GIT;
+            goto ex;
+        }
+        // Each "want" line is exactly 50 bytes: 4 (length) + 5 ("want ") + 40 (hex) + 1 (LF)
+        git_oid oid;
+        for (size_t off=0; off < args.len; off += GIT_OID_HEXSZ + 10) {
+            git_oid_fromstrn(&oid, &args.data[off + 9], GIT_OID_HEXSZ);
+            if (justin_fetch_copy_object(src, odb, &oid, err)) break;
+        }
+        git_odb_free(src);
+        git_repository_free(src_repo);
+        goto ex;
+    }
+
+    char msg[64];
+    sprintf(msg, "Fetching %zu blobs", wants.count);
+    justin_log_debug_indent(msg, 1);
+    justin_fetch_pack(ctx, repo, url, &args, err);
+
+    ex:
+    free(args.data);
+    git_odb_free(odb);
+    git_tree_free(tree);
+}
@@ -0,0 +1,37 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <git2.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_FETCH_H
+#define JUSTIN_FETCH_H
+
+/**
+ * Creates a bare repository at "path" holding every commit and tree reachable from the remote HEAD, but no blobs.
+ * Over HTTP(S) this uses the git v2 wire protocol with a "blob:none" filter; file:// remotes are read directly.
+ * If the remote cannot serve a filtered fetch, "err" is set to JUSTIN_ERR_PROTOCOL before anything is written.
+ */
+git_repository *justin_fetch_history(justin_context ctx, const char *url, const char *path, justin_err *err);
+
+/**
+ * Fetches the blobs missing from the tree of "commit", so that it can be checked out. Intended for repositories
+ * created by justin_fetch_history.
+ */
+void justin_fetch_blobs(justin_context ctx, git_repository *repo, const char *url, git_commit *commit, justin_err *err);
+
+#endif //JUSTIN_FETCH_H
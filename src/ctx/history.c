@@ -0,0 +1,176 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../ansi.h"
+#include "../logging.h"
+#include "history.h"
+
+static const char *HISTORY_DIR_S = JUSTIN_HISTORY_DIR;
+
+// The mean of this many builds is the estimate when the version was never built
+#define HISTORY_MEAN_OF 3
+
+// Reads up to JUSTIN_HISTORY_KEEP records, oldest first, returns the number read
+size_t justin_history_read(const char *path, justin_history_record *records) {
+    FILE *f = fopen(path, "re");
+    if (f == NULL) return 0;
+    char line[256];
+    size_t len = 0;
+    long long time;
+    unsigned long long wall, cpu, peak;
+    char version[JUSTIN_HISTORY_VERSION_MAX];
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (sscanf(line, "%lld %llu %llu %llu %63s", &time, &wall, &cpu, &peak, version) != 5) continue;
+        // Keep the newest, the file may have grown past the limit if builds of the same base raced
+        if (len == JUSTIN_HISTORY_KEEP) {
+            memmove(&records[0], &records[1], (JUSTIN_HISTORY_KEEP - 1) * sizeof(justin_history_record));
+            len--;
+        }
+        justin_history_record *r = &records[len++];
+        r->time = (int64_t) time;
+        r->wall_ms = (uint64_t) wall;
+        r->cpu_ms = (uint64_t) cpu;
+        r->peak_kib = (uint64_t) peak;
+        memcpy(r->version, version, sizeof version);
+    }
+    fclose(f);
+    return len;
+}
+
+void justin_history_add(justin_storage storage, const char *base, const justin_history_record *record) {
+    justin_err err;
+    char *path = justin_storage_path(storage, HISTORY_DIR_S, base, &err);
+    if (path == NULL) {
+        justin_log_err_soft(err);
+        return;
+    }
+    justin_history_record records[JUSTIN_HISTORY_KEEP];
+    size_t len = justin_history_read(path, records);
+    size_t skip = len == JUSTIN_HISTORY_KEEP ? 1 : 0;
+
+    // Rewritten whole and renamed over the old file, so a reader never sees half of it
+    char *tmp;
+    if (asprintf(&tmp, "%s.%ld.tmp", path, (long) getpid()) == -1) {
+        free(path);
+        justin_log_err_soft(JUSTIN_ERR_NOMEM);
+        return;
+    }
+    FILE *f = fopen(tmp, "we");
+    if (f == NULL) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        goto ex;
+    }
+    const justin_history_record *r;
+    for (size_t i=skip; i <= len; i++) {
+        r = i == len ? record : &records[i];
+        fprintf(f, "%lld %llu %llu %llu %s\n", (long long) r->time, (unsigned long long) r->wall_ms,
+                (unsigned long long) r->cpu_ms, (unsigned long long) r->peak_kib,
+                r->version[0] == '\0' ? "-" : r->version);
+    }
+    bool ok = fclose(f) == 0;
+    if (!ok || rename(tmp, path) == -1) {
+        unlink(tmp);
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    }
+
+    ex:
+    free(tmp);
+    free(path);
+}
+
+uint64_t justin_history_estimate(justin_storage storage, const char *base, const char *version) {
+    justin_err err;
+    char *path = justin_storage_path(storage, HISTORY_DIR_S, base, &err);
+    if (path == NULL) return 0;
+    justin_history_record records[JUSTIN_HISTORY_KEEP];
+    size_t len = justin_history_read(path, records);
+    free(path);
+    if (len == 0) return 0;
+
+    if (version != NULL) {
+        for (size_t i=len; i > 0; i--) {
+            if (strcmp(records[i - 1].version, version) == 0) return records[i - 1].wall_ms;
+        }
+    }
+    size_t n = len < HISTORY_MEAN_OF ? len : HISTORY_MEAN_OF;
+    uint64_t sum = 0;
+    for (size_t i=len - n; i < len; i++) sum += records[i].wall_ms;
+    return sum / n;
+}
+
+void justin_history_format(uint64_t ms, char *out, size_t size) {
+    unsigned long long s = (unsigned long long) ((ms + 500) / 1000);
+    if (s < 60) {
+        snprintf(out, size, "%llus", s);
+    } else if (s < 3600) {
+        snprintf(out, size, "%llum %02llus", s / 60, s % 60);
+    } else {
+        snprintf(out, size, "%lluh %02llum", s / 3600, (s / 60) % 60);
+    }
+}
+
+uint64_t justin_history_elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ms = ((int64_t) (now.tv_sec - since->tv_sec) * 1000) + ((now.tv_nsec - since->tv_nsec) / 1000000);
+    return ms < 0 ? 0 : (uint64_t) ms;
+}
+
+void justin_history_eta_start(justin_history_eta *eta, const char *base, uint64_t estimate_ms) {
+    eta->base = base;
+    eta->estimate_ms = estimate_ms;
+    clock_gettime(CLOCK_MONOTONIC, &eta->start);
+    eta->last = eta->start;
+    if (estimate_ms == 0) return;
+
+    char est[32];
+    justin_history_format(estimate_ms, est, sizeof est);
+    char buf[256];
+    snprintf(buf, sizeof buf, "Expected: %s%.128s %s:: %sabout %s", BYEL, base, BWHT, WHT, est);
+    justin_log_info(buf);
+}
+
+void justin_history_eta_write(void *data, const char *buf, size_t len) {
+    justin_history_eta *eta = (justin_history_eta*) data;
+    if (eta->on_output != NULL) eta->on_output(eta->output_data, buf, len);
+    if (eta->estimate_ms == 0 || justin_history_elapsed_ms(&eta->last) < JUSTIN_HISTORY_ETA_INTERVAL * 1000) return;
+    clock_gettime(CLOCK_MONOTONIC, &eta->last);
+
+    uint64_t elapsed = justin_history_eta_elapsed(eta);
+    char a[32];
+    char b[32];
+    char line[256];
+    justin_history_format(elapsed, a, sizeof a);
+    if (elapsed < eta->estimate_ms) {
+        justin_history_format(eta->estimate_ms - elapsed, b, sizeof b);
+        snprintf(line, sizeof line, "Progress: %s%.128s %s:: %s%s elapsed, about %s left", BYEL, eta->base, BWHT, WHT, a, b);
+    } else {
+        justin_history_format(eta->estimate_ms, b, sizeof b);
+        snprintf(line, sizeof line, "Progress: %s%.128s %s:: %s%s elapsed, longer than the usual %s", BYEL, eta->base, BWHT, WHT, a, b);
+    }
+    justin_log_info(line);
+}
+
+uint64_t justin_history_eta_elapsed(const justin_history_eta *eta) {
+    return justin_history_elapsed_ms(&eta->start);
+}
@@ -0,0 +1,87 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "../storage.h"
+
+#ifndef JUSTIN_HISTORY_H
+#define JUSTIN_HISTORY_H
+
+/*
+ * Build history. Every successful build adds a line to ".history/<pkgbase>" in the storage directory with the time
+ * it finished, the version built, its wall time, CPU time and peak memory; the last JUSTIN_HISTORY_KEEP builds are
+ * kept. The history gives the expected duration of the next build, which is shown while it runs and used to start the
+ * longest chains of builds first.
+ */
+
+#define JUSTIN_HISTORY_DIR ".history"
+#define JUSTIN_HISTORY_KEEP 16
+#define JUSTIN_HISTORY_VERSION_MAX 64
+
+typedef struct justin_history_record {
+    int64_t time;                               // end of the build, seconds since the epoch
+    uint64_t wall_ms;
+    uint64_t cpu_ms;                            // user and system time of makepkg and everything it waited for
+    uint64_t peak_kib;
+    char version[JUSTIN_HISTORY_VERSION_MAX];   // [epoch:]pkgver-pkgrel
+} justin_history_record;
+
+void justin_history_add(justin_storage storage, const char *base, const justin_history_record *record);
+
+/**
+ * Expected wall time of the next build of a base in milliseconds, 0 if it was never built. The last build of the
+ * same version is the best guess; without one (or with "version" NULL), the mean of the last three builds.
+ */
+uint64_t justin_history_estimate(justin_storage storage, const char *base, const char *version);
+
+/**
+ * Writes a duration such as "45s", "3m 12s" or "1h 05m"
+ */
+void justin_history_format(uint64_t ms, char *out, size_t size);
+
+/**
+ * Progress of a running build against its estimate. Sits between the build output and the build log, and every
+ * JUSTIN_HISTORY_ETA_INTERVAL seconds of output adds a line with the time left.
+ */
+typedef struct justin_history_eta {
+    const char *base;
+    uint64_t estimate_ms;
+    struct timespec start;
+    struct timespec last;
+    void (*on_output)(void *data, const char *buf, size_t len);
+    void *output_data;
+} justin_history_eta;
+
+#define JUSTIN_HISTORY_ETA_INTERVAL 30
+
+/**
+ * Starts the clock and announces the estimate, if there is one
+ */
+void justin_history_eta_start(justin_history_eta *eta, const char *base, uint64_t estimate_ms);
+
+/**
+ * Suitable as justin_proc_opts_t.on_output, with the ETA as data. Passes everything on to eta->on_output.
+ */
+void justin_history_eta_write(void *eta, const char *buf, size_t len);
+
+/**
+ * Milliseconds since justin_history_eta_start
+ */
+uint64_t justin_history_eta_elapsed(const justin_history_eta *eta);
+
+#endif //JUSTIN_HISTORY_H
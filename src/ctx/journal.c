@@ -0,0 +1,150 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "journal.h"
+
+static const char *JOURNAL_DIR_S = JUSTIN_JOURNAL_DIR;
+
+// Indexed by justin_journal_stage
+static const char *JOURNAL_STAGES[] = { "none", "cloned", "checkout", "sources", "built", "installed" };
+#define JOURNAL_STAGE_COUNT ((sizeof JOURNAL_STAGES) / sizeof(char*))
+
+bool justin_journal_read(const char *dir, justin_journal_t *journal) {
+    journal->stage = JUSTIN_JOURNAL_NONE;
+    journal->commit[0] = '\0';
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, JUSTIN_STORAGE_JOURNAL);
+    FILE *f = fopen(path, "re");
+    if (f == NULL) return false;
+    char line[128];
+    char stage[16];
+    char commit[41];
+    int n;
+    // Stages are appended as they complete, a line cut short by a crash is skipped
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (strchr(line, '\n') == NULL) continue;
+        n = sscanf(line, "%15s %40s", stage, commit);
+        if (n < 1) continue;
+        for (size_t i=1; i < JOURNAL_STAGE_COUNT; i++) {
+            if (strcmp(stage, JOURNAL_STAGES[i]) != 0) continue;
+            journal->stage = (justin_journal_stage) i;
+            if (i == JUSTIN_JOURNAL_CHECKOUT) {
+                if (n == 2) {
+                    memcpy(journal->commit, commit, sizeof commit);
+                } else {
+                    journal->commit[0] = '\0';
+                }
+            }
+            break;
+        }
+    }
+    fclose(f);
+    return journal->stage != JUSTIN_JOURNAL_NONE;
+}
+
+// Reads the directory ".resume/<base>" links to into "out", returns false if there is none
+bool justin_journal_link(justin_storage storage, const char *base, char **link, char *out, size_t size) {
+    justin_err err;
+    *link = justin_storage_path(storage, JOURNAL_DIR_S, base, &err);
+    if ((*link) == NULL) return false;
+    ssize_t len = readlink(*link, out, size - 1);
+    if (len <= 0) return false;
+    out[len] = '\0';
+    return true;
+}
+
+char *justin_journal_resume(justin_storage storage, const char *base, justin_journal_t *journal) {
+    char *link;
+    char dir[PATH_MAX];
+    bool found = justin_journal_link(storage, base, &link, dir, sizeof dir);
+    free(link);
+    // A directory on /dev/shm does not survive a reboot
+    if (!found || !justin_journal_read(dir, journal)) return NULL;
+    if (journal->stage == JUSTIN_JOURNAL_INSTALLED) return NULL;
+
+    char buf[256];
+    snprintf(buf, sizeof buf, "Resuming: %s%.128s %s:: %safter the %s stage", BYEL, base, BWHT, WHT, JOURNAL_STAGES[journal->stage]);
+    justin_log_info(buf);
+    char *ret = strdup(dir);
+    if (ret == NULL) justin_log_err_soft(JUSTIN_ERR_NOMEM);
+    return ret;
+}
+
+void justin_journal_begin(justin_storage storage, const char *base, const char *dir) {
+    char *link;
+    char old[PATH_MAX];
+    if (justin_journal_link(storage, base, &link, old, sizeof old) && strcmp(old, dir) != 0) {
+        // Only ever remove what still looks like a build directory of ours
+        justin_journal_t journal;
+        if (justin_journal_read(old, &journal)) {
+            char buf[256];
+            snprintf(buf, sizeof buf, "Discarding the unfinished build of %.128s (-R resumes it)", base);
+            justin_log_info(buf);
+            if (justin_util_rimraf(old) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        }
+    }
+    if (link == NULL) return;
+    unlink(link);
+    if (symlink(dir, link) == -1) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    free(link);
+}
+
+void justin_journal_mark(const char *dir, justin_journal_stage stage, const char *commit) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, JUSTIN_STORAGE_JOURNAL);
+    FILE *f = fopen(path, "ae");
+    if (f == NULL) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        return;
+    }
+    if (commit != NULL) {
+        fprintf(f, "%s %s\n", JOURNAL_STAGES[stage], commit);
+    } else {
+        fprintf(f, "%s\n", JOURNAL_STAGES[stage]);
+    }
+    // A journal ahead of the directory would resume a build that is not there
+    fflush(f);
+    fdatasync(fileno(f));
+    fclose(f);
+}
+
+void justin_journal_done(justin_storage storage, const char *base, char *dir, bool record, bool failed) {
+    justin_journal_t journal;
+    if (failed && justin_journal_read(dir, &journal) && journal.stage != JUSTIN_JOURNAL_INSTALLED) {
+        char buf[256];
+        snprintf(buf, sizeof buf, "The build directory of %.128s is kept, -R resumes it", base);
+        justin_log_info(buf);
+        justin_storage_build_dir_keep(storage, dir);
+        return;
+    }
+
+    char *link;
+    char target[PATH_MAX];
+    if (justin_journal_link(storage, base, &link, target, sizeof target) && strcmp(target, dir) == 0) unlink(link);
+    free(link);
+    justin_storage_build_dir_done(storage, base, dir, record);
+}
@@ -0,0 +1,75 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include "../storage.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_JOURNAL_H
+#define JUSTIN_JOURNAL_H
+
+/*
+ * Checkpoints of a build directory. Every stage a base gets through (cloned, checked out, sources fetched, built,
+ * installed) is appended to a journal in its build directory, and ".resume/<pkgbase>" in the storage directory links
+ * to the directory of the latest attempt. A build that fails or is interrupted after the clone leaves its directory
+ * behind (justin_storage_clean skips directories with a journal until JUSTIN_STORAGE_KEEP_DAYS have passed), and -R
+ * picks it up at the first stage it did not finish. The next run of the same base without -R discards it.
+ */
+
+#define JUSTIN_JOURNAL_DIR ".resume"
+
+typedef enum justin_journal_stage {
+    JUSTIN_JOURNAL_NONE,
+    JUSTIN_JOURNAL_CLONED,      // the git repository is in the directory
+    JUSTIN_JOURNAL_CHECKOUT,    // the tree of "commit" is written
+    JUSTIN_JOURNAL_SOURCES,     // the sources are downloaded and verified
+    JUSTIN_JOURNAL_BUILT,       // the packages are in the directory
+    JUSTIN_JOURNAL_INSTALLED
+} justin_journal_stage;
+
+typedef struct justin_journal_t {
+    justin_journal_stage stage;
+    char commit[41];            // hex oid of the commit checked out, empty if not known
+} justin_journal_t;
+#define JUSTIN_JOURNAL_INITIALIZER { JUSTIN_JOURNAL_NONE, "" }
+
+/**
+ * Reads the journal of a build directory. Returns false if it has none.
+ */
+bool justin_journal_read(const char *dir, justin_journal_t *journal);
+
+/**
+ * Returns the directory of an earlier attempt at a base with its journal, or NULL if there is nothing to resume
+ */
+char *justin_journal_resume(justin_storage storage, const char *base, justin_journal_t *journal);
+
+/**
+ * Makes "dir" the latest attempt at a base, discarding the directory of an earlier one
+ */
+void justin_journal_begin(justin_storage storage, const char *base, const char *dir);
+
+/**
+ * Records that a stage is complete. "commit" is only used for JUSTIN_JOURNAL_CHECKOUT and may be NULL.
+ */
+void justin_journal_mark(const char *dir, justin_journal_stage stage, const char *commit);
+
+/**
+ * Replaces justin_storage_build_dir_done. If the build failed after the clone, the directory is kept to be resumed;
+ * otherwise it is removed along with the link to it.
+ */
+void justin_journal_done(justin_storage storage, const char *base, char *dir, bool record, bool failed);
+
+#endif //JUSTIN_JOURNAL_H
@@ -0,0 +1,496 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "../util.h"
+#include "meta.h"
+
+#define META_DIR ".meta"
+#define META_MAGIC 0x3161746D6E74736AULL // "jstnmta1"
+#define META_SEGMENT_MAGIC 0x6D676573U // "segm"
+#define META_MAX_SEGMENTS 32
+#define META_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+struct justin_meta_header {
+    uint64_t magic;
+    uint64_t reserved;
+};
+
+struct justin_meta_segment_header {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t strtab_len;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+struct justin_meta_segment {
+    size_t count;
+    const unsigned char *oids;
+    const int64_t *commit_times;
+    const int64_t *author_times;
+    const uint32_t *summaries;
+    const char *strtab;
+};
+
+struct justin_meta_t {
+    int fd;
+    char *path;
+    uid_t user;
+    char *map;
+    size_t map_len;
+    size_t data_len;
+    struct justin_meta_segment *segments;
+    size_t segment_count;
+    size_t size;
+};
+
+static inline size_t justin_meta_segment_bytes(size_t count, size_t strtab_len) {
+    return sizeof(struct justin_meta_segment_header) +
+            META_ALIGN(count * GIT_OID_RAWSZ) +
+            (count * sizeof(int64_t) * 2) +
+            META_ALIGN(count * sizeof(uint32_t)) +
+            META_ALIGN(strtab_len);
+}
+
+// Reads segments from the mapping until the first one that is damaged (e.g. by an interrupted write)
+size_t justin_meta_parse(justin_meta meta, justin_err *err) {
+    size_t off = sizeof(struct justin_meta_header);
+    meta->segment_count = 0;
+    meta->size = 0;
+
+    size_t cap = 0;
+    const struct justin_meta_segment_header *hdr;
+    while (off + sizeof(struct justin_meta_segment_header) <= meta->map_len) {
+        hdr = (const struct justin_meta_segment_header*) &meta->map[off];
+        if (hdr->magic != META_SEGMENT_MAGIC) break;
+        size_t count = hdr->count;
+        size_t strtab_len = hdr->strtab_len;
+        size_t bytes = justin_meta_segment_bytes(count, strtab_len);
+        if (hdr->size != bytes || off + bytes > meta->map_len) break;
+
+        const char *col = (const char*) &hdr[1];
+        struct justin_meta_segment seg;
+        seg.count = count;
+        seg.oids = (const unsigned char*) col;
+        col += META_ALIGN(count * GIT_OID_RAWSZ);
+        seg.commit_times = (const int64_t*) col;
+        col += count * sizeof(int64_t);
+        seg.author_times = (const int64_t*) col;
+        col += count * sizeof(int64_t);
+        seg.summaries = (const uint32_t*) col;
+        col += META_ALIGN(count * sizeof(uint32_t));
+        seg.strtab = col;
+
+        bool valid = strtab_len > 0 && seg.strtab[strtab_len - 1] == '\0';
+        for (size_t i=0; valid && i < count; i++) {
+            if (seg.summaries[i] >= strtab_len) valid = false;
+        }
+        if (!valid) break;
+
+        if (meta->segment_count == cap) {
+            cap = cap == 0 ? 4 : cap << 1;
+            struct justin_meta_segment *segments = (struct justin_meta_segment*) reallocarray(meta->segments, cap, sizeof(struct justin_meta_segment));
+            if (segments == NULL) {
+                *err = JUSTIN_ERR_NOMEM;
+                return off;
+            }
+            meta->segments = segments;
+        }
+        meta->segments[meta->segment_count++] = seg;
+        meta->size += count;
+        off += bytes;
+    }
+    return off;
+}
+
+// BUILDER
+
+struct justin_meta_builder {
+    unsigned char *oids;
+    int64_t *commit_times;
+    int64_t *author_times;
+    uint32_t *summaries;
+    size_t count;
+    size_t cap;
+    char *strtab;
+    size_t strtab_len;
+    size_t strtab_cap;
+};
+
+void justin_meta_builder_write(int fd, struct justin_meta_builder *b, off_t at, justin_err *err);
+
+// FILE
+
+int justin_meta_open_fd(justin_meta meta, justin_err *err) {
+    int fd = open(meta->path, O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+    if (fd == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return -1;
+    }
+    if (fchown(fd, meta->user, -1) == -1) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    }
+    return fd;
+}
+
+// Locks the cache file, following it to the new one if it was replaced while waiting for the lock
+void justin_meta_lock(justin_meta meta, int op, justin_err *err) {
+    struct stat st_fd;
+    struct stat st_path;
+    while (true) {
+        if (flock(meta->fd, op) == -1 || fstat(meta->fd, &st_fd) == -1) {
+            *err = JUSTIN_ERR_SYSTEM;
+            return;
+        }
+        if (stat(meta->path, &st_path) == 0 && st_path.st_dev == st_fd.st_dev && st_path.st_ino == st_fd.st_ino) return;
+        flock(meta->fd, LOCK_UN);
+        int fd = justin_meta_open_fd(meta, err);
+        if (fd == -1) return;
+        close(meta->fd);
+        meta->fd = fd;
+    }
+}
+
+// Writes a new cache file holding only the segment of "b", if any, and renames it over the old one. Other processes
+// keep reading the old one through their mappings until they remap. Needs LOCK_EX.
+void justin_meta_replace(justin_meta meta, struct justin_meta_builder *b, justin_err *err) {
+    char *tmp;
+    if (asprintf(&tmp, "%s.XXXXXX", meta->path) == -1) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd == -1) {
+        free(tmp);
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    if (fchown(fd, meta->user, -1) == -1 || fchmod(fd, 0664) == -1) {
+        justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    }
+
+    struct justin_meta_header header = { META_MAGIC, 0 };
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) *err = JUSTIN_ERR_SYSTEM;
+    if (*err == JUSTIN_ERR_OK && b != NULL) justin_meta_builder_write(fd, b, sizeof(header), err);
+    if (*err == JUSTIN_ERR_OK && rename(tmp, meta->path) == -1) *err = JUSTIN_ERR_SYSTEM;
+    if (*err != JUSTIN_ERR_OK) {
+        unlink(tmp);
+        close(fd);
+    } else {
+        // Whoever waits for the lock on the old file finds it replaced and follows
+        close(meta->fd);
+        meta->fd = fd;
+    }
+    free(tmp);
+}
+
+// Maps the cache file. Damaged and unrecognized files are only repaired with "exclusive" (LOCK_EX held); otherwise
+// they read as empty.
+void justin_meta_remap(justin_meta meta, bool exclusive, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    if (meta->map != NULL) {
+        munmap(meta->map, meta->map_len);
+        meta->map = NULL;
+        meta->map_len = 0;
+    }
+    meta->segment_count = 0;
+    meta->size = 0;
+    meta->data_len = 0;
+
+    struct stat st;
+    if (fstat(meta->fd, &st) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    size_t len = (size_t) st.st_size;
+
+    if (len >= sizeof(struct justin_meta_header)) {
+        char *map = (char*) mmap(NULL, len, PROT_READ, MAP_SHARED, meta->fd, 0);
+        if (map == MAP_FAILED) {
+            *err = JUSTIN_ERR_SYSTEM;
+            return;
+        }
+        meta->map = map;
+        meta->map_len = len;
+        if (((const struct justin_meta_header*) map)->magic == META_MAGIC) {
+            size_t valid = justin_meta_parse(meta, err);
+            if (*err != JUSTIN_ERR_OK) return;
+            // Nothing past the last valid segment is mapped by anyone, so it can go
+            if (exclusive && valid < len && ftruncate(meta->fd, (off_t) valid) == -1) *err = JUSTIN_ERR_SYSTEM;
+            meta->data_len = valid;
+            return;
+        }
+        munmap(map, len);
+        meta->map = NULL;
+        meta->map_len = 0;
+    }
+
+    if (!exclusive) return;
+    // New or unrecognized file; the cache is disposable, so start over
+    if (len == 0) {
+        struct justin_meta_header header = { META_MAGIC, 0 };
+        if (pwrite(meta->fd, &header, sizeof(header), 0) != sizeof(header)) *err = JUSTIN_ERR_SYSTEM;
+    } else {
+        justin_meta_replace(meta, NULL, err);
+    }
+    if (*err == JUSTIN_ERR_OK) justin_meta_remap(meta, true, err);
+}
+
+justin_meta justin_meta_open(justin_storage storage, const char *name, justin_err *err) {
+    char *path = justin_storage_path(storage, META_DIR, name, err);
+    if (path == NULL) return NULL;
+
+    justin_meta ret = (justin_meta) calloc(1, sizeof(struct justin_meta_t));
+    if (ret == NULL) {
+        free(path);
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    ret->path = path;
+    ret->user = storage->user;
+    ret->fd = justin_meta_open_fd(ret, err);
+    if (ret->fd == -1) {
+        justin_meta_close(ret);
+        return NULL;
+    }
+
+    justin_meta_lock(ret, LOCK_SH, err);
+    if (*err == JUSTIN_ERR_OK) {
+        justin_meta_remap(ret, false, err);
+        flock(ret->fd, LOCK_UN);
+    }
+    if (*err != JUSTIN_ERR_OK) {
+        justin_meta_close(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+void justin_meta_close(justin_meta meta) {
+    if (meta->map != NULL) munmap(meta->map, meta->map_len);
+    free(meta->segments);
+    if (meta->fd != -1) close(meta->fd);
+    free(meta->path);
+    free(meta);
+}
+
+size_t justin_meta_size(justin_meta meta) {
+    return meta->size;
+}
+
+const struct justin_meta_segment *justin_meta_locate(justin_meta meta, size_t *index) {
+    const struct justin_meta_segment *seg;
+    for (size_t i=meta->segment_count; i > 0; i--) {
+        seg = &meta->segments[i - 1];
+        if (*index < seg->count) return seg;
+        *index -= seg->count;
+    }
+    return NULL;
+}
+
+void justin_meta_oid(justin_meta meta, size_t index, git_oid *out) {
+    const struct justin_meta_segment *seg = justin_meta_locate(meta, &index);
+    git_oid_fromraw(out, &seg->oids[index * GIT_OID_RAWSZ]);
+}
+
+int64_t justin_meta_commit_time(justin_meta meta, size_t index) {
+    const struct justin_meta_segment *seg = justin_meta_locate(meta, &index);
+    return seg->commit_times[index];
+}
+
+int64_t justin_meta_author_time(justin_meta meta, size_t index) {
+    const struct justin_meta_segment *seg = justin_meta_locate(meta, &index);
+    return seg->author_times[index];
+}
+
+const char* justin_meta_summary(justin_meta meta, size_t index) {
+    const struct justin_meta_segment *seg = justin_meta_locate(meta, &index);
+    return &seg->strtab[seg->summaries[index]];
+}
+
+// BUILDER
+
+void justin_meta_builder_free(struct justin_meta_builder *b) {
+    free(b->oids);
+    free(b->commit_times);
+    free(b->author_times);
+    free(b->summaries);
+    free(b->strtab);
+}
+
+bool justin_meta_builder_add(struct justin_meta_builder *b, const unsigned char *oid, int64_t commit_time,
+                             int64_t author_time, const char *summary, size_t summary_len) {
+    if (b->count == b->cap) {
+        size_t cap = b->cap == 0 ? 64 : b->cap << 1;
+        unsigned char *oids = (unsigned char*) realloc(b->oids, cap * GIT_OID_RAWSZ);
+        if (oids == NULL) return false;
+        b->oids = oids;
+        int64_t *commit_times = (int64_t*) reallocarray(b->commit_times, cap, sizeof(int64_t));
+        if (commit_times == NULL) return false;
+        b->commit_times = commit_times;
+        int64_t *author_times = (int64_t*) reallocarray(b->author_times, cap, sizeof(int64_t));
+        if (author_times == NULL) return false;
+        b->author_times = author_times;
+        uint32_t *summaries = (uint32_t*) reallocarray(b->summaries, cap, sizeof(uint32_t));
+        if (summaries == NULL) return false;
+        b->summaries = summaries;
+        b->cap = cap;
+    }
+    if (b->strtab_len + summary_len + 1 > b->strtab_cap) {
+        size_t cap = b->strtab_cap == 0 ? 4096 : b->strtab_cap;
+        while (cap < b->strtab_len + summary_len + 1) cap <<= 1;
+        char *strtab = (char*) realloc(b->strtab, cap);
+        if (strtab == NULL) return false;
+        b->strtab = strtab;
+        b->strtab_cap = cap;
+    }
+
+    memcpy(&b->oids[b->count * GIT_OID_RAWSZ], oid, GIT_OID_RAWSZ);
+    b->commit_times[b->count] = commit_time;
+    b->author_times[b->count] = author_time;
+    b->summaries[b->count] = (uint32_t) b->strtab_len;
+    memcpy(&b->strtab[b->strtab_len], summary, summary_len);
+    b->strtab[b->strtab_len + summary_len] = '\0';
+    b->strtab_len += summary_len + 1;
+    b->count++;
+    return true;
+}
+
+void justin_meta_builder_write(int fd, struct justin_meta_builder *b, off_t at, justin_err *err) {
+    size_t bytes = justin_meta_segment_bytes(b->count, b->strtab_len);
+    char *buf = (char*) calloc(1, bytes);
+    if (buf == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+
+    struct justin_meta_segment_header *hdr = (struct justin_meta_segment_header*) buf;
+    hdr->magic = META_SEGMENT_MAGIC;
+    hdr->count = (uint32_t) b->count;
+    hdr->strtab_len = (uint32_t) b->strtab_len;
+    hdr->size = bytes;
+
+    char *col = (char*) &hdr[1];
+    memcpy(col, b->oids, b->count * GIT_OID_RAWSZ);
+    col += META_ALIGN(b->count * GIT_OID_RAWSZ);
+    memcpy(col, b->commit_times, b->count * sizeof(int64_t));
+    col += b->count * sizeof(int64_t);
+    memcpy(col, b->author_times, b->count * sizeof(int64_t));
+    col += b->count * sizeof(int64_t);
+    memcpy(col, b->summaries, b->count * sizeof(uint32_t));
+    col += META_ALIGN(b->count * sizeof(uint32_t));
+    memcpy(col, b->strtab, b->strtab_len);
+
+    if (pwrite(fd, buf, bytes, at) != (ssize_t) bytes) *err = JUSTIN_ERR_SYSTEM;
+    free(buf);
+}
+
+// SYNC
+
+void justin_meta_sync0(justin_meta meta, git_repository *repo, justin_err *err) {
+    git_oid head;
+    if (git_reference_name_to_id(&head, repo, "HEAD") != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+
+    git_oid tip;
+    bool rebuild = false;
+    if (meta->size > 0) {
+        justin_meta_oid(meta, 0, &tip);
+        if (git_oid_equal(&tip, &head)) return;
+        rebuild = git_graph_descendant_of(repo, &head, &tip) != 1;
+    }
+
+    git_revwalk *walker;
+    if (git_revwalk_new(&walker, repo) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+    git_revwalk_sorting(walker, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
+    if (git_revwalk_push(walker, &head) != 0 ||
+            (meta->size > 0 && !rebuild && git_revwalk_hide(walker, &tip) != 0)) {
+        git_revwalk_free(walker);
+        *err = JUSTIN_ERR_GIT;
+        return;
+    }
+
+    struct justin_meta_builder b = { 0 };
+    git_oid oid;
+    git_commit *commit;
+    int no;
+    while ((no = git_revwalk_next(&oid, walker)) == 0) {
+        if (git_commit_lookup(&commit, repo, &oid) != 0) {
+            *err = JUSTIN_ERR_GIT;
+            goto ex;
+        }
+        const char *msg = git_commit_message(commit);
+        bool added = justin_meta_builder_add(&b, oid.id, git_commit_time(commit), git_commit_author(commit)->when.time,
+                                             msg, strlenol(msg));
+        git_commit_free(commit);
+        if (!added) {
+            *err = JUSTIN_ERR_NOMEM;
+            goto ex;
+        }
+    }
+    if (no != GIT_ITEROVER) {
+        *err = JUSTIN_ERR_GIT;
+        goto ex;
+    }
+    if (b.count == 0) goto ex;
+
+    if (rebuild || meta->segment_count >= META_MAX_SEGMENTS) {
+        // Compact: newest entries first, then everything still valid from the old segments
+        for (size_t i=0; !rebuild && i < meta->size; i++) {
+            justin_meta_oid(meta, i, &oid);
+            const char *summary = justin_meta_summary(meta, i);
+            if (!justin_meta_builder_add(&b, oid.id, justin_meta_commit_time(meta, i), justin_meta_author_time(meta, i),
+                                         summary, strlen(summary))) {
+                *err = JUSTIN_ERR_NOMEM;
+                goto ex;
+            }
+        }
+        // Others may have the file mapped, so it is replaced rather than rewritten
+        justin_meta_replace(meta, &b, err);
+    } else {
+        justin_meta_builder_write(meta->fd, &b, (off_t) meta->data_len, err);
+    }
+    if (*err == JUSTIN_ERR_OK) justin_meta_remap(meta, true, err);
+
+    ex:
+    justin_meta_builder_free(&b);
+    git_revwalk_free(walker);
+}
+
+void justin_meta_sync(justin_meta meta, git_repository *repo, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_meta_lock(meta, LOCK_EX, err);
+    if (*err != JUSTIN_ERR_OK) return;
+    // Another process may have extended or replaced the file since it was mapped
+    justin_meta_remap(meta, true, err);
+    if (*err == JUSTIN_ERR_OK) justin_meta_sync0(meta, repo, err);
+    flock(meta->fd, LOCK_UN);
+}
@@ -0,0 +1,59 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdint.h>
+#include <git2.h>
+#include "../storage.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_META_H
+#define JUSTIN_META_H
+
+/*
+ * Per-package commit metadata cache. Each package base gets a file in the storage directory holding, for every commit
+ * of its history, the oid, commit time, author time and first line of the message. The file is a sequence of
+ * segments, each one columnar (one array per field, plus a string table for the summaries), and is mapped into
+ * memory. New commits are appended as a new segment; index 0 is always the newest commit. Rebuilding or compacting
+ * writes a new file in place of the old one, which processes that still have it mapped keep reading.
+ */
+
+struct justin_meta_t;
+typedef struct justin_meta_t *justin_meta;
+
+justin_meta justin_meta_open(justin_storage storage, const char *name, justin_err *err);
+
+void justin_meta_close(justin_meta meta);
+
+/**
+ * Brings the cache up to date with the history reachable from HEAD. If HEAD is the newest cached commit, this is a
+ * single ref lookup. If the history was rewritten, the cache is rebuilt.
+ */
+void justin_meta_sync(justin_meta meta, git_repository *repo, justin_err *err);
+
+size_t justin_meta_size(justin_meta meta);
+
+void justin_meta_oid(justin_meta meta, size_t index, git_oid *out);
+
+int64_t justin_meta_commit_time(justin_meta meta, size_t index);
+
+int64_t justin_meta_author_time(justin_meta meta, size_t index);
+
+/**
+ * Returns the first line of the commit message, null-terminated
+ */
+const char* justin_meta_summary(justin_meta meta, size_t index);
+
+#endif //JUSTIN_META_H
@@ -0,0 +1,545 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <alpm.h>
+#include <git2.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "aur.h"
+#include "pkg.h"
+#include "repo.h"
+#include "artifact.h"
+#include "sources.h"
+#include "history.h"
+#include "remote.h"
+#include "pipeline.h"
+
+typedef struct justin_pipeline_stage {
+    justin_pipeline pipeline;
+    const char *verb;
+    void (*work)(justin_pipeline pipeline, justin_pipeline_item *item);
+    justin_pipeline_queue *in;
+    justin_pipeline_queue *out;
+    size_t active;
+    pthread_mutex_t mutex;
+} justin_pipeline_stage;
+
+struct justin_pipeline_t {
+    justin_context ctx;
+    justin_deps_graph graph;
+    justin_pipeline_item *items;    // same order as the graph nodes
+    size_t len;
+    justin_pipeline_queue input;
+    justin_pipeline_queue fetched;
+    justin_pipeline_queue sourced;
+    justin_pipeline_queue built;
+    // Items waiting for their dependencies, guarded by the mutex of "sourced"
+    justin_pipeline_item **parked;
+    size_t parked_len;
+    justin_remote_pool remote;      // NULL without -w
+};
+
+// Queue
+
+bool justin_pipeline_queue_init(justin_pipeline_queue *queue, size_t cap) {
+    queue->items = (justin_pipeline_item**) calloc(cap, sizeof(justin_pipeline_item*));
+    if (queue->items == NULL) return false;
+    queue->cap = cap;
+    queue->head = 0;
+    queue->len = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return true;
+}
+
+void justin_pipeline_queue_destroy(justin_pipeline_queue *queue) {
+    if (queue->items == NULL) return;
+    free(queue->items);
+    queue->items = NULL;
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
+
+void justin_pipeline_queue_push(justin_pipeline_queue *queue, justin_pipeline_item *item) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->len == queue->cap) pthread_cond_wait(&queue->not_full, &queue->mutex);
+    queue->items[(queue->head + queue->len) % queue->cap] = item;
+    queue->len++;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Must hold the queue mutex, and the queue must not be empty
+justin_pipeline_item *justin_pipeline_queue_take(justin_pipeline_queue *queue) {
+    justin_pipeline_item *item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->cap;
+    queue->len--;
+    pthread_cond_signal(&queue->not_full);
+    return item;
+}
+
+// Returns NULL once the queue is closed and empty
+justin_pipeline_item *justin_pipeline_queue_pop(justin_pipeline_queue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->len == 0 && !queue->closed) pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    justin_pipeline_item *item = queue->len == 0 ? NULL : justin_pipeline_queue_take(queue);
+    pthread_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+void justin_pipeline_queue_close(justin_pipeline_queue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Pipeline
+
+unsigned int justin_pipeline_max_layer(justin_pipeline pipeline) {
+    unsigned int ret = 0;
+    for (size_t i=0; i < pipeline->len; i++) {
+        if (pipeline->items[i].node->layer > ret) ret = pipeline->items[i].node->layer;
+    }
+    return ret;
+}
+
+// Dependents are in higher layers than what they depend on, so going down the layers sees every dependent of an item
+// before the item itself
+void justin_pipeline_rank(justin_pipeline pipeline) {
+    justin_pipeline_item *item;
+    justin_pipeline_item *dep;
+    unsigned int l = justin_pipeline_max_layer(pipeline);
+    do {
+        for (size_t i=0; i < pipeline->len; i++) {
+            item = &pipeline->items[i];
+            if (item->node->layer != l) continue;
+            item->rank += item->estimate;
+            for (size_t e=0; e < item->node->edge_count; e++) {
+                dep = &pipeline->items[item->node->edges[e]];
+                if (dep->rank < item->rank) dep->rank = item->rank;
+            }
+        }
+    } while (l-- != 0);
+}
+
+// Lowest layer first, then longest rank first
+int justin_pipeline_feed_order(const void *a, const void *b) {
+    const justin_pipeline_item *x = *((const justin_pipeline_item**) a);
+    const justin_pipeline_item *y = *((const justin_pipeline_item**) b);
+    if (x->node->layer != y->node->layer) return x->node->layer < y->node->layer ? -1 : 1;
+    if (x->rank != y->rank) return x->rank > y->rank ? -1 : 1;
+    return 0;
+}
+
+justin_pipeline justin_pipeline_create(justin_context ctx, justin_deps_graph graph, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_pipeline ret = (justin_pipeline) calloc(1, sizeof(struct justin_pipeline_t));
+    if (ret == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    ret->ctx = ctx;
+    ret->graph = graph;
+    ret->len = graph->len;
+    ret->items = (justin_pipeline_item*) calloc(graph->len + 1, sizeof(justin_pipeline_item));
+    ret->parked = (justin_pipeline_item**) calloc(graph->len + 1, sizeof(justin_pipeline_item*));
+    if (ret->items == NULL || ret->parked == NULL ||
+            !justin_pipeline_queue_init(&ret->input, JUSTIN_PIPELINE_QUEUE_CAP) ||
+            !justin_pipeline_queue_init(&ret->fetched, JUSTIN_PIPELINE_QUEUE_CAP) ||
+            !justin_pipeline_queue_init(&ret->sourced, JUSTIN_PIPELINE_QUEUE_CAP) ||
+            !justin_pipeline_queue_init(&ret->built, JUSTIN_PIPELINE_QUEUE_CAP)) {
+        *err = JUSTIN_ERR_NOMEM;
+        justin_pipeline_free(ret);
+        return NULL;
+    }
+
+    for (size_t i=0; i < graph->len; i++) {
+        ret->items[i].node = &graph->nodes[i];
+        ret->items[i].install = true;
+        ret->items[i].state = JUSTIN_PIPELINE_PENDING;
+        ret->items[i].estimate = justin_history_estimate(ctx->storage, graph->nodes[i].base, NULL);
+        if (ret->items[i].estimate == 0) ret->items[i].estimate = JUSTIN_PIPELINE_ESTIMATE_UNKNOWN;
+    }
+    justin_pipeline_rank(ret);
+    if (ctx->params->v_workers != NULL) {
+        justin_err remote_err;
+        ret->remote = justin_remote_pool_create(ctx, ctx->params->v_workers, &remote_err);
+        if (remote_err != JUSTIN_ERR_OK) justin_log_err_soft(remote_err);
+    }
+    return ret;
+}
+
+justin_pipeline_item *justin_pipeline_find(justin_pipeline pipeline, const char *name) {
+    for (size_t i=0; i < pipeline->len; i++) {
+        if (justin_deps_strv_contains(&pipeline->items[i].node->names, name)) return &pipeline->items[i];
+    }
+    return NULL;
+}
+
+void justin_pipeline_free(justin_pipeline pipeline) {
+    justin_pipeline_item *item;
+    if (pipeline->items != NULL) {
+        for (size_t i=0; i < pipeline->len; i++) {
+            item = &pipeline->items[i];
+            free(item->artifacts);
+            free(item->pkgnames);
+            if (item->own_dir) git_repository_free(item->repo);
+            justin_buildlog_close(item->log);
+            if (item->dir == NULL) continue;
+            justin_artifact_forget_built(item->dir);
+            if (!item->own_dir) continue;
+            justin_journal_done(pipeline->ctx->storage, item->node->base, item->dir, item->built, item->state != JUSTIN_PIPELINE_DONE);
+        }
+    }
+    free(pipeline->items);
+    free(pipeline->parked);
+    justin_remote_pool_free(pipeline->remote);
+    justin_pipeline_queue_destroy(&pipeline->input);
+    justin_pipeline_queue_destroy(&pipeline->fetched);
+    justin_pipeline_queue_destroy(&pipeline->sourced);
+    justin_pipeline_queue_destroy(&pipeline->built);
+    free(pipeline);
+}
+
+void justin_pipeline_log(const char *verb, justin_pipeline_item *item) {
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s %s%.200s", verb, BYEL, item->node->base);
+    justin_log_info(buf);
+}
+
+// Stages
+
+void justin_pipeline_fetch(justin_pipeline pipeline, justin_pipeline_item *item) {
+    if (item->dir != NULL) return;
+    justin_context ctx = pipeline->ctx;
+    justin_journal_t journal = JUSTIN_JOURNAL_INITIALIZER;
+    if (ctx->params->f_resume) item->dir = justin_journal_resume(ctx->storage, item->node->base, &journal);
+    if (item->dir == NULL) {
+        item->dir = justin_storage_build_dir_create(ctx->storage, item->node->base, &item->err);
+        if (item->err != JUSTIN_ERR_OK) return;
+        justin_journal_begin(ctx->storage, item->node->base, item->dir);
+    }
+    item->own_dir = true;
+    item->resume = journal.stage;
+    // Resumed builds are not looked up in the artifact cache, nor stored in it
+    if (journal.stage >= JUSTIN_JOURNAL_CHECKOUT) return;
+
+    justin_aur_project_t project = { 0 };
+    project.name = item->node->names.data[0];
+    project.base = item->node->base;
+    git_repository *repo = NULL;
+    if (journal.stage == JUSTIN_JOURNAL_CLONED) {
+        if (git_repository_open(&repo, item->dir) != 0) item->err = JUSTIN_ERR_GIT;
+    } else {
+        repo = justin_aur_project_clone_into(ctx, &project, item->dir, &item->err);
+        if (item->err == JUSTIN_ERR_OK) justin_journal_mark(item->dir, JUSTIN_JOURNAL_CLONED, NULL);
+    }
+    if (item->err != JUSTIN_ERR_OK) return;
+    git_commit *head = justin_repo_head_commit(repo, &item->err);
+    if (item->err != JUSTIN_ERR_OK) goto ex;
+
+    item->lookup = item->node->edge_count != 0;
+    if (!item->lookup) item->artifacts = justin_artifact_lookup(ctx, project.name, repo, head, &item->prebuilt, &item->err);
+    if (item->err == JUSTIN_ERR_OK && !item->prebuilt) {
+        justin_repo_checkout_into(repo, head, item->dir, &item->err);
+        if (item->err == JUSTIN_ERR_OK && justin_util_chown_r(item->dir, ctx->storage->user) != 0) item->err = JUSTIN_ERR_SYSTEM;
+        if (item->err == JUSTIN_ERR_OK) {
+            char oid[GIT_OID_HEXSZ + 1];
+            git_oid_tostr(oid, sizeof oid, git_commit_id(head));
+            justin_journal_mark(item->dir, JUSTIN_JOURNAL_CHECKOUT, oid);
+        }
+    }
+    git_commit_free(head);
+
+    ex:
+    if (item->lookup && item->err == JUSTIN_ERR_OK) {
+        item->repo = repo;
+    } else {
+        git_repository_free(repo);
+    }
+}
+
+void justin_pipeline_sources(justin_pipeline pipeline, justin_pipeline_item *item) {
+    if (item->prebuilt || item->resume >= JUSTIN_JOURNAL_SOURCES) return;
+    static char *const args[] = { "--verifysource", NULL };
+    const char *dir = item->dir;
+    justin_err prefetch_err;
+    justin_sources_prefetch(pipeline->ctx, &dir, 1, &prefetch_err);
+    if (prefetch_err != JUSTIN_ERR_OK) justin_log_err_soft(prefetch_err);
+    // Only VCS sources and checksums are left for makepkg here
+    item->log = justin_buildlog_open(pipeline->ctx, item->node->base);
+    justin_pkg_make_args(pipeline->ctx, item->dir, args, item->log, &item->err);
+    if (item->err == JUSTIN_ERR_OK) justin_journal_mark(item->dir, JUSTIN_JOURNAL_SOURCES, NULL);
+}
+
+// Looks up a base whose AUR dependencies were not installed yet in the fetch stage. On a hit, its sources were
+// downloaded for nothing, but the build is still skipped.
+void justin_pipeline_lookup(justin_pipeline pipeline, justin_pipeline_item *item) {
+    item->lookup = false;
+    justin_journal_t journal;
+    git_oid oid;
+    git_commit *commit = NULL;
+    if (item->repo != NULL && justin_journal_read(item->dir, &journal) && journal.commit[0] != '\0' &&
+            git_oid_fromstr(&oid, journal.commit) == 0 && git_commit_lookup(&commit, item->repo, &oid) == 0) {
+        item->artifacts = justin_artifact_lookup(pipeline->ctx, item->node->names.data[0], item->repo, commit, &item->prebuilt, &item->err);
+    }
+    git_commit_free(commit);
+    if (item->own_dir) {
+        git_repository_free(item->repo);
+        item->repo = NULL;
+    }
+}
+
+void justin_pipeline_build(justin_pipeline pipeline, justin_pipeline_item *item) {
+    if (item->lookup) justin_pipeline_lookup(pipeline, item);
+    if (item->prebuilt || item->err != JUSTIN_ERR_OK) return;
+    item->built = true;
+    if (item->resume >= JUSTIN_JOURNAL_BUILT) return;
+    if (item->log == NULL) item->log = justin_buildlog_open(pipeline->ctx, item->node->base);
+    if (item->install && item->pkgnames == NULL) {
+        // The packages of the base nothing depends on would only be archived to be thrown away. If the names do not
+        // match the .SRCINFO, the whole base is built as before.
+        justin_err split_err;
+        item->pkgnames = justin_pkg_split_select(item->dir, (const char *const *) item->node->names.data, item->node->names.len, &split_err);
+    }
+    // A worker would not have the packages of AUR dependencies built in this run
+    justin_journal_t journal;
+    bool remote = item->node->edge_count == 0 && justin_journal_read(item->dir, &journal) && journal.commit[0] != '\0';
+    int slot = justin_remote_acquire(pipeline->remote, remote);
+    remote = false;
+    if (slot >= 0) {
+        justin_remote_job job = { item->node->base, item->node->names.data[0], journal.commit, item->pkgnames };
+        remote = justin_remote_build(pipeline->remote, slot, &job, item->dir, item->log, &item->err);
+        justin_remote_release(pipeline->remote, slot);
+        if (!remote) slot = justin_remote_acquire(pipeline->remote, false);
+    }
+    if (!remote) {
+        justin_pkg_make_split(pipeline->ctx, item->dir, item->pkgnames, item->log, &item->err);
+        justin_remote_release(pipeline->remote, slot);
+    }
+    justin_buildlog_close(item->log);
+    item->log = NULL;
+    if (item->err == JUSTIN_ERR_OK) justin_journal_mark(item->dir, JUSTIN_JOURNAL_BUILT, NULL);
+    if (item->err != JUSTIN_ERR_OK) return;
+    // Uncompressed packages are not worth the space in the cache, and a later build may want the whole base. The key
+    // covers the makepkg configuration of this machine, which a worker's may not match.
+    if (item->artifacts != NULL && (pipeline->ctx->params->f_fast || item->pkgnames != NULL || remote ||
+            !justin_artifact_store(pipeline->ctx, item->dir, item->artifacts, &item->err))) {
+        free(item->artifacts);
+        item->artifacts = NULL;
+    }
+    // Dependents built in a sandbox install from here instead
+    if (item->err == JUSTIN_ERR_OK && item->artifacts == NULL) justin_artifact_add_built(item->dir);
+}
+
+// Returns 1 if every dependency of an item is done, -1 if one failed and 0 otherwise. Must hold the "sourced" mutex.
+int justin_pipeline_ready(justin_pipeline pipeline, justin_pipeline_item *item) {
+    justin_deps_node *node = item->node;
+    int ret = 1;
+    for (size_t i=0; i < node->edge_count; i++) {
+        switch (pipeline->items[node->edges[i]].state) {
+            case JUSTIN_PIPELINE_FAILED:
+                return -1;
+            case JUSTIN_PIPELINE_PENDING:
+                ret = 0;
+                break;
+            default:
+                break;
+        }
+    }
+    return ret;
+}
+
+// Next item whose dependencies are done, the one with the highest rank if several are. Everything in the queue is
+// parked first, so that the choice is made among all the items the earlier stages are done with.
+justin_pipeline_item *justin_pipeline_build_pop(justin_pipeline pipeline) {
+    justin_pipeline_queue *queue = &pipeline->sourced;
+    justin_pipeline_item *item = NULL;
+    int ready;
+    size_t best;
+    pthread_mutex_lock(&queue->mutex);
+    while (1) {
+        while (queue->len != 0) {
+            item = justin_pipeline_queue_take(queue);
+            if (item->err != JUSTIN_ERR_OK) goto ex;
+            pipeline->parked[pipeline->parked_len++] = item;
+        }
+        item = NULL;
+        best = pipeline->parked_len;
+        for (size_t i=0; i < pipeline->parked_len; i++) {
+            ready = justin_pipeline_ready(pipeline, pipeline->parked[i]);
+            if (ready < 0) {
+                pipeline->parked[i]->err = JUSTIN_ERR_DEPENDENCY;
+                best = i;
+                break;
+            }
+            if (ready > 0 && (best == pipeline->parked_len || pipeline->parked[i]->rank > pipeline->parked[best]->rank)) best = i;
+        }
+        if (best != pipeline->parked_len) {
+            item = pipeline->parked[best];
+            memmove(&pipeline->parked[best], &pipeline->parked[best + 1], (pipeline->parked_len - best - 1) * sizeof(justin_pipeline_item*));
+            pipeline->parked_len--;
+            goto ex;
+        }
+        if (queue->closed && pipeline->parked_len == 0) goto ex;
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    ex:
+    pthread_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+// Installs the packages of a built base that were asked for. Package files are named <name>-<pkgver>-<pkgrel>-<arch>.
+void justin_pipeline_install(justin_pipeline pipeline, justin_pipeline_item *item) {
+    if (!item->install) return;
+    justin_pipeline_log("Installing", item);
+    justin_err *err = &item->err;
+    const char *dir = item->artifacts != NULL ? item->artifacts : item->dir;
+    justin_pkg_target_list targets = justin_pkg_target_list_create(dir, err);
+    if ((*err) != JUSTIN_ERR_OK) return;
+
+    int flags = item->node->target ? ALPM_TRANS_FLAG_ALLEXPLICIT : ALPM_TRANS_FLAG_ALLDEPS;
+    size_t dir_len = strlen(dir);
+    const char *target;
+    while ((target = justin_pkg_target_list_next(targets, err)) != NULL) {
+        char *name = strndup(target, justin_pkg_archive_name_len(target));
+        if (name == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            break;
+        }
+        bool wanted = justin_deps_strv_contains(&item->node->names, name);
+        free(name);
+        if (!wanted) continue;
+
+        size_t target_len = strlen(target);
+        char *path = (char*) malloc(dir_len + target_len + 2);
+        if (path == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            break;
+        }
+        justin_util_path_join(dir, dir_len, target, target_len, path);
+        justin_log_debug_indent(path, 1);
+        justin_pkg_install_flags(pipeline->ctx, path, flags, err);
+        free(path);
+        if ((*err) != JUSTIN_ERR_OK) break;
+    }
+    justin_pkg_target_list_destroy(targets);
+    if ((*err) == JUSTIN_ERR_OK) justin_journal_mark(item->dir, JUSTIN_JOURNAL_INSTALLED, NULL);
+}
+
+void *justin_pipeline_worker(void *arg) {
+    justin_pipeline_stage *stage = (justin_pipeline_stage*) arg;
+    justin_pipeline pipeline = stage->pipeline;
+    bool build = stage->in == &pipeline->sourced;
+    bool install = stage->out == NULL;
+    justin_pipeline_item *item;
+    while ((item = build ? justin_pipeline_build_pop(pipeline) : justin_pipeline_queue_pop(stage->in)) != NULL) {
+        if (item->err == JUSTIN_ERR_OK) {
+            // Nothing to say about items that were fetched by the caller or found in the cache
+            bool quiet = item->prebuilt || (stage->in == &pipeline->input && item->dir != NULL);
+            if (stage->verb != NULL && !quiet) justin_pipeline_log(stage->verb, item);
+            stage->work(pipeline, item);
+        }
+        if (!install) {
+            justin_pipeline_queue_push(stage->out, item);
+            continue;
+        }
+
+        if (item->err != JUSTIN_ERR_OK) justin_log_err_msg(item->err, item->node->base);
+        // Wake up the build workers, which may have parked dependents of this item
+        pthread_mutex_lock(&pipeline->sourced.mutex);
+        item->state = item->err == JUSTIN_ERR_OK ? JUSTIN_PIPELINE_DONE : JUSTIN_PIPELINE_FAILED;
+        pthread_cond_broadcast(&pipeline->sourced.not_empty);
+        pthread_mutex_unlock(&pipeline->sourced.mutex);
+    }
+
+    pthread_mutex_lock(&stage->mutex);
+    bool last = --stage->active == 0;
+    pthread_mutex_unlock(&stage->mutex);
+    if (last && !install) justin_pipeline_queue_close(stage->out);
+    return NULL;
+}
+
+// Starts the workers of a stage, returns the number started
+size_t justin_pipeline_stage_start(justin_pipeline_stage *stage, pthread_t *threads, size_t count) {
+    pthread_mutex_init(&stage->mutex, NULL);
+    stage->active = count;
+    size_t started = 0;
+    while (started < count && pthread_create(&threads[started], NULL, justin_pipeline_worker, stage) == 0) started++;
+
+    pthread_mutex_lock(&stage->mutex);
+    stage->active -= count - started;
+    bool none = stage->active == 0;
+    pthread_mutex_unlock(&stage->mutex);
+    if (none && stage->out != NULL) justin_pipeline_queue_close(stage->out);
+    return started;
+}
+
+void justin_pipeline_run(justin_pipeline pipeline, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    // The build workers wait in justin_remote_acquire for a slot, here or on a remote worker
+    size_t jobs = pipeline->ctx->resources.builds + justin_remote_pool_slots(pipeline->remote);
+    justin_pipeline_stage stages[4] = {
+            { pipeline, "Fetching", justin_pipeline_fetch, &pipeline->input, &pipeline->fetched },
+            { pipeline, "Downloading sources for", justin_pipeline_sources, &pipeline->fetched, &pipeline->sourced },
+            { pipeline, "Building", justin_pipeline_build, &pipeline->sourced, &pipeline->built },
+            { pipeline, NULL, justin_pipeline_install, &pipeline->built, NULL }
+    };
+    size_t counts[4] = { JUSTIN_PIPELINE_FETCH_WORKERS, JUSTIN_PIPELINE_SOURCE_WORKERS, jobs, 1 };
+    size_t started[4];
+    pthread_t *threads[4];
+
+    bool ok = true;
+    for (int s=0; s < 4; s++) {
+        threads[s] = (pthread_t*) calloc(counts[s], sizeof(pthread_t));
+        started[s] = threads[s] == NULL ? 0 : justin_pipeline_stage_start(&stages[s], threads[s], counts[s]);
+        if (threads[s] == NULL) {
+            pthread_mutex_init(&stages[s].mutex, NULL);
+            if (stages[s].out != NULL) justin_pipeline_queue_close(stages[s].out);
+        }
+        ok &= started[s] != 0;
+    }
+
+    // Feed the bases in dependency order, lowest layer first, and the longest chains first within a layer
+    justin_pipeline_item **order = ok ? (justin_pipeline_item**) malloc((pipeline->len + 1) * sizeof(justin_pipeline_item*)) : NULL;
+    if (order != NULL) {
+        for (size_t i=0; i < pipeline->len; i++) order[i] = &pipeline->items[i];
+        qsort(order, pipeline->len, sizeof(justin_pipeline_item*), justin_pipeline_feed_order);
+        for (size_t i=0; i < pipeline->len; i++) justin_pipeline_queue_push(&pipeline->input, order[i]);
+        free(order);
+    } else {
+        *err = ok ? JUSTIN_ERR_NOMEM : JUSTIN_ERR_SYSTEM;
+    }
+    justin_pipeline_queue_close(&pipeline->input);
+
+    for (int s=0; s < 4; s++) {
+        for (size_t i=0; i < started[s]; i++) pthread_join(threads[s][i], NULL);
+        free(threads[s]);
+        pthread_mutex_destroy(&stages[s].mutex);
+    }
+
+    for (size_t i=0; i < pipeline->len; i++) {
+        if ((*err) == JUSTIN_ERR_OK) *err = pipeline->items[i].err;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <git2.h>
+#include "../context.h"
+#include "../logging.h"
+#include "deps.h"
+#include "buildlog.h"
+#include "journal.h"
+
+#ifndef JUSTIN_PIPELINE_H
+#define JUSTIN_PIPELINE_H
+
+/*
+ * Builds the bases of a dependency graph in four stages: fetch (clone), sources (makepkg --verifysource), build
+ * (makepkg) and install. Each stage has its own workers, connected by bounded queues, so that one base can be
+ * cloning while another is compiling and a third is being installed. Bases enter in dependency order. A base is only
+ * built once everything it depends on is installed; until then the build workers set it aside and keep draining
+ * their queue, so a slow dependency never blocks the stages before it.
+ *
+ * Installs happen on a single worker, since the alpm handle is not thread safe. Bases found in the artifact cache
+ * skip the checkout, sources and build stages. The cache key covers the versions the dependencies resolve to, so bases
+ * with AUR dependencies in the same run are only looked up in the build stage, once those are installed. Of a split base that is only a dependency, just the packages that are
+ * needed get packaged; such partial builds are not stored in the artifact cache.
+ *
+ * With -w, the build stage also hands bases to remote workers (see remote.h).
+ *
+ * Every stage a base completes is recorded in the journal of its build directory. With -R, the bases an earlier run
+ * did not finish pick up at the stage after the last one recorded.
+ *
+ * Of the bases that are ready, the build workers take the one with the longest expected chain of builds behind it
+ * (its own time plus that of everything that waits for it, see justin_history_estimate), which keeps the total time
+ * of the run close to the longest chain instead of leaving one long build for the end.
+ */
+
+/**
+ * Expected build time of a base without history
+ */
+#define JUSTIN_PIPELINE_ESTIMATE_UNKNOWN 60000
+
+#define JUSTIN_PIPELINE_FETCH_WORKERS 4
+#define JUSTIN_PIPELINE_SOURCE_WORKERS 4
+#define JUSTIN_PIPELINE_QUEUE_CAP 4
+
+typedef enum justin_pipeline_state {
+    JUSTIN_PIPELINE_PENDING,
+    JUSTIN_PIPELINE_DONE,       // built, and installed if the item asked for it
+    JUSTIN_PIPELINE_FAILED
+} justin_pipeline_state;
+
+typedef struct justin_pipeline_item {
+    justin_deps_node *node;
+    char *dir;
+    bool own_dir;       // the directory was created by the pipeline and is removed with it
+    bool install;       // false to stop after building, leaving the packages to the caller
+    bool prebuilt;      // the packages were found in the artifact cache, skip to installing
+    bool lookup;        // not looked up in the artifact cache until its AUR dependencies are installed
+    git_repository *repo; // for that lookup; opened by the fetch stage if own_dir, the caller's otherwise
+    bool built;         // makepkg ran in the directory
+    uint64_t estimate;  // expected build time in ms, from the history
+    uint64_t rank;      // expected time from the start of this build to the end of its longest chain of dependents
+    char *artifacts;    // artifact cache directory the packages are stored in once built
+    char *pkgnames;     // packages of a split base to build, comma-separated, NULL for all; freed with the pipeline
+    justin_journal_stage resume; // stage the directory was left at by an earlier run, see justin_journal_resume
+    justin_buildlog log; // shared by the source and build stages
+    justin_err err;
+    justin_pipeline_state state;
+} justin_pipeline_item;
+
+typedef struct justin_pipeline_queue {
+    justin_pipeline_item **items;
+    size_t cap;
+    size_t head;
+    size_t len;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} justin_pipeline_queue;
+
+struct justin_pipeline_t;
+typedef struct justin_pipeline_t *justin_pipeline;
+
+justin_pipeline justin_pipeline_create(justin_context ctx, justin_deps_graph graph, justin_err *err);
+
+/**
+ * Returns the item of the base providing a package name, or NULL
+ */
+justin_pipeline_item *justin_pipeline_find(justin_pipeline pipeline, const char *name);
+
+/**
+ * Runs every stage to completion. Items that fail do not stop independent ones; the first error is returned.
+ */
+void justin_pipeline_run(justin_pipeline pipeline, justin_err *err);
+
+void justin_pipeline_free(justin_pipeline pipeline);
+
+#endif //JUSTIN_PIPELINE_H
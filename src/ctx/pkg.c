@@ -17,116 +17,315 @@
 #define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <alpm.h>
 #include <errno.h>
-#include <sys/mman.h>
-#include <sys/wait.h>
+#include <limits.h>
+#include <time.h>
 #include "../logging.h"
 #include "../util.h"
+#include "../proc.h"
+#include "srcinfo.h"
+#include "sources.h"
+#include "vcs.h"
+#include "ccache.h"
+#include "sandbox.h"
+#include "cgroup.h"
+#include "history.h"
 #include "pkg.h"
 
 #define PATH2_MAKEPKG "/usr/bin/makepkg"
 static const char *PATH2_MAKEPKG_S = PATH2_MAKEPKG;
 
-#define PKG_EXT ".pkg.tar.zst"
+#define SRCINFO ".SRCINFO"
+static const char *SRCINFO_S = SRCINFO;
+
+#define PKG_EXT ".pkg.tar"
 static const char *PKG_EXT_S = PKG_EXT;
 #define PKG_EXT_L ((sizeof PKG_EXT) - 1)
 
-void justin_pkg_make0(const char *path, justin_err *err) {
-    char *old_cwd = get_current_dir_name();
-    if (old_cwd == NULL) {
-        *err = JUSTIN_ERR_NOMEM;
-        return;
-    }
-    if (chdir(path) != 0) {
-        *err = JUSTIN_ERR_SYSTEM;
-        goto ex;
+// Everything makepkg can compress a package with, after PKG_EXT
+static const char *PKG_EXT_COMPRESSIONS[] = { "", ".zst", ".gz", ".xz", ".bz2", ".lzo", ".lrz", ".lz4", ".lz", ".Z" };
+
+#define PKGEXT_FAST "PKGEXT=" PKG_EXT
+static const char *PKGEXT_FAST_S = PKGEXT_FAST;
+
+bool justin_pkg_is_archive(const char *name) {
+    const char *in = NULL;
+    const char *next = name;
+    while ((next = strcasestr(next, PKG_EXT_S)) != NULL) in = next++;
+    if (in == NULL) return false;
+    const char *suffix = &in[PKG_EXT_L];
+    for (size_t i=0; i < (sizeof PKG_EXT_COMPRESSIONS) / sizeof(char*); i++) {
+        if (strcasecmp(suffix, PKG_EXT_COMPRESSIONS[i]) == 0) return true;
     }
+    return false;
+}
 
-    errno = 0;
-    FILE *proc = popen(PATH2_MAKEPKG_S, "r");
-    if (proc == NULL) {
-        if (errno == 0) {
-            *err = JUSTIN_ERR_NOMEM;
-        } else {
-            *err = JUSTIN_ERR_SYSTEM;
+bool justin_pkg_base_info(const char *path, char *base, size_t base_size, char *version, size_t version_size) {
+    char file[PATH_MAX];
+    snprintf(file, sizeof file, "%s/%s", path, SRCINFO_S);
+    snprintf(base, base_size, "build");
+    if (version != NULL) *version = '\0';
+    size_t len;
+    char *data = justin_util_read_file(file, &len);
+    if (data == NULL) return false;
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    bool ok = justin_srcinfo_parse(&info, data, len);
+    if (ok) {
+        snprintf(base, base_size, "%.*s", (int) info.pkgbase.len, info.pkgbase.ptr);
+        if (version != NULL && info.epoch.len != 0) {
+            snprintf(version, version_size, "%.*s:%.*s-%.*s", (int) info.epoch.len, info.epoch.ptr,
+                     (int) info.pkgver.len, info.pkgver.ptr, (int) info.pkgrel.len, info.pkgrel.ptr);
+        } else if (version != NULL) {
+            snprintf(version, version_size, "%.*s-%.*s", (int) info.pkgver.len, info.pkgver.ptr,
+                     (int) info.pkgrel.len, info.pkgrel.ptr);
         }
-        goto ex;
     }
+    justin_srcinfo_free(&info);
+    free(data);
+    return ok;
+}
+
+size_t justin_pkg_archive_name_len(const char *file) {
+    size_t len = strlen(file);
+    for (int dashes = 0; len > 0 && dashes < 3; ) {
+        if (file[--len] == '-') dashes++;
+    }
+    return len;
+}
 
-    char buf[1024];
-    while (fgets(buf, sizeof(buf), proc) != NULL) {
-        printf("%s", buf);
+char *justin_pkg_split_select(const char *path, const char *const *names, size_t count, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    char file[PATH_MAX];
+    snprintf(file, sizeof file, "%s/%s", path, SRCINFO_S);
+    size_t len;
+    char *data = justin_util_read_file(file, &len);
+    if (data == NULL) return NULL;
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    char *ret = NULL;
+    size_t ret_len = 0;
+    size_t matched = 0;
+    if (!justin_srcinfo_parse(&info, data, len)) goto ex;
+
+    for (size_t i=0; i < count; i++) {
+        bool found = false;
+        for (size_t n=0; n < info.pkgnames_len && !found; n++) {
+            found = strlen(names[i]) == info.pkgnames[n].len && memcmp(names[i], info.pkgnames[n].ptr, info.pkgnames[n].len) == 0;
+        }
+        if (!found) {
+            *err = JUSTIN_ERR_ARGS;
+            goto ex;
+        }
     }
-    if (errno != 0) *err = JUSTIN_ERR_SYSTEM;
 
-    int close = pclose(proc);
-    if (close == -1) {
-        if ((*err) == JUSTIN_ERR_OK) *err = JUSTIN_ERR_SYSTEM;
-    } else {
-        int stat = WEXITSTATUS(close);
-        if (stat != 0) {
-            *err = JUSTIN_ERR_SUBPROC(stat);
+    // In the order of the .SRCINFO, which is the order makepkg packages them in anyway
+    ret = (char*) malloc(len + 1);
+    if (ret == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    for (size_t n=0; n < info.pkgnames_len; n++) {
+        const justin_srcinfo_str *name = &info.pkgnames[n];
+        bool wanted = false;
+        for (size_t i=0; i < count && !wanted; i++) {
+            wanted = strlen(names[i]) == name->len && memcmp(names[i], name->ptr, name->len) == 0;
         }
+        if (!wanted) continue;
+        if (ret_len != 0) ret[ret_len++] = ',';
+        memcpy(&ret[ret_len], name->ptr, name->len);
+        ret_len += name->len;
+        matched++;
+    }
+    ret[ret_len] = '\0';
+    if (matched == info.pkgnames_len || matched == 0) {
+        free(ret);
+        ret = NULL;
     }
 
     ex:
-    chdir(old_cwd);
-    free(old_cwd);
+    justin_srcinfo_free(&info);
+    free(data);
+    return ret;
 }
 
-// Setup correct permissions and run justin_pkg_make0
-void justin_pkg_make(uid_t user, const char *path, justin_err *err) {
-    justin_err *shared_err = (justin_err*) mmap(NULL, sizeof(justin_err), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-    if (shared_err == MAP_FAILED) {
-        *err = JUSTIN_ERR_SYSTEM;
+// "full" is false for the steps before a build (e.g. --verifysource), which skip the sandbox and leave no record
+void justin_pkg_make_run(justin_context ctx, const char *path, char *const args[], bool full, const char *pkgnames, justin_buildlog log, justin_err *err) {
+    size_t argc = 0;
+    if (args != NULL) {
+        while (args[argc] != NULL) argc++;
+    }
+    char **argv = (char**) malloc((argc + 2) * sizeof(char*));
+    if (argv == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
         return;
     }
-    *shared_err = JUSTIN_ERR_OK;
-
-    pid_t pid = fork();
-    switch (pid) {
-        case -1:
-            *err = JUSTIN_ERR_SYSTEM;
-            goto close_map;
-        case 0: {
-            setuid(user);
-            justin_pkg_make0(path, shared_err);
-            exit(0);
+    argv[0] = "makepkg";
+    if (argc != 0) memcpy(&argv[1], args, argc * sizeof(char*));
+    argv[argc + 1] = NULL;
+
+    // An explicit MAKEFLAGS in the environment wins; makepkg.conf still overrides both if it sets one
+    char makeflags[32];
+    char *env[5 + JUSTIN_CCACHE_ENV_COUNT];
+    size_t envc = 0;
+    if (getenv("MAKEFLAGS") == NULL) {
+        snprintf(makeflags, sizeof makeflags, "MAKEFLAGS=-j%u", ctx->resources.make_jobs);
+        env[envc++] = makeflags;
+    }
+    // makepkg takes PKGEXT from the environment over makepkg.conf
+    if (ctx->params->f_fast) env[envc++] = (char*) PKGEXT_FAST_S;
+    // Sources are shared between builds and kept for the next one, see justin_sources_prefetch
+    char *srcdest = NULL;
+    char *srcdest_dir = justin_sources_dir(ctx, err);
+    if ((*err) != JUSTIN_ERR_OK) {
+        free(argv);
+        return;
+    }
+    if (asprintf(&srcdest, "SRCDEST=%s", srcdest_dir) == -1) srcdest = NULL;
+    if (srcdest == NULL) {
+        free(srcdest_dir);
+        free(argv);
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    env[envc++] = srcdest;
+    // VCS packages build in a persistent BUILDDIR, so that their src/ is reused by the next build
+    char *builddir = NULL;
+    justin_vcs_t vcs = JUSTIN_VCS_INITIALIZER;
+    justin_vcs_acquire(ctx, path, &vcs, err);
+    if ((*err) != JUSTIN_ERR_OK) {
+        justin_log_err_soft(*err);
+        *err = JUSTIN_ERR_OK;
+    } else if (vcs.builddir != NULL) {
+        if (asprintf(&builddir, "BUILDDIR=%s", vcs.builddir) == -1) {
+            builddir = NULL;
+            free(vcs.builddir);
+            vcs.builddir = NULL;
+        } else {
+            env[envc++] = builddir;
         }
-        default: {
-            int stat;
-            if (waitpid(pid, &stat, 0) == -1) {
-                *err = JUSTIN_ERR_SYSTEM;
-                goto close_map;
-            }
-            if (WIFEXITED(stat)) {
-                int exs = WEXITSTATUS(stat);
-                if (exs != 0) *err = JUSTIN_ERR_SUBPROC(exs);
-                goto close_map;
-            }
-            justin_log_warn("Child process did not terminate normally");
-            *err = JUSTIN_ERR_ASSERTION;
-            goto close_map;
+    }
+    justin_ccache_t cc = JUSTIN_CCACHE_INITIALIZER;
+    size_t ccache_envc = justin_ccache_prepare(ctx, path, &cc, err);
+    if ((*err) != JUSTIN_ERR_OK) {
+        justin_log_err_soft(*err);
+        *err = JUSTIN_ERR_OK;
+    }
+    memcpy(&env[envc], cc.env, ccache_envc * sizeof(char*));
+    envc += ccache_envc;
+    env[envc] = NULL;
+
+    justin_proc_opts_t opts = JUSTIN_PROC_OPTS_INITIALIZER;
+    opts.cwd = path;
+    opts.user = ctx->storage->user;
+    opts.env_add = env;
+    // Full builds are timed against their history, and added to it if they succeed and packaged the whole base
+    char base[128] = "build";
+    char version[JUSTIN_HISTORY_VERSION_MAX] = "";
+    bool timed = full && justin_pkg_base_info(path, base, sizeof base, version, sizeof version);
+    justin_history_eta eta;
+    justin_history_eta_start(&eta, base, timed ? justin_history_estimate(ctx->storage, base, version) : 0);
+    eta.on_output = justin_buildlog_write;
+    eta.output_data = log;
+    if (log != NULL) {
+        opts.on_output = justin_history_eta_write;
+        opts.output_data = &eta;
+    }
+    justin_cgroup_t cg = JUSTIN_CGROUP_INITIALIZER;
+    justin_cgroup_create(ctx, &cg, err);
+    if ((*err) != JUSTIN_ERR_OK) {
+        justin_log_err_soft(*err);
+        *err = JUSTIN_ERR_OK;
+    }
+    opts.cgroup_fd = cg.procs_fd;
+    opts.kill_fd = cg.kill_fd;
+    // The steps before a build need nothing installed
+    justin_sandbox_t sandbox = JUSTIN_SANDBOX_INITIALIZER;
+    char *vcs_dir = NULL;
+    char *ccache_dir = NULL;
+    if (ctx->params->f_sandbox && full) {
+        const char *binds[4] = { srcdest_dir, NULL, NULL, NULL };
+        size_t bindc = 1;
+        if (vcs.builddir != NULL) {
+            if (asprintf(&vcs_dir, "%s/%s", vcs.builddir, vcs.base) == -1) vcs_dir = NULL;
+            if (vcs_dir == NULL) *err = JUSTIN_ERR_NOMEM;
+            binds[bindc++] = vcs_dir;
+        }
+        if (ccache_envc != 0 && (*err) == JUSTIN_ERR_OK) {
+            ccache_dir = justin_storage_path(ctx->storage, JUSTIN_CCACHE_DIR, "", err);
+            binds[bindc++] = ccache_dir;
         }
+        if ((*err) == JUSTIN_ERR_OK) justin_sandbox_create(ctx, path, binds, &sandbox, err);
+        opts.setup = justin_sandbox_enter;
+        opts.setup_data = &sandbox;
     }
+    justin_proc_result_t result;
+    if ((*err) == JUSTIN_ERR_OK) justin_proc_run(PATH2_MAKEPKG_S, argv, &opts, &result, err);
+    justin_sandbox_destroy(&sandbox);
+    free(vcs_dir);
+    free(ccache_dir);
+    free(srcdest_dir);
+    uint64_t peak = justin_cgroup_finish(full ? base : NULL, &cg);
+    justin_ccache_finish(path, &cc);
+    free(argv);
+    free(srcdest);
+    free(builddir);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    justin_proc_log_usage("makepkg", &result);
+    justin_proc_check(&result, err);
+    if ((*err) != JUSTIN_ERR_OK && log != NULL) justin_buildlog_print_tail(log, JUSTIN_BUILDLOG_TAIL_LINES);
+    // Only full builds leave checkouts at the commit that was built
+    if ((*err) == JUSTIN_ERR_OK && full) justin_vcs_record(ctx, path, &vcs);
+    if ((*err) == JUSTIN_ERR_OK && timed && pkgnames == NULL) {
+        const struct rusage *u = &result.usage;
+        justin_history_record record;
+        record.time = (int64_t) time(NULL);
+        record.wall_ms = justin_history_eta_elapsed(&eta);
+        record.cpu_ms = ((uint64_t) (u->ru_utime.tv_sec + u->ru_stime.tv_sec) * 1000) +
+                ((uint64_t) (u->ru_utime.tv_usec + u->ru_stime.tv_usec) / 1000);
+        // ru_maxrss is the largest single process; the cgroup knows the peak of the build as a whole
+        record.peak_kib = peak != 0 ? peak >> 10 : (uint64_t) u->ru_maxrss;
+        memcpy(record.version, version, sizeof version);
+        justin_history_add(ctx->storage, base, &record);
+    }
+
+    ex:
+    justin_vcs_release(&vcs);
+}
+
+void justin_pkg_make(justin_context ctx, const char *path, justin_buildlog log, justin_err *err) {
+    justin_pkg_make_run(ctx, path, NULL, true, NULL, log, err);
+}
+
+void justin_pkg_make_split(justin_context ctx, const char *path, const char *pkgnames, justin_buildlog log, justin_err *err) {
+    if (pkgnames == NULL) {
+        justin_pkg_make(ctx, path, log, err);
+        return;
+    }
+    char *const args[] = { "--pkg", (char*) pkgnames, NULL };
+    justin_pkg_make_run(ctx, path, args, true, pkgnames, log, err);
+}
 
-    close_map:
-    if (*err == JUSTIN_ERR_OK) memcpy(err, shared_err, sizeof(justin_err));
-    int unmap_err = munmap(shared_err, sizeof(justin_err));
-    if (unmap_err == -1 && *err == JUSTIN_ERR_OK) *err = JUSTIN_ERR_SYSTEM;
+void justin_pkg_make_args(justin_context ctx, const char *path, char *const args[], justin_buildlog log, justin_err *err) {
+    justin_pkg_make_run(ctx, path, args, args == NULL, NULL, log, err);
 }
 
 void justin_pkg_install(justin_context ctx, const char *file, justin_err *err) {
+    justin_pkg_install_flags(ctx, file, ALPM_TRANS_FLAG_ALLEXPLICIT, err);
+}
+
+void justin_pkg_install_locked(justin_context ctx, const char *file, int flags, justin_err *err) {
     alpm_db_t *db = ctx->alpm_db;
     alpm_handle_t *handle = alpm_db_get_handle(db);
 
     justin_log_debug("Initializing transaction");
-    if (alpm_trans_init(handle, ALPM_TRANS_FLAG_ALLEXPLICIT) != 0) {
+    if (alpm_trans_init(handle, flags) != 0) {
         *err = JUSTIN_ERR_ALPM;
         return;
     }
@@ -168,6 +367,12 @@ void justin_pkg_install(justin_context ctx, const char *file, justin_err *err) {
     *err = JUSTIN_ERR_OK;
 }
 
+void justin_pkg_install_flags(justin_context ctx, const char *file, int flags, justin_err *err) {
+    justin_context_alpm_lock(ctx);
+    justin_pkg_install_locked(ctx, file, flags, err);
+    justin_context_alpm_unlock(ctx);
+}
+
 struct justin_pkg_target_list_t {
     const char *dir;
     DIR *dirent;
@@ -198,7 +403,7 @@ justin_pkg_target_list justin_pkg_target_list_create(const char *path, justin_er
     ret->dirent = dirent;
     ret->dirent_open = true;
 
-    char *path_box = (char*) (ret + sizeof(struct justin_pkg_target_list_t));
+    char *path_box = (char*) &ret[1];
     memcpy(path_box, path, path_len);
     path_box[path_len] = '\0';
     ret->dir = path_box;
@@ -220,6 +425,7 @@ justin_pkg_target_list justin_pkg_target_list_create(const char *path, justin_er
 }
 
 void justin_pkg_target_list_destroy(justin_pkg_target_list tl) {
+    for (size_t i=0; i < tl->cache_len; i++) free(tl->cache[i]);
     free(tl->cache);
     if (tl->selection != NULL) free(tl->selection);
     if (tl->dirent_open) {
@@ -228,6 +434,7 @@ void justin_pkg_target_list_destroy(justin_pkg_target_list tl) {
     free(tl);
 }
 
+// Takes ownership of name
 void justin_pkg_target_list_insert(justin_pkg_target_list tl, char *name, justin_err *err) {
     size_t cap = tl->cache_capacity;
     size_t len = tl->cache_len;
@@ -237,8 +444,10 @@ void justin_pkg_target_list_insert(justin_pkg_target_list tl, char *name, justin
         cache = (char**) reallocarray(cache, cap, sizeof(char*));
         if (cache == NULL) {
             *err = JUSTIN_ERR_NOMEM;
+            free(name);
             return;
         }
+        tl->cache = cache;
         tl->cache_capacity = cap;
     }
     cache[len] = name;
@@ -251,14 +460,18 @@ const char* justin_pkg_target_list_next(justin_pkg_target_list tl, justin_err *e
         errno = 0;
         struct dirent *ent;
         char *name;
-        char *in;
         while ((ent = readdir(tl->dirent)) != NULL) {
             if (ent->d_type != DT_REG) continue;
             name = ent->d_name;
-            in = strcasestr(name, PKG_EXT_S);
-            if (in == NULL) continue;
-            if (in[PKG_EXT_L] != '\0') continue; // ends with
+            if (!justin_pkg_is_archive(name)) continue;
+            // The dirent entry is only valid until the next readdir, so the list keeps its own copy
+            name = strdup(name);
+            if (name == NULL) {
+                *err = JUSTIN_ERR_NOMEM;
+                return NULL;
+            }
             justin_pkg_target_list_insert(tl, name, err);
+            if ((*err) != JUSTIN_ERR_OK) return NULL;
             return name;
         }
         if (errno != 0) {
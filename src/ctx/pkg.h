@@ -17,14 +17,58 @@
 #include <stdbool.h>
 #include "../logging.h"
 #include "../context.h"
+#include "buildlog.h"
 
 #ifndef JUSTIN_PKG_H
 #define JUSTIN_PKG_H
 
-void justin_pkg_make(uid_t user, const char *path, justin_err *err);
+/**
+ * Runs makepkg as the storage user in the given directory, with MAKEFLAGS derived from the context resources unless
+ * set in the environment. Output is captured by "log" if not NULL, and the end of it is printed if the build fails.
+ */
+void justin_pkg_make(justin_context ctx, const char *path, justin_buildlog log, justin_err *err);
+
+/**
+ * Like justin_pkg_make, with a NULL-terminated list of extra arguments, e.g. { "--verifysource", NULL }
+ */
+void justin_pkg_make_args(justin_context ctx, const char *path, char *const args[], justin_buildlog log, justin_err *err);
+
+/**
+ * Like justin_pkg_make, packaging only the given pkgnames (comma-separated) of a split base; NULL for all of them.
+ * The whole base is still built, but the packages that are not wanted are never archived.
+ */
+void justin_pkg_make_split(justin_context ctx, const char *path, const char *pkgnames, justin_buildlog log, justin_err *err);
 
 void justin_pkg_install(justin_context ctx, const char *file, justin_err *err);
 
+/**
+ * True if the file name has the extension of a package archive (.pkg.tar, optionally compressed)
+ */
+bool justin_pkg_is_archive(const char *name);
+
+/**
+ * Reads the pkgbase and, if "version" is not NULL, the full version from the .SRCINFO in "path". Returns false if
+ * there is no readable .SRCINFO, in which case the base is "build" (good enough for reports) and the version empty.
+ */
+bool justin_pkg_base_info(const char *path, char *base, size_t base_size, char *version, size_t version_size);
+
+/**
+ * Length of the package name at the start of an archive file name, <name>-<pkgver>-<pkgrel>-<arch><ext>
+ */
+size_t justin_pkg_archive_name_len(const char *file);
+
+/**
+ * Reads the .SRCINFO in "path" and returns the given pkgnames as a list for justin_pkg_make_split, or NULL if they
+ * are all the packages of the base (or there is no .SRCINFO). A name that is not a package of the base is an error.
+ */
+char *justin_pkg_split_select(const char *path, const char *const *names, size_t count, justin_err *err);
+
+/**
+ * Like justin_pkg_install, with the given alpm transaction flags (e.g. ALPM_TRANS_FLAG_ALLDEPS to install as a
+ * dependency)
+ */
+void justin_pkg_install_flags(justin_context ctx, const char *file, int flags, justin_err *err);
+
 struct justin_pkg_target_list_t;
 typedef struct justin_pkg_target_list_t *justin_pkg_target_list;
 
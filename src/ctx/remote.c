@@ -0,0 +1,687 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <git2.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "aur.h"
+#include "repo.h"
+#include "pkg.h"
+#include "remote.h"
+
+#define REMOTE_LINE_MAX 512
+
+// Seconds to wait for a connection, a greeting or a job before giving up on the other side
+#define REMOTE_TIMEOUT 10
+
+// Seconds a worker may go without sending anything during a build before it is given up on
+#define REMOTE_BUILD_TIMEOUT 1800
+
+// Characters of AUR package names, and of the comma-separated lists of them
+static const char *REMOTE_NAME_CHARS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789@._+-";
+static const char *REMOTE_LIST_CHARS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789@._+-,";
+static const char *REMOTE_HEX_CHARS = "0123456789abcdef";
+
+typedef struct justin_remote_worker {
+    char *addr;
+    unsigned int slots;     // builds the worker takes at once, from its greeting
+    unsigned int running;   // builds of this run on it
+    bool down;
+} justin_remote_worker;
+
+struct justin_remote_pool_t {
+    justin_remote_worker *workers;
+    size_t len;
+    unsigned int local_slots;
+    unsigned int local_running;
+    uid_t user;
+    pthread_mutex_t mutex;
+    pthread_cond_t freed;
+};
+
+// Builds the worker is running, for its greeting
+static unsigned int REMOTE_RUNNING = 0;
+
+// Sockets
+
+// Makes reads and writes on a blocking socket fail after "seconds" without progress
+bool justin_remote_timeout(int fd, int seconds) {
+    struct timeval tv = { seconds, 0 };
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv) == 0;
+}
+
+// Connects a nonblocking socket within REMOTE_TIMEOUT and makes it blocking again, with REMOTE_TIMEOUT on its I/O
+bool justin_remote_connect_fd(int fd, const struct sockaddr *addr, socklen_t addr_len) {
+    if (connect(fd, addr, addr_len) == -1) {
+        if (errno != EINPROGRESS && errno != EAGAIN) return false;
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int n;
+        do {
+            n = poll(&pfd, 1, REMOTE_TIMEOUT * 1000);
+        } while (n == -1 && errno == EINTR);
+        if (n != 1) return false;
+        int so_err = 0;
+        socklen_t so_err_len = sizeof so_err;
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_err, &so_err_len) == -1 || so_err != 0) return false;
+    }
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == 0 && justin_remote_timeout(fd, REMOTE_TIMEOUT);
+}
+
+// Returns a connected socket, or -1. "addr" is an absolute path for a UNIX socket, host:port otherwise.
+int justin_remote_connect(const char *addr) {
+    int fd;
+    if (addr[0] == '/') {
+        struct sockaddr_un un = { 0 };
+        un.sun_family = AF_UNIX;
+        if (strlen(addr) >= sizeof un.sun_path) return -1;
+        strcpy(un.sun_path, addr);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd == -1) return -1;
+        if (justin_remote_connect_fd(fd, (struct sockaddr*) &un, sizeof un)) return fd;
+        close(fd);
+        return -1;
+    }
+
+    const char *colon = strrchr(addr, ':');
+    if (colon == NULL) return -1;
+    char *host = strndup(addr, colon - addr);
+    if (host == NULL) return -1;
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res;
+    int gai = getaddrinfo(host, &colon[1], &hints, &res);
+    free(host);
+    if (gai != 0) return -1;
+    fd = -1;
+    for (struct addrinfo *ai = res; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd != -1 && !justin_remote_connect_fd(fd, ai->ai_addr, ai->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int justin_remote_listen(const char *addr) {
+    int fd;
+    if (addr[0] == '/') {
+        struct sockaddr_un un = { 0 };
+        un.sun_family = AF_UNIX;
+        if (strlen(addr) >= sizeof un.sun_path) return -1;
+        strcpy(un.sun_path, addr);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        // Left behind by an earlier worker
+        unlink(addr);
+        if (bind(fd, (struct sockaddr*) &un, sizeof un) == 0 && chmod(addr, 0600) == 0 && listen(fd, 16) == 0) return fd;
+        close(fd);
+        return -1;
+    }
+
+    const char *colon = strrchr(addr, ':');
+    if (colon == NULL) return -1;
+    char *host = strndup(addr, colon - addr);
+    if (host == NULL) return -1;
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *res;
+    int gai = getaddrinfo(host[0] == '\0' ? NULL : host, &colon[1], &hints, &res);
+    free(host);
+    if (gai != 0) return -1;
+    fd = -1;
+    int one = 1;
+    for (struct addrinfo *ai = res; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1 || listen(fd, 16) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// A closed connection must not kill the process with SIGPIPE
+bool justin_remote_write(int fd, const void *buf, size_t len) {
+    const char *p = (const char*) buf;
+    ssize_t w;
+    while (len > 0) {
+        w = send(fd, p, len, MSG_NOSIGNAL);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        len -= w;
+    }
+    return true;
+}
+
+bool justin_remote_read(int fd, void *buf, size_t len) {
+    char *p = (char*) buf;
+    ssize_t r;
+    while (len > 0) {
+        r = read(fd, p, len);
+        if (r == -1 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        len -= r;
+    }
+    return true;
+}
+
+// Reads a line without the newline. The header lines are few and short, one byte at a time is fine.
+bool justin_remote_read_line(int fd, char *buf, size_t size) {
+    size_t len = 0;
+    char c;
+    while (justin_remote_read(fd, &c, 1)) {
+        if (c == '\n') {
+            buf[len] = '\0';
+            return true;
+        }
+        if (len + 1 >= size) return false;
+        buf[len++] = c;
+    }
+    return false;
+}
+
+bool justin_remote_send_frame(int fd, char type, const void *buf, size_t len) {
+    unsigned char head[5];
+    head[0] = (unsigned char) type;
+    head[1] = (unsigned char) (len >> 24);
+    head[2] = (unsigned char) (len >> 16);
+    head[3] = (unsigned char) (len >> 8);
+    head[4] = (unsigned char) len;
+    return justin_remote_write(fd, head, sizeof head) && justin_remote_write(fd, buf, len);
+}
+
+bool justin_remote_read_frame_head(int fd, char *type, size_t *len) {
+    unsigned char head[5];
+    if (!justin_remote_read(fd, head, sizeof head)) return false;
+    *type = (char) head[0];
+    *len = ((size_t) head[1] << 24) | ((size_t) head[2] << 16) | ((size_t) head[3] << 8) | (size_t) head[4];
+    return true;
+}
+
+bool justin_remote_valid(const char *str, const char *chars, size_t max) {
+    size_t len = strlen(str);
+    return len != 0 && len <= max && strspn(str, chars) == len && str[0] != '.' && str[0] != '-';
+}
+
+// Coordinator
+
+bool justin_remote_greeting(int fd, unsigned int *slots, unsigned int *running) {
+    char line[REMOTE_LINE_MAX];
+    unsigned int version;
+    if (!justin_remote_read_line(fd, line, sizeof line)) return false;
+    if (sscanf(line, "justin %u %u %u", &version, slots, running) != 3) return false;
+    return version == JUSTIN_REMOTE_VERSION && (*slots) != 0;
+}
+
+justin_remote_pool justin_remote_pool_create(justin_context ctx, const char *addrs, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_remote_pool pool = (justin_remote_pool) calloc(1, sizeof(struct justin_remote_pool_t));
+    if (pool == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    size_t count = 1;
+    for (const char *c = addrs; *c != '\0'; c++) {
+        if (*c == ',') count++;
+    }
+    pool->workers = (justin_remote_worker*) calloc(count, sizeof(justin_remote_worker));
+    if (pool->workers == NULL) {
+        free(pool);
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    pool->local_slots = ctx->resources.builds;
+    pool->user = ctx->storage->user;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->freed, NULL);
+
+    const char *start = addrs;
+    const char *end;
+    size_t up = 0;
+    char buf[256];
+    do {
+        end = strchr(start, ',');
+        if (end == NULL) end = &start[strlen(start)];
+        justin_remote_worker *w = &pool->workers[pool->len];
+        w->addr = strndup(start, end - start);
+        if (w->addr == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            justin_remote_pool_free(pool);
+            return NULL;
+        }
+        pool->len++;
+        unsigned int running;
+        int fd = justin_remote_connect(w->addr);
+        w->down = fd == -1 || !justin_remote_greeting(fd, &w->slots, &running);
+        if (fd != -1) close(fd);
+        if (w->down) {
+            snprintf(buf, sizeof buf, "Build worker %.200s does not answer, leaving it out", w->addr);
+            justin_log_warn(buf);
+        } else {
+            snprintf(buf, sizeof buf, "Build worker: %s%.200s %s:: %s%u at once", BYEL, w->addr, BWHT, WHT, w->slots);
+            justin_log_info(buf);
+            up++;
+        }
+        start = end + 1;
+    } while (*end != '\0');
+
+    if (up == 0) {
+        justin_remote_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+unsigned int justin_remote_pool_slots(justin_remote_pool pool) {
+    if (pool == NULL) return 0;
+    unsigned int slots = 0;
+    for (size_t i=0; i < pool->len; i++) {
+        if (!pool->workers[i].down) slots += pool->workers[i].slots;
+    }
+    return slots;
+}
+
+int justin_remote_acquire(justin_remote_pool pool, bool remote) {
+    if (pool == NULL) return -1;
+    pthread_mutex_lock(&pool->mutex);
+    int best;
+    unsigned int best_running, best_slots;
+    justin_remote_worker *w;
+    while (1) {
+        // This machine first, it wins ties since its builds need no copying
+        best = pool->local_running < pool->local_slots ? -1 : -2;
+        best_running = pool->local_running;
+        best_slots = pool->local_slots;
+        for (size_t i=0; remote && i < pool->len; i++) {
+            w = &pool->workers[i];
+            if (w->down || w->running >= w->slots) continue;
+            if (best == -2 || (uint64_t) w->running * best_slots < (uint64_t) best_running * w->slots) {
+                best = (int) i;
+                best_running = w->running;
+                best_slots = w->slots;
+            }
+        }
+        if (best != -2) break;
+        pthread_cond_wait(&pool->freed, &pool->mutex);
+    }
+    if (best == -1) {
+        pool->local_running++;
+    } else {
+        pool->workers[best].running++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return best;
+}
+
+void justin_remote_release(justin_remote_pool pool, int slot) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->mutex);
+    if (slot < 0) {
+        pool->local_running--;
+    } else {
+        pool->workers[slot].running--;
+    }
+    pthread_cond_broadcast(&pool->freed);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Removes the packages of a job that did not finish, so that the local build starts from a clean directory
+void justin_remote_discard(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+    struct dirent *ent;
+    char path[PATH_MAX];
+    while ((ent = readdir(d)) != NULL) {
+        if (!justin_pkg_is_archive(ent->d_name)) continue;
+        snprintf(path, sizeof path, "%s/%s", dir, ent->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+bool justin_remote_build(justin_remote_pool pool, int slot, const justin_remote_job *job, const char *dir, justin_buildlog log, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_remote_worker *w = &pool->workers[slot];
+    char buf[256];
+    unsigned int slots, running;
+    int fd = justin_remote_connect(w->addr);
+    if (fd == -1 || !justin_remote_greeting(fd, &slots, &running)) {
+        snprintf(buf, sizeof buf, "Build worker %.200s is gone, building %.32s locally", w->addr, job->base);
+        justin_log_warn(buf);
+        pthread_mutex_lock(&pool->mutex);
+        w->down = true;
+        pthread_mutex_unlock(&pool->mutex);
+        if (fd != -1) close(fd);
+        return false;
+    }
+    // Busy with the builds of another coordinator
+    if (running >= slots) {
+        close(fd);
+        return false;
+    }
+
+    char *head;
+    int head_len = asprintf(&head, "base %s\nname %s\ncommit %s\n%s%s%s\n", job->base, job->name, job->commit,
+                            job->pkgnames != NULL ? "pkgnames " : "", job->pkgnames != NULL ? job->pkgnames : "",
+                            job->pkgnames != NULL ? "\n" : "");
+    if (head_len == -1) {
+        close(fd);
+        *err = JUSTIN_ERR_NOMEM;
+        return true;
+    }
+    // Builds can be quiet for a long time, in the link step say
+    bool ok = justin_remote_write(fd, head, (size_t) head_len) && justin_remote_timeout(fd, REMOTE_BUILD_TIMEOUT);
+    free(head);
+    snprintf(buf, sizeof buf, "Building: %s%.128s %s:: %son %.100s", BYEL, job->base, BWHT, WHT, w->addr);
+    justin_log_info(buf);
+
+    char *chunk = (char*) malloc(JUSTIN_REMOTE_CHUNK + 1);
+    if (chunk == NULL) ok = false;
+    int out = -1;
+    bool done = false;
+    bool busy = false;
+    char type;
+    size_t len;
+    justin_err result = JUSTIN_ERR_OK;
+    while (ok && !done && justin_remote_read_frame_head(fd, &type, &len)) {
+        if (len > JUSTIN_REMOTE_CHUNK || !justin_remote_read(fd, chunk, len)) break;
+        chunk[len] = '\0';
+        switch (type) {
+            case 'L':
+                if (log != NULL) justin_buildlog_write(log, chunk, len);
+                break;
+            case 'F': {
+                if (out != -1) close(out);
+                out = -1;
+                // Only package files, and only into the build directory
+                if (strlen(chunk) != len || strchr(chunk, '/') != NULL || !justin_pkg_is_archive(chunk)) {
+                    ok = false;
+                    break;
+                }
+                char path[PATH_MAX];
+                snprintf(path, sizeof path, "%s/%s", dir, chunk);
+                out = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                ok = out != -1 && fchown(out, pool->user, -1) == 0;
+                break;
+            }
+            case 'D':
+                ok = out != -1 && write(out, chunk, len) == (ssize_t) len;
+                break;
+            case 'R':
+                done = sscanf(chunk, "%lld", (long long*) &result) == 1;
+                ok = done;
+                break;
+            case 'B':
+                busy = true;
+                ok = false;
+                break;
+            default:
+                ok = false;
+                break;
+        }
+    }
+    if (out != -1 && close(out) == -1) ok = false;
+    free(chunk);
+    close(fd);
+
+    if (busy) {
+        justin_remote_discard(dir);
+        return false;
+    }
+    if (!done || !ok) {
+        snprintf(buf, sizeof buf, "Build worker %.200s lost %.32s, building it locally", w->addr, job->base);
+        justin_log_warn(buf);
+        justin_remote_discard(dir);
+        return false;
+    }
+    if (result == JUSTIN_ERR_DEPENDENCY) {
+        snprintf(buf, sizeof buf, "Build worker %.200s can not install the dependencies of %.32s, building it locally", w->addr, job->base);
+        justin_log_info(buf);
+        justin_remote_discard(dir);
+        return false;
+    }
+    *err = result;
+    return true;
+}
+
+void justin_remote_pool_free(justin_remote_pool pool) {
+    if (pool == NULL) return;
+    for (size_t i=0; i < pool->len; i++) free(pool->workers[i].addr);
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->freed);
+    free(pool);
+}
+
+// Worker
+
+typedef struct justin_remote_conn {
+    justin_context ctx;
+    int fd;
+    bool broken;
+} justin_remote_conn;
+
+void justin_remote_tee(void *data, const char *buf, size_t len) {
+    justin_remote_conn *conn = (justin_remote_conn*) data;
+    size_t n;
+    while (!conn->broken && len > 0) {
+        n = len > JUSTIN_REMOTE_CHUNK ? JUSTIN_REMOTE_CHUNK : len;
+        if (!justin_remote_send_frame(conn->fd, 'L', buf, n)) conn->broken = true;
+        buf += n;
+        len -= n;
+    }
+}
+
+bool justin_remote_send_file(int fd, const char *dir, const char *name, char *chunk) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in == -1) return false;
+    bool ok = justin_remote_send_frame(fd, 'F', name, strlen(name));
+    ssize_t r;
+    while (ok && (r = read(in, chunk, JUSTIN_REMOTE_CHUNK)) != 0) {
+        if (r == -1) {
+            ok = errno == EINTR;
+            continue;
+        }
+        ok = justin_remote_send_frame(fd, 'D', chunk, (size_t) r);
+    }
+    close(in);
+    return ok;
+}
+
+bool justin_remote_send_packages(int fd, const char *dir) {
+    char *chunk = (char*) malloc(JUSTIN_REMOTE_CHUNK);
+    if (chunk == NULL) return false;
+    DIR *d = opendir(dir);
+    bool ok = d != NULL;
+    struct dirent *ent;
+    while (ok && (ent = readdir(d)) != NULL) {
+        if (justin_pkg_is_archive(ent->d_name)) ok = justin_remote_send_file(fd, dir, ent->d_name, chunk);
+    }
+    if (d != NULL) closedir(d);
+    free(chunk);
+    return ok;
+}
+
+void justin_remote_job_run(justin_remote_conn *conn, const justin_remote_job *job, justin_err *err) {
+    justin_context ctx = conn->ctx;
+    char *dir = justin_storage_build_dir_create(ctx->storage, job->base, err);
+    if ((*err) != JUSTIN_ERR_OK) return;
+    bool built = false;
+
+    justin_aur_project_t project = { 0 };
+    project.name = job->name;
+    project.base = job->base;
+    git_repository *repo = justin_aur_project_clone_into(ctx, &project, dir, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    git_oid oid;
+    git_commit *commit = NULL;
+    if (git_oid_fromstr(&oid, job->commit) != 0 || git_commit_lookup(&commit, repo, &oid) != 0) {
+        *err = JUSTIN_ERR_GIT;
+    } else {
+        justin_repo_checkout_into(repo, commit, dir, err);
+        if ((*err) == JUSTIN_ERR_OK && justin_util_chown_r(dir, ctx->storage->user) != 0) *err = JUSTIN_ERR_SYSTEM;
+    }
+    git_commit_free(commit);
+    git_repository_free(repo);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    justin_buildlog log = justin_buildlog_open(ctx, job->base);
+    if (log != NULL) justin_buildlog_tee(log, justin_remote_tee, conn);
+    built = true;
+    justin_pkg_make_split(ctx, dir, job->pkgnames, log, err);
+    justin_buildlog_close(log);
+    if ((*err) == JUSTIN_ERR_OK && !justin_remote_send_packages(conn->fd, dir)) conn->broken = true;
+
+    ex:
+    justin_storage_build_dir_done(ctx->storage, job->base, dir, built);
+}
+
+void *justin_remote_conn_run(void *arg) {
+    justin_remote_conn *conn = (justin_remote_conn*) arg;
+    char line[REMOTE_LINE_MAX];
+    char base[REMOTE_LINE_MAX] = "";
+    char name[REMOTE_LINE_MAX] = "";
+    char commit[REMOTE_LINE_MAX] = "";
+    char pkgnames[REMOTE_LINE_MAX] = "";
+    unsigned int slots = conn->ctx->resources.builds;
+    unsigned int running = __atomic_load_n(&REMOTE_RUNNING, __ATOMIC_RELAXED);
+    snprintf(line, sizeof line, "justin %d %u %u\n", JUSTIN_REMOTE_VERSION, slots, running);
+    if (!justin_remote_timeout(conn->fd, REMOTE_TIMEOUT) || !justin_remote_write(conn->fd, line, strlen(line))) goto ex;
+
+    // A coordinator that only wanted the greeting hangs up here
+    char *value;
+    while (justin_remote_read_line(conn->fd, line, sizeof line) && line[0] != '\0') {
+        value = strchr(line, ' ');
+        if (value == NULL) goto ex;
+        *(value++) = '\0';
+        if (strcmp(line, "base") == 0) {
+            strcpy(base, value);
+        } else if (strcmp(line, "name") == 0) {
+            strcpy(name, value);
+        } else if (strcmp(line, "commit") == 0) {
+            strcpy(commit, value);
+        } else if (strcmp(line, "pkgnames") == 0) {
+            strcpy(pkgnames, value);
+        }
+    }
+    // The names end up in paths and URLs
+    if (!justin_remote_valid(base, REMOTE_NAME_CHARS, 255) || !justin_remote_valid(name, REMOTE_NAME_CHARS, 255) ||
+            strlen(commit) != GIT_OID_HEXSZ || strspn(commit, REMOTE_HEX_CHARS) != GIT_OID_HEXSZ ||
+            (pkgnames[0] != '\0' && !justin_remote_valid(pkgnames, REMOTE_LIST_CHARS, sizeof pkgnames))) {
+        goto ex;
+    }
+
+    // The greeting is stale by now, other coordinators may have taken the last build in the meantime
+    if (__atomic_add_fetch(&REMOTE_RUNNING, 1, __ATOMIC_RELAXED) > slots) {
+        __atomic_sub_fetch(&REMOTE_RUNNING, 1, __ATOMIC_RELAXED);
+        justin_remote_send_frame(conn->fd, 'B', "", 0);
+        goto ex;
+    }
+
+    justin_remote_job job = { base, name, commit, pkgnames[0] == '\0' ? NULL : pkgnames };
+    char buf[256];
+    snprintf(buf, sizeof buf, "Building: %s%.128s %s:: %s%.40s", BYEL, base, BWHT, WHT, commit);
+    justin_log_info(buf);
+    justin_err err;
+    justin_remote_job_run(conn, &job, &err);
+    __atomic_sub_fetch(&REMOTE_RUNNING, 1, __ATOMIC_RELAXED);
+    if (err != JUSTIN_ERR_OK) justin_log_err_msg(err, base);
+
+    snprintf(line, sizeof line, "%lld", (long long) err);
+    if (!conn->broken) justin_remote_send_frame(conn->fd, 'R', line, strlen(line));
+
+    ex:
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+void justin_remote_serve(justin_context ctx, const char *addr, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    int fd = justin_remote_listen(addr);
+    if (fd == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    char buf[256];
+    snprintf(buf, sizeof buf, "Waiting for builds on %.200s, %u at once", addr, ctx->resources.builds);
+    justin_log_info(buf);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int client;
+    while (1) {
+        client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
+        }
+        justin_remote_conn *conn = (justin_remote_conn*) malloc(sizeof(justin_remote_conn));
+        if (conn == NULL) {
+            close(client);
+            justin_log_err_soft(JUSTIN_ERR_NOMEM);
+            continue;
+        }
+        conn->ctx = ctx;
+        conn->fd = client;
+        conn->broken = false;
+        if (pthread_create(&thread, &attr, justin_remote_conn_run, conn) != 0) {
+            close(client);
+            free(conn);
+            justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        }
+    }
+    pthread_attr_destroy(&attr);
+    close(fd);
+}
@@ -0,0 +1,93 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include "../context.h"
+#include "../logging.h"
+#include "buildlog.h"
+
+#ifndef JUSTIN_REMOTE_H
+#define JUSTIN_REMOTE_H
+
+/*
+ * Distributed builds. "-W<addr>" turns a machine into a build worker, listening on a UNIX socket (an absolute path)
+ * or on TCP (host:port); "-w<addr>,<addr>,..." has the build stage of the pipeline hand bases to such workers, the
+ * least loaded first (the lowest share of its builds in use, counting this machine as one more worker). A job is the
+ * pkgbase, a package name to clone it by, the commit to build and the pkgnames to package. The worker clones the base
+ * itself, builds it with justin_pkg_make in its sandbox and streams the build output and the packages back.
+ *
+ * Only bases without AUR dependencies in the same run are sent out, since the workers do not have those packages, and
+ * a worker that cannot install the dependencies of a base leaves it to be built locally. Nothing is authenticated:
+ * listen on TCP only on a trusted network.
+ *
+ * Protocol: the worker greets with "justin <version> <slots> <running>\n". The coordinator sends the job as
+ * "<key> <value>\n" lines ended by an empty line. The worker answers with frames of a type byte and a 32-bit
+ * big-endian length: 'L' build output, 'F' the name of a package file followed by 'D' frames with its content, and
+ * last 'R' with the result (a justin_err) as decimal text. A worker whose builds were all taken since its greeting
+ * answers with a single empty 'B' frame instead.
+ *
+ * Connecting, the greeting and the job time out after a few seconds, and a build after half an hour without any
+ * output; the base is then built locally.
+ */
+
+#define JUSTIN_REMOTE_VERSION 1
+#define JUSTIN_REMOTE_CHUNK 65536
+
+typedef struct justin_remote_job {
+    const char *base;
+    const char *name;
+    const char *commit;     // hex oid
+    const char *pkgnames;   // see justin_pkg_make_split, NULL for all
+} justin_remote_job;
+
+struct justin_remote_pool_t;
+typedef struct justin_remote_pool_t *justin_remote_pool;
+
+/**
+ * Asks each of the comma-separated workers how many builds it takes at once. Workers that do not answer are left out
+ * with a warning; NULL is returned if none do.
+ */
+justin_remote_pool justin_remote_pool_create(justin_context ctx, const char *addrs, justin_err *err);
+
+/**
+ * Builds the workers of the pool take at once, in total
+ */
+unsigned int justin_remote_pool_slots(justin_remote_pool pool);
+
+/**
+ * Waits for a free build slot and takes it: the index of a worker, or -1 for this machine. Only this machine is
+ * considered if "remote" is false. With a NULL pool, returns -1 right away.
+ */
+int justin_remote_acquire(justin_remote_pool pool, bool remote);
+
+void justin_remote_release(justin_remote_pool pool, int slot);
+
+/**
+ * Runs a job on the worker in "slot", writing its output to "log" and its packages to "dir". Returns false if the
+ * worker did not take the job or could not finish it for reasons of its own (unreachable, busy, missing
+ * dependencies), in which case the base should be built locally; otherwise "err" is the result of the build.
+ */
+bool justin_remote_build(justin_remote_pool pool, int slot, const justin_remote_job *job, const char *dir, justin_buildlog log, justin_err *err);
+
+void justin_remote_pool_free(justin_remote_pool pool);
+
+/**
+ * Takes jobs on "addr" until the process is stopped, each connection on a thread of its own. A worker that is running
+ * as many builds as it takes at once says so in its greeting, and the coordinator looks elsewhere.
+ */
+void justin_remote_serve(justin_context ctx, const char *addr, justin_err *err);
+
+#endif //JUSTIN_REMOTE_H
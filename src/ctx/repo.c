@@ -17,248 +17,361 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
 #include "../ansi.h"
 #include "../util.h"
+#include "../term.h"
 #include "repo.h"
 
 //
 
-justin_repo_commit_list justin_repo_commit_list_create(git_repository *repo, justin_err *err) {
+justin_repo_commit_list justin_repo_commit_list_create(git_repository *repo, justin_storage storage, const char *name, justin_err *err) {
     *err = JUSTIN_ERR_OK;
 
-    git_reference *head;
-    if (git_repository_head(&head, repo) != 0) {
-        *err = JUSTIN_ERR_GIT;
-        return NULL;
-    }
-
-    git_annotated_commit *commit;
-    if (git_annotated_commit_from_ref(&commit, repo, head) != 0) {
-        git_reference_free(head);
-        *err = JUSTIN_ERR_GIT;
-        return NULL;
-    }
+    justin_meta meta = justin_meta_open(storage, name, err);
+    if (meta == NULL) return NULL;
 
-    const git_oid *oid = git_annotated_commit_id(commit);
-    git_commit *un_commit;
-    if (git_commit_lookup(&un_commit, repo, oid) != 0) {
-        git_annotated_commit_free(commit);
-        git_reference_free(head);
-        *err = JUSTIN_ERR_GIT;
-        return NULL;
-    }
-    git_annotated_commit_free(commit);
-    oid = git_commit_id(un_commit);
-
-    git_revwalk *walker;
-    if (git_revwalk_new(&walker, repo) != 0) {
-        git_commit_free(un_commit);
-        git_reference_free(head);
-        *err = JUSTIN_ERR_GIT;
-        return NULL;
-    }
-    git_revwalk_sorting(walker, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
-    if (git_revwalk_push(walker, oid) != 0) {
-        git_revwalk_free(walker);
-        git_commit_free(un_commit);
-        git_reference_free(head);
-        *err = JUSTIN_ERR_GIT;
+    justin_meta_sync(meta, repo, err);
+    if (*err != JUSTIN_ERR_OK) {
+        justin_meta_close(meta);
         return NULL;
     }
 
     justin_repo_commit_list ret = (justin_repo_commit_list) malloc(sizeof(justin_repo_commit_list_t));
     if (ret == NULL) {
-        git_revwalk_free(walker);
-        git_commit_free(un_commit);
-        git_reference_free(head);
+        justin_meta_close(meta);
         *err = JUSTIN_ERR_NOMEM;
         return NULL;
     }
-
     ret->repo = repo;
-    ret->head = head;
-    git_oid_cpy(&ret->oid, oid);
-    git_revwalk_next(&ret->oid, walker);
-    ret->walker = walker;
-    ret->cache_capacity = 1;
-    ret->cache_len = 1;
+    ret->meta = meta;
     ret->traversal_head = 0;
-    ret->iter_over = false;
-
-    git_commit **cache = (git_commit**) calloc(1, sizeof(git_commit*));
-    if (cache == NULL) {
-        git_revwalk_free(walker);
-        git_commit_free(un_commit);
-        git_reference_free(head);
-        free(ret);
-        *err = JUSTIN_ERR_NOMEM;
-        return NULL;
-    }
-
-    cache[0] = un_commit;
-    ret->cache = cache;
     return ret;
 }
 
 bool justin_repo_commit_list_next(justin_repo_commit_list list, justin_repo_commit_list_entry *entry, justin_err *err) {
     *err = JUSTIN_ERR_OK;
-    git_commit *commit;
-    if (list->traversal_head < list->cache_len) {
-        commit = list->cache[list->traversal_head++];
-    } else {
-        if (list->iter_over) {
-            return false;
-        }
-        int no = git_revwalk_next(&list->oid, list->walker);
-        if (no == GIT_ITEROVER) {
-            list->iter_over = true;
-            return false;
-        } else if (no != 0) {
-            *err = JUSTIN_ERR_GIT;
-            return false;
-        }
-        if (git_commit_lookup(&commit, list->repo, &list->oid) != 0) {
-            *err = JUSTIN_ERR_GIT;
-            return false;
-        }
-        // Insert commit into cache
-        if (list->cache_len >= list->cache_capacity) {
-            size_t cap = list->cache_capacity << 1;
-            git_commit **n_cache = (git_commit**) reallocarray(list->cache, cap, sizeof(git_commit*));
-            if (n_cache == NULL) {
-                *err = JUSTIN_ERR_NOMEM;
-                return false;
-            }
-            list->cache = n_cache;
-            list->cache_capacity = cap;
-        }
-        list->cache[list->traversal_head++] = commit;
-        list->cache_len = list->traversal_head;
-    }
-    entry->commit = commit;
-    entry->message = git_commit_message(commit);
+    if (list->traversal_head >= justin_meta_size(list->meta)) return false;
+
+    size_t index = list->traversal_head++;
+    justin_meta_oid(list->meta, index, &entry->oid);
+    entry->message = justin_meta_summary(list->meta, index);
     entry->index = list->traversal_head;
     return true;
 }
 
 void justin_repo_commit_list_goto(justin_repo_commit_list list, size_t dest) {
-    size_t max = list->cache_len;
-
-    if (dest > max) {
-        list->traversal_head = max;
-        dest -= max;
-        justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
-        justin_err err = JUSTIN_ERR_OK;
-        while (dest > 0 && justin_repo_commit_list_next(list, &entry, &err)) dest--;
-        if (err != JUSTIN_ERR_OK) justin_log_err_soft(err);
-    } else {
-        list->traversal_head = dest;
+    size_t max = justin_meta_size(list->meta);
+    list->traversal_head = dest > max ? max : dest;
+}
+
+size_t justin_repo_commit_list_size(justin_repo_commit_list list) {
+    return justin_meta_size(list->meta);
+}
+
+git_commit *justin_repo_commit_list_resolve(justin_repo_commit_list list, const justin_repo_commit_list_entry *entry, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    git_commit *commit;
+    if (git_commit_lookup(&commit, list->repo, &entry->oid) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
     }
+    return commit;
 }
 
 void justin_repo_commit_list_free(justin_repo_commit_list list) {
-    git_revwalk_free(list->walker);
-    for (size_t i=0; i < list->cache_len; i++) git_commit_free(list->cache[i]);
-    free(list->cache);
-    git_reference_free(list->head);
+    justin_meta_close(list->meta);
     free(list);
 }
 
-#define LIST_PROMPT_SIZE 10
-justin_repo_commit_list_entry justin_repo_commit_list_prompt(justin_repo_commit_list list, size_t start, justin_err *err) {
-    // CHECK IF EMPTY BEFORE CALLING
-    justin_log_info("Select a version to install");
+git_commit *justin_repo_head_commit(git_repository *repo, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
 
-    justin_repo_commit_list_entry entries[LIST_PROMPT_SIZE];
-    size_t entry_count = 0;
+    git_oid oid;
+    if (git_reference_name_to_id(&oid, repo, "HEAD") != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
 
-    justin_repo_commit_list_goto(list, start);
+    git_commit *commit;
+    if (git_commit_lookup(&commit, repo, &oid) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+    return commit;
+}
+
+void justin_repo_checkout_into(git_repository *repo, git_commit *commit, const char *path, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+
+    git_checkout_options opts;
+    git_checkout_options_init(&opts, GIT_CHECKOUT_OPTIONS_VERSION);
+    // The target directory starts out empty, so every file of the tree is written. There is no index to maintain.
+    opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_RECREATE_MISSING |
+            GIT_CHECKOUT_DONT_UPDATE_INDEX | GIT_CHECKOUT_DONT_WRITE_INDEX;
+    opts.target_directory = path;
 
-    while (justin_repo_commit_list_next(list, &entries[entry_count], err)) {
-        if ((++entry_count) == LIST_PROMPT_SIZE) break;
+    if (git_checkout_tree(repo, (const git_object *) commit, &opts) != 0) {
+        *err = JUSTIN_ERR_GIT;
     }
-    if (*err != JUSTIN_ERR_OK) return entries[0];
+}
 
-    char lbuf[256];
-    for (int i=(LIST_PROMPT_SIZE - 1); i >= 0; i--) {
-        if (i >= entry_count) continue;
-        int head = sprintf(lbuf, "%s[%s%ld%s] %s", CYN, BYEL, entries[i].index, CYN, BWHT);
-        if (head < 0) {
-            *err = JUSTIN_ERR_ASSERTION;
-            return entries[0];
+justin_repo_commit_list_entry justin_repo_commit_list_search(justin_repo_commit_list list, const char *term, justin_err *err) {
+    int term_len = (int) strlen(term);
+
+    justin_repo_commit_list_goto(list, 0);
+    justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+    int dist;
+    justin_repo_commit_list_entry min = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+    int min_dist = INT_MAX;
+    while (justin_repo_commit_list_next(list, &entry, err)) {
+        dist = justin_util_str_dist(entry.message, strlenol(entry.message), term, term_len);
+        if (dist == -1) {
+            *err = JUSTIN_ERR_NOMEM;
+            return min;
         }
-        const char* msg = entries[i].message;
-        size_t msg_len = strlen(msg);
-        char c;
-        for (size_t q=0; q < msg_len; q++) {
-            c = msg[q];
-            if (c == '\n' || c == '\r') break;
-            lbuf[head++] = c;
-            if (head == 255) break;
+        if (dist < min_dist) {
+            min = entry;
+            min_dist = dist;
+            if (dist == 0) break;
         }
-        lbuf[head] = (char) 0;
-        justin_log_info_indent(lbuf, 1);
     }
+    return min;
+}
 
-    justin_log_info("Number, (S)earch, (N)ext or (P)revious: ");
-    scanf("%255s", lbuf);
-
-    switch (lbuf[0]) {
-        case '0': case '1': case '2':
-        case '3': case '4': case '5':
-        case '6': case '7': case '8':
-        case '9': {
-            errno = 0;
-            long dest = strtol(lbuf, NULL, 10);
-            if (errno == EINVAL) {
-                *err = JUSTIN_ERR_ARGS;
+#define LIST_PROMPT_SIZE 10
+justin_repo_commit_list_entry justin_repo_commit_list_prompt_lines(justin_repo_commit_list list, size_t start, justin_err *err) {
+    // CHECK IF EMPTY BEFORE CALLING
+    justin_repo_commit_list_entry entries[LIST_PROMPT_SIZE];
+    size_t entry_count;
+    char lbuf[256];
+
+    while (1) {
+        justin_log_info("Select a version to install");
+        entry_count = 0;
+        justin_repo_commit_list_goto(list, start);
+
+        while (justin_repo_commit_list_next(list, &entries[entry_count], err)) {
+            if ((++entry_count) == LIST_PROMPT_SIZE) break;
+        }
+        if (*err != JUSTIN_ERR_OK) return entries[0];
+
+        for (int i=(LIST_PROMPT_SIZE - 1); i >= 0; i--) {
+            if (i >= entry_count) continue;
+            int head = sprintf(lbuf, "%s[%s%ld%s] %s", CYN, BYEL, entries[i].index, CYN, BWHT);
+            if (head < 0) {
+                *err = JUSTIN_ERR_ASSERTION;
                 return entries[0];
             }
-            justin_repo_commit_list_goto(list, (size_t) ((dest - 1) & LONG_MAX));
-            justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
-            if (justin_repo_commit_list_next(list, &entry, err)) {
-                return entry;
+            const char* msg = entries[i].message;
+            size_t msg_len = strlen(msg);
+            char c;
+            for (size_t q=0; q < msg_len; q++) {
+                c = msg[q];
+                if (c == '\n' || c == '\r') break;
+                lbuf[head++] = c;
+                if (head == 255) break;
             }
-            if ((*err) == JUSTIN_ERR_OK) *err = JUSTIN_ERR_ARGS;
-            return entries[0];
+            lbuf[head] = (char) 0;
+            justin_log_info_indent(lbuf, 1);
         }
-        case 's': case 'S': {
-            justin_log_info("Enter search term:");
-            scanf("%255s", lbuf);
-            int inp_len = (int) strlen(lbuf);
-
-            justin_repo_commit_list_goto(list, 0);
-            justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
-            int dist;
-            justin_repo_commit_list_entry min = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
-            int min_dist = INT_MAX;
-            while (justin_repo_commit_list_next(list, &entry, err)) {
-                dist = justin_util_str_dist(entry.message, strlenol(entry.message), lbuf, inp_len);
-                if (dist == -1) {
-                    *err = JUSTIN_ERR_NOMEM;
-                    return min;
+
+        justin_log_info("Number, (S)earch, (N)ext or (P)revious: ");
+        scanf("%255s", lbuf);
+
+        switch (lbuf[0]) {
+            case '0': case '1': case '2':
+            case '3': case '4': case '5':
+            case '6': case '7': case '8':
+            case '9': {
+                errno = 0;
+                long dest = strtol(lbuf, NULL, 10);
+                if (errno == EINVAL) {
+                    *err = JUSTIN_ERR_ARGS;
+                    return entries[0];
                 }
-                if (dist < min_dist) {
-                    min = entry;
-                    min_dist = dist;
-                    if (dist == 0) break;
+                justin_repo_commit_list_goto(list, (size_t) ((dest - 1) & LONG_MAX));
+                justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+                if (justin_repo_commit_list_next(list, &entry, err)) {
+                    return entry;
                 }
+                if ((*err) == JUSTIN_ERR_OK) *err = JUSTIN_ERR_ARGS;
+                return entries[0];
             }
-            if ((*err) == JUSTIN_ERR_OK) {
-                sprintf(lbuf, "Selected %s%.238s", BYEL, min.message);
-                justin_log_info(lbuf);
+            case 's': case 'S': {
+                justin_log_info("Enter search term:");
+                scanf("%255s", lbuf);
+                justin_repo_commit_list_entry min = justin_repo_commit_list_search(list, lbuf, err);
+                if ((*err) == JUSTIN_ERR_OK) {
+                    sprintf(lbuf, "Selected %s%.238s", BYEL, min.message);
+                    justin_log_info(lbuf);
+                }
+                return min;
             }
-            return min;
+            case 'n': case 'N':
+                if (entry_count == LIST_PROMPT_SIZE) start += LIST_PROMPT_SIZE;
+                break;
+            case 'p': case 'P':
+                start = start >= LIST_PROMPT_SIZE ? start - LIST_PROMPT_SIZE : 0;
+                break;
+            default: {
+                *err = JUSTIN_ERR_ARGS;
+                return entries[0];
+            }
+        }
+    }
+}
+
+// Renders the rows [top, top + view) into the frame and returns how many exist
+size_t justin_repo_commit_list_render(justin_repo_commit_list list, justin_term_frame_t *frame, size_t top, size_t view,
+                                      size_t sel, int cols, justin_err *err) {
+    justin_repo_commit_list_entry entry = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+    size_t shown = 0;
+    justin_repo_commit_list_goto(list, top);
+    while (shown < view && justin_repo_commit_list_next(list, &entry, err)) {
+        char prefix[32];
+        int prefix_len = sprintf(prefix, "[%zu] ", entry.index);
+        int msg_len = strlenol(entry.message);
+        int room = cols - prefix_len;
+        if (msg_len > room) msg_len = room < 0 ? 0 : room;
+
+        bool ok = justin_term_frame_printf(frame, "%s%s[%s%zu%s] %s%.*s" CRESET "\e[K\r\n",
+                                            (top + shown) == sel ? "\e[7m" : "", CYN, BYEL, entry.index, CYN, BWHT,
+                                            msg_len, entry.message);
+        if (!ok) {
+            *err = JUSTIN_ERR_NOMEM;
+            return shown;
+        }
+        shown++;
+    }
+    return shown;
+}
+
+#define BROWSE_HELP "Up/Down/PgUp/PgDn/Home/End move, / search, Enter select, q quit"
+
+justin_repo_commit_list_entry justin_repo_commit_list_browse(justin_repo_commit_list list, size_t start, justin_err *err) {
+    justin_repo_commit_list_entry ret = JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER;
+    justin_term_t term;
+    if (!justin_term_begin(&term)) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return ret;
+    }
+
+    justin_term_frame_t frame = JUSTIN_TERM_FRAME_INITIALIZER;
+    size_t top = start;
+    size_t sel = start;
+    char query[128];
+    size_t query_len = 0;
+    bool searching = false;
+    int rows, cols, key;
+
+    while (1) {
+        justin_term_size(&rows, &cols);
+        size_t view = rows > 2 ? (size_t) (rows - 2) : 1;
+        if (sel < top) top = sel;
+        if (sel >= top + view) top = sel - view + 1;
+
+        justin_term_frame_append(&frame, "\e[H", 3);
+        justin_term_frame_printf(&frame, "%sSelect a version to install %s(%zu commits)" CRESET "\e[K\r\n",
+                                 BWHT, CYN, justin_repo_commit_list_size(list));
+        size_t shown = justin_repo_commit_list_render(list, &frame, top, view, sel, cols, err);
+        if (*err != JUSTIN_ERR_OK) break;
+        if (shown == 0 && top == 0) {
+            *err = JUSTIN_ERR_ASSERTION;
+            break;
+        }
+        if (sel >= top + shown) {
+            // Moved past the end of the history; clamp and redraw
+            sel = justin_repo_commit_list_size(list) - 1;
+            frame.len = 0;
+            continue;
         }
-        case 'n': case 'N': {
-            return justin_repo_commit_list_prompt(list, entry_count == LIST_PROMPT_SIZE ? start + LIST_PROMPT_SIZE : start, err);
+        justin_term_frame_printf(&frame, "\e[J\e[%d;1H", rows);
+        if (searching) {
+            justin_term_frame_printf(&frame, "%s/%s%.*s\e[K", BYEL, WHT, (int) query_len, query);
+        } else {
+            justin_term_frame_printf(&frame, "%s%.*s" CRESET "\e[K", CYN, cols, BROWSE_HELP);
         }
-        case 'p': case 'P': {
-            return justin_repo_commit_list_prompt(list, start >= LIST_PROMPT_SIZE ? start - LIST_PROMPT_SIZE : 0, err);
+        if (!justin_term_frame_flush(&frame)) {
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
         }
-        default: {
+
+        key = justin_term_read_key();
+        if (key == JUSTIN_TERM_KEY_EOF) {
             *err = JUSTIN_ERR_ARGS;
-            return entries[0];
+            break;
+        }
+        if (searching) {
+            if (key == JUSTIN_TERM_KEY_ENTER) {
+                searching = false;
+                query[query_len] = '\0';
+                if (query_len == 0) continue;
+                justin_repo_commit_list_entry found = justin_repo_commit_list_search(list, query, err);
+                if (*err != JUSTIN_ERR_OK) break;
+                if (found.message != NULL) sel = found.index - 1;
+            } else if (key == '\e' || key == JUSTIN_TERM_KEY_INTERRUPT) {
+                searching = false;
+            } else if (key == JUSTIN_TERM_KEY_BACKSPACE) {
+                if (query_len > 0) query_len--;
+            } else if (key >= ' ' && key < 0x7F && query_len < (sizeof(query) - 1)) {
+                query[query_len++] = (char) key;
+            }
+            continue;
         }
+
+        bool done = false;
+        switch (key) {
+            case JUSTIN_TERM_KEY_UP: case 'k':
+                if (sel > 0) sel--;
+                break;
+            case JUSTIN_TERM_KEY_DOWN: case 'j':
+                sel++;
+                break;
+            case JUSTIN_TERM_KEY_PAGE_UP:
+                sel = sel > view ? sel - view : 0;
+                break;
+            case JUSTIN_TERM_KEY_PAGE_DOWN: case ' ':
+                sel += view;
+                break;
+            case JUSTIN_TERM_KEY_HOME: case 'g':
+                sel = 0;
+                break;
+            case JUSTIN_TERM_KEY_END: case 'G':
+                sel = justin_repo_commit_list_size(list) - 1;
+                break;
+            case '/':
+                searching = true;
+                query_len = 0;
+                break;
+            case JUSTIN_TERM_KEY_ENTER:
+                justin_repo_commit_list_goto(list, sel);
+                if (!justin_repo_commit_list_next(list, &ret, err) && *err == JUSTIN_ERR_OK) *err = JUSTIN_ERR_ASSERTION;
+                done = true;
+                break;
+            case 'q': case 'Q': case '\e': case JUSTIN_TERM_KEY_INTERRUPT:
+                *err = JUSTIN_ERR_ARGS;
+                done = true;
+                break;
+            default:
+                break;
+        }
+        if (done) break;
+    }
+
+    justin_term_frame_free(&frame);
+    justin_term_end(&term);
+    if (*err == JUSTIN_ERR_OK) {
+        char lbuf[256];
+        sprintf(lbuf, "Selected %s%.*s", BYEL, mini(238, strlenol(ret.message)), ret.message);
+        justin_log_info(lbuf);
+    }
+    return ret;
+}
+
+justin_repo_commit_list_entry justin_repo_commit_list_prompt(justin_repo_commit_list list, size_t start, justin_err *err) {
+    if (justin_term_interactive()) {
+        return justin_repo_commit_list_browse(list, start, err);
     }
+    return justin_repo_commit_list_prompt_lines(list, start, err);
 }
@@ -17,41 +17,56 @@
 #include <git2.h>
 #include <stdbool.h>
 #include "../logging.h"
+#include "../storage.h"
+#include "meta.h"
 
 #ifndef JUSTIN_REPO_H
 #define JUSTIN_REPO_H
 
 typedef struct justin_repo_commit_list_entry {
-    git_commit *commit;
+    git_oid oid;
     const char *message;
     size_t index;
 } justin_repo_commit_list_entry;
-#define JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER { NULL, NULL, -1 }
+#define JUSTIN_REPO_COMMIT_LIST_ENTRY_INITIALIZER { { { 0 } }, NULL, -1 }
 
+/*
+ * The commit list is backed by the commit metadata cache (meta.h), so listing, rendering and searching never touch
+ * libgit2. Only the chosen entry is turned into a git_commit, with justin_repo_commit_list_resolve.
+ */
 typedef struct justin_repo_commit_list_t {
     git_repository *repo;
-    git_reference *head;
-    git_oid oid;
-    git_revwalk *walker;
-    git_commit **cache;
-    size_t cache_capacity;
-    size_t cache_len;
+    justin_meta meta;
     size_t traversal_head;
-    bool iter_over;
 } justin_repo_commit_list_t;
 
 typedef justin_repo_commit_list_t *justin_repo_commit_list;
 
 //
 
-justin_repo_commit_list justin_repo_commit_list_create(git_repository *repo, justin_err *err);
+justin_repo_commit_list justin_repo_commit_list_create(git_repository *repo, justin_storage storage, const char *name, justin_err *err);
 
 bool justin_repo_commit_list_next(justin_repo_commit_list list, justin_repo_commit_list_entry *entry, justin_err *err);
 
 void justin_repo_commit_list_goto(justin_repo_commit_list list, size_t skip);
 
+size_t justin_repo_commit_list_size(justin_repo_commit_list list);
+
+/**
+ * Looks up the commit behind an entry. The caller owns the result.
+ */
+git_commit *justin_repo_commit_list_resolve(justin_repo_commit_list list, const justin_repo_commit_list_entry *entry, justin_err *err);
+
 void justin_repo_commit_list_free(justin_repo_commit_list list);
 
+git_commit *justin_repo_head_commit(git_repository *repo, justin_err *err);
+
+/**
+ * Writes the tree of a commit into a directory, without touching the index or HEAD of the repository. This works
+ * for bare repositories.
+ */
+void justin_repo_checkout_into(git_repository *repo, git_commit *commit, const char *path, justin_err *err);
+
 justin_repo_commit_list_entry justin_repo_commit_list_prompt(justin_repo_commit_list list, size_t start, justin_err *err);
 
 #endif //JUSTIN_REPO_H
@@ -0,0 +1,531 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mount.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <alpm.h>
+#include "../util.h"
+#include "../proc.h"
+#include "srcinfo.h"
+#include "artifact.h"
+#include "sandbox.h"
+
+#define PATH2_PACMAN "/usr/bin/pacman"
+static const char *PATH2_PACMAN_S = PATH2_PACMAN;
+
+#define SRCINFO ".SRCINFO"
+static const char *SRCINFO_S = SRCINFO;
+
+#define ROOT_NAME "root"
+#define LAYERS_NAME "layers"
+#define READY_FILE ".justin-ready"
+#define HOSTNAME "justin"
+
+#define HOST_SYNC "/var/lib/pacman/sync"
+#define HOST_CACHE "/var/cache/pacman/pkg"
+#define HOST_SHM "/dev/shm"
+
+// Where the AUR dependencies are put in the layer for pacman -U
+#define LAYER_DEPS "/var/cache/justin"
+
+// Host paths visible in every layer, besides the directories of the build
+static const struct {
+    const char *path;
+    bool file;
+    bool recursive;
+    bool read_only;
+} SANDBOX_HOST_MOUNTS[] = {
+        { "/dev", false, true, false },
+        { HOST_CACHE, false, false, false },
+        { HOST_SYNC, false, false, true },
+        { "/etc/pacman.conf", true, false, true },
+        { "/etc/pacman.d", false, false, true },
+        { "/etc/resolv.conf", true, false, true }
+};
+#define SANDBOX_HOST_MOUNTS_LEN ((sizeof SANDBOX_HOST_MOUNTS) / (sizeof SANDBOX_HOST_MOUNTS[0]))
+
+static const justin_srcinfo_field SANDBOX_DEP_FIELDS[] = {
+        JUSTIN_SRCINFO_DEPENDS, JUSTIN_SRCINFO_MAKEDEPENDS, JUSTIN_SRCINFO_CHECKDEPENDS
+};
+
+typedef struct justin_sandbox_argv {
+    char **data;
+    size_t len;
+    size_t cap;
+} justin_sandbox_argv;
+
+// Appends an argument, taking ownership of it. NULL is appended as the terminator.
+bool justin_sandbox_argv_push(justin_sandbox_argv *argv, char *arg) {
+    if (argv->len == argv->cap) {
+        size_t cap = argv->cap == 0 ? 16 : argv->cap << 1;
+        char **data = (char**) realloc(argv->data, cap * sizeof(char*));
+        if (data == NULL) {
+            free(arg);
+            return false;
+        }
+        argv->data = data;
+        argv->cap = cap;
+    }
+    argv->data[argv->len++] = arg;
+    return true;
+}
+
+void justin_sandbox_argv_free(char **argv) {
+    if (argv == NULL) return;
+    for (char **arg = argv; *arg != NULL; arg++) free(*arg);
+    free(argv);
+}
+
+// Starts a pacman command line that installs into the layer
+bool justin_sandbox_argv_init(justin_sandbox_argv *argv, const char *op) {
+    static const char *prefix[] = { "pacman", NULL, "--noconfirm", "--needed", "--asdeps" };
+    char *arg;
+    for (size_t i=0; i < (sizeof prefix) / sizeof(char*); i++) {
+        arg = strdup(prefix[i] == NULL ? op : prefix[i]);
+        if (arg == NULL || !justin_sandbox_argv_push(argv, arg)) return false;
+    }
+    return true;
+}
+
+// mkdir -p, with a buffer on the stack so that it can run in the child
+int justin_sandbox_mkdirs(const char *path) {
+    char buf[PATH_MAX];
+    size_t len = strlen(path);
+    if (len >= sizeof buf) return ENAMETOOLONG;
+    memcpy(buf, path, len + 1);
+    for (size_t i=1; i <= len; i++) {
+        if (buf[i] != '/' && buf[i] != '\0') continue;
+        buf[i] = '\0';
+        if (mkdir(buf, 0755) == -1 && errno != EEXIST) return errno;
+        if (i != len) buf[i] = '/';
+    }
+    return 0;
+}
+
+// Copies the host sync databases into the base root, so that its pacman sees the same repositories
+void justin_sandbox_sync_dbs(const char *root, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof dir, "%s" HOST_SYNC, root);
+    if (justin_sandbox_mkdirs(dir) != 0) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+
+    DIR *d = opendir(HOST_SYNC);
+    if (d == NULL) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    struct dirent *ent;
+    size_t len;
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    while ((ent = readdir(d)) != NULL) {
+        len = strlen(ent->d_name);
+        if (len < 4 || strcmp(&ent->d_name[len - 3], ".db") != 0) continue;
+        snprintf(src, sizeof src, HOST_SYNC "/%s", ent->d_name);
+        snprintf(dst, sizeof dst, "%s/%s", dir, ent->d_name);
+        if (justin_util_file_copy(src, dst) != 0) {
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
+        }
+    }
+    closedir(d);
+}
+
+void justin_sandbox_prepare(justin_context ctx, justin_err *err) {
+    char *root = justin_storage_path(ctx->storage, JUSTIN_SANDBOX_DIR, ROOT_NAME, err);
+    if (root == NULL) return;
+    justin_sandbox_sync_dbs(root, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    char ready[PATH_MAX];
+    char dbpath[PATH_MAX];
+    snprintf(ready, sizeof ready, "%s/%s", root, READY_FILE);
+    snprintf(dbpath, sizeof dbpath, "%s/var/lib/pacman", root);
+    bool installed = access(ready, F_OK) == 0;
+    if (installed) {
+        justin_log_debug("Updating the build sandbox");
+    } else {
+        justin_log_info("Installing the build sandbox (" JUSTIN_SANDBOX_BASE ")");
+    }
+
+    // Packages come from the host's package cache, so that layers can install them without downloading again
+    char *argv[] = {
+            "pacman", "--root", root, "--dbpath", dbpath, "--cachedir", HOST_CACHE, "--noconfirm",
+            "-S", "--needed", JUSTIN_SANDBOX_BASE, installed ? "-u" : NULL, NULL
+    };
+    justin_proc_result_t result;
+    justin_proc_run(PATH2_PACMAN_S, argv, NULL, &result, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    justin_proc_check(&result, err);
+    if ((*err) != JUSTIN_ERR_OK || installed) goto ex;
+
+    int fd = open(ready, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+    } else {
+        close(fd);
+    }
+
+    ex:
+    free(root);
+}
+
+// Creates upper/etc/passwd with the build user added, so that makepkg and fakeroot can resolve it
+void justin_sandbox_passwd(justin_context ctx, const char *root, const char *layer, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/upper/etc", layer);
+    if (justin_sandbox_mkdirs(path) != 0) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    char src[PATH_MAX];
+    snprintf(src, sizeof src, "%s/etc/passwd", root);
+    strncat(path, "/passwd", sizeof path - strlen(path) - 1);
+    if (justin_util_file_copy(src, path) != 0) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+
+    FILE *f = fopen(path, "ae");
+    if (f == NULL) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    unsigned int uid = (unsigned int) ctx->storage->user;
+    fprintf(f, "justin:x:%u:%u::/tmp:/bin/bash\n", uid, uid);
+    if (fclose(f) != 0) *err = JUSTIN_ERR_SYSTEM;
+}
+
+bool justin_sandbox_has_dep(const justin_sandbox_argv *argv, const char *dep) {
+    for (size_t i=0; i < argv->len; i++) {
+        if (strcmp(argv->data[i], dep) == 0) return true;
+    }
+    return false;
+}
+
+// Links (or copies, across filesystems) a cached package into the layer, returns its path as pacman in the layer sees it
+char* justin_sandbox_link_dep(justin_sandbox_t *sandbox, const char *file) {
+    const char *name = strrchr(file, '/');
+    name = name == NULL ? file : &name[1];
+    char dir[PATH_MAX];
+    char dst[PATH_MAX];
+    snprintf(dir, sizeof dir, "%s/upper" LAYER_DEPS, sandbox->layer);
+    snprintf(dst, sizeof dst, "%s/%s", dir, name);
+    if (justin_sandbox_mkdirs(dir) != 0) return NULL;
+    if (link(file, dst) == -1 && justin_util_file_copy(file, dst) != 0) return NULL;
+    char *ret;
+    if (asprintf(&ret, LAYER_DEPS "/%s", name) == -1) return NULL;
+    return ret;
+}
+
+// Sorts the dependencies of the build into packages from the cache (pacman -U) and packages from the repos (pacman -S)
+void justin_sandbox_deps(justin_context ctx, const char *path, justin_sandbox_t *sandbox, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    char file[PATH_MAX];
+    snprintf(file, sizeof file, "%s/%s", path, SRCINFO_S);
+    size_t len;
+    char *data = justin_util_read_file(file, &len);
+    if (data == NULL) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    if (!justin_srcinfo_parse(&info, data, len)) {
+        *err = JUSTIN_ERR_PROTOCOL;
+        goto ex;
+    }
+    struct utsname uts;
+    if (uname(&uts) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        goto ex;
+    }
+    int arch = justin_srcinfo_arch(&info, uts.machine);
+
+    justin_sandbox_argv deps = { NULL, 0, 0 };
+    if (ctx->params->v_ccache != NULL && !justin_sandbox_argv_push(&deps, strdup("ccache"))) goto nomem;
+    justin_srcinfo_iter iter;
+    justin_srcinfo_str value;
+    for (size_t section=0; section <= info.pkgnames_len; section++) {
+        for (size_t f=0; f < (sizeof SANDBOX_DEP_FIELDS) / sizeof(justin_srcinfo_field); f++) {
+            justin_srcinfo_iter_init(&info, &iter, SANDBOX_DEP_FIELDS[f], (uint16_t) section, arch);
+            while (justin_srcinfo_iter_next(&info, &iter, &value)) {
+                char *dep = strndup(value.ptr, value.len);
+                if (dep == NULL) goto nomem;
+                if (justin_sandbox_has_dep(&deps, dep)) {
+                    free(dep);
+                } else if (!justin_sandbox_argv_push(&deps, dep)) {
+                    goto nomem;
+                }
+            }
+        }
+    }
+
+    justin_sandbox_argv files = { NULL, 0, 0 };
+    justin_sandbox_argv names = { NULL, 0, 0 };
+    alpm_handle_t *handle = alpm_db_get_handle(ctx->alpm_db);
+    for (size_t i=0; i < deps.len; i++) {
+        char *dep = deps.data[i];
+        deps.data[i] = NULL;
+        // Version constraints are left to pacman for repo packages; a cached build is the newest one there is
+        char *name = strndup(dep, strcspn(dep, "<>="));
+        char *cached = name == NULL ? NULL : justin_artifact_find(ctx, name);
+        free(name);
+        // An AUR package that was installed on the host but never built by justin has nowhere to come from
+        bool found = cached != NULL;
+        if (!found) {
+            justin_context_alpm_lock(ctx);
+            found = alpm_find_dbs_satisfier(handle, alpm_get_syncdbs(handle), dep) != NULL;
+            justin_context_alpm_unlock(ctx);
+        }
+        if (!found) {
+            char buf[256];
+            snprintf(buf, sizeof buf, "%.200s is in neither the sync repositories nor the package cache", dep);
+            justin_log_err_msg(JUSTIN_ERR_DEPENDENCY, buf);
+            free(dep);
+            *err = JUSTIN_ERR_DEPENDENCY;
+            goto fail;
+        }
+        justin_sandbox_argv *target = cached == NULL ? &names : &files;
+        if (target->len == 0 && !justin_sandbox_argv_init(target, cached == NULL ? "-S" : "-U")) {
+            free(dep);
+            free(cached);
+            goto nomem_all;
+        }
+        if (cached != NULL) {
+            free(dep);
+            dep = justin_sandbox_link_dep(sandbox, cached);
+            free(cached);
+            if (dep == NULL) {
+                *err = JUSTIN_ERR_SYSTEM;
+                goto fail;
+            }
+        }
+        if (!justin_sandbox_argv_push(target, dep)) goto nomem_all;
+    }
+    if (files.len != 0 && !justin_sandbox_argv_push(&files, NULL)) goto nomem_all;
+    if (names.len != 0 && !justin_sandbox_argv_push(&names, NULL)) goto nomem_all;
+    sandbox->install_files = files.data;
+    sandbox->install_names = names.data;
+    free(deps.data);
+    goto ex;
+
+    nomem_all:
+    *err = JUSTIN_ERR_NOMEM;
+    fail:
+    // The dependencies taken so far are in "files" or "names", or already freed
+    for (size_t i=0; i < files.len; i++) free(files.data[i]);
+    for (size_t i=0; i < names.len; i++) free(names.data[i]);
+    free(files.data);
+    free(names.data);
+    for (size_t i=0; i < deps.len; i++) free(deps.data[i]);
+    free(deps.data);
+    goto ex;
+
+    nomem:
+    for (size_t i=0; i < deps.len; i++) free(deps.data[i]);
+    free(deps.data);
+    *err = JUSTIN_ERR_NOMEM;
+    ex:
+    justin_srcinfo_free(&info);
+    free(data);
+}
+
+// Adds a mount at the same path in the merged root, returns false if out of memory or mounts
+bool justin_sandbox_mount_add(justin_sandbox_t *sandbox, const char *src, const char *dst, bool file, bool recursive, bool read_only) {
+    if (sandbox->mounts_len == JUSTIN_SANDBOX_MOUNTS_MAX) return false;
+    justin_sandbox_mount *m = &sandbox->mounts[sandbox->mounts_len];
+    if (asprintf(&m->dst, "%s%s", sandbox->merged, dst) == -1) {
+        m->dst = NULL;
+        return false;
+    }
+    m->src = src;
+    m->file = file;
+    m->recursive = recursive;
+    m->read_only = read_only;
+    sandbox->mounts_len++;
+    return true;
+}
+
+// Makes sure a directory the build writes to is there to be mounted
+bool justin_sandbox_bind_dir(justin_context ctx, const char *dir) {
+    if (mkdir(dir, 0755) == -1) return errno == EEXIST;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    bool ok = fd != -1 && fchown(fd, ctx->storage->user, -1) == 0;
+    if (fd != -1) close(fd);
+    return ok;
+}
+
+void justin_sandbox_create(justin_context ctx, const char *path, const char *const *binds, justin_sandbox_t *sandbox, justin_err *err) {
+    char *root = justin_storage_path(ctx->storage, JUSTIN_SANDBOX_DIR, ROOT_NAME, err);
+    if (root == NULL) return;
+    char *layers = justin_storage_path(ctx->storage, JUSTIN_SANDBOX_DIR, LAYERS_NAME, err);
+    if (layers == NULL) goto ex;
+    if (mkdir(layers, 0755) == -1 && errno != EEXIST) {
+        *err = JUSTIN_ERR_SYSTEM;
+        goto ex;
+    }
+    sandbox->layer = justin_storage_dir_create_in(ctx->storage, layers, err);
+    if (sandbox->layer == NULL) goto ex;
+
+    // Created by root, the merged root directory takes its owner from upper/
+    static const char *subdirs[] = { "upper", "work", "merged" };
+    char dir[PATH_MAX];
+    for (size_t i=0; i < (sizeof subdirs) / sizeof(char*); i++) {
+        snprintf(dir, sizeof dir, "%s/%s", sandbox->layer, subdirs[i]);
+        if (mkdir(dir, 0755) == -1) {
+            *err = JUSTIN_ERR_SYSTEM;
+            goto ex;
+        }
+    }
+    justin_sandbox_passwd(ctx, root, sandbox->layer, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+
+    // Everything the child needs is worked out here, it cannot allocate after fork
+    if (asprintf(&sandbox->merged, "%s/merged", sandbox->layer) == -1) sandbox->merged = NULL;
+    if (asprintf(&sandbox->proc, "%s/merged/proc", sandbox->layer) == -1) sandbox->proc = NULL;
+    if (asprintf(&sandbox->overlay, "lowerdir=%s,upperdir=%s/upper,workdir=%s/work", root, sandbox->layer,
+                 sandbox->layer) == -1) sandbox->overlay = NULL;
+    if (sandbox->merged == NULL || sandbox->proc == NULL || sandbox->overlay == NULL) goto nomem;
+
+    struct stat st;
+    for (size_t i=0; i < SANDBOX_HOST_MOUNTS_LEN; i++) {
+        if (stat(SANDBOX_HOST_MOUNTS[i].path, &st) == -1) continue;
+        if (!justin_sandbox_mount_add(sandbox, SANDBOX_HOST_MOUNTS[i].path, SANDBOX_HOST_MOUNTS[i].path,
+                                      SANDBOX_HOST_MOUNTS[i].file, SANDBOX_HOST_MOUNTS[i].recursive,
+                                      SANDBOX_HOST_MOUNTS[i].read_only)) goto nomem;
+    }
+    // Build directories on tmpfs are under /dev/shm, which would otherwise show those of every other build
+    if (!justin_sandbox_mount_add(sandbox, NULL, HOST_SHM, false, false, false)) goto nomem;
+    if (!justin_sandbox_mount_add(sandbox, path, path, false, false, false)) goto nomem;
+    for (const char *const *bind = binds; *bind != NULL; bind++) {
+        if (!justin_sandbox_bind_dir(ctx, *bind)) {
+            *err = JUSTIN_ERR_SYSTEM;
+            goto ex;
+        }
+        if (!justin_sandbox_mount_add(sandbox, *bind, *bind, false, false, false)) goto nomem;
+    }
+
+    justin_sandbox_deps(ctx, path, sandbox, err);
+    goto ex;
+
+    nomem:
+    *err = JUSTIN_ERR_NOMEM;
+    ex:
+    free(layers);
+    free(root);
+}
+
+// Runs pacman in the layer. Child side, async-signal-safe.
+int justin_sandbox_pacman(char **argv) {
+    pid_t pid = fork();
+    if (pid == -1) return errno;
+    if (pid == 0) {
+        execve(PATH2_PACMAN_S, argv, environ);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) return errno;
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : ENOPKG;
+}
+
+// The process that called unshare stays outside of the new PID namespace and only passes on the exit status
+_Noreturn void justin_sandbox_wait(pid_t pid) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3U, ~0U, 0U) == -1)
+#endif
+    for (int fd=3; fd < 1024; fd++) close(fd);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) _exit(127);
+    }
+    if (WIFEXITED(status)) _exit(WEXITSTATUS(status));
+    _exit(128 + WTERMSIG(status));
+}
+
+int justin_sandbox_enter(void *data) {
+    justin_sandbox_t *sandbox = (justin_sandbox_t*) data;
+    if (unshare(CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWUTS | CLONE_NEWIPC) == -1) return errno;
+    pid_t pid = fork();
+    if (pid == -1) return errno;
+    if (pid != 0) justin_sandbox_wait(pid);
+
+    // Nothing mounted from here on is seen by the host, and all of it goes away with the namespace
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == -1) return errno;
+    if (mount("overlay", sandbox->merged, "overlay", 0, sandbox->overlay) == -1) return errno;
+
+    int e;
+    const justin_sandbox_mount *m;
+    for (size_t i=0; i < sandbox->mounts_len; i++) {
+        m = &sandbox->mounts[i];
+        if (m->file) {
+            int fd = open(m->dst, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd == -1) return errno;
+            close(fd);
+        } else if ((e = justin_sandbox_mkdirs(m->dst)) != 0) {
+            return e;
+        }
+        if (m->src == NULL) {
+            if (mount("tmpfs", m->dst, "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777") == -1) return errno;
+            continue;
+        }
+        if (mount(m->src, m->dst, NULL, MS_BIND | (m->recursive ? MS_REC : 0), NULL) == -1) return errno;
+        if (m->read_only && mount(NULL, m->dst, NULL, MS_REMOUNT | MS_BIND | MS_RDONLY, NULL) == -1) return errno;
+    }
+    if ((e = justin_sandbox_mkdirs(sandbox->proc)) != 0) return e;
+    if (mount("proc", sandbox->proc, "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == -1) return errno;
+
+    if (chroot(sandbox->merged) == -1 || chdir("/") == -1) return errno;
+    sethostname(HOSTNAME, (sizeof HOSTNAME) - 1);
+
+    if (sandbox->install_files != NULL && (e = justin_sandbox_pacman(sandbox->install_files)) != 0) return e;
+    if (sandbox->install_names != NULL && (e = justin_sandbox_pacman(sandbox->install_names)) != 0) return e;
+    return 0;
+}
+
+void justin_sandbox_destroy(justin_sandbox_t *sandbox) {
+    // The mounts lived in the namespace of the build, only the files are left
+    if (sandbox->layer != NULL && justin_util_rimraf(sandbox->layer) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    for (size_t i=0; i < sandbox->mounts_len; i++) free(sandbox->mounts[i].dst);
+    justin_sandbox_argv_free(sandbox->install_files);
+    justin_sandbox_argv_free(sandbox->install_names);
+    free(sandbox->layer);
+    free(sandbox->merged);
+    free(sandbox->overlay);
+    free(sandbox->proc);
+    justin_sandbox_t empty = JUSTIN_SANDBOX_INITIALIZER;
+    *sandbox = empty;
+}
@@ -0,0 +1,83 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_SANDBOX_H
+#define JUSTIN_SANDBOX_H
+
+/*
+ * Clean builds, enabled with -s. A base root with base-devel is installed once into the ".sandbox" storage directory
+ * and upgraded along with the host's sync databases on later runs. Every build then gets a fresh overlayfs layer over
+ * it, entered in new mount, PID, UTS and IPC namespaces: a few mounts, no copying. The dependencies of the build are
+ * installed into its own layer (AUR dependencies from the package cache), and the layer is thrown away afterwards.
+ * Of the storage directory the build only sees what it writes to: its build directory, the sources, its VCS checkouts
+ * and the compiler cache. The package cache, the history and the other builds stay out of its reach.
+ */
+
+#define JUSTIN_SANDBOX_DIR ".sandbox"
+#define JUSTIN_SANDBOX_BASE "base-devel"
+#define JUSTIN_SANDBOX_MOUNTS_MAX 12
+
+typedef struct justin_sandbox_mount {
+    const char *src;        // NULL for an empty tmpfs
+    char *dst;              // inside the merged root
+    bool file;
+    bool recursive;
+    bool read_only;
+} justin_sandbox_mount;
+
+typedef struct justin_sandbox_t {
+    char *layer;            // holds upper/, work/ and merged/
+    char *merged;
+    char *overlay;          // overlayfs mount options
+    char *proc;
+    justin_sandbox_mount mounts[JUSTIN_SANDBOX_MOUNTS_MAX];
+    size_t mounts_len;
+    char **install_files;   // pacman -U arguments, NULL if there is nothing to install this way
+    char **install_names;   // pacman -S arguments, NULL if there is nothing to install this way
+} justin_sandbox_t;
+#define JUSTIN_SANDBOX_INITIALIZER { NULL, NULL, NULL, NULL, { { NULL, NULL, false, false, false } }, 0, NULL, NULL }
+
+/**
+ * Installs the base root, or brings it up to date with the sync databases. Call once per run, before building, with
+ * the storage locked.
+ */
+void justin_sandbox_prepare(justin_context ctx, justin_err *err);
+
+/**
+ * Creates the layer for a build of the package in "path" and works out what to install into it. "binds" is a
+ * NULL-terminated list of other directories the build writes to, which are mounted at the same paths; they must
+ * outlive the sandbox.
+ */
+void justin_sandbox_create(justin_context ctx, const char *path, const char *const *binds, justin_sandbox_t *sandbox, justin_err *err);
+
+/**
+ * Suitable as justin_proc_opts_t.setup, with the sandbox as data. Moves the child into the layer, as PID 1 of a new
+ * PID namespace, and installs the dependencies; the build starts once this returns.
+ */
+int justin_sandbox_enter(void *sandbox);
+
+/**
+ * Removes the layer and frees the sandbox
+ */
+void justin_sandbox_destroy(justin_sandbox_t *sandbox);
+
+#endif //JUSTIN_SANDBOX_H
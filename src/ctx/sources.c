@@ -0,0 +1,422 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <curl/curl.h>
+#include "../util.h"
+#include "../hash.h"
+#include "srcinfo.h"
+#include "sources.h"
+
+#define SRCINFO ".SRCINFO"
+static const char *SRCINFO_S = SRCINFO;
+
+// Strongest first; the first algorithm with a checksum for every source is used
+static const struct {
+    justin_hash_alg alg;
+    justin_srcinfo_field field;
+} SOURCES_ALGS[] = {
+        { JUSTIN_HASH_B2, JUSTIN_SRCINFO_B2SUMS },
+        { JUSTIN_HASH_SHA512, JUSTIN_SRCINFO_SHA512SUMS },
+        { JUSTIN_HASH_SHA384, JUSTIN_SRCINFO_SHA384SUMS },
+        { JUSTIN_HASH_SHA256, JUSTIN_SRCINFO_SHA256SUMS },
+        { JUSTIN_HASH_SHA224, JUSTIN_SRCINFO_SHA224SUMS }
+};
+#define SOURCES_ALGS_LEN ((sizeof SOURCES_ALGS) / sizeof(SOURCES_ALGS[0]))
+
+// Protocols makepkg hands to a VCS instead of downloading
+static const char *SOURCES_VCS[] = { "git", "svn", "hg", "bzr", "fossil" };
+
+typedef struct justin_sources_entry {
+    char *file;             // name inside SRCDEST
+    char *url;
+    justin_hash_alg alg;
+    char *sum;              // expected digest in hex, NULL to leave verification to makepkg
+} justin_sources_entry;
+
+typedef struct justin_sources_list {
+    justin_sources_entry *data;
+    size_t len;
+    size_t cap;
+} justin_sources_list;
+
+typedef struct justin_sources_transfer {
+    justin_sources_entry *entry;
+    CURL *easy;
+    char *part;
+    char *dest;
+    int fd;
+    bool write_failed;
+    justin_hash_t hash;
+} justin_sources_transfer;
+
+char* justin_sources_dir(justin_context ctx, justin_err *err) {
+    return justin_storage_path(ctx->storage, JUSTIN_SOURCES_DIR, "", err);
+}
+
+bool justin_sources_is_remote(const char *url) {
+    const char *sep = strstr(url, "://");
+    if (sep == NULL) return false;
+    size_t proto_len = sep - url;
+    if (memchr(url, '+', proto_len) != NULL) return false;
+    for (size_t i=0; i < (sizeof SOURCES_VCS) / sizeof(char*); i++) {
+        if (strlen(SOURCES_VCS[i]) == proto_len && strncmp(SOURCES_VCS[i], url, proto_len) == 0) return false;
+    }
+    return true;
+}
+
+bool justin_sources_list_add(justin_sources_list *list, justin_srcinfo_str src, justin_hash_alg alg, const justin_srcinfo_str *sum) {
+    // [name::]url, the file name defaulting to everything after the last slash, like makepkg does
+    const char *end = &src.ptr[src.len];
+    const char *url = src.ptr;
+    const char *file = src.ptr;
+    const char *sep = (const char*) memmem(src.ptr, src.len, "::", 2);
+    size_t file_len;
+    if (sep != NULL) {
+        url = &sep[2];
+        file_len = sep - src.ptr;
+    } else {
+        for (const char *c = src.ptr; c < end; c++) {
+            if (*c == '/') file = &c[1];
+        }
+        file_len = end - file;
+    }
+    // The name comes from the AUR and the file is written as root: nothing outside SRCDEST, nothing hidden
+    if (file_len == 0 || file[0] == '.' || memchr(file, '/', file_len) != NULL) return true;
+    char *url_z = strndup(url, end - url);
+    if (url_z == NULL) return false;
+    if (!justin_sources_is_remote(url_z)) {
+        free(url_z);
+        return true;
+    }
+    if (sum != NULL && sum->len == 4 && memcmp(sum->ptr, "SKIP", 4) == 0) sum = NULL;
+
+    for (size_t i=0; i < list->len; i++) {
+        if (strlen(list->data[i].file) == file_len && strncmp(list->data[i].file, file, file_len) == 0) {
+            free(url_z);
+            return true;
+        }
+    }
+
+    if (list->len == list->cap) {
+        size_t cap = list->cap == 0 ? 16 : list->cap << 1;
+        justin_sources_entry *grown = (justin_sources_entry*) reallocarray(list->data, cap, sizeof(justin_sources_entry));
+        if (grown == NULL) {
+            free(url_z);
+            return false;
+        }
+        list->data = grown;
+        list->cap = cap;
+    }
+    justin_sources_entry *entry = &list->data[list->len];
+    entry->file = strndup(file, file_len);
+    entry->url = url_z;
+    entry->alg = sum == NULL ? JUSTIN_HASH_NONE : alg;
+    entry->sum = sum == NULL ? NULL : strndup(sum->ptr, sum->len);
+    if (entry->file == NULL || (sum != NULL && entry->sum == NULL)) {
+        free(entry->file);
+        free(entry->url);
+        free(entry->sum);
+        return false;
+    }
+    list->len++;
+    return true;
+}
+
+void justin_sources_list_free(justin_sources_list *list) {
+    for (size_t i=0; i < list->len; i++) {
+        free(list->data[i].file);
+        free(list->data[i].url);
+        free(list->data[i].sum);
+    }
+    free(list->data);
+}
+
+// Counts the values of a field in the pkgbase section for one architecture suffix, split packages cannot change sources
+size_t justin_sources_count(const justin_srcinfo_t *info, justin_srcinfo_field field, int arch) {
+    size_t n = 0;
+    for (size_t i=0; i < info->entries_len; i++) {
+        const justin_srcinfo_entry *e = &info->entries[i];
+        if (e->field == field && e->arch == arch && e->section == JUSTIN_SRCINFO_BASE) n++;
+    }
+    return n;
+}
+
+// Adds the remote sources of the pkgbase section of a parsed .SRCINFO to the list
+bool justin_sources_collect(const justin_srcinfo_t *info, const char *arch, justin_sources_list *list) {
+    int archs[2] = { JUSTIN_SRCINFO_ANY, justin_srcinfo_arch(info, arch) };
+    for (int a=0; a < 2; a++) {
+        if (archs[a] < 0) continue;
+        size_t count = justin_sources_count(info, JUSTIN_SRCINFO_SOURCE, archs[a]);
+        if (count == 0) continue;
+
+        justin_srcinfo_field sums = JUSTIN_SRCINFO_FIELD_COUNT;
+        justin_hash_alg alg = JUSTIN_HASH_NONE;
+        for (size_t i=0; i < SOURCES_ALGS_LEN; i++) {
+            if (justin_sources_count(info, SOURCES_ALGS[i].field, archs[a]) == count) {
+                sums = SOURCES_ALGS[i].field;
+                alg = SOURCES_ALGS[i].alg;
+                break;
+            }
+        }
+
+        // Entries are in file order, so the nth source pairs up with the nth checksum
+        size_t sum_pos = 0;
+        for (size_t i=0; i < info->entries_len; i++) {
+            const justin_srcinfo_entry *e = &info->entries[i];
+            if (e->field != JUSTIN_SRCINFO_SOURCE || e->arch != archs[a] || e->section != JUSTIN_SRCINFO_BASE) continue;
+            const justin_srcinfo_str *sum = NULL;
+            for (; alg != JUSTIN_HASH_NONE && sum_pos < info->entries_len; sum_pos++) {
+                const justin_srcinfo_entry *s = &info->entries[sum_pos];
+                if (s->field == sums && s->arch == archs[a] && s->section == JUSTIN_SRCINFO_BASE) {
+                    sum = &s->value;
+                    sum_pos++;
+                    break;
+                }
+            }
+            if (!justin_sources_list_add(list, e->value, alg, sum)) return false;
+        }
+    }
+    return true;
+}
+
+bool justin_sources_digest_matches(justin_hash_t *hash, const char *expected) {
+    uint8_t digest[JUSTIN_HASH_MAX_SIZE];
+    char hex[(JUSTIN_HASH_MAX_SIZE << 1) + 1];
+    size_t size = justin_hash_final(hash, digest);
+    justin_util_b2hex(digest, size, hex);
+    return strcasecmp(hex, expected) == 0;
+}
+
+// True if the file is already in SRCDEST and, where a checksum is known, matches it
+bool justin_sources_present(const char *path, justin_sources_entry *entry) {
+    struct stat st;
+    if (entry->sum == NULL) return lstat(path, &st) == 0 && S_ISREG(st.st_mode);
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    justin_hash_t hash;
+    justin_hash_init(&hash, entry->alg);
+    char *buf = (char*) malloc(65536);
+    ssize_t r = -1;
+    while (buf != NULL) {
+        r = read(fd, buf, 65536);
+        if (r == -1 && errno == EINTR) continue;
+        if (r <= 0) break;
+        justin_hash_update(&hash, buf, r);
+    }
+    free(buf);
+    close(fd);
+    return r == 0 && justin_sources_digest_matches(&hash, entry->sum);
+}
+
+size_t justin_sources_on_data(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    justin_sources_transfer *t = (justin_sources_transfer*) userdata;
+    size_t len = size * nmemb;
+    justin_hash_update(&t->hash, ptr, len);
+    size_t off = 0;
+    ssize_t w;
+    while (off < len) {
+        w = write(t->fd, &ptr[off], len - off);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            t->write_failed = true;
+            return 0;
+        }
+        off += w;
+    }
+    return len;
+}
+
+void justin_sources_warn(justin_sources_transfer *t, const char *reason) {
+    char buf[512];
+    snprintf(buf, sizeof buf, "Could not prefetch %.200s (%.200s), leaving it to makepkg", t->entry->file, reason);
+    justin_log_warn(buf);
+}
+
+// Moves a finished download into place if it is complete and matches its checksum
+bool justin_sources_finish(justin_sources_transfer *t, CURLcode result) {
+    bool ok = false;
+    if (close(t->fd) == -1) t->write_failed = true;
+    t->fd = -1;
+    if (result != CURLE_OK) {
+        justin_sources_warn(t, t->write_failed ? "write failed" : curl_easy_strerror(result));
+    } else if (t->entry->sum != NULL && !justin_sources_digest_matches(&t->hash, t->entry->sum)) {
+        justin_sources_warn(t, "checksum mismatch");
+    } else if (rename(t->part, t->dest) == -1) {
+        justin_sources_warn(t, strerror(errno));
+    } else {
+        ok = true;
+    }
+    if (!ok) unlink(t->part);
+    return ok;
+}
+
+void justin_sources_prefetch(justin_context ctx, const char *const *dirs, size_t count, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    struct utsname uts;
+    if (uname(&uts) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+
+    justin_sources_list list = { NULL, 0, 0 };
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    char path[PATH_MAX];
+    for (size_t i=0; i < count; i++) {
+        snprintf(path, sizeof path, "%s/%s", dirs[i], SRCINFO_S);
+        size_t len;
+        char *data = justin_util_read_file(path, &len);
+        if (data == NULL) continue;
+        bool ok = !justin_srcinfo_parse(&info, data, len) ? info.pkgbase.ptr == NULL
+                : justin_sources_collect(&info, uts.machine, &list);
+        free(data);
+        if (!ok) {
+            *err = JUSTIN_ERR_NOMEM;
+            goto ex;
+        }
+    }
+    if (list.len == 0) goto ex;
+
+    char *srcdest = justin_sources_dir(ctx, err);
+    if ((*err) != JUSTIN_ERR_OK) goto ex;
+    size_t srcdest_len = strlen(srcdest);
+
+    justin_sources_transfer *transfers = (justin_sources_transfer*) calloc(list.len, sizeof(justin_sources_transfer));
+    CURLM *multi = curl_multi_init();
+    if (transfers == NULL || multi == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex_t;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) JUSTIN_SOURCES_CONNECTIONS);
+
+    size_t started = 0;
+    size_t cached = 0;
+    for (size_t i=0; i < list.len; i++) {
+        justin_sources_transfer *t = &transfers[started];
+        t->entry = &list.data[i];
+        t->fd = -1;
+        t->dest = (char*) malloc(srcdest_len + strlen(t->entry->file) + 2);
+        t->part = (char*) malloc(srcdest_len + strlen(t->entry->file) + 10);
+        if (t->dest == NULL || t->part == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            started++;
+            goto ex_m;
+        }
+        sprintf(t->dest, "%s/%s", srcdest, t->entry->file);
+        if (justin_sources_present(t->dest, t->entry)) {
+            free(t->dest);
+            free(t->part);
+            t->dest = NULL;
+            t->part = NULL;
+            cached++;
+            continue;
+        }
+        started++;
+
+        // Concurrent batches may fetch the same file, so every download gets its own partial file
+        sprintf(t->part, "%s.XXXXXX", t->dest);
+        t->fd = mkostemp(t->part, O_NOFOLLOW | O_CLOEXEC);
+        if (t->fd == -1) {
+            justin_sources_warn(t, strerror(errno));
+            continue;
+        }
+        if (fchown(t->fd, ctx->storage->user, -1) == -1 || fchmod(t->fd, 0644) == -1) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        justin_hash_init(&t->hash, t->entry->alg);
+
+        CURL *easy = curl_easy_init();
+        if (easy == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            goto ex_m;
+        }
+        t->easy = easy;
+        curl_easy_setopt(easy, CURLOPT_URL, t->entry->url);
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, 30L);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, justin_sources_on_data);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void*) t);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, (void*) t);
+        curl_multi_add_handle(multi, easy);
+    }
+
+    char buf[256];
+    size_t downloading = 0;
+    for (size_t i=0; i < started; i++) {
+        if (transfers[i].fd != -1) downloading++;
+    }
+    if (downloading != 0) {
+        snprintf(buf, sizeof buf, "Prefetching %zu sources (%zu already cached)", downloading, cached);
+        justin_log_info(buf);
+    }
+
+    int running = 1;
+    int queued;
+    size_t fetched = 0;
+    CURLMsg *msg;
+    while (running > 0) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) break;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            justin_sources_transfer *t;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &t);
+            if (justin_sources_finish(t, msg->data.result)) fetched++;
+            curl_multi_remove_handle(multi, t->easy);
+            curl_easy_cleanup(t->easy);
+            t->easy = NULL;
+        }
+        if (running > 0 && curl_multi_poll(multi, NULL, 0, 1000, NULL) != CURLM_OK) break;
+    }
+    if (downloading != 0) {
+        snprintf(buf, sizeof buf, "Prefetched %zu of %zu sources", fetched, downloading);
+        justin_log_info(buf);
+    }
+
+    ex_m:
+    for (size_t i=0; i < started; i++) {
+        justin_sources_transfer *t = &transfers[i];
+        // Only left over if the loop above was cut short
+        if (t->easy != NULL) {
+            curl_multi_remove_handle(multi, t->easy);
+            curl_easy_cleanup(t->easy);
+        }
+        if (t->fd != -1) {
+            close(t->fd);
+            unlink(t->part);
+        }
+        free(t->dest);
+        free(t->part);
+    }
+    ex_t:
+    if (multi != NULL) curl_multi_cleanup(multi);
+    free(transfers);
+    free(srcdest);
+    ex:
+    justin_srcinfo_free(&info);
+    justin_sources_list_free(&list);
+}
@@ -0,0 +1,47 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stddef.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_SOURCES_H
+#define JUSTIN_SOURCES_H
+
+/*
+ * Shared source cache. makepkg is pointed at a persistent SRCDEST in the storage directory, and the remote sources
+ * listed in the .SRCINFO of each build directory are downloaded into it beforehand, all at once. Checksums are
+ * computed while the bytes arrive, and a file only gets its final name once it matches, so makepkg finds every
+ * source it can use already in place. VCS and local sources are left to makepkg.
+ */
+
+#define JUSTIN_SOURCES_DIR ".srcdest"
+#define JUSTIN_SOURCES_CONNECTIONS 8
+
+/**
+ * Path of the shared SRCDEST, created if needed
+ */
+char* justin_sources_dir(justin_context ctx, justin_err *err);
+
+/**
+ * Downloads the missing sources of every build directory in "dirs" concurrently. A source that cannot be fetched or
+ * does not match its checksum is only warned about, since makepkg will try again and report it properly; "err" is set
+ * for anything else.
+ */
+void justin_sources_prefetch(justin_context ctx, const char *const *dirs, size_t count, justin_err *err);
+
+#endif //JUSTIN_SOURCES_H
@@ -0,0 +1,258 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "srcinfo.h"
+
+#define SRCINFO_FILE ".SRCINFO"
+static const char *SRCINFO_FILE_S = SRCINFO_FILE;
+
+typedef struct justin_srcinfo_key {
+    const char *name;
+    uint8_t len;
+    uint8_t field;
+} justin_srcinfo_key;
+
+#define KEY(s, f) { s, (sizeof s) - 1, f }
+static const justin_srcinfo_key SRCINFO_KEYS[] = {
+        KEY("depends", JUSTIN_SRCINFO_DEPENDS),
+        KEY("makedepends", JUSTIN_SRCINFO_MAKEDEPENDS),
+        KEY("checkdepends", JUSTIN_SRCINFO_CHECKDEPENDS),
+        KEY("optdepends", JUSTIN_SRCINFO_OPTDEPENDS),
+        KEY("provides", JUSTIN_SRCINFO_PROVIDES),
+        KEY("conflicts", JUSTIN_SRCINFO_CONFLICTS),
+        KEY("replaces", JUSTIN_SRCINFO_REPLACES),
+        KEY("source", JUSTIN_SRCINFO_SOURCE),
+        KEY("cksums", JUSTIN_SRCINFO_CKSUMS),
+        KEY("md5sums", JUSTIN_SRCINFO_MD5SUMS),
+        KEY("sha1sums", JUSTIN_SRCINFO_SHA1SUMS),
+        KEY("sha224sums", JUSTIN_SRCINFO_SHA224SUMS),
+        KEY("sha256sums", JUSTIN_SRCINFO_SHA256SUMS),
+        KEY("sha384sums", JUSTIN_SRCINFO_SHA384SUMS),
+        KEY("sha512sums", JUSTIN_SRCINFO_SHA512SUMS),
+        KEY("b2sums", JUSTIN_SRCINFO_B2SUMS)
+};
+#undef KEY
+#define SRCINFO_KEYS_LEN ((sizeof SRCINFO_KEYS) / sizeof(justin_srcinfo_key))
+
+static inline bool justin_srcinfo_eq(const char *a, size_t al, const char *b, size_t bl) {
+    return al == bl && memcmp(a, b, al) == 0;
+}
+
+#define justin_srcinfo_eq_lit(a, al, lit) justin_srcinfo_eq(a, al, lit, (sizeof lit) - 1)
+
+// Grows an array of the parsed info by doubling, keeping it for the next parse
+bool justin_srcinfo_reserve(void **data, size_t *cap, size_t len, size_t size) {
+    if (len < *cap) return true;
+    size_t next = (*cap) == 0 ? 16 : (*cap) << 1;
+    void *grown = reallocarray(*data, next, size);
+    if (grown == NULL) return false;
+    *data = grown;
+    *cap = next;
+    return true;
+}
+
+int justin_srcinfo_arch_slice(justin_srcinfo_t *info, const char *arch, size_t len) {
+    for (size_t i=1; i < info->archs_len; i++) {
+        if (justin_srcinfo_eq(info->archs[i].ptr, info->archs[i].len, arch, len)) return (int) i;
+    }
+    if (info->archs_len > UINT8_MAX) return -1;
+    if (!justin_srcinfo_reserve((void**) &info->archs, &info->archs_cap, info->archs_len, sizeof(justin_srcinfo_str))) return -1;
+    info->archs[info->archs_len].ptr = arch;
+    info->archs[info->archs_len].len = (uint32_t) len;
+    return (int) info->archs_len++;
+}
+
+bool justin_srcinfo_parse(justin_srcinfo_t *info, const char *data, size_t len) {
+    static const justin_srcinfo_str empty = { NULL, 0 };
+    info->pkgbase = empty;
+    info->pkgver = empty;
+    info->pkgrel = empty;
+    info->epoch = empty;
+    info->pkgnames_len = 0;
+    info->archs_len = 1;
+    info->entries_len = 0;
+    if (!justin_srcinfo_reserve((void**) &info->archs, &info->archs_cap, 0, sizeof(justin_srcinfo_str))) return false;
+    info->archs[0] = empty;
+
+    const char *p = data;
+    const char *end = &data[len];
+    const char *eol, *key, *key_end, *value, *value_end, *under;
+    uint16_t section = JUSTIN_SRCINFO_BASE;
+    while (p < end) {
+        eol = (const char*) memchr(p, '\n', end - p);
+        if (eol == NULL) eol = end;
+        key = p;
+        p = &eol[1];
+
+        while (key < eol && (*key == ' ' || *key == '\t')) key++;
+        if (key == eol || *key == '#') continue;
+        value = (const char*) memchr(key, '=', eol - key);
+        if (value == NULL) continue;
+        key_end = value++;
+        while (key_end > key && key_end[-1] == ' ') key_end--;
+        while (value < eol && *value == ' ') value++;
+        value_end = eol;
+        while (value_end > value && (value_end[-1] == '\r' || value_end[-1] == ' ')) value_end--;
+        size_t key_len = key_end - key;
+        justin_srcinfo_str str = { value, (uint32_t) (value_end - value) };
+
+        switch (key[0]) {
+            case 'p':
+                if (justin_srcinfo_eq_lit(key, key_len, "pkgbase")) {
+                    info->pkgbase = str;
+                    section = JUSTIN_SRCINFO_BASE;
+                    continue;
+                }
+                if (justin_srcinfo_eq_lit(key, key_len, "pkgname")) {
+                    if (info->pkgnames_len >= UINT16_MAX) return false;
+                    if (!justin_srcinfo_reserve((void**) &info->pkgnames, &info->pkgnames_cap, info->pkgnames_len, sizeof(justin_srcinfo_str))) return false;
+                    info->pkgnames[info->pkgnames_len++] = str;
+                    section = (uint16_t) info->pkgnames_len;
+                    continue;
+                }
+                if (section == JUSTIN_SRCINFO_BASE) {
+                    if (justin_srcinfo_eq_lit(key, key_len, "pkgver")) {
+                        info->pkgver = str;
+                        continue;
+                    }
+                    if (justin_srcinfo_eq_lit(key, key_len, "pkgrel")) {
+                        info->pkgrel = str;
+                        continue;
+                    }
+                }
+                break;
+            case 'e':
+                if (section == JUSTIN_SRCINFO_BASE && justin_srcinfo_eq_lit(key, key_len, "epoch")) {
+                    info->epoch = str;
+                    continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+        // <field>[_<arch>]
+        under = (const char*) memchr(key, '_', key_len);
+        size_t name_len = under == NULL ? key_len : (size_t) (under - key);
+        int field = -1;
+        for (size_t i=0; i < SRCINFO_KEYS_LEN; i++) {
+            if (justin_srcinfo_eq(key, name_len, SRCINFO_KEYS[i].name, SRCINFO_KEYS[i].len)) {
+                field = SRCINFO_KEYS[i].field;
+                break;
+            }
+        }
+        if (field < 0) continue;
+
+        int arch = JUSTIN_SRCINFO_ANY;
+        if (under != NULL) {
+            arch = justin_srcinfo_arch_slice(info, &under[1], key_end - &under[1]);
+            if (arch < 0) return false;
+        }
+        if (!justin_srcinfo_reserve((void**) &info->entries, &info->entries_cap, info->entries_len, sizeof(justin_srcinfo_entry))) return false;
+        justin_srcinfo_entry *entry = &info->entries[info->entries_len++];
+        entry->field = (uint8_t) field;
+        entry->arch = (uint8_t) arch;
+        entry->section = section;
+        entry->value = str;
+    }
+    return info->pkgbase.ptr != NULL;
+}
+
+void justin_srcinfo_free(justin_srcinfo_t *info) {
+    free(info->pkgnames);
+    free(info->archs);
+    free(info->entries);
+    info->pkgnames = NULL;
+    info->archs = NULL;
+    info->entries = NULL;
+    info->pkgnames_cap = 0;
+    info->archs_cap = 0;
+    info->entries_cap = 0;
+}
+
+int justin_srcinfo_arch(const justin_srcinfo_t *info, const char *arch) {
+    size_t len = strlen(arch);
+    for (size_t i=1; i < info->archs_len; i++) {
+        if (justin_srcinfo_eq(info->archs[i].ptr, info->archs[i].len, arch, len)) return (int) i;
+    }
+    return -1;
+}
+
+bool justin_srcinfo_has(const justin_srcinfo_t *info, uint8_t field, uint16_t section, uint8_t arch) {
+    for (size_t i=0; i < info->entries_len; i++) {
+        const justin_srcinfo_entry *e = &info->entries[i];
+        if (e->field == field && e->section == section && e->arch == arch) return true;
+    }
+    return false;
+}
+
+void justin_srcinfo_iter_init(const justin_srcinfo_t *info, justin_srcinfo_iter *iter, justin_srcinfo_field field, uint16_t section, int arch) {
+    iter->pos = 0;
+    iter->field = (uint8_t) field;
+    iter->phase = 0;
+    iter->arch = arch;
+    iter->section[0] = section;
+    iter->section[1] = section;
+    if (section == JUSTIN_SRCINFO_BASE) return;
+    if (!justin_srcinfo_has(info, field, section, JUSTIN_SRCINFO_ANY)) iter->section[0] = JUSTIN_SRCINFO_BASE;
+    if (arch > 0 && !justin_srcinfo_has(info, field, section, (uint8_t) arch)) iter->section[1] = JUSTIN_SRCINFO_BASE;
+}
+
+bool justin_srcinfo_iter_next(const justin_srcinfo_t *info, justin_srcinfo_iter *iter, justin_srcinfo_str *out) {
+    while (iter->phase < 2) {
+        uint8_t arch = iter->phase == 0 ? JUSTIN_SRCINFO_ANY : (uint8_t) iter->arch;
+        uint16_t section = iter->section[iter->phase];
+        while (iter->pos < info->entries_len) {
+            const justin_srcinfo_entry *e = &info->entries[iter->pos++];
+            if (e->field == iter->field && e->arch == arch && e->section == section) {
+                *out = e->value;
+                return true;
+            }
+        }
+        iter->pos = 0;
+        iter->phase = (iter->phase == 0 && iter->arch > 0) ? 1 : 2;
+    }
+    return false;
+}
+
+git_blob *justin_srcinfo_load(git_repository *repo, git_commit *commit, justin_srcinfo_t *info, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    git_tree *tree;
+    if (git_commit_tree(&tree, commit) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        return NULL;
+    }
+    const git_tree_entry *entry = git_tree_entry_byname(tree, SRCINFO_FILE_S);
+    git_blob *blob = NULL;
+    if (entry != NULL && git_blob_lookup(&blob, repo, git_tree_entry_id(entry)) != 0) {
+        *err = JUSTIN_ERR_GIT;
+        blob = NULL;
+    }
+    git_tree_free(tree);
+    if (blob == NULL) return NULL;
+
+    const char *data = (const char*) git_blob_rawcontent(blob);
+    size_t len = (size_t) git_blob_rawsize(blob);
+    if (!justin_srcinfo_parse(info, data, len)) {
+        *err = info->pkgbase.ptr == NULL ? JUSTIN_ERR_ASSERTION : JUSTIN_ERR_NOMEM;
+        git_blob_free(blob);
+        return NULL;
+    }
+    return blob;
+}
@@ -0,0 +1,124 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <git2.h>
+#include "../logging.h"
+
+#ifndef JUSTIN_SRCINFO_H
+#define JUSTIN_SRCINFO_H
+
+/*
+ * .SRCINFO parser. Nothing is copied: every value is a slice of the input buffer (usually the raw content of a git
+ * blob), which must outlive the parsed info. All list values of all sections go into one flat array of entries,
+ * tagged with their field, section and architecture, and the arrays are reused from one parse to the next, so that
+ * walking a whole history does not allocate after the first few commits.
+ */
+
+typedef struct justin_srcinfo_str {
+    const char *ptr;
+    uint32_t len;
+} justin_srcinfo_str;
+
+typedef enum justin_srcinfo_field {
+    JUSTIN_SRCINFO_DEPENDS,
+    JUSTIN_SRCINFO_MAKEDEPENDS,
+    JUSTIN_SRCINFO_CHECKDEPENDS,
+    JUSTIN_SRCINFO_OPTDEPENDS,
+    JUSTIN_SRCINFO_PROVIDES,
+    JUSTIN_SRCINFO_CONFLICTS,
+    JUSTIN_SRCINFO_REPLACES,
+    JUSTIN_SRCINFO_SOURCE,
+    JUSTIN_SRCINFO_CKSUMS,
+    JUSTIN_SRCINFO_MD5SUMS,
+    JUSTIN_SRCINFO_SHA1SUMS,
+    JUSTIN_SRCINFO_SHA224SUMS,
+    JUSTIN_SRCINFO_SHA256SUMS,
+    JUSTIN_SRCINFO_SHA384SUMS,
+    JUSTIN_SRCINFO_SHA512SUMS,
+    JUSTIN_SRCINFO_B2SUMS,
+    JUSTIN_SRCINFO_FIELD_COUNT
+} justin_srcinfo_field;
+
+/** Section index of the pkgbase; package n (0-based, in pkgnames) is section n + 1 */
+#define JUSTIN_SRCINFO_BASE 0
+/** Architecture index of entries without a suffix */
+#define JUSTIN_SRCINFO_ANY 0
+
+typedef struct justin_srcinfo_entry {
+    uint8_t field;
+    uint8_t arch;
+    uint16_t section;
+    justin_srcinfo_str value;
+} justin_srcinfo_entry;
+
+typedef struct justin_srcinfo_t {
+    justin_srcinfo_str pkgbase;
+    justin_srcinfo_str pkgver;
+    justin_srcinfo_str pkgrel;
+    justin_srcinfo_str epoch;
+    justin_srcinfo_str *pkgnames;
+    size_t pkgnames_len;
+    size_t pkgnames_cap;
+    justin_srcinfo_str *archs;      // architecture suffixes seen, index 0 is unused (JUSTIN_SRCINFO_ANY)
+    size_t archs_len;
+    size_t archs_cap;
+    justin_srcinfo_entry *entries;
+    size_t entries_len;
+    size_t entries_cap;
+} justin_srcinfo_t;
+#define JUSTIN_SRCINFO_INITIALIZER { { NULL, 0 }, { NULL, 0 }, { NULL, 0 }, { NULL, 0 }, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0 }
+
+/**
+ * Parses "len" bytes of .SRCINFO into "info", replacing what it held. Unknown keys are skipped. Returns false if out
+ * of memory or if there is no pkgbase.
+ */
+bool justin_srcinfo_parse(justin_srcinfo_t *info, const char *data, size_t len);
+
+void justin_srcinfo_free(justin_srcinfo_t *info);
+
+/**
+ * Index of an architecture suffix in info->archs, or -1 if no entry uses it
+ */
+int justin_srcinfo_arch(const justin_srcinfo_t *info, const char *arch);
+
+typedef struct justin_srcinfo_iter {
+    size_t pos;
+    uint8_t field;
+    uint8_t phase;              // 0 while reading generic values, 1 for the architecture, 2 when done
+    int arch;
+    uint16_t section[2];        // section to read the generic and the architecture specific values from
+} justin_srcinfo_iter;
+
+/**
+ * Starts iterating over the values of "field" for a section, generic values first, then those of "arch" (an index
+ * from justin_srcinfo_arch, or -1 for generic values only). A package section that sets a field replaces the pkgbase
+ * values of it, per architecture, as in makepkg.
+ */
+void justin_srcinfo_iter_init(const justin_srcinfo_t *info, justin_srcinfo_iter *iter, justin_srcinfo_field field, uint16_t section, int arch);
+
+bool justin_srcinfo_iter_next(const justin_srcinfo_t *info, justin_srcinfo_iter *iter, justin_srcinfo_str *out);
+
+/**
+ * Parses the .SRCINFO in the tree of "commit". The returned blob backs the parsed values and must be freed after
+ * them; NULL with "err" unset means the tree has no .SRCINFO.
+ */
+git_blob *justin_srcinfo_load(git_repository *repo, git_commit *commit, justin_srcinfo_t *info, justin_err *err);
+
+#endif //JUSTIN_SRCINFO_H
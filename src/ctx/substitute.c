@@ -0,0 +1,282 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <curl/curl.h>
+#include "../hash.h"
+#include "../util.h"
+#include "pkg.h"
+#include "artifact.h"
+#include "substitute.h"
+
+static const char *SUBSTITUTE_INDEX_S = JUSTIN_SUBSTITUTE_INDEX;
+
+#define SUBSTITUTE_SUM_LEN 64
+
+typedef struct justin_substitute_sink {
+    int fd;
+    justin_hash_t *hash;    // NULL if the content is not checked
+    bool write_failed;
+} justin_substitute_sink;
+
+static inline bool justin_substitute_is_url(const char *src) {
+    return strncmp(src, "http://", 7) == 0 || strncmp(src, "https://", 8) == 0;
+}
+
+// Index entries name files in the entry itself, never anything else
+bool justin_substitute_name_ok(const char *name) {
+    return name[0] != '.' && strchr(name, '/') == NULL && justin_pkg_is_archive(name);
+}
+
+bool justin_substitute_sink_write(justin_substitute_sink *sink, const char *data, size_t len) {
+    if (sink->hash != NULL) justin_hash_update(sink->hash, data, len);
+    size_t off = 0;
+    ssize_t w;
+    while (off < len) {
+        w = write(sink->fd, &data[off], len - off);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            sink->write_failed = true;
+            return false;
+        }
+        off += w;
+    }
+    return true;
+}
+
+size_t justin_substitute_on_data(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    size_t len = size * nmemb;
+    return justin_substitute_sink_write((justin_substitute_sink*) userdata, ptr, len) ? len : 0;
+}
+
+// Returns 1 if the file was copied from the entry, 0 if the substituter does not have it and -1 if it failed
+int justin_substitute_get(const char *src, const char *key, const char *file, justin_substitute_sink *sink) {
+    size_t src_len = strlen(src);
+    while (src_len > 1 && src[src_len - 1] == '/') src_len--;
+    char *from;
+    if (asprintf(&from, "%.*s/%s/%s", (int) src_len, src, key, file) == -1) return -1;
+
+    int ret = 1;
+    if (justin_substitute_is_url(src)) {
+        // The shared handle of the context belongs to the main thread, lookups also run in the pipeline
+        CURL *easy = curl_easy_init();
+        if (easy == NULL) {
+            free(from);
+            return -1;
+        }
+        curl_easy_setopt(easy, CURLOPT_URL, from);
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, 30L);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, justin_substitute_on_data);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void*) sink);
+        CURLcode res = curl_easy_perform(easy);
+        long status = 0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_cleanup(easy);
+        if (res != CURLE_OK) ret = (res == CURLE_HTTP_RETURNED_ERROR && (status == 404 || status == 410)) ? 0 : -1;
+    } else {
+        int fd = open(from, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            ret = errno == ENOENT ? 0 : -1;
+        } else {
+            char *buf = (char*) malloc(65536);
+            ssize_t r = -1;
+            while (buf != NULL) {
+                r = read(fd, buf, 65536);
+                if (r == -1 && errno == EINTR) continue;
+                if (r <= 0 || !justin_substitute_sink_write(sink, buf, r)) break;
+            }
+            if (r != 0) ret = -1;
+            free(buf);
+            close(fd);
+        }
+    }
+    free(from);
+    return ret;
+}
+
+// Copies "file" of the entry into "dir", returns as justin_substitute_get
+int justin_substitute_get_into(const char *src, const char *key, const char *file, const char *dir, justin_hash_t *hash) {
+    char dest[PATH_MAX];
+    snprintf(dest, sizeof dest, "%s/%s", dir, file);
+    justin_substitute_sink sink = { -1, hash, false };
+    sink.fd = open(dest, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (sink.fd == -1) return -1;
+    int ret = justin_substitute_get(src, key, file, &sink);
+    if (close(sink.fd) != 0 || sink.write_failed) ret = -1;
+    return ret;
+}
+
+void justin_substitute_warn(const char *src, const char *msg) {
+    char buf[256];
+    snprintf(buf, sizeof buf, "Substituter %.128s: %s", src, msg);
+    justin_log_warn(buf);
+}
+
+// Fills "dir" with the entry "key" of one substituter, returns as justin_substitute_get
+int justin_substitute_fetch_from(const char *src, const char *key, const char *dir) {
+    int ret = justin_substitute_get_into(src, key, SUBSTITUTE_INDEX_S, dir, NULL);
+    if (ret != 1) {
+        if (ret == -1) justin_substitute_warn(src, "could not read the index");
+        return ret;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, SUBSTITUTE_INDEX_S);
+    size_t len;
+    char *data = justin_util_read_file(path, &len);
+    if (data == NULL) return -1;
+
+    size_t count = 0;
+    char *save;
+    char *line = strtok_r(data, "\n", &save);
+    justin_hash_t hash;
+    uint8_t digest[JUSTIN_HASH_MAX_SIZE];
+    char hex[(JUSTIN_HASH_MAX_SIZE << 1) + 1];
+    char msg[256];
+    while (line != NULL) {
+        char *file = &line[SUBSTITUTE_SUM_LEN + 1];
+        if (strlen(line) <= SUBSTITUTE_SUM_LEN + 1 || line[SUBSTITUTE_SUM_LEN] != ' ' ||
+            strspn(line, "0123456789abcdefABCDEF") != SUBSTITUTE_SUM_LEN || !justin_substitute_name_ok(file)) {
+            justin_substitute_warn(src, "bad index");
+            ret = -1;
+            break;
+        }
+        line[SUBSTITUTE_SUM_LEN] = '\0';
+        justin_hash_init(&hash, JUSTIN_HASH_SHA256);
+        if (justin_substitute_get_into(src, key, file, dir, &hash) != 1) {
+            snprintf(msg, sizeof msg, "could not download %.128s", file);
+            justin_substitute_warn(src, msg);
+            ret = -1;
+            break;
+        }
+        justin_util_b2hex(digest, justin_hash_final(&hash, digest), hex);
+        if (strcasecmp(hex, line) != 0) {
+            snprintf(msg, sizeof msg, "%.128s does not match the index", file);
+            justin_substitute_warn(src, msg);
+            ret = -1;
+            break;
+        }
+        count++;
+        line = strtok_r(NULL, "\n", &save);
+    }
+    free(data);
+    if (ret == 1 && count == 0) {
+        justin_substitute_warn(src, "empty index");
+        ret = -1;
+    }
+    return ret;
+}
+
+bool justin_substitute_fetch(justin_context ctx, const char *key, const char *path, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    if (ctx->params->v_substituters == NULL) return false;
+    char *srcs = strdup(ctx->params->v_substituters);
+    if (srcs == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return false;
+    }
+
+    bool fetched = false;
+    char *save;
+    char *src = strtok_r(srcs, ",", &save);
+    while (!fetched && src != NULL) {
+        char *tmp = justin_artifact_stage(ctx, err);
+        if (tmp == NULL) break;
+        if (justin_substitute_fetch_from(src, key, tmp) == 1) {
+            // As in justin_artifact_store, another process may have put the same entry in place first
+            fetched = rename(tmp, path) == 0 || errno == EEXIST || errno == ENOTEMPTY;
+            if (fetched) {
+                char buf[256];
+                snprintf(buf, sizeof buf, "Downloaded %.64s from %.128s", key, src);
+                justin_log_debug(buf);
+            } else {
+                *err = JUSTIN_ERR_SYSTEM;
+            }
+        }
+        if (access(tmp, F_OK) == 0 && justin_util_rimraf(tmp) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        free(tmp);
+        if ((*err) != JUSTIN_ERR_OK) break;
+        src = strtok_r(NULL, ",", &save);
+    }
+    free(srcs);
+    return fetched;
+}
+
+void justin_substitute_index(const char *dir, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, SUBSTITUTE_INDEX_S);
+    FILE *index = fopen(path, "we");
+    if (index == NULL) {
+        closedir(d);
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+
+    struct dirent *ent;
+    justin_hash_t hash;
+    uint8_t digest[JUSTIN_HASH_MAX_SIZE];
+    char hex[(JUSTIN_HASH_MAX_SIZE << 1) + 1];
+    char *buf = (char*) malloc(65536);
+    if (buf == NULL) *err = JUSTIN_ERR_NOMEM;
+    while ((*err) == JUSTIN_ERR_OK && (ent = readdir(d)) != NULL) {
+        if (ent->d_type != DT_REG || !justin_substitute_name_ok(ent->d_name)) continue;
+        snprintf(path, sizeof path, "%s/%s", dir, ent->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
+        }
+        justin_hash_init(&hash, JUSTIN_HASH_SHA256);
+        ssize_t r;
+        while ((r = read(fd, buf, 65536)) != 0) {
+            if (r == -1 && errno == EINTR) continue;
+            if (r == -1) break;
+            justin_hash_update(&hash, buf, r);
+        }
+        close(fd);
+        if (r != 0) {
+            *err = JUSTIN_ERR_SYSTEM;
+            break;
+        }
+        justin_util_b2hex(digest, justin_hash_final(&hash, digest), hex);
+        // Lowercase like sha256sum, so that an index can also be written by hand
+        for (char *c = hex; *c != '\0'; c++) *c = (char) tolower(*c);
+        fprintf(index, "%s %s\n", hex, ent->d_name);
+    }
+    free(buf);
+    closedir(d);
+    if (fclose(index) != 0 && (*err) == JUSTIN_ERR_OK) *err = JUSTIN_ERR_SYSTEM;
+}
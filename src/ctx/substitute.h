@@ -0,0 +1,49 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include "../context.h"
+#include "../logging.h"
+
+#ifndef JUSTIN_SUBSTITUTE_H
+#define JUSTIN_SUBSTITUTE_H
+
+/*
+ * Binary substituters. "-B<src>,<src>,..." names caches of built packages that are asked, in order, for an entry
+ * before anything is built: a directory or an http(s):// URL laid out like the artifact cache, so the ".artifacts"
+ * directory of another machine's storage works as either (shared over NFS, or behind any static file server). An
+ * entry is "<key>/index", one "<sha256> <file>" line per package, next to the packages themselves; every entry the
+ * artifact cache stores gets an index. The packages are downloaded into the local artifact cache and checked against
+ * the index, and a partial or corrupt entry is discarded as a miss. One machine builds, the others download.
+ *
+ * The index only guards against broken transfers: a substituter is trusted as much as the AUR itself.
+ */
+
+#define JUSTIN_SUBSTITUTE_INDEX "index"
+
+/**
+ * Writes the index of the package archives in "dir"
+ */
+void justin_substitute_index(const char *dir, justin_err *err);
+
+/**
+ * Fetches the entry "key" from the first substituter that has it into "path", a cache directory from
+ * justin_artifact_lookup. Returns true if "path" now holds the packages. Substituters that fail are warned about and
+ * skipped; "err" is only set for local failures.
+ */
+bool justin_substitute_fetch(justin_context ctx, const char *key, const char *path, justin_err *err);
+
+#endif //JUSTIN_SUBSTITUTE_H
@@ -0,0 +1,576 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <git2.h>
+#include "../ansi.h"
+#include "../util.h"
+#include "vcs.h"
+
+#define SRCINFO ".SRCINFO"
+static const char *SRCINFO_S = SRCINFO;
+
+#define REFS_EXT ".refs"
+#define LOCK_EXT ".lock"
+
+// Protocols makepkg hands to a VCS, either alone (git://) or as a prefix (git+https://)
+static const char *VCS_PROTOCOLS[] = { "git", "svn", "hg", "bzr", "fossil" };
+
+// Package name suffixes of VCS packages by AUR convention
+static const char *VCS_SUFFIXES[] = { "-git", "-svn", "-hg", "-bzr", "-fossil", "-darcs", "-cvs" };
+
+typedef struct justin_vcs_source {
+    char *url;              // as handed to the VCS, without prefix and fragment
+    char *ref;              // ref the build follows, NULL if pinned to a commit
+    char *dir;              // name of the checkout in src/
+    bool git;               // only git remotes can be asked for their refs
+    bool resolved;
+    git_oid oid;
+} justin_vcs_source;
+
+typedef struct justin_vcs_source_list {
+    justin_vcs_source *data;
+    size_t len;
+    size_t cap;
+} justin_vcs_source_list;
+
+typedef struct justin_vcs_pool {
+    justin_vcs_source **sources;
+    size_t count;
+    size_t next;
+    pthread_mutex_t mutex;
+} justin_vcs_pool;
+
+// Length of the protocol of a VCS source URL (up to the '+' or "://"), 0 if it is not one
+size_t justin_vcs_protocol(const char *url, size_t len) {
+    const char *proto_end = (const char*) memmem(url, len, "://", 3);
+    if (proto_end == NULL) return 0;
+    const char *plus = (const char*) memchr(url, '+', proto_end - url);
+    if (plus != NULL) proto_end = plus;
+    size_t proto_len = proto_end - url;
+    for (size_t i=0; i < (sizeof VCS_PROTOCOLS) / sizeof(char*); i++) {
+        if (strlen(VCS_PROTOCOLS[i]) == proto_len && memcmp(VCS_PROTOCOLS[i], url, proto_len) == 0) return proto_len;
+    }
+    return 0;
+}
+
+bool justin_vcs_source_list_add(justin_vcs_source_list *list, justin_srcinfo_str src) {
+    // [name::]proto[+transport]://host/path[?query][#fragment]
+    const char *end = &src.ptr[src.len];
+    const char *url = src.ptr;
+    const char *name = NULL;
+    size_t name_len = 0;
+    const char *sep = (const char*) memmem(src.ptr, src.len, "::", 2);
+    if (sep != NULL) {
+        name = src.ptr;
+        name_len = sep - src.ptr;
+        url = &sep[2];
+    }
+    size_t proto_len = justin_vcs_protocol(url, end - url);
+    if (proto_len == 0) return true;
+    bool git = proto_len == 3 && memcmp(url, "git", 3) == 0;
+    if (url[proto_len] == '+') url = &url[proto_len + 1];
+
+    const char *fragment = (const char*) memchr(url, '#', end - url);
+    const char *url_end = fragment == NULL ? end : fragment;
+    const char *query = (const char*) memchr(url, '?', url_end - url);
+    if (query != NULL) url_end = query;
+
+    // Same file name as makepkg gives the checkout
+    if (name == NULL) {
+        const char *path_end = url_end;
+        while (path_end > url && path_end[-1] == '/') path_end--;
+        name = path_end;
+        while (name > url && name[-1] != '/') name--;
+        name_len = path_end - name;
+        if (name_len > 4 && memcmp(&name[name_len - 4], ".git", 4) == 0) name_len -= 4;
+    }
+
+    char *ref = NULL;
+    if (fragment == NULL) {
+        ref = strdup("HEAD");
+    } else {
+        int frag_len = (int) (end - &fragment[1]);
+        const char *frag = &fragment[1];
+        if (strncmp(frag, "branch=", 7) == 0) {
+            if (asprintf(&ref, "refs/heads/%.*s", frag_len - 7, &frag[7]) == -1) ref = NULL;
+        } else if (strncmp(frag, "tag=", 4) == 0) {
+            if (asprintf(&ref, "refs/tags/%.*s", frag_len - 4, &frag[4]) == -1) ref = NULL;
+        } else {
+            // commit= and revision= never move
+            return true;
+        }
+    }
+
+    if (list->len == list->cap) {
+        size_t cap = list->cap == 0 ? 4 : list->cap << 1;
+        justin_vcs_source *grown = (justin_vcs_source*) reallocarray(list->data, cap, sizeof(justin_vcs_source));
+        if (grown == NULL) {
+            free(ref);
+            return false;
+        }
+        list->data = grown;
+        list->cap = cap;
+    }
+    justin_vcs_source *s = &list->data[list->len];
+    memset(s, 0, sizeof(justin_vcs_source));
+    s->url = strndup(url, url_end - url);
+    s->dir = strndup(name, name_len);
+    s->ref = ref;
+    s->git = git;
+    if (s->url == NULL || s->dir == NULL || s->ref == NULL) {
+        free(s->url);
+        free(s->dir);
+        free(s->ref);
+        return false;
+    }
+    list->len++;
+    return true;
+}
+
+bool justin_vcs_source_list_parse(const justin_srcinfo_t *info, justin_vcs_source_list *list) {
+    for (size_t i=0; i < info->entries_len; i++) {
+        const justin_srcinfo_entry *e = &info->entries[i];
+        if (e->field != JUSTIN_SRCINFO_SOURCE || e->section != JUSTIN_SRCINFO_BASE) continue;
+        if (!justin_vcs_source_list_add(list, e->value)) return false;
+    }
+    return true;
+}
+
+void justin_vcs_source_list_free(justin_vcs_source_list *list) {
+    for (size_t i=0; i < list->len; i++) {
+        free(list->data[i].url);
+        free(list->data[i].ref);
+        free(list->data[i].dir);
+    }
+    free(list->data);
+    list->data = NULL;
+    list->len = 0;
+    list->cap = 0;
+}
+
+// Asks the remote of a git source where its ref points, preferring the peeled commit of annotated tags
+void justin_vcs_ls_remote(justin_vcs_source *src) {
+    git_remote *remote;
+    if (git_remote_create_detached(&remote, src->url) != 0) return;
+    git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+    if (git_remote_connect(remote, GIT_DIRECTION_FETCH, &callbacks, NULL, NULL) == 0) {
+        const git_remote_head **heads;
+        size_t count;
+        if (git_remote_ls(&heads, &count, remote) == 0) {
+            size_t ref_len = strlen(src->ref);
+            for (size_t i=0; i < count; i++) {
+                const char *name = heads[i]->name;
+                if (strncmp(name, src->ref, ref_len) != 0) continue;
+                if (name[ref_len] == '\0' || strcmp(&name[ref_len], "^{}") == 0) {
+                    git_oid_cpy(&src->oid, &heads[i]->oid);
+                    src->resolved = true;
+                }
+            }
+        }
+        git_remote_disconnect(remote);
+    }
+    git_remote_free(remote);
+}
+
+void *justin_vcs_resolve_worker(void *arg) {
+    justin_vcs_pool *pool = (justin_vcs_pool*) arg;
+    justin_vcs_source *src;
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        src = pool->next < pool->count ? pool->sources[pool->next++] : NULL;
+        pthread_mutex_unlock(&pool->mutex);
+        if (src == NULL) break;
+        justin_vcs_ls_remote(src);
+    }
+    return NULL;
+}
+
+// Resolves the refs of all the given git sources, JUSTIN_VCS_CONNECTIONS at a time
+void justin_vcs_resolve(justin_vcs_source **sources, size_t count) {
+    if (count == 0) return;
+    justin_vcs_pool pool = { sources, count, 0, PTHREAD_MUTEX_INITIALIZER };
+    size_t n = count < JUSTIN_VCS_CONNECTIONS ? count : JUSTIN_VCS_CONNECTIONS;
+    pthread_t threads[JUSTIN_VCS_CONNECTIONS];
+    size_t started = 0;
+    while (started < n - 1 && pthread_create(&threads[started], NULL, justin_vcs_resolve_worker, &pool) == 0) started++;
+    justin_vcs_resolve_worker(&pool);
+    for (size_t i=0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+// Resolves the refs of the git sources in a list, returning false if out of memory
+bool justin_vcs_source_list_resolve(justin_vcs_source_list *list) {
+    if (list->len == 0) return true;
+    justin_vcs_source **git = (justin_vcs_source**) malloc(list->len * sizeof(justin_vcs_source*));
+    if (git == NULL) return false;
+    size_t git_len = 0;
+    for (size_t i=0; i < list->len; i++) {
+        if (list->data[i].git) git[git_len++] = &list->data[i];
+    }
+    justin_vcs_resolve(git, git_len);
+    free(git);
+    return true;
+}
+
+// Parses the .SRCINFO of a build directory
+char* justin_vcs_srcinfo(const char *path, justin_srcinfo_t *info) {
+    char file[PATH_MAX];
+    snprintf(file, sizeof file, "%s/%s", path, SRCINFO_S);
+    size_t len;
+    char *data = justin_util_read_file(file, &len);
+    if (data != NULL && !justin_srcinfo_parse(info, data, len)) {
+        free(data);
+        data = NULL;
+    }
+    return data;
+}
+
+// Copies the pkgbase if the package has a VCS source and the name is safe to use as a file name
+char* justin_vcs_pkgbase(const char *path) {
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    char *data = justin_vcs_srcinfo(path, &info);
+    if (data == NULL) return NULL;
+
+    char *ret = NULL;
+    justin_srcinfo_str base = info.pkgbase;
+    if (base.len == 0 || base.ptr[0] == '.' || memchr(base.ptr, '/', base.len) != NULL) goto ex;
+
+    for (size_t i=0; i < info.entries_len; i++) {
+        const justin_srcinfo_str *src = &info.entries[i].value;
+        if (info.entries[i].field != JUSTIN_SRCINFO_SOURCE) continue;
+        const char *sep = (const char*) memmem(src->ptr, src->len, "::", 2);
+        const char *url = sep == NULL ? src->ptr : &sep[2];
+        if (justin_vcs_protocol(url, &src->ptr[src->len] - url) != 0) {
+            ret = strndup(base.ptr, base.len);
+            break;
+        }
+    }
+
+    ex:
+    justin_srcinfo_free(&info);
+    free(data);
+    return ret;
+}
+
+char* justin_vcs_file(justin_context ctx, const char *base, const char *ext, justin_err *err) {
+    char name[NAME_MAX];
+    snprintf(name, sizeof name, "%.200s%s", base, ext);
+    return justin_storage_path(ctx->storage, JUSTIN_VCS_DIR, name, err);
+}
+
+void justin_vcs_acquire(justin_context ctx, const char *path, justin_vcs_t *vcs, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    vcs->base = justin_vcs_pkgbase(path);
+    if (vcs->base == NULL) return;
+
+    char *lock_path = justin_vcs_file(ctx, vcs->base, LOCK_EXT, err);
+    if ((*err) != JUSTIN_ERR_OK) return;
+    int fd = open(lock_path, O_CREAT | O_RDWR | O_CLOEXEC, 0664);
+    free(lock_path);
+    if (fd == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+    if (fchown(fd, ctx->storage->user, -1) == -1) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        close(fd);
+        if (errno != EWOULDBLOCK) *err = JUSTIN_ERR_SYSTEM;
+        return;
+    }
+
+    vcs->builddir = justin_storage_path(ctx->storage, JUSTIN_VCS_DIR, "", err);
+    if ((*err) == JUSTIN_ERR_OK && asprintf(&vcs->pkgdir, "%s/%s/pkg", vcs->builddir, vcs->base) == -1) {
+        vcs->pkgdir = NULL;
+        *err = JUSTIN_ERR_NOMEM;
+    }
+    if ((*err) != JUSTIN_ERR_OK) {
+        free(vcs->builddir);
+        vcs->builddir = NULL;
+        close(fd);
+        return;
+    }
+    vcs->lock_fd = fd;
+}
+
+void justin_vcs_record(justin_context ctx, const char *path, justin_vcs_t *vcs) {
+    if (vcs->base == NULL) return;
+    justin_err err = JUSTIN_ERR_OK;
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    justin_vcs_source_list list = { NULL, 0, 0 };
+    char *record = NULL;
+    char *tmp = NULL;
+    FILE *f = NULL;
+
+    char *data = justin_vcs_srcinfo(path, &info);
+    if (data == NULL || !justin_vcs_source_list_parse(&info, &list)) {
+        err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    // What upstream points at is what justin_vcs_check compares with, the checkout can be at a peeled tag or a merge
+    if (!justin_vcs_source_list_resolve(&list)) {
+        err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    record = justin_vcs_file(ctx, vcs->base, REFS_EXT, &err);
+    if (err != JUSTIN_ERR_OK) goto ex;
+    if (asprintf(&tmp, "%s.tmp", record) == -1) {
+        tmp = NULL;
+        err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    if ((f = fopen(tmp, "we")) == NULL) {
+        err = JUSTIN_ERR_SYSTEM;
+        goto ex;
+    }
+
+    // <commit or -> <ref> <url>, with "-" where upstream could not be asked
+    char hex[GIT_OID_HEXSZ + 1];
+    for (size_t i=0; i < list.len; i++) {
+        justin_vcs_source *src = &list.data[i];
+        strcpy(hex, "-");
+        if (src->resolved) git_oid_tostr(hex, sizeof hex, &src->oid);
+        fprintf(f, "%s %s %s\n", hex, src->ref, src->url);
+    }
+    if (fclose(f) != 0 || rename(tmp, record) == -1) {
+        err = JUSTIN_ERR_SYSTEM;
+        unlink(tmp);
+    }
+    f = NULL;
+
+    ex:
+    if (f != NULL) {
+        fclose(f);
+        unlink(tmp);
+    }
+    if (err != JUSTIN_ERR_OK) justin_log_err_soft(err);
+    free(tmp);
+    free(record);
+    justin_vcs_source_list_free(&list);
+    justin_srcinfo_free(&info);
+    free(data);
+}
+
+void justin_vcs_release(justin_vcs_t *vcs) {
+    // Packaged files are a copy of what is in the archive, only src/ is worth keeping
+    if (vcs->pkgdir != NULL) justin_util_rimraf(vcs->pkgdir);
+    free(vcs->pkgdir);
+    free(vcs->builddir);
+    free(vcs->base);
+    vcs->pkgdir = NULL;
+    vcs->builddir = NULL;
+    vcs->base = NULL;
+    if (vcs->lock_fd != -1) {
+        close(vcs->lock_fd);
+        vcs->lock_fd = -1;
+    }
+}
+
+bool justin_vcs_is_vcs_name(const char *name) {
+    size_t len = strlen(name);
+    for (size_t i=0; i < (sizeof VCS_SUFFIXES) / sizeof(char*); i++) {
+        size_t suffix_len = strlen(VCS_SUFFIXES[i]);
+        if (len > suffix_len && strcmp(&name[len - suffix_len], VCS_SUFFIXES[i]) == 0) return true;
+    }
+    return false;
+}
+
+char* justin_vcs_describe_info(const justin_srcinfo_t *info, bool *resolved, justin_err *err) {
+    justin_vcs_source_list list = { NULL, 0, 0 };
+    char *ret = NULL;
+    size_t ret_len = 0;
+    FILE *f = NULL;
+    if (!justin_vcs_source_list_parse(info, &list) || !justin_vcs_source_list_resolve(&list)) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    if (list.len == 0) goto ex;
+
+    if ((f = open_memstream(&ret, &ret_len)) == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    char hex[GIT_OID_HEXSZ + 1];
+    for (size_t i=0; i < list.len; i++) {
+        justin_vcs_source *src = &list.data[i];
+        if (!src->resolved) {
+            *resolved = false;
+            continue;
+        }
+        git_oid_tostr(hex, sizeof hex, &src->oid);
+        fprintf(f, "vcs %s %s %s\n", src->url, src->ref, hex);
+    }
+    if (fclose(f) != 0) {
+        free(ret);
+        ret = NULL;
+        *err = JUSTIN_ERR_NOMEM;
+    }
+
+    ex:
+    justin_vcs_source_list_free(&list);
+    return ret;
+}
+
+char* justin_vcs_describe(const char *name, git_repository *repo, git_commit *commit, bool *resolved, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    *resolved = true;
+    justin_srcinfo_t info = JUSTIN_SRCINFO_INITIALIZER;
+    justin_err load_err;
+    char *ret = NULL;
+    git_blob *blob = justin_srcinfo_load(repo, commit, &info, &load_err);
+    if (blob != NULL) {
+        ret = justin_vcs_describe_info(&info, resolved, err);
+        git_blob_free(blob);
+    } else if (load_err != JUSTIN_ERR_OK || justin_vcs_is_vcs_name(name)) {
+        // The sources of a .SRCINFO that cannot be read are as unknown as those of a missing one
+        *resolved = false;
+    }
+    justin_srcinfo_free(&info);
+    return ret;
+}
+
+bool justin_vcs_has_record(justin_context ctx, const char *base) {
+    justin_err err;
+    char *path = justin_vcs_file(ctx, base, REFS_EXT, &err);
+    if (err != JUSTIN_ERR_OK) return false;
+    bool ret = access(path, F_OK) == 0;
+    free(path);
+    return ret;
+}
+
+// Reads a record written by justin_vcs_record, returning false if there is none
+bool justin_vcs_record_read(justin_context ctx, const char *base, justin_vcs_source_list *list, justin_err *err) {
+    char *path = justin_vcs_file(ctx, base, REFS_EXT, err);
+    if ((*err) != JUSTIN_ERR_OK) return false;
+    size_t len;
+    char *data = justin_util_read_file(path, &len);
+    free(path);
+    if (data == NULL) return false;
+
+    char *save;
+    char *line = strtok_r(data, "\n", &save);
+    while (line != NULL) {
+        char *ref = strchr(line, ' ');
+        char *url = ref == NULL ? NULL : strchr(&ref[1], ' ');
+        if (url != NULL) {
+            *(ref++) = '\0';
+            *(url++) = '\0';
+            if (list->len == list->cap) {
+                size_t cap = list->cap == 0 ? 4 : list->cap << 1;
+                justin_vcs_source *grown = (justin_vcs_source*) reallocarray(list->data, cap, sizeof(justin_vcs_source));
+                if (grown == NULL) {
+                    *err = JUSTIN_ERR_NOMEM;
+                    break;
+                }
+                list->data = grown;
+                list->cap = cap;
+            }
+            justin_vcs_source *src = &list->data[list->len++];
+            memset(src, 0, sizeof(justin_vcs_source));
+            src->git = git_oid_fromstr(&src->oid, line) == 0;
+            src->url = strdup(url);
+            src->ref = strdup(ref);
+            if (src->url == NULL || src->ref == NULL) {
+                *err = JUSTIN_ERR_NOMEM;
+                break;
+            }
+        }
+        line = strtok_r(NULL, "\n", &save);
+    }
+    free(data);
+    return true;
+}
+
+void justin_vcs_check(justin_context ctx, const char *const *bases, size_t count, bool *changed, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+    justin_vcs_source_list *lists = (justin_vcs_source_list*) calloc(count, sizeof(justin_vcs_source_list));
+    git_oid *recorded = NULL;
+    justin_vcs_source **git = NULL;
+    if (lists == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+
+    size_t total = 0;
+    for (size_t i=0; i < count; i++) {
+        changed[i] = !justin_vcs_record_read(ctx, bases[i], &lists[i], err);
+        if ((*err) != JUSTIN_ERR_OK) goto ex;
+        total += lists[i].len;
+    }
+
+    recorded = (git_oid*) malloc((total + 1) * sizeof(git_oid));
+    git = (justin_vcs_source**) malloc((total + 1) * sizeof(justin_vcs_source*));
+    if (recorded == NULL || git == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        goto ex;
+    }
+    size_t git_len = 0;
+    for (size_t i=0; i < count; i++) {
+        for (size_t z=0; z < lists[i].len; z++) {
+            justin_vcs_source *src = &lists[i].data[z];
+            if (!src->git) continue;
+            git_oid_cpy(&recorded[git_len], &src->oid);
+            git[git_len++] = src;
+        }
+    }
+    justin_vcs_resolve(git, git_len);
+
+    char buf[512];
+    size_t git_pos = 0;
+    for (size_t i=0; i < count; i++) {
+        const char *why = changed[i] ? "no record of the last build" : NULL;
+        bool unreachable = false;
+        for (size_t z=0; z < lists[i].len; z++) {
+            justin_vcs_source *src = &lists[i].data[z];
+            if (!src->git) {
+                if (why == NULL) why = "source cannot be checked";
+                continue;
+            }
+            if (!src->resolved) {
+                unreachable = true;
+            } else if (!git_oid_equal(&src->oid, &recorded[git_pos]) && why == NULL) {
+                why = src->url;
+            }
+            git_pos++;
+        }
+        if (why != NULL) {
+            changed[i] = true;
+            snprintf(buf, sizeof buf, "%s%.160s %s:: %schanged (%.200s)", BYEL, bases[i], BWHT, WHT, why);
+            justin_log_info_indent(buf, 1);
+        } else if (unreachable) {
+            snprintf(buf, sizeof buf, "Could not reach the upstream of %.200s, skipping it", bases[i]);
+            justin_log_warn(buf);
+        } else {
+            snprintf(buf, sizeof buf, "%s%.160s %s:: %sup to date", BYEL, bases[i], BWHT, WHT);
+            justin_log_debug_indent(buf, 1);
+        }
+    }
+
+    ex:
+    free(git);
+    free(recorded);
+    for (size_t i=0; i < count; i++) justin_vcs_source_list_free(&lists[i]);
+    free(lists);
+}
@@ -0,0 +1,88 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <git2.h>
+#include "../context.h"
+#include "../logging.h"
+#include "srcinfo.h"
+
+#ifndef JUSTIN_VCS_H
+#define JUSTIN_VCS_H
+
+/*
+ * Persistent working directories for VCS packages. When the .SRCINFO of a build directory has a VCS source, makepkg
+ * is given a BUILDDIR in the storage directory, so that its src/ (the checkouts and whatever the build left next to
+ * them) survives the build. On the next one makepkg fetches into the existing checkouts and resets them, and the
+ * build system only redoes what changed. The pkg/ directory is removed after every build.
+ *
+ * After a build, the commit each git checkout ended up at is recorded next to it (<pkgbase>.refs), so that upstream
+ * changes can later be detected by asking the remotes for their refs instead of cloning and building.
+ */
+
+#define JUSTIN_VCS_DIR ".vcs"
+#define JUSTIN_VCS_CONNECTIONS 16
+
+typedef struct justin_vcs_t {
+    char *base;             // NULL if the package has no VCS sources
+    char *builddir;         // NULL if the build should not be incremental
+    char *pkgdir;
+    int lock_fd;
+} justin_vcs_t;
+#define JUSTIN_VCS_INITIALIZER { NULL, NULL, NULL, -1 }
+
+/**
+ * Claims the persistent BUILDDIR for the package in "path" if it has VCS sources. A package whose directory is in use
+ * by another build (e.g. concurrent bisect candidates) is built from scratch instead; either way "vcs->builddir" is
+ * left NULL and "err" unset.
+ */
+void justin_vcs_acquire(justin_context ctx, const char *path, justin_vcs_t *vcs, justin_err *err);
+
+/**
+ * Records where the upstream refs of the git sources of a successful build of "path" point, for justin_vcs_check
+ */
+void justin_vcs_record(justin_context ctx, const char *path, justin_vcs_t *vcs);
+
+void justin_vcs_release(justin_vcs_t *vcs);
+
+/**
+ * Describes where the VCS sources in the tree of "commit" point upstream right now, one line per source, asking all
+ * remotes at once. Unsets "resolved" if a source cannot be asked (other VCS than git, unreachable remotes, a .SRCINFO
+ * that cannot be read, or a missing one for a package named like a VCS one), in which case the description does not
+ * identify the build. Returns NULL with "err" unset if there are no VCS sources.
+ */
+char* justin_vcs_describe(const char *name, git_repository *repo, git_commit *commit, bool *resolved, justin_err *err);
+
+/**
+ * True if "name" follows the AUR naming of VCS packages (-git, -svn, ...)
+ */
+bool justin_vcs_is_vcs_name(const char *name);
+
+/**
+ * True if a build of the package base was recorded by justin_vcs_record
+ */
+bool justin_vcs_has_record(justin_context ctx, const char *base);
+
+/**
+ * For each package base, sets "changed" if the upstream ref of one of its sources no longer points at the recorded
+ * commit, or if there is no record to compare with. The remotes of all bases are asked at once, with at most
+ * JUSTIN_VCS_CONNECTIONS connections.
+ */
+void justin_vcs_check(justin_context ctx, const char *const *bases, size_t count, bool *changed, justin_err *err);
+
+#endif //JUSTIN_VCS_H
@@ -0,0 +1,310 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <string.h>
+#include <stdbool.h>
+#include "hash.h"
+
+// SHA-2 (FIPS 180-4)
+
+static const uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t SHA224_IV[8] = {
+        0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+
+static const uint32_t SHA256_IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint64_t SHA512_K[80] = {
+        0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 0x3956c25bf348b538,
+        0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242, 0x12835b0145706fbe,
+        0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
+        0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+        0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5, 0x983e5152ee66dfab,
+        0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+        0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed,
+        0x53380d139d95b3df, 0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+        0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
+        0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8, 0x19a4c116b8d2d0c8, 0x1e376c085141ab53,
+        0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373,
+        0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+        0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b, 0xca273eceea26619c,
+        0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba, 0x0a637dc5a2c898a6,
+        0x113f9804bef90dae, 0x1b710b35131c471b, 0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
+        0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+};
+
+static const uint64_t SHA384_IV[8] = {
+        0xcbbb9d5dc1059ed8, 0x629a292a367cd507, 0x9159015a3070dd17, 0x152fecd8f70e5939,
+        0x67332667ffc00b31, 0x8eb44a8768581511, 0xdb0c2e0d64f98fa7, 0x47b5481dbefa4fa4
+};
+
+// Also the BLAKE2b IV
+static const uint64_t SHA512_IV[8] = {
+        0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+        0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+};
+
+static inline uint32_t ror32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint64_t ror64(uint64_t x, int n) {
+    return (x >> n) | (x << (64 - n));
+}
+
+static inline uint32_t load32_be(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline uint64_t load64_be(const uint8_t *p) {
+    return ((uint64_t) load32_be(p) << 32) | (uint64_t) load32_be(&p[4]);
+}
+
+static inline uint64_t load64_le(const uint8_t *p) {
+    uint64_t ret = 0;
+    for (int i=7; i >= 0; i--) ret = (ret << 8) | p[i];
+    return ret;
+}
+
+void justin_hash_sha256_block(uint32_t *state, const uint8_t *block) {
+    uint32_t w[64];
+    for (int i=0; i < 16; i++) w[i] = load32_be(&block[i << 2]);
+    for (int i=16; i < 64; i++) {
+        uint32_t s0 = ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i=0; i < 64; i++) {
+        uint32_t t1 = h + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+        uint32_t t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void justin_hash_sha512_block(uint64_t *state, const uint8_t *block) {
+    uint64_t w[80];
+    for (int i=0; i < 16; i++) w[i] = load64_be(&block[i << 3]);
+    for (int i=16; i < 80; i++) {
+        uint64_t s0 = ror64(w[i - 15], 1) ^ ror64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+        uint64_t s1 = ror64(w[i - 2], 19) ^ ror64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i=0; i < 80; i++) {
+        uint64_t t1 = h + (ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[i] + w[i];
+        uint64_t t2 = (ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// BLAKE2b (RFC 7693), unkeyed with a 64 byte digest
+
+static const uint8_t B2_SIGMA[12][16] = {
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+        { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+        { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+        { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+        { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+        { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+        { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+        { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+        { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 }
+};
+
+#define B2_G(a, b, c, d, x, y) do { \
+    v[a] = v[a] + v[b] + (x); v[d] = ror64(v[d] ^ v[a], 32); \
+    v[c] = v[c] + v[d];       v[b] = ror64(v[b] ^ v[c], 24); \
+    v[a] = v[a] + v[b] + (y); v[d] = ror64(v[d] ^ v[a], 16); \
+    v[c] = v[c] + v[d];       v[b] = ror64(v[b] ^ v[c], 63); \
+} while (0)
+
+void justin_hash_b2_block(uint64_t *state, const uint8_t *block, uint64_t counter, bool last) {
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i=0; i < 16; i++) m[i] = load64_le(&block[i << 3]);
+    for (int i=0; i < 8; i++) {
+        v[i] = state[i];
+        v[i + 8] = SHA512_IV[i];
+    }
+    v[12] ^= counter;
+    if (last) v[14] = ~v[14];
+
+    const uint8_t *s;
+    for (int r=0; r < 12; r++) {
+        s = B2_SIGMA[r];
+        B2_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        B2_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        B2_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        B2_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        B2_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        B2_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        B2_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        B2_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i=0; i < 8; i++) state[i] ^= v[i] ^ v[i + 8];
+}
+
+// Generic
+
+static inline size_t justin_hash_block_size(justin_hash_alg alg) {
+    return (alg == JUSTIN_HASH_SHA224 || alg == JUSTIN_HASH_SHA256) ? 64 : 128;
+}
+
+void justin_hash_init(justin_hash_t *hash, justin_hash_alg alg) {
+    hash->alg = alg;
+    hash->len = 0;
+    hash->buf_len = 0;
+    switch (alg) {
+        case JUSTIN_HASH_SHA224:
+            memcpy(hash->state.sha256, SHA224_IV, sizeof SHA224_IV);
+            break;
+        case JUSTIN_HASH_SHA256:
+            memcpy(hash->state.sha256, SHA256_IV, sizeof SHA256_IV);
+            break;
+        case JUSTIN_HASH_SHA384:
+            memcpy(hash->state.sha512, SHA384_IV, sizeof SHA384_IV);
+            break;
+        case JUSTIN_HASH_SHA512:
+            memcpy(hash->state.sha512, SHA512_IV, sizeof SHA512_IV);
+            break;
+        case JUSTIN_HASH_B2:
+            memcpy(hash->state.b2, SHA512_IV, sizeof SHA512_IV);
+            // Parameter block: 64 byte digest, no key, fanout and depth 1
+            hash->state.b2[0] ^= 0x01010000 | JUSTIN_HASH_MAX_SIZE;
+            break;
+        default:
+            break;
+    }
+}
+
+void justin_hash_block(justin_hash_t *hash, const uint8_t *block) {
+    switch (hash->alg) {
+        case JUSTIN_HASH_SHA224:
+        case JUSTIN_HASH_SHA256:
+            justin_hash_sha256_block(hash->state.sha256, block);
+            break;
+        case JUSTIN_HASH_SHA384:
+        case JUSTIN_HASH_SHA512:
+            justin_hash_sha512_block(hash->state.sha512, block);
+            break;
+        case JUSTIN_HASH_B2:
+            justin_hash_b2_block(hash->state.b2, block, hash->len, false);
+            break;
+        default:
+            break;
+    }
+}
+
+void justin_hash_update(justin_hash_t *hash, const void *data, size_t len) {
+    if (hash->alg == JUSTIN_HASH_NONE) return;
+    const uint8_t *bytes = (const uint8_t*) data;
+    size_t block = justin_hash_block_size(hash->alg);
+    size_t take;
+    while (len > 0) {
+        // BLAKE2b must keep the final block back until it knows it is the last one
+        if (hash->buf_len == block) {
+            hash->len += block;
+            justin_hash_block(hash, hash->buf);
+            hash->buf_len = 0;
+        }
+        if (hash->buf_len == 0 && len > block && hash->alg != JUSTIN_HASH_B2) {
+            hash->len += block;
+            justin_hash_block(hash, bytes);
+            bytes += block;
+            len -= block;
+            continue;
+        }
+        take = block - hash->buf_len;
+        if (take > len) take = len;
+        memcpy(&hash->buf[hash->buf_len], bytes, take);
+        hash->buf_len += take;
+        bytes += take;
+        len -= take;
+    }
+}
+
+size_t justin_hash_final(justin_hash_t *hash, uint8_t *out) {
+    size_t block = justin_hash_block_size(hash->alg);
+    switch (hash->alg) {
+        case JUSTIN_HASH_B2: {
+            hash->len += hash->buf_len;
+            memset(&hash->buf[hash->buf_len], 0, block - hash->buf_len);
+            justin_hash_b2_block(hash->state.b2, hash->buf, hash->len, true);
+            for (int i=0; i < JUSTIN_HASH_MAX_SIZE; i++) out[i] = (uint8_t) (hash->state.b2[i >> 3] >> ((i & 7) << 3));
+            return JUSTIN_HASH_MAX_SIZE;
+        }
+        case JUSTIN_HASH_SHA224:
+        case JUSTIN_HASH_SHA256:
+        case JUSTIN_HASH_SHA384:
+        case JUSTIN_HASH_SHA512: {
+            if (hash->buf_len == block) {
+                hash->len += block;
+                justin_hash_block(hash, hash->buf);
+                hash->buf_len = 0;
+            }
+            uint64_t bits = (hash->len + hash->buf_len) << 3;
+            size_t len_size = block >> 3;   // 8 or 16 bytes of length
+            hash->buf[hash->buf_len++] = 0x80;
+            if (hash->buf_len > block - len_size) {
+                memset(&hash->buf[hash->buf_len], 0, block - hash->buf_len);
+                justin_hash_block(hash, hash->buf);
+                hash->buf_len = 0;
+            }
+            memset(&hash->buf[hash->buf_len], 0, block - hash->buf_len);
+            for (int i=0; i < 8; i++) hash->buf[block - 1 - i] = (uint8_t) (bits >> (i << 3));
+            justin_hash_block(hash, hash->buf);
+
+            size_t size;
+            if (block == 64) {
+                size = hash->alg == JUSTIN_HASH_SHA224 ? 28 : 32;
+                for (size_t i=0; i < size; i++) out[i] = (uint8_t) (hash->state.sha256[i >> 2] >> ((3 - (i & 3)) << 3));
+            } else {
+                size = hash->alg == JUSTIN_HASH_SHA384 ? 48 : 64;
+                for (size_t i=0; i < size; i++) out[i] = (uint8_t) (hash->state.sha512[i >> 3] >> ((7 - (i & 7)) << 3));
+            }
+            return size;
+        }
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef JUSTIN_HASH_H
+#define JUSTIN_HASH_H
+
+/*
+ * Incremental hashes for the checksums makepkg supports and that are worth verifying while downloading. md5 and sha1
+ * are left to makepkg.
+ */
+
+typedef enum justin_hash_alg {
+    JUSTIN_HASH_NONE,
+    JUSTIN_HASH_SHA224,
+    JUSTIN_HASH_SHA256,
+    JUSTIN_HASH_SHA384,
+    JUSTIN_HASH_SHA512,
+    JUSTIN_HASH_B2
+} justin_hash_alg;
+
+#define JUSTIN_HASH_MAX_SIZE 64
+
+typedef struct justin_hash_t {
+    justin_hash_alg alg;
+    uint64_t len;           // bytes hashed so far
+    size_t buf_len;
+    uint8_t buf[128];
+    union {
+        uint32_t sha256[8];
+        uint64_t sha512[8];
+        uint64_t b2[8];
+    } state;
+} justin_hash_t;
+
+void justin_hash_init(justin_hash_t *hash, justin_hash_alg alg);
+
+void justin_hash_update(justin_hash_t *hash, const void *data, size_t len);
+
+/**
+ * Writes the digest to "out" (at least JUSTIN_HASH_MAX_SIZE bytes) and returns its size
+ */
+size_t justin_hash_final(justin_hash_t *hash, uint8_t *out);
+
+#endif //JUSTIN_HASH_H
@@ -39,6 +39,8 @@ static const char* MSG_LOCKFILE_FULL = "Lockfile is at capacity";
 static const char* MSG_LINK = "Linkage error";
 static const char* MSG_ARGS = "Bad command-line arguments";
 static const char* MSG_ASSERTION = "Assertion error";
+static const char* MSG_PROTOCOL = "Remote does not support the requested protocol";
+static const char* MSG_DEPENDENCY = "Dependencies cannot be resolved";
 
 const char* err_str_ext(const char *restrict base, const char *restrict desc, size_t desc_len) {
     memcpy(EXT_ERR_BUF, desc, desc_len);
@@ -89,6 +91,10 @@ const char* justin_err_str(justin_err err) {
             return MSG_ARGS;
         case JUSTIN_ERR_ASSERTION:
             return MSG_ASSERTION;
+        case JUSTIN_ERR_PROTOCOL:
+            return MSG_PROTOCOL;
+        case JUSTIN_ERR_DEPENDENCY:
+            return MSG_DEPENDENCY;
         case JUSTIN_ERR_GIT: {
             const char* base = git_error_last()->message;
             return err_str_ext(base, GIT_ERR, 11);
@@ -32,6 +32,8 @@ typedef int64_t justin_err;
 #define JUSTIN_ERR_ARGS 4L
 #define JUSTIN_ERR_ASSERTION 5L
 #define JUSTIN_ERR_GIT 6L
+#define JUSTIN_ERR_PROTOCOL 7L
+#define JUSTIN_ERR_DEPENDENCY 8L
 #define JUSTIN_ERR_FLAG_SYSTEM (0b1L << (sizeof(int) * 8))
 #define JUSTIN_ERR_SYSTEM (errno | JUSTIN_ERR_FLAG_SYSTEM)
 #define JUSTIN_ERR_FLAG_CURL (0b10L << (sizeof(int) * 8))
@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "util.h"
 #include "logging.h"
 #include "params.h"
@@ -32,6 +33,29 @@ justin_params justin_params_create(int argc, char **argv) {
     ret->v_target = NULL;
     ret->f_latest = false;
     ret->f_yes = false;
+    ret->f_names = false;
+    ret->f_nodeps = false;
+    ret->f_ephemeral = false;
+    ret->f_partial = false;
+    ret->f_fast = false;
+    ret->f_check = false;
+    ret->f_sandbox = false;
+    ret->f_cgroup = false;
+    ret->f_resume = false;
+    ret->v_remote = NULL;
+    ret->v_ccache = NULL;
+    ret->v_pkgnames = NULL;
+    ret->v_workers = NULL;
+    ret->v_serve = NULL;
+    ret->v_substituters = NULL;
+    ret->v_good = NULL;
+    ret->v_bad = NULL;
+    ret->v_test = NULL;
+    ret->v_jobs = 0;
+    ret->v_cpu_weight = JUSTIN_PARAMS_WEIGHT_DEFAULT;
+    ret->v_io_weight = JUSTIN_PARAMS_WEIGHT_DEFAULT;
+    ret->v_mem_high = 0;
+    ret->v_mem_max = 0;
     ret->v_uid = 0;
     //
     return ret;
@@ -42,8 +66,104 @@ void justin_params_destroy(justin_params params) {
     free(params);
 }
 
+// Empty, or a size as ccache reads it: digits with an optional K, M, G or T, optionally followed by i
+bool justin_params_is_size(const char *str) {
+    if (*str == '\0') return true;
+    const char *c = str;
+    while (*c >= '0' && *c <= '9') c++;
+    if (c == str) return false;
+    if (*c != '\0' && strchr("kKMGT", *c) != NULL) {
+        c++;
+        if (*c == 'i') c++;
+    }
+    return *c == '\0';
+}
+
+// Leading digits of a string of "len" chars, with "*end" set past them; UINT64_MAX on overflow
+uint64_t justin_params_digits(const char *str, size_t len, size_t *end) {
+    uint64_t ret = 0;
+    size_t i = 0;
+    for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+        if (ret > (UINT64_MAX - 9) / 10) return UINT64_MAX;
+        ret = (ret * 10) + (uint64_t) (str[i] - '0');
+    }
+    *end = i;
+    return ret;
+}
+
+// Digits with an optional K, M, G or T (powers of 1024), optionally followed by i; 0 if malformed
+uint64_t justin_params_size_bytes(const char *str, size_t len) {
+    size_t i;
+    uint64_t ret = justin_params_digits(str, len, &i);
+    if (i == 0 || ret == UINT64_MAX) return 0;
+    if (i == len) return ret;
+    static const char *units = "KMGT";
+    const char *unit = strchr(units, str[i] == 'k' ? 'K' : str[i]);
+    if (unit == NULL) return 0;
+    i++;
+    if (i < len && str[i] == 'i') i++;
+    if (i != len) return 0;
+    int shift = 10 * (int) (unit - units + 1);
+    if (ret > (UINT64_MAX >> shift)) return 0;
+    return ret << shift;
+}
+
+// Comma-separated cpu=<weight>, io=<weight>, high=<size> and max=<size>, each optional
+bool justin_params_read_limits(justin_params params, const char *str) {
+    const char *next;
+    const char *eq;
+    size_t len;
+    while (*str != '\0') {
+        next = strchr(str, ',');
+        if (next == NULL) next = &str[strlen(str)];
+        eq = memchr(str, '=', next - str);
+        if (eq == NULL) return false;
+        len = (size_t) (eq - str);
+        const char *value = &eq[1];
+        size_t value_len = (size_t) (next - value);
+        if ((len == 3 && strncmp(str, "cpu", 3) == 0) || (len == 2 && strncmp(str, "io", 2) == 0)) {
+            size_t end;
+            uint64_t weight = justin_params_digits(value, value_len, &end);
+            // The range of cpu.weight and io.weight
+            if (end != value_len || weight < 1 || weight > 10000) return false;
+            if (len == 3) {
+                params->v_cpu_weight = (unsigned int) weight;
+            } else {
+                params->v_io_weight = (unsigned int) weight;
+            }
+        } else if ((len == 4 && strncmp(str, "high", 4) == 0) || (len == 3 && strncmp(str, "max", 3) == 0)) {
+            uint64_t size = justin_params_size_bytes(value, value_len);
+            if (size == 0) return false;
+            if (len == 4) {
+                params->v_mem_high = size;
+            } else {
+                params->v_mem_max = size;
+            }
+        } else {
+            return false;
+        }
+        str = *next == ',' ? &next[1] : next;
+    }
+    return true;
+}
+
+// Called once all arguments are read
+void justin_params_validate(justin_params params) {
+    // Without targets, -c checks every installed VCS package
+    if (params->err == JUSTIN_PARAMS_ERR_NO_TARGET && params->f_check) params->err = JUSTIN_PARAMS_ERR_OK;
+    // A worker builds what it is sent
+    if (params->err == JUSTIN_PARAMS_ERR_NO_TARGET && params->v_serve != NULL) params->err = JUSTIN_PARAMS_ERR_OK;
+    if (params->err != JUSTIN_PARAMS_ERR_OK) return;
+    bool any = params->v_good != NULL || params->v_bad != NULL || params->v_test != NULL;
+    bool all = params->v_good != NULL && params->v_bad != NULL && params->v_test != NULL;
+    if (any && !all) params->err = JUSTIN_PARAMS_ERR_BISECT_INCOMPLETE;
+}
+
 bool justin_params_read(justin_params params) {
-    if (params->head >= params->argc) return false;
+    if (params->head >= params->argc) {
+        justin_params_validate(params);
+        return false;
+    }
     int pos = params->head++;
     char* str = params->argv[pos];
     size_t str_len = strlen(str);
@@ -58,6 +178,103 @@ bool justin_params_read(justin_params params) {
             case 'y':
                 params->f_yes = true;
                 break;
+            case 'n':
+                params->f_names = true;
+                break;
+            case 'd':
+                params->f_nodeps = true;
+                break;
+            case 'e':
+                params->f_ephemeral = true;
+                break;
+            case 'p':
+                params->f_partial = true;
+                params->f_ephemeral = true;
+                break;
+            case 'f':
+                params->f_fast = true;
+                break;
+            case 'c':
+                params->f_check = true;
+                break;
+            case 's':
+                params->f_sandbox = true;
+                break;
+            case 'R':
+                params->f_resume = true;
+                break;
+            case 'C':
+                if (!justin_params_is_size(&str[2])) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_BAD_VALUE;
+                    return false;
+                }
+                params->v_ccache = &str[2];
+                break;
+            case 'L':
+                if (!justin_params_read_limits(params, &str[2])) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_BAD_VALUE;
+                    return false;
+                }
+                params->f_cgroup = true;
+                break;
+            case 'r':
+                if (str_len < 3) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_NO_VALUE;
+                    return false;
+                }
+                params->v_remote = &str[2];
+                break;
+            case 'P':
+                if (str_len < 3) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_NO_VALUE;
+                    return false;
+                }
+                params->v_pkgnames = &str[2];
+                break;
+            case 'w':
+            case 'W':
+                if (str_len < 3) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_NO_VALUE;
+                    return false;
+                }
+                if (str[1] == 'w') {
+                    params->v_workers = &str[2];
+                } else {
+                    params->v_serve = &str[2];
+                }
+                break;
+            case 'B':
+                if (str_len < 3) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_NO_VALUE;
+                    return false;
+                }
+                params->v_substituters = &str[2];
+                break;
+            case 'g':
+            case 'b':
+            case 't':
+                if (str_len < 3) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_NO_VALUE;
+                    return false;
+                }
+                if (str[1] == 'g') {
+                    params->v_good = &str[2];
+                } else if (str[1] == 'b') {
+                    params->v_bad = &str[2];
+                } else {
+                    params->v_test = &str[2];
+                }
+                break;
+            case 'j': {
+                char *end;
+                long jobs = strtol(&str[2], &end, 10);
+                if (str_len < 3 || *end != '\0' || jobs < 1 || jobs > 256) {
+                    params->err = JUSTIN_PARAMS_ERR_FLAG_BAD_VALUE;
+                    return false;
+                }
+                params->v_jobs = (unsigned int) jobs;
+                break;
+            }
             case 'u': {
                 size_t rem = str_len - 2;
                 if (rem != (sizeof(__uid_t) << 1)) {
@@ -106,6 +323,8 @@ const char* justin_params_strerror(justin_params params) {
             return "Bad value for flag";
         case JUSTIN_PARAMS_ERR_MIX_MATCH:
             return "Cannot mix positional arguments with flags";
+        case JUSTIN_PARAMS_ERR_BISECT_INCOMPLETE:
+            return "Bisecting requires all of -g, -b and -t";
     }
     return NULL;
 }
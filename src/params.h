@@ -26,7 +26,8 @@ typedef enum justin_params_err: uint_fast8_t {
     JUSTIN_PARAMS_ERR_FLAG_UNKNOWN,
     JUSTIN_PARAMS_ERR_FLAG_NO_VALUE,
     JUSTIN_PARAMS_ERR_FLAG_BAD_VALUE,
-    JUSTIN_PARAMS_ERR_MIX_MATCH
+    JUSTIN_PARAMS_ERR_MIX_MATCH,
+    JUSTIN_PARAMS_ERR_BISECT_INCOMPLETE
 } justin_params_err;
 
 struct justin_params {
@@ -40,6 +41,29 @@ struct justin_params {
     char *v_target;
     bool f_latest;
     bool f_yes;
+    bool f_names;
+    bool f_nodeps;
+    bool f_ephemeral;
+    bool f_partial;
+    bool f_fast;
+    bool f_check;
+    bool f_sandbox;
+    bool f_cgroup;
+    bool f_resume;
+    const char *v_remote;
+    const char *v_ccache;
+    const char *v_pkgnames; // comma-separated
+    const char *v_workers;  // comma-separated addresses of build workers
+    const char *v_serve;    // address to take builds on as a worker
+    const char *v_substituters; // comma-separated directories or URLs of binary caches
+    const char *v_good;
+    const char *v_bad;
+    const char *v_test;
+    unsigned int v_jobs;
+    unsigned int v_cpu_weight;
+    unsigned int v_io_weight;
+    uint64_t v_mem_high;    // 0 for no limit
+    uint64_t v_mem_max;     // 0 for no limit
     __uid_t v_uid;
 };
 typedef struct justin_params* justin_params;
@@ -56,4 +80,14 @@ const char* justin_params_strerror(justin_params params);
 
 const char* justin_params_get_target(justin_params params);
 
+/**
+ * True if a bisect was requested with -g, -b and -t
+ */
+#define justin_params_is_bisect(params) ((params)->v_test != NULL)
+
+/**
+ * cpu.weight and io.weight of the cgroup builds run in with -L, unless given
+ */
+#define JUSTIN_PARAMS_WEIGHT_DEFAULT 10
+
 #endif //JUSTIN_PARAMS_H
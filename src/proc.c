@@ -0,0 +1,286 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "proc.h"
+
+extern char **environ;
+
+// Copies the environment with the given entries added, replacing inherited entries of the same name
+char** justin_proc_env(char *const *env_add) {
+    size_t base = 0;
+    size_t extra = 0;
+    while (environ[base] != NULL) base++;
+    while (env_add[extra] != NULL) extra++;
+
+    char **ret = (char**) malloc((base + extra + 1) * sizeof(char*));
+    if (ret == NULL) return NULL;
+
+    size_t n = 0;
+    const char *eq;
+    size_t name_len;
+    bool replaced;
+    for (size_t i=0; i < base; i++) {
+        eq = strchr(environ[i], '=');
+        name_len = eq == NULL ? strlen(environ[i]) : (size_t) (eq - environ[i]);
+        replaced = false;
+        for (size_t z=0; z < extra; z++) {
+            if (strncmp(env_add[z], environ[i], name_len) == 0 && env_add[z][name_len] == '=') {
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) ret[n++] = environ[i];
+    }
+    for (size_t z=0; z < extra; z++) ret[n++] = env_add[z];
+    ret[n] = NULL;
+    return ret;
+}
+
+// Identity of opts->user. initgroups reads the group database, which the child can not, so the groups are listed
+// before the fork.
+typedef struct justin_proc_ident {
+    gid_t gid;
+    gid_t *groups;
+    int groups_len;
+} justin_proc_ident;
+
+bool justin_proc_ident_init(justin_proc_ident *ident, uid_t user) {
+    ident->groups = NULL;
+    ident->groups_len = 0;
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (size <= 0) size = 16384;
+    char *buf = (char*) malloc((size_t) size);
+    if (buf == NULL) return false;
+    struct passwd pw;
+    struct passwd *found = NULL;
+    bool ok = getpwuid_r(user, &pw, buf, (size_t) size, &found) == 0 && found != NULL;
+    if (ok) {
+        ident->gid = pw.pw_gid;
+        int len = 32;
+        do {
+            gid_t *groups = (gid_t*) realloc(ident->groups, len * sizeof(gid_t));
+            if (groups == NULL) {
+                ok = false;
+                break;
+            }
+            ident->groups = groups;
+            ident->groups_len = len;
+            // Sets "len" to the number of groups, which is only more than asked for if they did not fit
+        } while (getgrouplist(pw.pw_name, pw.pw_gid, ident->groups, &len) == -1 && len > ident->groups_len);
+        if (ok) ident->groups_len = len;
+    }
+    free(buf);
+    return ok;
+}
+
+// Runs in the child between fork and exec, so only async-signal-safe calls are allowed here
+_Noreturn void justin_proc_child(const char *path, char *const argv[], char *const envp[], const justin_proc_opts_t *opts, const justin_proc_ident *ident, int report, int output) {
+    int fd_out = output != -1 ? output : opts->fd_out;
+    int fd_err = output != -1 ? output : opts->fd_err;
+    if (opts->fd_in != -1 && dup2(opts->fd_in, STDIN_FILENO) == -1) goto fail;
+    if (fd_out != -1 && dup2(fd_out, STDOUT_FILENO) == -1) goto fail;
+    if (fd_err != -1 && dup2(fd_err, STDERR_FILENO) == -1) goto fail;
+    // "0" is the writing process itself
+    if (opts->cgroup_fd != -1 && write(opts->cgroup_fd, "0", 1) == -1) goto fail;
+    if (opts->setup != NULL && (errno = opts->setup(opts->setup_data)) != 0) goto fail;
+    if (opts->user != JUSTIN_PROC_USER_KEEP) {
+        // Groups first, they can not be changed once root is given up
+        if (setgroups((size_t) ident->groups_len, ident->groups) == -1 || setgid(ident->gid) == -1) goto fail;
+        if (setuid(opts->user) == -1) goto fail;
+    }
+    if (opts->cwd != NULL && chdir(opts->cwd) == -1) goto fail;
+    execve(path, argv, envp);
+
+    fail: {
+        int e = errno;
+        ssize_t w;
+        do {
+            w = write(report, &e, sizeof e);
+        } while (w == -1 && errno == EINTR);
+        _exit(127);
+    }
+}
+
+// True once the child has exited, leaving it to be waited for
+bool justin_proc_exited(pid_t pid) {
+    siginfo_t info;
+    info.si_pid = 0;
+    return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+}
+
+// Passes the output of the child on until EOF, or until the child has exited and the pipe is quiet. Watches a pidfd
+// for the exit where there is one (Linux 5.3), and checks every JUSTIN_PROC_DRAIN_MS otherwise.
+void justin_proc_drain(pid_t pid, int fd, const justin_proc_opts_t *opts, justin_err *err) {
+    char *buf = (char*) malloc(JUSTIN_PROC_OUTPUT_CHUNK);
+    if (buf == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return;
+    }
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+#endif
+    struct pollfd fds[2] = { { fd, POLLIN, 0 }, { pidfd, POLLIN, 0 } };
+    bool exited = false;
+    bool was_exited;
+    int ready;
+    ssize_t n;
+    while (1) {
+        was_exited = exited;
+        ready = poll(fds, exited || pidfd == -1 ? 1 : 2, exited || pidfd == -1 ? JUSTIN_PROC_DRAIN_MS : -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!exited && (pidfd == -1 ? justin_proc_exited(pid) : (fds[1].revents & POLLIN) != 0)) {
+            exited = true;
+            if (opts->kill_fd != -1 && write(opts->kill_fd, "1", 1) == -1) justin_log_debug("Failed to kill what the child left running");
+        }
+        if (ready == 0 || (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+            if (was_exited) break;
+            continue;
+        }
+        n = read(fd, buf, JUSTIN_PROC_OUTPUT_CHUNK);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        opts->on_output(opts->output_data, buf, (size_t) n);
+    }
+    if (pidfd != -1) close(pidfd);
+    free(buf);
+}
+
+void justin_proc_run(const char *path, char *const argv[], const justin_proc_opts_t *opts, justin_proc_result_t *result, justin_err *err) {
+    static const justin_proc_opts_t defaults = JUSTIN_PROC_OPTS_INITIALIZER;
+    if (opts == NULL) opts = &defaults;
+    *err = JUSTIN_ERR_OK;
+
+    char **envp = environ;
+    if (opts->env_add != NULL) {
+        envp = justin_proc_env(opts->env_add);
+        if (envp == NULL) {
+            *err = JUSTIN_ERR_NOMEM;
+            return;
+        }
+    }
+
+    justin_proc_ident ident = { 0, NULL, 0 };
+    if (opts->user != JUSTIN_PROC_USER_KEEP && !justin_proc_ident_init(&ident, opts->user)) {
+        *err = JUSTIN_ERR_SYSTEM;
+        goto ex;
+    }
+
+    int report[2];
+    int output[2] = { -1, -1 };
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        goto ex;
+    }
+    if (opts->on_output != NULL && pipe2(output, O_CLOEXEC) == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        close(report[0]);
+        close(report[1]);
+        goto ex;
+    }
+
+    // Anything still buffered would otherwise show up after the child's output
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report[0]);
+        if (output[0] != -1) close(output[0]);
+        justin_proc_child(path, argv, envp, opts, &ident, report[1], output[1]);
+    }
+    close(report[1]);
+    if (output[1] != -1) close(output[1]);
+    if (pid == -1) {
+        *err = JUSTIN_ERR_SYSTEM;
+        close(report[0]);
+        if (output[0] != -1) close(output[0]);
+        goto ex;
+    }
+
+    int child_errno = 0;
+    ssize_t r;
+    do {
+        r = read(report[0], &child_errno, sizeof child_errno);
+    } while (r == -1 && errno == EINTR);
+    close(report[0]);
+
+    if (output[0] != -1) {
+        justin_proc_drain(pid, output[0], opts, err);
+        close(output[0]);
+    }
+
+    pid_t waited;
+    do {
+        waited = wait4(pid, &result->status, 0, &result->usage);
+    } while (waited == -1 && errno == EINTR);
+
+    if (r == sizeof child_errno) {
+        // The pipe only carries data if the child failed before exec
+        errno = child_errno;
+        *err = JUSTIN_ERR_SYSTEM;
+    } else if (waited == -1 && (*err) == JUSTIN_ERR_OK) {
+        *err = JUSTIN_ERR_SYSTEM;
+    }
+
+    ex:
+    free(ident.groups);
+    if (envp != environ) free(envp);
+}
+
+int justin_proc_exit_code(const justin_proc_result_t *result) {
+    if (!WIFEXITED(result->status)) return -1;
+    return WEXITSTATUS(result->status);
+}
+
+void justin_proc_check(const justin_proc_result_t *result, justin_err *err) {
+    int code = justin_proc_exit_code(result);
+    if (code == 0) return;
+    if (code == -1) {
+        justin_log_warn("Child process did not terminate normally");
+        *err = JUSTIN_ERR_ASSERTION;
+        return;
+    }
+    *err = JUSTIN_ERR_SUBPROC(code);
+}
+
+void justin_proc_log_usage(const char *name, const justin_proc_result_t *result) {
+#ifndef NDEBUG
+    const struct rusage *u = &result->usage;
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s: %ld.%02lds user, %ld.%02lds system, %ld MiB peak", name,
+             (long) u->ru_utime.tv_sec, (long) (u->ru_utime.tv_usec / 10000),
+             (long) u->ru_stime.tv_sec, (long) (u->ru_stime.tv_usec / 10000),
+             u->ru_maxrss >> 10);
+    justin_log_debug(buf);
+#endif
+}
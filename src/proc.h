@@ -0,0 +1,90 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "logging.h"
+
+#ifndef JUSTIN_PROC_H
+#define JUSTIN_PROC_H
+
+/*
+ * Subprocess runner. The program is executed directly (no shell), with the working directory, user, environment and
+ * standard descriptors set up in the child between fork and exec. Failures in that window, including exec itself, are
+ * sent back over a close-on-exec pipe, so the caller can tell "could not start" from "ran and failed".
+ */
+
+#define JUSTIN_PROC_USER_KEEP ((uid_t) -1)
+
+typedef struct justin_proc_opts_t {
+    const char *cwd;        // NULL to inherit
+    uid_t user;             // JUSTIN_PROC_USER_KEEP to inherit
+    char *const *env_add;   // NAME=value entries added to (or replacing in) the inherited environment, NULL-terminated
+    int fd_in;              // -1 to inherit
+    int fd_out;             // -1 to inherit
+    int fd_err;             // -1 to inherit
+    // If set, stdout and stderr of the child go to a pipe, and everything read from it is passed here in large chunks
+    void (*on_output)(void *data, const char *buf, size_t len);
+    void *output_data;
+    // cgroup.procs of a cgroup the child moves itself into before anything else runs in it, -1 to stay
+    int cgroup_fd;
+    // cgroup.kill of that cgroup, written once the child has exited so that what it left running dies, -1 for none
+    int kill_fd;
+    // If set, runs in the child after the descriptors are set up and before the user and directory are switched.
+    // Returns 0, or an errno to fail the start. Only async-signal-safe calls are allowed.
+    int (*setup)(void *data);
+    void *setup_data;
+} justin_proc_opts_t;
+#define JUSTIN_PROC_OPTS_INITIALIZER { NULL, JUSTIN_PROC_USER_KEEP, NULL, -1, -1, -1, NULL, NULL, -1, -1, NULL, NULL }
+
+#define JUSTIN_PROC_OUTPUT_CHUNK 65536
+
+/**
+ * Once the child has exited, the output pipe is read until it has been quiet this long, since processes the child
+ * left running may hold it open forever
+ */
+#define JUSTIN_PROC_DRAIN_MS 200
+
+typedef struct justin_proc_result_t {
+    int status;             // as reported by wait4
+    struct rusage usage;
+} justin_proc_result_t;
+
+/**
+ * Runs the program at "path" and waits for it. "err" is only set if the process could not be started or waited for;
+ * use justin_proc_check to turn the result into an error.
+ */
+void justin_proc_run(const char *path, char *const argv[], const justin_proc_opts_t *opts, justin_proc_result_t *result, justin_err *err);
+
+/**
+ * Exit code of the process, or -1 if it was killed by a signal
+ */
+int justin_proc_exit_code(const justin_proc_result_t *result);
+
+/**
+ * Sets "err" to JUSTIN_ERR_SUBPROC with the exit code if the process did not exit with 0, or JUSTIN_ERR_ASSERTION if
+ * it did not exit normally
+ */
+void justin_proc_check(const justin_proc_result_t *result, justin_err *err);
+
+/**
+ * Logs the resource usage of a finished process (debug builds only)
+ */
+void justin_proc_log_usage(const char *name, const justin_proc_result_t *result);
+
+#endif //JUSTIN_PROC_H
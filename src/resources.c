@@ -0,0 +1,146 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "logging.h"
+#include "resources.h"
+
+#define PROC_SELF_CGROUP "/proc/self/cgroup"
+static const char *PROC_SELF_CGROUP_S = PROC_SELF_CGROUP;
+
+#define PROC_MEMINFO "/proc/meminfo"
+static const char *PROC_MEMINFO_S = PROC_MEMINFO;
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+static const char *CGROUP_ROOT_S = CGROUP_ROOT;
+
+// Reads the first line of a small file, without the line break
+bool justin_resources_read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "re");
+    if (f == NULL) return false;
+    bool ok = fgets(buf, (int) size, f) != NULL;
+    fclose(f);
+    if (ok) buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+unsigned int justin_resources_cpus_online() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0) {
+        int n = CPU_COUNT(&set);
+        if (n > 0) return (unsigned int) n;
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (unsigned int) n;
+}
+
+uint64_t justin_resources_mem_available() {
+    FILE *f = fopen(PROC_MEMINFO_S, "re");
+    if (f == NULL) return 0;
+    char line[256];
+    unsigned long long kb;
+    uint64_t ret = 0;
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+            ret = (uint64_t) kb << 10;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+// Applies the limits of the cgroup of this process and of all its ancestors (cgroup v2 only)
+void justin_resources_cgroup(unsigned int *cpus, uint64_t *mem) {
+    char line[4096];
+    if (!justin_resources_read_line(PROC_SELF_CGROUP_S, line, sizeof line)) return;
+    if (strncmp(line, "0::", 3) != 0) return;
+
+    char dir[sizeof line + sizeof CGROUP_ROOT];
+    char file[sizeof dir + 32];
+    char value[128];
+    snprintf(dir, sizeof dir, "%s%s", CGROUP_ROOT_S, &line[3]);
+    size_t root_len = strlen(CGROUP_ROOT_S);
+    size_t len = strlen(dir);
+    while (len > root_len && dir[len - 1] == '/') dir[--len] = '\0';
+
+    char *slash;
+    while (len > root_len) {
+        // cpu.max is "<quota> <period>" or "max <period>"
+        snprintf(file, sizeof file, "%s/cpu.max", dir);
+        unsigned long long quota, period;
+        if (justin_resources_read_line(file, value, sizeof value)
+            && sscanf(value, "%llu %llu", &quota, &period) == 2 && period != 0) {
+            unsigned int limit = (unsigned int) ((quota + period - 1) / period);
+            if (limit < 1) limit = 1;
+            if (limit < *cpus) *cpus = limit;
+        }
+
+        unsigned long long max, current = 0;
+        snprintf(file, sizeof file, "%s/memory.max", dir);
+        if (justin_resources_read_line(file, value, sizeof value) && sscanf(value, "%llu", &max) == 1) {
+            snprintf(file, sizeof file, "%s/memory.current", dir);
+            if (justin_resources_read_line(file, value, sizeof value)) sscanf(value, "%llu", &current);
+            uint64_t room = current < max ? (uint64_t) (max - current) : 0;
+            if ((*mem) == 0 || room < *mem) *mem = room;
+        }
+
+        slash = strrchr(dir, '/');
+        if (slash == NULL) break;
+        *slash = '\0';
+        len = (size_t) (slash - dir);
+    }
+}
+
+void justin_resources_detect(unsigned int requested_builds, justin_resources_t *out) {
+    unsigned int cpus = justin_resources_cpus_online();
+    uint64_t mem = justin_resources_mem_available();
+    justin_resources_cgroup(&cpus, &mem);
+    out->cpus = cpus;
+    out->mem_available = mem;
+
+    // Jobs a build could run by memory alone; unknown memory does not limit anything
+    uint64_t mem_jobs = mem == 0 ? cpus : mem / JUSTIN_RESOURCES_JOB_MEM;
+    if (mem_jobs < 1) mem_jobs = 1;
+
+    unsigned int builds = requested_builds;
+    if (builds == 0) {
+        // Builds are mostly parallel themselves, so prefer fewer builds with more jobs each
+        builds = cpus / 4;
+        if (builds > mem_jobs / 2) builds = (unsigned int) (mem_jobs / 2);
+        if (builds > JUSTIN_RESOURCES_BUILDS_MAX) builds = JUSTIN_RESOURCES_BUILDS_MAX;
+        if (builds < 1) builds = 1;
+    }
+    out->builds = builds;
+    out->mem_per_build = mem / builds;
+
+    uint64_t jobs = cpus / builds;
+    if (jobs > mem_jobs / builds) jobs = mem_jobs / builds;
+    out->make_jobs = jobs < 1 ? 1 : (unsigned int) jobs;
+
+#ifndef NDEBUG
+    char buf[256];
+    snprintf(buf, sizeof buf, "Resources: %u CPUs, %llu MiB available; %u builds at -j%u", cpus,
+             (unsigned long long) (mem >> 20), out->builds, out->make_jobs);
+    justin_log_debug(buf);
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <stdint.h>
+
+#ifndef JUSTIN_RESOURCES_H
+#define JUSTIN_RESOURCES_H
+
+#define JUSTIN_RESOURCES_BUILDS_MAX 8
+
+/**
+ * Memory to set aside for each make job. Compiler processes for large C++ units easily reach this.
+ */
+#define JUSTIN_RESOURCES_JOB_MEM (1024ULL * 1024ULL * 1024ULL)
+
+typedef struct justin_resources_t {
+    unsigned int cpus;          // usable CPUs, after the affinity mask and cgroup quota
+    uint64_t mem_available;     // bytes, after cgroup memory limits
+    unsigned int builds;        // package builds to run at once
+    unsigned int make_jobs;     // make jobs per build (MAKEFLAGS=-jN)
+    uint64_t mem_per_build;     // memory headroom of each build, in bytes
+} justin_resources_t;
+
+/**
+ * Detects the CPUs and memory available to this process (affinity, cgroup v2 cpu.max and memory.max, MemAvailable)
+ * and splits them between builds. If "requested_builds" is non-zero, it is used as the number of concurrent builds
+ * and only the per-build share is derived.
+ */
+void justin_resources_detect(unsigned int requested_builds, justin_resources_t *out);
+
+/**
+ * MemAvailable from /proc/meminfo in bytes, or 0 if unknown
+ */
+uint64_t justin_resources_mem_available();
+
+#endif //JUSTIN_RESOURCES_H
@@ -14,10 +14,12 @@
    limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/mman.h>
@@ -27,9 +29,13 @@
 #include <stdbool.h>
 #include <pwd.h>
 #include <errno.h>
+#include <limits.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <sys/statvfs.h>
 #include "util.h"
 #include "logging.h"
+#include "resources.h"
 #include "storage.h"
 
 #define DATA_DIR_STR ".cache/justin"
@@ -40,13 +46,55 @@ static const char* DATA_DIR = DATA_DIR_STR;
 static const char* LOCK_FILE = LOCK_FILE_STR;
 #define LOCK_FILE_LEN ((sizeof LOCK_FILE_STR) - 1)
 
+#define MEM_ROOT_STR "/dev/shm"
+static const char* MEM_ROOT = MEM_ROOT_STR;
+
+// Every run gets a fresh directory of its own, /dev/shm is world-writable and a fixed name could be planted there
+#define MEM_DIR_PREFIX "justin-"
+#define MEM_DIR_TEMPLATE MEM_ROOT_STR "/" MEM_DIR_PREFIX "XXXXXX"
+static const char* MEM_DIR_TEMPLATE_S = MEM_DIR_TEMPLATE;
+
+static pthread_mutex_t MEM_DIR_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static char MEM_DIR[sizeof MEM_DIR_TEMPLATE];
+static bool MEM_DIR_TRIED = false;
+static bool MEM_DIR_READY = false;
+
+// Returns the directory of this run on the memory-backed filesystem, creating it on first use; NULL if there is none
+const char* justin_storage_mem_dir() {
+    pthread_mutex_lock(&MEM_DIR_MUTEX);
+    if (!MEM_DIR_TRIED) {
+        MEM_DIR_TRIED = true;
+        memcpy(MEM_DIR, MEM_DIR_TEMPLATE_S, sizeof MEM_DIR);
+        if (mkdtemp(MEM_DIR) != NULL) {
+            int fd = open(MEM_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            struct stat st;
+            // Builds run as the user, who needs to get through it to the build directories, but not to list or write it
+            MEM_DIR_READY = fd != -1 && fstat(fd, &st) == 0 && st.st_uid == geteuid() && fchmod(fd, 0711) == 0;
+            if (fd != -1) close(fd);
+            if (!MEM_DIR_READY) rmdir(MEM_DIR);
+        }
+    }
+    pthread_mutex_unlock(&MEM_DIR_MUTEX);
+    return MEM_DIR_READY ? MEM_DIR : NULL;
+}
+
+void justin_storage_mem_dir_remove() {
+    pthread_mutex_lock(&MEM_DIR_MUTEX);
+    // Still holds the build directories kept for -R if it is not empty
+    if (MEM_DIR_READY && rmdir(MEM_DIR) == 0) {
+        MEM_DIR_TRIED = false;
+        MEM_DIR_READY = false;
+    }
+    pthread_mutex_unlock(&MEM_DIR_MUTEX);
+}
+
 justin_storage justin_storage_init(uid_t uid) {
     struct passwd *user = getpwuid(uid);
     char *home = user->pw_dir;
     size_t home_len = strlen(home);
 
     justin_storage ret = (justin_storage) justin_malloc_msg(sizeof(struct justin_storage) + home_len + DATA_DIR_LEN + 2, "Failed to allocate storage struct");
-    char* dir = (char*) (ret + sizeof(struct justin_storage));
+    char* dir = (char*) &ret[1];
     size_t dir_len = justin_util_path_join(home, strlen(home), DATA_DIR, DATA_DIR_LEN, dir);
     ret->user = uid;
     ret->path = dir;
@@ -72,16 +120,18 @@ justin_storage justin_storage_init(uid_t uid) {
     if (fchown(lockfile_fd, uid, -1) == -1) {
         justin_log_err_soft(JUSTIN_ERR_SYSTEM);
     }
-    if (ftruncate(lockfile_fd, sizeof(struct justin_storage_lockfile)) == -1) {
-        free(ret);
-        return NULL;
-    }
     ret->lockfile_handle = lockfile_fd;
 
+    // Other processes read the lockfile under LOCK_SH, so it is only sized while nobody else holds it
     if (flock(lockfile_fd, LOCK_EX) == -1) {
         free(ret);
         return NULL;
     }
+    if (ftruncate(lockfile_fd, sizeof(struct justin_storage_lockfile)) == -1) {
+        flock(lockfile_fd, LOCK_UN);
+        free(ret);
+        return NULL;
+    }
 
     long page_size = sysconf(_SC_PAGE_SIZE);
     justin_storage_lockfile lockfile = (justin_storage_lockfile) mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, lockfile_fd, 0);
@@ -117,6 +167,7 @@ justin_storage justin_storage_init(uid_t uid) {
 }
 
 void justin_storage_destroy(justin_storage storage) {
+    justin_storage_mem_dir_remove();
     if (munmap(storage->lockfile, sysconf(_SC_PAGE_SIZE)) == -1) {
         justin_log_err_soft(JUSTIN_ERR_SYSTEM);
     }
@@ -124,36 +175,62 @@ void justin_storage_destroy(justin_storage storage) {
     free(storage);
 }
 
-// INTERNAL METHOD! ASSUMES THAT LOCKFILE IS CURRENTLY WRITE-LOCKED
-void justin_storage_clean(justin_storage storage) {
-    DIR *d;
+bool justin_storage_is_journaled(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, JUSTIN_STORAGE_JOURNAL);
+    return access(path, F_OK) == 0;
+}
+
+// A kept build directory that nobody resumed for JUSTIN_STORAGE_KEEP_DAYS is given up on
+bool justin_storage_is_expired(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", dir, JUSTIN_STORAGE_JOURNAL);
+    struct stat st;
+    if (stat(path, &st) == -1) return true;
+    return time(NULL) - st.st_mtime > (time_t) JUSTIN_STORAGE_KEEP_DAYS * 86400;
+}
+
+// Removes the directories in "dir" except the build directories kept to be resumed, returns false if one could not be
+bool justin_storage_clean_in(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return true;
     struct dirent *ent;
-    d = opendir(storage->path);
-    if (d == NULL) return;
+    char path[PATH_MAX];
+    bool ok = true;
+    while (ok && (ent = readdir(d)) != NULL) {
+        if (ent->d_type != DT_DIR) continue;
+        if (ent->d_name[0] == '.') continue;
+        snprintf(path, sizeof path, "%s/%s", dir, ent->d_name);
+        if (justin_storage_is_journaled(path) && !justin_storage_is_expired(path)) continue;
+        ok = justin_util_rimraf(path) == 0;
+    }
+    closedir(d);
+    return ok;
+}
 
-    size_t base_len = strlen(storage->path);
-    char* path_buffer = malloc(base_len + FILENAME_MAX + 2);
-    if (path_buffer == NULL) {
-        justin_log_err(JUSTIN_ERR_NOMEM);
-        closedir(d);
+// INTERNAL METHOD! ASSUMES THAT LOCKFILE IS CURRENTLY WRITE-LOCKED
+void justin_storage_clean(justin_storage storage) {
+    if (!justin_storage_clean_in(storage->path)) {
+        justin_log_err_msg(JUSTIN_ERR_SYSTEM, "Failed to clean cache");
         return;
     }
 
-    size_t ent_name_len;
-    int err;
+    // The directory of a run on /dev/shm outlives it if it kept a build directory there
+    DIR *d = opendir(MEM_ROOT);
+    if (d == NULL) return;
+    struct dirent *ent;
+    struct stat st;
+    char path[PATH_MAX];
     while ((ent = readdir(d)) != NULL) {
-        if (ent->d_type != DT_DIR) continue;
-        ent_name_len = strlen(ent->d_name);
-        if (ent_name_len < 1) continue;
-        if (ent->d_name[0] == '.') continue;
-        justin_util_path_join(storage->path, base_len, ent->d_name, ent_name_len, path_buffer);
-        err = justin_util_rimraf(path_buffer);
-        if (err != 0) {
-            justin_log_err_msg(JUSTIN_ERR_SYSTEM, "Failed to clean cache");
-            break;
-        }
+        if (strncmp(ent->d_name, MEM_DIR_PREFIX, (sizeof MEM_DIR_PREFIX) - 1) != 0) continue;
+        snprintf(path, sizeof path, "%s/%s", MEM_ROOT, ent->d_name);
+        // Anyone can create a directory of that name, only those of our own are ours to clean
+        if (lstat(path, &st) == -1 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid()) continue;
+        justin_storage_clean_in(path);
+        pthread_mutex_lock(&MEM_DIR_MUTEX);
+        if (!MEM_DIR_READY || strcmp(path, MEM_DIR) != 0) rmdir(path);
+        pthread_mutex_unlock(&MEM_DIR_MUTEX);
     }
-    free(path_buffer);
     closedir(d);
 }
 
@@ -203,7 +280,7 @@ justin_err justin_storage_unlock(justin_storage storage) {
     return justin_storage_set_locked(storage, false);
 }
 
-const char* justin_storage_dir_create(justin_storage storage, justin_err *err) {
+char* justin_storage_dir_create_in(justin_storage storage, const char *base, justin_err *err) {
     *err = JUSTIN_ERR_OK;
 
     char id_bytes[sizeof(__time_t)];
@@ -222,14 +299,14 @@ const char* justin_storage_dir_create(justin_storage storage, justin_err *err) {
     }
     id_hex[sizeof(__time_t) * 2] = (char) 0;
 
-    size_t path_len = strlen(storage->path);
-    size_t total_len = path_len + (sizeof(__time_t) * 2) + 1;
+    size_t path_len = strlen(base);
+    size_t total_len = path_len + (sizeof(__time_t) * 2) + 2;
     char* fn = (char*) malloc(total_len);
     if (fn == NULL) {
         *err = JUSTIN_ERR_NOMEM;
         return NULL;
     }
-    justin_util_path_join(storage->path, path_len, id_hex, sizeof(__time_t) * 2, fn);
+    justin_util_path_join(base, path_len, id_hex, sizeof(__time_t) * 2, fn);
 
     if (mkdir(fn, 0775) == -1) {
         *err = JUSTIN_ERR_SYSTEM;
@@ -237,8 +314,192 @@ const char* justin_storage_dir_create(justin_storage storage, justin_err *err) {
         return NULL;
     }
 
-    if (chown(fn, storage->user, -1) == -1) {
+    // Through a descriptor, so that a symlink put in its place is never followed as root
+    int fd = open(fn, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1 || fchown(fd, storage->user, -1) == -1) {
         justin_log_err_soft(JUSTIN_ERR_SYSTEM);
     }
+    if (fd != -1) close(fd);
     return fn;
 }
+
+const char* justin_storage_dir_create(justin_storage storage, justin_err *err) {
+    return justin_storage_dir_create_in(storage, storage->path, err);
+}
+
+char* justin_storage_path(justin_storage storage, const char *dir, const char *name, justin_err *err) {
+    *err = JUSTIN_ERR_OK;
+
+    size_t base_len = strlen(storage->path);
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *ret = (char*) malloc(base_len + dir_len + name_len + 3);
+    if (ret == NULL) {
+        *err = JUSTIN_ERR_NOMEM;
+        return NULL;
+    }
+    size_t head = justin_util_path_join(storage->path, base_len, dir, dir_len, ret);
+
+    struct stat st = { 0 };
+    if (stat(ret, &st) == -1) {
+        if (mkdir(ret, 0775) == -1 && errno != EEXIST) {
+            *err = JUSTIN_ERR_SYSTEM;
+            free(ret);
+            return NULL;
+        }
+        if (chown(ret, storage->user, -1) == -1) {
+            justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+        }
+    }
+
+    if (name_len > 0) {
+        ret[head++] = '/';
+        memcpy(&ret[head], name, name_len + 1);
+    }
+    return ret;
+}
+
+const char* justin_storage_mem_dir_create(justin_storage storage, justin_err *err) {
+    const char *mem_dir = justin_storage_mem_dir();
+    if (mem_dir == NULL) {
+        justin_log_warn("No memory-backed filesystem available, falling back to cache directory");
+        return justin_storage_dir_create(storage, err);
+    }
+    return justin_storage_dir_create_in(storage, mem_dir, err);
+}
+
+// Build directories
+
+#define SIZES_DIR ".sizes"
+static const char *SIZES_DIR_S = SIZES_DIR;
+
+// Memory-backed build directories of this process and the space set aside for them
+typedef struct justin_storage_reservation {
+    char *dir;
+    uint64_t size;
+    struct justin_storage_reservation *next;
+} justin_storage_reservation;
+
+static pthread_mutex_t RESERVATIONS_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static justin_storage_reservation *RESERVATIONS = NULL;
+static uint64_t RESERVED = 0;
+
+uint64_t justin_storage_build_size_read(justin_storage storage, const char *name) {
+    justin_err err;
+    char *path = justin_storage_path(storage, SIZES_DIR_S, name, &err);
+    if (err != JUSTIN_ERR_OK) return 0;
+    unsigned long long size = 0;
+    FILE *f = fopen(path, "re");
+    free(path);
+    if (f == NULL) return 0;
+    if (fscanf(f, "%llu", &size) != 1) size = 0;
+    fclose(f);
+    return (uint64_t) size;
+}
+
+void justin_storage_build_size_write(justin_storage storage, const char *name, uint64_t size) {
+    justin_err err;
+    char *path = justin_storage_path(storage, SIZES_DIR_S, name, &err);
+    if (err != JUSTIN_ERR_OK) return;
+    FILE *f = fopen(path, "we");
+    if (f != NULL) {
+        fprintf(f, "%llu\n", (unsigned long long) size);
+        fclose(f);
+    }
+    free(path);
+}
+
+// Free space on the memory-backed filesystem, 0 if builds cannot go there
+uint64_t justin_storage_mem_free() {
+    struct statvfs st;
+    if (statvfs(MEM_ROOT, &st) == -1) return 0;
+    // Builds run configure scripts and tests from the build directory
+    if ((st.f_flag & ST_NOEXEC) != 0) return 0;
+    return (uint64_t) st.f_bavail * st.f_frsize;
+}
+
+char* justin_storage_build_dir_create(justin_storage storage, const char *name, justin_err *err) {
+    uint64_t estimate = justin_storage_build_size_read(storage, name);
+    if (estimate == 0) estimate = JUSTIN_STORAGE_BUILD_GUESS;
+    // Room for the estimate to be off
+    uint64_t need = estimate + (estimate >> 2);
+
+    pthread_mutex_lock(&RESERVATIONS_MUTEX);
+    uint64_t mem = justin_resources_mem_available();
+    uint64_t shm = justin_storage_mem_free();
+    // What is written to tmpfs is memory the compilers no longer have, so leave at least as much again
+    bool fits = shm > RESERVED + need && mem > RESERVED + (need << 1);
+
+    justin_storage_reservation *res = NULL;
+    char *ret = NULL;
+    const char *mem_dir = fits ? justin_storage_mem_dir() : NULL;
+    if (mem_dir != NULL) res = (justin_storage_reservation*) malloc(sizeof(justin_storage_reservation));
+    if (res != NULL) {
+        ret = justin_storage_dir_create_in(storage, mem_dir, err);
+        if ((*err) == JUSTIN_ERR_OK) {
+            res->dir = ret;
+            res->size = need;
+            res->next = RESERVATIONS;
+            RESERVATIONS = res;
+            RESERVED += need;
+        } else {
+            free(res);
+            ret = NULL;
+        }
+    }
+    pthread_mutex_unlock(&RESERVATIONS_MUTEX);
+    if (ret != NULL) return ret;
+
+    return justin_storage_dir_create_in(storage, storage->path, err);
+}
+
+// Gives back the memory set aside for a build directory, returns false if it is on disk
+bool justin_storage_build_dir_release(char *dir) {
+    pthread_mutex_lock(&RESERVATIONS_MUTEX);
+    bool in_mem = false;
+    justin_storage_reservation **link = &RESERVATIONS;
+    while ((*link) != NULL) {
+        if ((*link)->dir == dir) {
+            justin_storage_reservation *res = *link;
+            *link = res->next;
+            RESERVED -= res->size;
+            free(res);
+            in_mem = true;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    pthread_mutex_unlock(&RESERVATIONS_MUTEX);
+    return in_mem;
+}
+
+void justin_storage_build_dir_done(justin_storage storage, const char *name, char *dir, bool record) {
+    bool in_mem = justin_storage_build_dir_release(dir);
+    if (record) {
+        uint64_t size = justin_util_du(dir);
+        if (in_mem) {
+            struct statvfs st;
+            // Less than 1% left means the build most likely died of it; make sure the next estimate does not fit
+            if (statvfs(dir, &st) == 0 && st.f_bavail < (st.f_blocks / 100)) {
+                justin_log_warn("Memory-backed build directory ran full, the next build will use the disk");
+                size = (uint64_t) st.f_blocks * st.f_frsize;
+            }
+        }
+        justin_storage_build_size_write(storage, name, size);
+    }
+
+    if (justin_util_rimraf(dir) != 0) justin_log_err_soft(JUSTIN_ERR_SYSTEM);
+    free(dir);
+}
+
+void justin_storage_build_dir_keep(justin_storage storage, char *dir) {
+    // Whatever it holds stays on the memory-backed filesystem, so its reservation does too
+    pthread_mutex_lock(&RESERVATIONS_MUTEX);
+    for (justin_storage_reservation *res = RESERVATIONS; res != NULL; res = res->next) {
+        if (res->dir != dir) continue;
+        res->dir = NULL;
+        break;
+    }
+    pthread_mutex_unlock(&RESERVATIONS_MUTEX);
+    free(dir);
+}
@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "logging.h"
 
 #ifndef JUSTIN_STORAGE_H
@@ -46,4 +47,55 @@ justin_err justin_storage_unlock(justin_storage storage);
 
 const char* justin_storage_dir_create(justin_storage storage, justin_err *err);
 
+/**
+ * Creates a uniquely named directory inside "base", owned by the user
+ */
+char* justin_storage_dir_create_in(justin_storage storage, const char *base, justin_err *err);
+
+/**
+ * Builds the path of "name" inside the persistent storage subdirectory "dir", creating the subdirectory if needed.
+ * Subdirectories starting with a dot survive justin_storage_clean. Pass an empty name to get the directory itself.
+ */
+char* justin_storage_path(justin_storage storage, const char *dir, const char *name, justin_err *err);
+
+/**
+ * Creates a temporary directory on a memory-backed filesystem (/dev/shm), or in the cache directory if none is
+ * available. Unlike directories from justin_storage_dir_create, these are not cleaned up by the storage lock and
+ * should be removed by the caller when no longer needed.
+ */
+const char* justin_storage_mem_dir_create(justin_storage storage, justin_err *err);
+
+/**
+ * Expected size of a build with no recorded history
+ */
+#define JUSTIN_STORAGE_BUILD_GUESS (512ULL * 1024ULL * 1024ULL)
+
+/**
+ * Creates a build directory for the package base "name". It goes on the memory-backed filesystem if the expected
+ * size (the footprint recorded by its last build, or JUSTIN_STORAGE_BUILD_GUESS) fits there and in available memory,
+ * next to the builds already placed there; otherwise in the cache directory. Finish with justin_storage_build_dir_done.
+ */
+char* justin_storage_build_dir_create(justin_storage storage, const char *name, justin_err *err);
+
+/**
+ * Removes a directory from justin_storage_build_dir_create and frees "dir". If "record" is set, the size the build
+ * reached is saved for the next estimate; a build that filled the memory-backed filesystem is recorded as too large
+ * for it, so that the next one spills over to disk.
+ */
+void justin_storage_build_dir_done(justin_storage storage, const char *name, char *dir, bool record);
+
+/**
+ * Like justin_storage_build_dir_done, but leaves the directory where it is, so that a later run can pick it up. A
+ * directory on the memory-backed filesystem still counts against the space there for the rest of the process.
+ */
+void justin_storage_build_dir_keep(justin_storage storage, char *dir);
+
+/**
+ * Build directories holding a file of this name can be resumed and survive justin_storage_clean, for
+ * JUSTIN_STORAGE_KEEP_DAYS after the last stage they completed
+ */
+#define JUSTIN_STORAGE_JOURNAL ".journal"
+
+#define JUSTIN_STORAGE_KEEP_DAYS 7
+
 #endif //JUSTIN_STORAGE_H
@@ -0,0 +1,172 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include "term.h"
+
+#define SCREEN_ENTER "\e[?1049h\e[?25l"
+#define SCREEN_LEAVE "\e[?25h\e[?1049l"
+
+// Terminals send escape sequences in one go, so an Esc followed by nothing within this long was the Esc key
+#define ESC_TIMEOUT_MS 50
+
+bool justin_term_interactive() {
+    return isatty(STDIN_FILENO) && isatty(STDERR_FILENO);
+}
+
+bool justin_term_begin(justin_term_t *term) {
+    term->active = false;
+    if (tcgetattr(STDIN_FILENO, &term->saved) == -1) return false;
+
+    struct termios raw = term->saved;
+    // ISIG is cleared as well, so that Ctrl-C arrives as a key and the terminal can be restored before leaving
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) return false;
+
+    term->active = true;
+    write(STDERR_FILENO, SCREEN_ENTER, (sizeof SCREEN_ENTER) - 1);
+    return true;
+}
+
+void justin_term_end(justin_term_t *term) {
+    if (!term->active) return;
+    write(STDERR_FILENO, SCREEN_LEAVE, (sizeof SCREEN_LEAVE) - 1);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &term->saved);
+    term->active = false;
+}
+
+void justin_term_size(int *rows, int *cols) {
+    struct winsize ws;
+    if (ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0) {
+        *rows = 24;
+        *cols = 80;
+        return;
+    }
+    *rows = ws.ws_row;
+    *cols = ws.ws_col;
+}
+
+int justin_term_read_byte() {
+    unsigned char c;
+    ssize_t r;
+    do {
+        r = read(STDIN_FILENO, &c, 1);
+    } while (r == -1 && errno == EINTR);
+    return r == 1 ? (int) c : JUSTIN_TERM_KEY_EOF;
+}
+
+int justin_term_read_key() {
+    int c = justin_term_read_byte();
+    if (c == '\n') return JUSTIN_TERM_KEY_ENTER;
+    if (c == '\b') return JUSTIN_TERM_KEY_BACKSPACE;
+    if (c != '\e') return c;
+
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, ESC_TIMEOUT_MS);
+    } while (ready == -1 && errno == EINTR);
+    if (ready != 1) return '\e';
+    int a = justin_term_read_byte();
+    if (a != '[' && a != 'O') return '\e';
+    int b = justin_term_read_byte();
+    if (b == JUSTIN_TERM_KEY_EOF) return b;
+    switch (b) {
+        case 'A': return JUSTIN_TERM_KEY_UP;
+        case 'B': return JUSTIN_TERM_KEY_DOWN;
+        case 'H': return JUSTIN_TERM_KEY_HOME;
+        case 'F': return JUSTIN_TERM_KEY_END;
+        default: break;
+    }
+    if (b < '0' || b > '9') return JUSTIN_TERM_KEY_NONE;
+
+    // CSI <n> ~
+    int n = b - '0';
+    while ((c = justin_term_read_byte()) >= '0' && c <= '9') n = (n * 10) + (c - '0');
+    if (c == JUSTIN_TERM_KEY_EOF) return c;
+    if (c != '~') return JUSTIN_TERM_KEY_NONE;
+    switch (n) {
+        case 1: case 7: return JUSTIN_TERM_KEY_HOME;
+        case 4: case 8: return JUSTIN_TERM_KEY_END;
+        case 5: return JUSTIN_TERM_KEY_PAGE_UP;
+        case 6: return JUSTIN_TERM_KEY_PAGE_DOWN;
+        default: return JUSTIN_TERM_KEY_NONE;
+    }
+}
+
+bool justin_term_frame_reserve(justin_term_frame_t *frame, size_t extra) {
+    if (frame->len + extra <= frame->cap) return true;
+    size_t cap = frame->cap < 4096 ? 4096 : frame->cap;
+    while (cap < frame->len + extra) cap <<= 1;
+    char *data = (char*) realloc(frame->data, cap);
+    if (data == NULL) return false;
+    frame->data = data;
+    frame->cap = cap;
+    return true;
+}
+
+bool justin_term_frame_append(justin_term_frame_t *frame, const char *str, size_t len) {
+    if (!justin_term_frame_reserve(frame, len)) return false;
+    memcpy(&frame->data[frame->len], str, len);
+    frame->len += len;
+    return true;
+}
+
+bool justin_term_frame_printf(justin_term_frame_t *frame, const char *fmt, ...) {
+    va_list vl;
+    va_start(vl, fmt);
+    int req = vsnprintf(NULL, 0, fmt, vl);
+    va_end(vl);
+    if (req < 0 || !justin_term_frame_reserve(frame, req + 1)) return false;
+
+    va_start(vl, fmt);
+    vsnprintf(&frame->data[frame->len], req + 1, fmt, vl);
+    va_end(vl);
+    frame->len += req;
+    return true;
+}
+
+bool justin_term_frame_flush(justin_term_frame_t *frame) {
+    size_t off = 0;
+    ssize_t w;
+    while (off < frame->len) {
+        w = write(STDERR_FILENO, &frame->data[off], frame->len - off);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            frame->len = 0;
+            return false;
+        }
+        off += w;
+    }
+    frame->len = 0;
+    return true;
+}
+
+void justin_term_frame_free(justin_term_frame_t *frame) {
+    free(frame->data);
+    frame->data = NULL;
+    frame->len = 0;
+    frame->cap = 0;
+}
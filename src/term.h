@@ -0,0 +1,90 @@
+/*
+   Copyright 2024 Wasabi Codes
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <termios.h>
+
+#ifndef JUSTIN_TERM_H
+#define JUSTIN_TERM_H
+
+// Keys
+
+#define JUSTIN_TERM_KEY_NONE (-1)
+#define JUSTIN_TERM_KEY_EOF (-2)
+#define JUSTIN_TERM_KEY_UP 0x100
+#define JUSTIN_TERM_KEY_DOWN 0x101
+#define JUSTIN_TERM_KEY_PAGE_UP 0x102
+#define JUSTIN_TERM_KEY_PAGE_DOWN 0x103
+#define JUSTIN_TERM_KEY_HOME 0x104
+#define JUSTIN_TERM_KEY_END 0x105
+#define JUSTIN_TERM_KEY_ENTER '\r'
+#define JUSTIN_TERM_KEY_BACKSPACE 0x7F
+#define JUSTIN_TERM_KEY_INTERRUPT 0x03
+
+// Session
+
+typedef struct justin_term_t {
+    struct termios saved;
+    bool active;
+} justin_term_t;
+
+/**
+ * True if both stdin and stderr are terminals, in which case justin_term_begin may be used
+ */
+bool justin_term_interactive();
+
+/**
+ * Switches the terminal to raw input and the alternate screen. Returns false if the terminal could not be set up.
+ */
+bool justin_term_begin(justin_term_t *term);
+
+/**
+ * Restores the state saved by justin_term_begin
+ */
+void justin_term_end(justin_term_t *term);
+
+void justin_term_size(int *rows, int *cols);
+
+/**
+ * Reads a single key press, decoding the escape sequences of special keys into JUSTIN_TERM_KEY_* values. A lone Esc
+ * is told apart from a sequence by nothing following it within a short delay. Sequences that are not known give
+ * JUSTIN_TERM_KEY_NONE, and JUSTIN_TERM_KEY_EOF means there is nothing more to read.
+ */
+int justin_term_read_key();
+
+// Frame
+
+/**
+ * Output buffer for a whole screen. Everything drawn in a frame reaches the terminal with a single write, so that
+ * redraws do not flicker and cost one system call.
+ */
+typedef struct justin_term_frame_t {
+    char *data;
+    size_t len;
+    size_t cap;
+} justin_term_frame_t;
+#define JUSTIN_TERM_FRAME_INITIALIZER { NULL, 0, 0 }
+
+bool justin_term_frame_append(justin_term_frame_t *frame, const char *str, size_t len);
+
+bool justin_term_frame_printf(justin_term_frame_t *frame, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+bool justin_term_frame_flush(justin_term_frame_t *frame);
+
+void justin_term_frame_free(justin_term_frame_t *frame);
+
+#endif //JUSTIN_TERM_H
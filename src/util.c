@@ -14,7 +14,7 @@
    limitations under the License.
  */
 
-#define _XOPEN_SOURCE 500
+#define _XOPEN_SOURCE 700
 #include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -22,12 +22,13 @@
 #include <stdio.h>
 #include <ftw.h>
 #include <sys/stat.h>
-#include <sys/wait.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
 #include <alloca.h>
 #include "logging.h"
 #include "util.h"
+#include "proc.h"
 
 int justin_util_mini(size_t count, ...) {
     if (count < 1) return -1;
@@ -100,11 +101,57 @@ int justin_util_rimraf(const char *dir) {
     return nftw(dir, justin_util_rimraf0, 16, FTW_DEPTH | FTW_PHYS);
 }
 
-static uid_t CHOWN_RECURSIVE_ACTIVE_USER = 0;
+int justin_util_file_copy(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY);
+    if (in == -1) return 1;
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out == -1) {
+        close(in);
+        return 1;
+    }
+
+    int ret = 0;
+    char buf[65536];
+    ssize_t r, w, off;
+    while ((r = read(in, buf, sizeof buf)) != 0) {
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            ret = 1;
+            break;
+        }
+        for (off = 0; off < r; off += w) {
+            w = write(out, &buf[off], r - off);
+            if (w == -1) {
+                if (errno == EINTR) {
+                    w = 0;
+                    continue;
+                }
+                ret = 1;
+                break;
+            }
+        }
+        if (ret != 0) break;
+    }
+    close(in);
+    if (close(out) == -1) ret = 1;
+    if (ret != 0) unlink(dst);
+    return ret;
+}
+
+int justin_util_file_move(const char *src, const char *dst) {
+    if (rename(src, dst) == 0) return 0;
+    if (errno != EXDEV) return 1;
+    if (justin_util_file_copy(src, dst) != 0) return 1;
+    unlink(src);
+    return 0;
+}
+
+// nftw has no user data argument; thread-local so that concurrent builds can chown their own trees
+static __thread uid_t CHOWN_RECURSIVE_ACTIVE_USER = 0;
 int justin_util_chown_r0(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
     switch (typeflag) {
         case FTW_F: case FTW_SL: case FTW_D: case FTW_DP:
-            if (chown(fpath, CHOWN_RECURSIVE_ACTIVE_USER, -1) == -1) {
+            if (lchown(fpath, CHOWN_RECURSIVE_ACTIVE_USER, -1) == -1) {
                 return errno;
             }
             return 0;
@@ -114,32 +161,43 @@ int justin_util_chown_r0(const char *fpath, const struct stat *sb, int typeflag,
 }
 
 int justin_util_chown_r(const char *dir, uid_t user) {
-    pid_t pid = fork();
-    switch (pid) {
-        case -1:
-            return 1;
-        case 0: {
-            CHOWN_RECURSIVE_ACTIVE_USER = user;
-            exit(nftw(dir, justin_util_chown_r0, 16, FTW_DEPTH | FTW_PHYS));
-        }
-        default: {
-            int stat;
-            if (waitpid(pid, &stat, 0) == -1) {
-                return 1;
-            }
-            if (WIFEXITED(stat)) {
-                int exs = WEXITSTATUS(stat);
-                if (exs != 0) {
-                    errno = exs;
-                    return 1;
-                } else {
-                    return 0;
-                }
-            }
-            justin_log_warn("Child process did not terminate normally");
-            return 1;
+    CHOWN_RECURSIVE_ACTIVE_USER = user;
+    int ret = nftw(dir, justin_util_chown_r0, 16, FTW_DEPTH | FTW_PHYS);
+    if (ret > 0) errno = ret;
+    return ret == 0 ? 0 : 1;
+}
+
+static __thread uint64_t DU_TOTAL = 0;
+int justin_util_du0(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    DU_TOTAL += ((uint64_t) sb->st_blocks) << 9;
+    return 0;
+}
+
+uint64_t justin_util_du(const char *dir) {
+    DU_TOTAL = 0;
+    nftw(dir, justin_util_du0, 16, FTW_PHYS);
+    return DU_TOTAL;
+}
+
+char* justin_util_read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    struct stat st;
+    char *ret = NULL;
+    if (fstat(fd, &st) == 0 && (ret = (char*) malloc(st.st_size + 1)) != NULL) {
+        size_t off = 0;
+        ssize_t r;
+        while (off < (size_t) st.st_size) {
+            r = read(fd, &ret[off], st.st_size - off);
+            if (r == -1 && errno == EINTR) continue;
+            if (r <= 0) break;
+            off += r;
         }
+        ret[off] = '\0';
+        *len = off;
     }
+    close(fd);
+    return ret;
 }
 
 static const char *HEX_CHARS = "0123456789ABCDEF";
@@ -397,52 +455,16 @@ bool justin_util_iset_contains(justin_util_iset iset, int i) {
     return false;
 }
 
-#define SUDO_EXE "/usr/bin/sudo -S"
-static const char *SUDO_EXE_S = SUDO_EXE;
+#define PATH2_SUDO "/usr/bin/sudo"
+static const char *PATH2_SUDO_S = PATH2_SUDO;
 
 #define PROC_SELF_EXE "/proc/self/exe"
 static const char *PROC_SELF_EXE_S = PROC_SELF_EXE;
 
-#define ARG_U " -u"
+#define ARG_U "-u"
 static const char *ARG_U_S = ARG_U;
 #define ARG_U_L ((sizeof ARG_U) - 1)
 
-int justin_util_sudo0(const char *cmd) {
-    int ret = 0;
-
-    errno = 0;
-    FILE *proc = popen(cmd, "r");
-    if (proc == NULL) {
-        if (errno == 0) {
-            justin_log_err(JUSTIN_ERR_NOMEM);
-        } else {
-            justin_log_err(JUSTIN_ERR_SYSTEM);
-        }
-        return 1;
-    }
-
-    char buf[1024];
-    while (fgets(buf, sizeof(buf), proc) != NULL) {
-        printf("%s", buf);
-    }
-    if (errno != 0) {
-        justin_log_err(JUSTIN_ERR_SYSTEM);
-        ret = 1;
-    }
-
-    int close = pclose(proc);
-    if (close == -1) {
-        if (ret == 0) {
-            justin_log_err(JUSTIN_ERR_SYSTEM);
-            ret = 1;
-        }
-    } else {
-        ret = WEXITSTATUS(close);
-    }
-
-    return ret;
-}
-
 int justin_util_sudo(int argc, char *argv[], uid_t uid) {
     size_t bsize = 16;
     char *buf = (char*) malloc(bsize);
@@ -472,39 +494,36 @@ int justin_util_sudo(int argc, char *argv[], uid_t uid) {
         }
     }
 
-    size_t tsize = (sizeof SUDO_EXE) + read + ARG_U_L + (sizeof(__uid_t) << 1) + 8;
-    for (int i=1; i < argc; i++) {
-        bsize += strlen(argv[i]) + 1;
-    }
-
-    char *full = (char*) malloc(tsize);
+    // sudo -S <self> <args...> -u<uid hex>
+    char **full = (char**) malloc((argc + 4) * sizeof(char*));
     if (full == NULL) {
         free(buf);
         justin_log_err(JUSTIN_ERR_NOMEM);
         return 1;
     }
+    char arg_u[ARG_U_L + (sizeof(uid_t) << 1) + 1];
+    memcpy(arg_u, ARG_U_S, ARG_U_L);
+    justin_util_b2hex(&uid, sizeof(uid_t), &arg_u[ARG_U_L]);
 
-    memcpy(full, SUDO_EXE_S, (sizeof SUDO_EXE) - 1);
-    full[(sizeof SUDO_EXE) - 1] = ' ';
-    memcpy(&full[sizeof SUDO_EXE], buf, read);
-    free(buf);
-
-    size_t args_off = sizeof SUDO_EXE + read;
-    char *args_el;
-    size_t args_el_len;
-    for (int i=1; i < argc; i++) {
-        full[args_off++] = ' ';
-        args_el = argv[i];
-        args_el_len = strlen(args_el);
-        memcpy(&full[args_off], args_el, args_el_len);
-        args_off += args_el_len;
+    int n = 0;
+    full[n++] = "sudo";
+    full[n++] = "-S";
+    full[n++] = buf;
+    for (int i=1; i < argc; i++) full[n++] = argv[i];
+    full[n++] = arg_u;
+    full[n] = NULL;
+
+    int ret = 1;
+    justin_err err;
+    justin_proc_result_t result;
+    justin_proc_run(PATH2_SUDO_S, full, NULL, &result, &err);
+    if (err != JUSTIN_ERR_OK) {
+        justin_log_err(err);
+    } else {
+        ret = justin_proc_exit_code(&result);
+        if (ret == -1) ret = 1;
     }
-    memcpy(&full[args_off], ARG_U_S, ARG_U_L);
-    args_off += ARG_U_L;
-
-    justin_util_b2hex(&uid, sizeof(uid_t), &full[args_off]);
-
-    int ret = justin_util_sudo0(full);
     free(full);
+    free(buf);
     return ret;
 }
@@ -31,8 +31,25 @@ size_t justin_util_path_join(const char *restrict a, size_t al, const char *rest
 
 int justin_util_rimraf(const char *dir);
 
+int justin_util_file_copy(const char *src, const char *dst);
+
+/**
+ * Moves a file, copying it if source and destination are on different filesystems
+ */
+int justin_util_file_move(const char *src, const char *dst);
+
 int justin_util_chown_r(const char *dir, uid_t user);
 
+/**
+ * Disk usage of a directory tree in bytes (allocated blocks, not apparent size)
+ */
+uint64_t justin_util_du(const char *dir);
+
+/**
+ * Reads a whole file into a null-terminated buffer, returning NULL if it cannot be opened or if out of memory
+ */
+char* justin_util_read_file(const char *path, size_t *len);
+
 char justin_util_n2hex(int n);
 
 int justin_util_hex2n(char hex);